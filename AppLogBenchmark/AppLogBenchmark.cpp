@@ -0,0 +1,161 @@
+/**
+*  @file AppLogBenchmark.cpp
+*  @brief Command line tool that measures how the ImGui log window copes with a long session.
+*
+*  Adds lines to the ImGuiAppLog the way the log writer thread does, then filters them by text and
+*  level, and times what a frame of the log window has to look at. Does the same with the log window
+*  as it used to be, one growing buffer that every frame scanned, to compare against. Nothing is drawn,
+*  so it needs no window and builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -DD_USE_IMGUI -I../TestApp AppLogBenchmark.cpp ../TestApp/ImGui/imgui.cpp ../TestApp/ImGui/imgui_draw.cpp -o AppLogBenchmark
+*
+*  Usage: AppLogBenchmark [lines]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "ImGui/ImGuiAppLog.h"
+
+/// How many lines fit in the log window, the most a frame draws.
+static const int VISIBLE_LINES = 40;
+/// Lines are added in batches of up to this many, as the log writer thread hands them over.
+static const int LINES_PER_BATCH = 64;
+
+/**
+*  @brief The log window as it was, all the text in one buffer and the end of every line.
+*/
+struct GrowingAppLog
+{
+	ImGuiTextBuffer     Buf;
+	ImVector<int>       LineOffsets;
+
+	void    AddLog(const char* text, int length)
+	{
+		int old_size = Buf.size();
+		Buf.appendf("%.*s", length, text);
+		for (int new_size = Buf.size(); old_size < new_size; old_size++)
+			if (Buf[old_size] == '\n')
+				LineOffsets.push_back(old_size);
+	}
+
+	// What Draw did each frame with a filter set, without the drawing
+	int     CountFiltered(const ImGuiTextFilter& filter) const
+	{
+		int count = 0;
+		const char* buf_begin = Buf.begin();
+		const char* line = buf_begin;
+		for (int line_no = 0; line != NULL; line_no++)
+		{
+			const char* line_end = (line_no < LineOffsets.Size) ? buf_begin + LineOffsets[line_no] : NULL;
+			if (filter.PassFilter(line, line_end))
+				count++;
+			line = line_end && line_end[1] ? line_end + 1 : NULL;
+		}
+		return count;
+	}
+};
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+*  @brief Makes batches of lines like the logger writes, with a mix of levels.
+*/
+static std::vector<std::string> MakeBatches(int lines)
+{
+	static const char* const levels[] = { "ERROR  ", "WARNING", "INFO   ", "INFO   ", "INFO   ", "DEBUG  ", "DEBUG  ", "VERBOSE" };
+	static const char* const functions[] = { "Render", "LoadModel", "Update", "CompileShader" };
+
+	std::vector<std::string> batches;
+	std::string batch;
+	char line[256];
+	for (int i = 0; i < lines; i++)
+	{
+		const int length = snprintf(line, sizeof(line), "%s [%s:%d] Benchmark line %d, value %g\n", levels[i % 8], functions[i % 4], 100 + i % 50, i, i * 0.5);
+		batch.append(line, (size_t)length);
+		if ((i + 1) % LINES_PER_BATCH == 0 || i + 1 == lines)
+		{
+			batches.push_back(batch);
+			batch.clear();
+		}
+	}
+	return batches;
+}
+
+/**
+*  @brief Times a frame's worth of reading the visible lines from the match index, averaged over many frames.
+*/
+static double TimeVisibleFrame(ImGuiAppLog& log)
+{
+	const int frames = 1000;
+	size_t checksum = 0;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+	{
+		std::lock_guard<std::mutex> lock(log.Mutex);
+		const int count = log.MatchCount();
+		const int first = count > VISIBLE_LINES ? count - VISIBLE_LINES : 0;
+		for (int i = first; i < count; i++)
+		{
+			const ImGuiAppLog::Line& line = log.GetMatch(i);
+			checksum += line.Length + (unsigned char)log.LineText(line)[0];
+		}
+	}
+	const double seconds = SecondsSince(start) / frames;
+	if (checksum == 0)
+		printf("No lines matched\n");
+	return seconds;
+}
+
+int main(int argc, char** argv)
+{
+	const int lines = argc > 1 ? atoi(argv[1]) : 1000000;
+	if (lines <= 0)
+	{
+		fprintf(stderr, "Usage: AppLogBenchmark [lines]\n");
+		return 1;
+	}
+
+	const std::vector<std::string> batches = MakeBatches(lines);
+	printf("%d lines, the log keeps the last %d\n\n", lines, (int)ImGuiAppLog::MAX_LINES);
+
+	// The ring, which keeps its match index up to date as lines are added
+	static ImGuiAppLog log;
+	log.SetFilter("Render");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (const std::string& batch : batches)
+		log.AddText(batch.data(), batch.size());
+	double seconds = SecondsSince(start);
+	printf("Ring:    added in %8.1f ms, %6.1f ns a line, %d lines kept, %d match \"Render\"\n", seconds * 1e3, seconds * 1e9 / lines, (int)(log.NextLine - log.FirstLine), log.MatchCount());
+	printf("Ring:    a frame reads %d lines in %8.3f us\n", VISIBLE_LINES, TimeVisibleFrame(log) * 1e6);
+
+	start = std::chrono::steady_clock::now();
+	log.SetFilter("CompileShader,-value 1");
+	log.SetLevelShown(4, false);
+	seconds = SecondsSince(start);
+	printf("Ring:    changing the filter took %8.3f ms, %d match\n", seconds * 1e3, log.MatchCount());
+	printf("Ring:    a frame reads %d lines in %8.3f us\n", VISIBLE_LINES, TimeVisibleFrame(log) * 1e6);
+
+	// The old window, which kept everything and filtered it all every frame
+	GrowingAppLog growing;
+	start = std::chrono::steady_clock::now();
+	for (const std::string& batch : batches)
+		growing.AddLog(batch.data(), (int)batch.size());
+	seconds = SecondsSince(start);
+	printf("\nGrowing: added in %8.1f ms, %6.1f ns a line, %.1f MB kept\n", seconds * 1e3, seconds * 1e9 / lines, growing.Buf.size() / (1024.0 * 1024.0));
+
+	ImGuiTextFilter filter("Render");
+	const int frames = 10;
+	int matches = 0;
+	start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+		matches = growing.CountFiltered(filter);
+	seconds = SecondsSince(start) / frames;
+	printf("Growing: a frame filters every line in %8.3f ms, %d match \"Render\"\n", seconds * 1e3, matches);
+	return 0;
+}
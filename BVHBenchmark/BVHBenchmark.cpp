@@ -0,0 +1,447 @@
+/**
+*  @file BVHBenchmark.cpp
+*  @brief Command line tool that checks BVH queries against brute force, and times building and querying.
+*
+*  Builds hierarchies over scattered, clustered, identical and exponentially spaced boxes, and checks each
+*  node bounds what's under it, every leaf fits the leaf size and every primitive is in exactly one leaf.
+*  QueryFrustum has to find exactly the boxes IntersectsBox keeps when testing them one by one, from
+*  random cameras, and Raycast the same closest hit as testing every box or triangle. A hierarchy read
+*  back from Serialize has to answer the same, and data for another key or cut short has to be refused.
+*  Finally times the build, and a query against testing every box one by one and with CullBoxes.
+*  Only uses the C++ standard library and glm, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -msse2 -I../TestApp -I../inc BVHBenchmark.cpp ../TestApp/BVH.cpp ../TestApp/Frustum.cpp -o BVHBenchmark
+*
+*  Usage: BVHBenchmark [rounds]
+*
+*  @bug No known bugs.
+*/
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "BVH.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+static const unsigned int MAX_LEAF_SIZE = 4;
+
+/**
+*  @brief Boxes to build a hierarchy over.
+*/
+struct Boxes
+{
+	std::vector<glm::vec3> mMin;
+	std::vector<glm::vec3> mMax;
+
+	void Add(const glm::vec3& centre, const glm::vec3& extent)
+	{
+		mMin.push_back(centre - extent);
+		mMax.push_back(centre + extent);
+	}
+	unsigned int Size() const { return (unsigned int)mMin.size(); }
+};
+
+static Frustum MakeFrustum(const glm::vec3& position, const glm::vec3& target)
+{
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	return Frustum(projection * glm::lookAt(position, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+}
+
+static bool Contains(const glm::vec3& outerMin, const glm::vec3& outerMax, const glm::vec3& innerMin, const glm::vec3& innerMax)
+{
+	return glm::all(glm::lessThanEqual(outerMin, innerMin)) && glm::all(glm::lessThanEqual(innerMax, outerMax));
+}
+
+/**
+*  @brief Walks the tree checking each node's bounds and links, and that the leaves cover the primitives once.
+*
+*  @return The depth of the deepest leaf, the root being 1.
+*/
+static unsigned int CheckNode(const std::vector<BVHNode>& nodes, uint32_t index, const Boxes& boxes, const std::vector<uint32_t>& leafOrder,
+	std::vector<unsigned int>& slotUses, unsigned int depth)
+{
+	const BVHNode& node = nodes[index];
+	if (node.IsLeaf())
+	{
+		CHECK(node.miCount <= MAX_LEAF_SIZE);
+		bool bounded = true;
+		for (uint32_t slot = node.miRightOrFirst; slot < node.miRightOrFirst + node.miCount && slot < slotUses.size(); slot++)
+		{
+			slotUses[slot]++;
+			const uint32_t primitive = leafOrder[slot];
+			bounded = bounded && Contains(node.mBoundsMin, node.mBoundsMax, boxes.mMin[primitive], boxes.mMax[primitive]);
+		}
+		CHECK(bounded);
+		return depth;
+	}
+
+	// Depth first, the left child follows its parent and the right one comes after the left's subtree
+	const uint32_t left = index + 1;
+	const uint32_t right = node.miRightOrFirst;
+	CHECK(right > left && right < nodes.size());
+	if (right <= left || right >= nodes.size())
+		return depth;
+	CHECK(Contains(node.mBoundsMin, node.mBoundsMax, nodes[left].mBoundsMin, nodes[left].mBoundsMax));
+	CHECK(Contains(node.mBoundsMin, node.mBoundsMax, nodes[right].mBoundsMin, nodes[right].mBoundsMax));
+	return std::max(CheckNode(nodes, left, boxes, leafOrder, slotUses, depth + 1), CheckNode(nodes, right, boxes, leafOrder, slotUses, depth + 1));
+}
+
+/**
+*  @brief Checks the tree's shape, using a frustum that sees everything to get the primitives in leaf order.
+*
+*  @return The depth of the tree.
+*/
+static unsigned int CheckStructure(const BVH& bvh, const Boxes& boxes)
+{
+	CHECK(bvh.NumPrimitives() == boxes.Size());
+	CHECK(bvh.IsEmpty() == (boxes.Size() == 0));
+	if (bvh.IsEmpty())
+		return 0;
+
+	std::vector<uint32_t> leafOrder;
+	bvh.QueryFrustum(Frustum(), leafOrder);
+	CHECK(leafOrder.size() == boxes.Size());
+	if (leafOrder.size() != boxes.Size())
+		return 0;
+
+	std::vector<unsigned int> primitiveUses(boxes.Size(), 0);
+	for (uint32_t primitive : leafOrder)
+		primitiveUses[primitive]++;
+	CHECK(std::count(primitiveUses.begin(), primitiveUses.end(), 1u) == (ptrdiff_t)boxes.Size());
+
+	std::vector<unsigned int> slotUses(boxes.Size(), 0);
+	const unsigned int depth = CheckNode(bvh.GetNodes(), 0, boxes, leafOrder, slotUses, 1);
+	CHECK(std::count(slotUses.begin(), slotUses.end(), 1u) == (ptrdiff_t)boxes.Size());
+	return depth;
+}
+
+/**
+*  @brief Checks the query finds exactly the boxes the frustum keeps when testing each one.
+*/
+static void CheckQuery(const BVH& bvh, const Boxes& boxes, const Frustum& frustum)
+{
+	std::vector<uint32_t> found;
+	bvh.QueryFrustum(frustum, found);
+	std::sort(found.begin(), found.end());
+
+	std::vector<uint32_t> expected;
+	for (uint32_t i = 0; i < boxes.Size(); i++)
+	{
+		if (frustum.IntersectsBox(boxes.mMin[i], boxes.mMax[i]))
+			expected.push_back(i);
+	}
+	CHECK(found == expected);
+}
+
+/**
+*  @brief The closest box along a ray, found by testing every one.
+*/
+static bool RaycastBoxes(const Boxes& boxes, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& closest)
+{
+	const glm::vec3 inverseDirection = 1.0f / direction;
+	closest = maxDistance;
+	bool found = false;
+	for (uint32_t i = 0; i < boxes.Size(); i++)
+	{
+		const glm::vec3 t0 = (boxes.mMin[i] - origin) * inverseDirection;
+		const glm::vec3 t1 = (boxes.mMax[i] - origin) * inverseDirection;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+		const float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		const float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+		if (entry <= exit && entry < closest)
+		{
+			closest = entry;
+			found = true;
+		}
+	}
+	return found;
+}
+
+/**
+*  @brief The closest triangle along a ray, found by testing every one.
+*/
+static bool RaycastTriangles(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const glm::vec3& origin,
+	const glm::vec3& direction, float maxDistance, float& closest)
+{
+	closest = maxDistance;
+	bool found = false;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const glm::vec3& a = positions[indices[i]];
+		const glm::vec3 edge1 = positions[indices[i + 1]] - a;
+		const glm::vec3 edge2 = positions[indices[i + 2]] - a;
+		const glm::vec3 p = glm::cross(direction, edge2);
+		const float determinant = glm::dot(edge1, p);
+		if (fabsf(determinant) < 1e-12f)
+			continue;
+
+		const float inverseDeterminant = 1.0f / determinant;
+		const glm::vec3 t = origin - a;
+		const float u = glm::dot(t, p) * inverseDeterminant;
+		const glm::vec3 q = glm::cross(t, edge1);
+		const float v = glm::dot(direction, q) * inverseDeterminant;
+		const float distance = glm::dot(edge2, q) * inverseDeterminant;
+		if (u >= 0.0f && u <= 1.0f && v >= 0.0f && u + v <= 1.0f && distance >= 0.0f && distance < closest)
+		{
+			closest = distance;
+			found = true;
+		}
+	}
+	return found;
+}
+
+static bool SameDistance(float a, float b)
+{
+	return fabsf(a - b) <= 1e-4f * std::max(1.0f, fabsf(a));
+}
+
+static glm::vec3 RandomDirection(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+	glm::vec3 direction;
+	do
+	{
+		direction = glm::vec3(value(random), value(random), value(random));
+	} while (glm::dot(direction, direction) < 0.01f);
+	return glm::normalize(direction);
+}
+
+/**
+*  @brief Checks a built hierarchy's shape, frustum queries and rays, and that it survives serialising.
+*/
+static void CheckBoxes(const char* name, const Boxes& boxes, const glm::vec3& centre, float size, std::mt19937& random)
+{
+	BVH bvh;
+	bvh.Build(boxes.mMin, boxes.mMax, MAX_LEAF_SIZE);
+	const unsigned int depth = CheckStructure(bvh, boxes);
+	printf("  %-24s %6u boxes %6u nodes, %3u deep\n", name, boxes.Size(), bvh.NumNodes(), depth);
+
+	std::uniform_real_distribution<float> offset(-size, size);
+	for (unsigned int round = 0; round < 20; round++)
+	{
+		const glm::vec3 eye = centre + glm::vec3(offset(random), offset(random), offset(random));
+		const glm::vec3 target = centre + glm::vec3(offset(random), offset(random), offset(random));
+		if (glm::distance(eye, target) > 0.0f)
+			CheckQuery(bvh, boxes, MakeFrustum(eye, target));
+	}
+	CheckQuery(bvh, boxes, Frustum());
+
+	for (unsigned int round = 0; round < 200; round++)
+	{
+		const glm::vec3 origin = centre + glm::vec3(offset(random), offset(random), offset(random));
+		const glm::vec3 direction = RandomDirection(random);
+		BVHRayHit hit;
+		float closest;
+		const bool hitBVH = bvh.Raycast(origin, direction, FLT_MAX, hit);
+		const bool hitAny = RaycastBoxes(boxes, origin, direction, FLT_MAX, closest);
+		CHECK(hitBVH == hitAny);
+		if (hitBVH && hitAny)
+		{
+			CHECK(SameDistance(hit.mDistance, closest));
+			CHECK(hit.miPrimitive < boxes.Size());
+		}
+	}
+
+	// Read back from its serialised form it answers the same
+	std::vector<unsigned char> data;
+	bvh.Serialize(1234, data);
+	BVH loaded;
+	CHECK(loaded.Deserialize(1234, data.data(), data.size()));
+	CHECK(loaded.NumNodes() == bvh.NumNodes() && loaded.NumPrimitives() == bvh.NumPrimitives());
+	const Frustum frustum = MakeFrustum(centre + glm::vec3(0.0f, size, size), centre);
+	std::vector<uint32_t> found, foundLoaded;
+	bvh.QueryFrustum(frustum, found);
+	loaded.QueryFrustum(frustum, foundLoaded);
+	CHECK(found == foundLoaded);
+	CHECK(!loaded.Deserialize(4321, data.data(), data.size()));
+	CHECK(loaded.IsEmpty());
+	CHECK(!loaded.Deserialize(1234, data.data(), data.size() - 1));
+	CHECK(loaded.IsEmpty());
+}
+
+/**
+*  @brief Checks rays against a hierarchy built from a bumpy triangulated grid hit the same triangles as testing each.
+*/
+static void CheckTriangles(std::mt19937& random)
+{
+	const unsigned int size = 40;
+	std::uniform_real_distribution<float> height(-1.0f, 1.0f);
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	for (unsigned int z = 0; z <= size; z++)
+	{
+		for (unsigned int x = 0; x <= size; x++)
+			positions.push_back(glm::vec3((float)x, height(random), (float)z));
+	}
+	for (unsigned int z = 0; z < size; z++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			const uint32_t corner = z * (size + 1) + x;
+			const uint32_t quad[6] = { corner, corner + 1, corner + size + 1, corner + 1, corner + size + 2, corner + size + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+
+	BVH bvh;
+	bvh.BuildFromTriangles(positions, indices, MAX_LEAF_SIZE);
+	CHECK(bvh.NumPrimitives() == indices.size() / 3);
+
+	std::uniform_real_distribution<float> across(0.0f, (float)size);
+	unsigned int hits = 0;
+	for (unsigned int round = 0; round < 1000; round++)
+	{
+		const glm::vec3 origin(across(random), 5.0f, across(random));
+		const glm::vec3 target(across(random), 0.0f, across(random));
+		const glm::vec3 direction = round % 2 == 0 ? glm::normalize(target - origin) : RandomDirection(random);
+		const float maxDistance = round % 5 == 0 ? 3.0f : FLT_MAX;
+		BVHRayHit hit;
+		float closest;
+		const bool hitBVH = bvh.Raycast(origin, direction, maxDistance, hit);
+		const bool hitAny = RaycastTriangles(positions, indices, origin, direction, maxDistance, closest);
+		CHECK(hitBVH == hitAny);
+		if (hitBVH && hitAny)
+		{
+			CHECK(SameDistance(hit.mDistance, closest));
+			CHECK(hit.miPrimitive < indices.size() / 3);
+		}
+		hits += hitBVH ? 1 : 0;
+	}
+	CHECK(hits > 500);
+}
+
+/**
+*  @brief Boxes scattered over a ground plane, like a level's meshes.
+*/
+static Boxes ScatteredBoxes(unsigned int count, float range, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> position(-range, range);
+	std::uniform_real_distribution<float> size(0.1f, range * 0.02f);
+	Boxes boxes;
+	for (unsigned int i = 0; i < count; i++)
+		boxes.Add(glm::vec3(position(random), position(random) * 0.1f, position(random)), glm::vec3(size(random), size(random), size(random)));
+	return boxes;
+}
+
+static void CheckHierarchies(std::mt19937& random)
+{
+	printf("Hierarchies checked:\n");
+	CheckBoxes("Empty", Boxes(), glm::vec3(0.0f), 10.0f, random);
+
+	Boxes one;
+	one.Add(glm::vec3(1.0f, 2.0f, 3.0f), glm::vec3(0.5f));
+	CheckBoxes("One box", one, glm::vec3(0.0f), 10.0f, random);
+
+	CheckBoxes("Scattered", ScatteredBoxes(5000, 500.0f, random), glm::vec3(0.0f), 500.0f, random);
+
+	// A few tight clusters far apart, with most of the space empty
+	Boxes clustered;
+	std::normal_distribution<float> spread(0.0f, 2.0f);
+	std::uniform_real_distribution<float> size(0.05f, 0.5f);
+	for (unsigned int cluster = 0; cluster < 8; cluster++)
+	{
+		const glm::vec3 centre(cluster * 100.0f - 350.0f, 0.0f, (cluster % 3) * 150.0f - 150.0f);
+		for (unsigned int i = 0; i < 500; i++)
+			clustered.Add(centre + glm::vec3(spread(random), spread(random), spread(random)), glm::vec3(size(random)));
+	}
+	CheckBoxes("Clustered", clustered, glm::vec3(0.0f), 400.0f, random);
+
+	// No split plane separates anything, so the builder has to halve the list
+	Boxes identical;
+	for (unsigned int i = 0; i < 1000; i++)
+		identical.Add(glm::vec3(3.0f, 0.0f, -3.0f), glm::vec3(1.0f, 2.0f, 1.0f));
+	CheckBoxes("Identical", identical, glm::vec3(0.0f), 20.0f, random);
+
+	// Each split can only peel a few boxes off, making a tree far deeper than a balanced one
+	Boxes spaced;
+	for (unsigned int i = 0; i < 400; i++)
+		spaced.Add(glm::vec3(100.0f * powf(0.8f, (float)i), 0.0f, 0.0f), glm::vec3(1e-3f * powf(0.8f, (float)i)));
+	CheckBoxes("Exponentially spaced", spaced, glm::vec3(50.0f, 0.0f, 0.0f), 100.0f, random);
+
+	CheckTriangles(random);
+}
+
+/**
+*  @brief Prints the best time of a few rounds to build, and to query from a camera over the middle of the scene.
+*/
+static void TimeHierarchies(std::mt19937& random, unsigned int rounds)
+{
+	const Frustum frustum = MakeFrustum(glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(300.0f, 0.0f, -200.0f));
+	printf("Building and querying, best of %u rounds:\n", rounds);
+	printf("  %8s %12s %12s %14s %12s %9s\n", "boxes", "build", "query", "IntersectsBox", "CullBoxes", "visible");
+	for (unsigned int count : { 1000u, 10000u, 100000u })
+	{
+		const Boxes boxes = ScatteredBoxes(count, 2000.0f, random);
+		BoundingBoxesSoA soa;
+		soa.Resize(count);
+		for (unsigned int i = 0; i < count; i++)
+			soa.Set(i, boxes.mMin[i], boxes.mMax[i]);
+		std::vector<uint8_t> visible(soa.PaddedSize());
+		std::vector<uint32_t> found;
+		found.reserve(count);
+
+		BVH bvh;
+		double best[4] = { 0.0, 0.0, 0.0, 0.0 };
+		unsigned int numVisible = 0;
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			for (int method = 0; method < 4; method++)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				if (method == 0)
+				{
+					bvh.Build(boxes.mMin, boxes.mMax, MAX_LEAF_SIZE);
+				}
+				else if (method == 1)
+				{
+					bvh.QueryFrustum(frustum, found);
+					numVisible = (unsigned int)found.size();
+				}
+				else if (method == 2)
+				{
+					found.clear();
+					for (uint32_t i = 0; i < count; i++)
+					{
+						if (frustum.IntersectsBox(boxes.mMin[i], boxes.mMax[i]))
+							found.push_back(i);
+					}
+				}
+				else
+				{
+					frustum.CullBoxes(soa, visible.data());
+				}
+				const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+				if (round == 0 || us < best[method])
+					best[method] = us;
+			}
+		}
+		printf("  %8u %9.1f us %9.1f us %11.1f us %9.1f us %9u\n", count, best[0], best[1], best[2], best[3], numVisible);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const int rounds = argc > 1 ? atoi(argv[1]) : 5;
+	if (rounds <= 0)
+	{
+		fprintf(stderr, "Usage: BVHBenchmark [rounds]\n");
+		return 1;
+	}
+
+	std::mt19937 random(1234);
+	CheckHierarchies(random);
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	TimeHierarchies(random, (unsigned int)rounds);
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/**
+*  @file ConfigBenchmark.cpp
+*  @brief Command line tool that checks the Config store and measures how fast settings are read.
+*
+*  Writes a settings file, checks the values come back trimmed and typed, and that editing the file
+*  is picked up by Update with callbacks for just the settings that changed. Then times reading an int
+*  setting the way Config used to (a std::map lookup, a copy and stoi), by key, and through a handle.
+*  Only uses the C++ standard library, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -I../TestApp ConfigBenchmark.cpp ../TestApp/Config.cpp -o ConfigBenchmark
+*
+*  Usage: ConfigBenchmark [extra keys] [reads]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Config.h"
+
+static const char* const PATH = "ConfigBenchmark.cfg";
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/**
+*  @brief Writes the settings file, with the filler keys after the ones that are checked.
+*/
+static void WriteSettings(const char* settings, int extraKeys)
+{
+	FILE* file = fopen(PATH, "w");
+	if (!file)
+	{
+		printf("Couldn't write %s\n", PATH);
+		exit(1);
+	}
+	fputs(settings, file);
+	for (int i = 0; i < extraKeys; i++)
+		fprintf(file, "FILLER_SETTING_%d=%d\n", i, i);
+	fclose(file);
+}
+
+static void CheckValues(int extraKeys)
+{
+	WriteSettings(
+		"# Application Settings\n"
+		"SCREEN_WIDTH=1920\t\n"
+		"  SCREEN_HEIGHT = 1080\r\n"
+		"FULL_SCREEN=True\n"
+		"SCALE=1.5\n"
+		"NAME= Test App \n"
+		"#COMMENTED=1\n"
+		"no equals sign\n", extraKeys);
+
+	Config config;
+	CHECK(config.ReadInFromFile(PATH));
+	CHECK(config.GetValue("SCREEN_WIDTH") == "1920");
+	CHECK(config.GetValueAsInt("SCREEN_WIDTH") == 1920);
+	CHECK(config.GetValueAsInt("SCREEN_HEIGHT") == 1080);
+	CHECK(config.GetValueAsBool("FULL_SCREEN"));
+	CHECK(config.GetValueAsFloat("SCALE") == 1.5f);
+	CHECK(config.GetValueAsInt("SCALE") == 1);
+	CHECK(config.GetValue("NAME") == "Test App");
+	CHECK(config.GetValue("#COMMENTED").empty());
+	CHECK(config.GetValueAsInt("MISSING") == 0);
+	CHECK(config.GetValueAsInt("FILLER_SETTING_7") == (extraKeys > 7 ? 7 : 0));
+
+	ConfigHandle width = config.GetHandle("SCREEN_WIDTH");
+	ConfigHandle missing = config.GetHandle("MISSING");
+	CHECK(config.Get(width).meType == CONFIG_INT);
+	CHECK(config.Get(config.GetHandle("SCALE")).meType == CONFIG_FLOAT);
+	CHECK(config.Get(config.GetHandle("FULL_SCREEN")).meType == CONFIG_BOOL);
+	CHECK(config.Get(config.GetHandle("NAME")).meType == CONFIG_STRING);
+	CHECK(!config.Get(missing).mbPresent);
+
+	int widthChanges = 0, missingChanges = 0, heightChanges = 0;
+	config.AddCallback(width, [&widthChanges](const ConfigValue& value) { widthChanges++; CHECK(value.AsInt() == 2560); });
+	config.AddCallback(missing, [&missingChanges](const ConfigValue& value) { missingChanges++; CHECK(value.AsString() == "here"); });
+	config.AddCallback(config.GetHandle("SCREEN_HEIGHT"), [&heightChanges](const ConfigValue& value) { heightChanges++; CHECK(!value.mbPresent); });
+
+	// Nothing has changed yet
+	config.Reload();
+	CHECK(widthChanges == 0 && missingChanges == 0 && heightChanges == 0);
+
+	// A different size, so the watcher sees it even if the time hasn't ticked over
+	WriteSettings(
+		"SCREEN_WIDTH=2560\n"
+		"FULL_SCREEN=True\n"
+		"SCALE=1.5\n"
+		"NAME= Test App \n"
+		"MISSING=here\n", extraKeys);
+	std::this_thread::sleep_for(Config::WATCH_INTERVAL + std::chrono::milliseconds(100));
+	CHECK(config.Update());
+	CHECK(widthChanges == 1 && missingChanges == 1 && heightChanges == 1);
+	CHECK(config.Get(width).AsInt() == 2560);
+	CHECK(config.Get(missing).AsString() == "here");
+	CHECK(config.GetValueAsInt("SCREEN_HEIGHT") == 0);
+	CHECK(!config.Update());
+}
+
+/**
+*  @brief Reads an int setting the way Config used to.
+*/
+static int GetIntTheOldWay(std::map<std::string, std::string>& values, const std::string& key)
+{
+	std::string value;
+	std::map<std::string, std::string>::iterator i = values.find(key);
+	if (i != values.end())
+		value = i->second;
+
+	try
+	{
+		return std::stoi(value);
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+
+template <typename Read>
+static void TimeReads(const char* name, int reads, Read read)
+{
+	long long total = 0;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < reads; i++)
+		total += read(i & 3);
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	printf("%-24s %7.1f ns/read  (total %lld)\n", name, std::chrono::duration<double, std::nano>(end - start).count() / reads, total);
+}
+
+int main(int argc, char** argv)
+{
+	const int extraKeys = argc > 1 ? atoi(argv[1]) : 200;
+	const int reads = argc > 2 ? atoi(argv[2]) : 1000000;
+	if (extraKeys < 0 || reads <= 0)
+	{
+		fprintf(stderr, "Usage: ConfigBenchmark [extra keys] [reads]\n");
+		return 1;
+	}
+
+	CheckValues(extraKeys);
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	WriteSettings("SCREEN_WIDTH=1920\t\nSCREEN_HEIGHT=1080\nFULL_SCREEN=false\n", extraKeys);
+	Config config;
+	config.ReadInFromFile(PATH);
+
+	std::map<std::string, std::string> oldValues;
+	oldValues["SCREEN_WIDTH"] = "1920\t";
+	oldValues["SCREEN_HEIGHT"] = "1080";
+	oldValues["FULL_SCREEN"] = "false";
+	for (int i = 0; i < extraKeys; i++)
+		oldValues["FILLER_SETTING_" + std::to_string(i)] = std::to_string(i);
+
+	// Cycling through a few keys stops the compiler hoisting the read out of the loop
+	printf("%d settings, %d reads of 4 int settings\n", extraKeys + 3, reads);
+	const std::string keys[4] = { "SCREEN_WIDTH", "SCREEN_HEIGHT", "FILLER_SETTING_0", "FILLER_SETTING_1" };
+	ConfigHandle handles[4];
+	for (int i = 0; i < 4; i++)
+		handles[i] = config.GetHandle(keys[i]);
+	TimeReads("map, copy and stoi (old)", reads, [&oldValues, &keys](int i) { return GetIntTheOldWay(oldValues, keys[i]); });
+	TimeReads("GetValueAsInt(key)", reads, [&config, &keys](int i) { return config.GetValueAsInt(keys[i]); });
+	TimeReads("Get(handle).AsInt()", reads, [&config, &handles](int i) { return config.Get(handles[i]).AsInt(); });
+
+	remove(PATH);
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+/**
+*  @file DecodeBenchmark.cpp
+*  @brief Command line tool that times decoding a model's textures with 1 to N threads.
+*
+*  Decodes the images with ImageDecoder::DecodeImages, as Model does when it loads, and checks every thread
+*  count decodes each image exactly once into the same pixels as a single thread does, and that cancelling
+*  stops it. Then times each thread count, taking the best of a few rounds. Only uses the C++ standard
+*  library and stb, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -pthread -I../inc -I../TestApp DecodeBenchmark.cpp ../TestApp/ImageDecoder.cpp ../TestApp/Profiler.cpp ../TestApp/LogQueue.cpp ../TestApp/BinaryLog.cpp -o DecodeBenchmark
+*
+*  Usage: DecodeBenchmark [-t max threads] [-r rounds] image.png [image2.png ...]
+*  The images have to be in one directory, e.g. every .png in Resources/Models/Sponza/textures.
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ImageDecoder.h"
+#include "Log.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/**
+*  @brief What an image decoded to, to compare between runs without keeping the pixels.
+*/
+struct DecodeResult
+{
+	uint64_t hash;
+	int width;
+	int height;
+	bool hasAlpha;
+	bool baked;
+	size_t bytes;
+	unsigned int timesDecoded;
+};
+
+static uint64_t HashBytes(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+*  @brief Decodes every image on the given number of threads, recording and freeing each as it's done.
+*
+*  @return The number of images decoded.
+*/
+static unsigned int Decode(const std::string& directory, const std::vector<std::string>& paths, unsigned int numThreads,
+	const std::atomic<bool>& cancel, std::vector<DecodeResult>& results, bool hashPixels)
+{
+	std::vector<DecodedImage> images(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+		images[i].mPath = paths[i];
+
+	results.assign(paths.size(), DecodeResult());
+	DecodedImage* first = images.data();
+	DecodeResult* pResults = results.data();
+	return ImageDecoder::DecodeImages(directory, images, numThreads, cancel, [first, pResults, hashPixels](DecodedImage& image)
+	{
+		DecodeResult& result = pResults[&image - first];
+		const size_t pixelBytes = image.mpData ? (size_t)image.miWidth * image.miHeight * 4 : 0;
+		result.bytes = image.mbBaked ? image.mFileData.size() : pixelBytes;
+		if (hashPixels)
+			result.hash = image.mbBaked ? HashBytes(image.mFileData.data(), image.mFileData.size()) : HashBytes(image.mpData, pixelBytes);
+		result.width = image.miWidth;
+		result.height = image.miHeight;
+		result.hasAlpha = image.mbHasAlpha;
+		result.baked = image.mbBaked;
+		result.timesDecoded++;
+
+		ImageDecoder::FreePixels(image);
+		std::vector<unsigned char>().swap(image.mFileData);
+	});
+}
+
+static bool SameResults(const std::vector<DecodeResult>& a, const std::vector<DecodeResult>& b)
+{
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (a[i].hash != b[i].hash || a[i].width != b[i].width || a[i].height != b[i].height ||
+			a[i].hasAlpha != b[i].hasAlpha || a[i].baked != b[i].baked || a[i].timesDecoded != b[i].timesDecoded)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+*  @brief Decodes with every thread count, checking each matches a single thread, and that cancelling stops it.
+*/
+static void CheckDecode(const std::string& directory, const std::vector<std::string>& paths, unsigned int maxThreads)
+{
+	std::atomic<bool> cancel(false);
+	std::vector<DecodeResult> reference;
+	CHECK(Decode(directory, paths, 1, cancel, reference, true) == paths.size());
+	for (size_t i = 0; i < reference.size(); i++)
+	{
+		CHECK(reference[i].timesDecoded == 1);
+		if (reference[i].bytes == 0)
+			printf("Couldn't decode %s/%s\n", directory.c_str(), paths[i].c_str());
+		CHECK(reference[i].bytes > 0);
+	}
+
+	for (unsigned int threads = 2; threads <= maxThreads; threads++)
+	{
+		std::vector<DecodeResult> results;
+		CHECK(Decode(directory, paths, threads, cancel, results, true) == paths.size());
+		CHECK(SameResults(results, reference));
+	}
+
+	// Cancelled before it starts nothing is decoded, and a worker stops after the image it's on
+	cancel.store(true);
+	std::vector<DecodeResult> results;
+	CHECK(Decode(directory, paths, maxThreads, cancel, results, false) == 0);
+
+	cancel.store(false);
+	std::vector<DecodedImage> images(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+		images[i].mPath = paths[i];
+	unsigned int decoded = 0;
+	CHECK(ImageDecoder::DecodeImages(directory, images, 1, cancel, [&cancel, &decoded](DecodedImage& image)
+	{
+		decoded++;
+		cancel.store(true);
+		ImageDecoder::FreePixels(image);
+	}) == 1);
+	CHECK(decoded == 1);
+}
+
+/**
+*  @brief Prints the best time of a few rounds for each thread count.
+*/
+static void TimeDecode(const std::string& directory, const std::vector<std::string>& paths, unsigned int maxThreads, unsigned int rounds)
+{
+	const std::atomic<bool> cancel(false);
+	std::vector<DecodeResult> results;
+	double singleThreadMs = 0.0;
+	printf("%zu images, best of %u rounds:\n", paths.size(), rounds);
+	for (unsigned int threads = 1; threads <= maxThreads; threads++)
+	{
+		double bestMs = 0.0;
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			Decode(directory, paths, threads, cancel, results, false);
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (round == 0 || ms < bestMs)
+				bestMs = ms;
+		}
+		if (threads == 1)
+			singleThreadMs = bestMs;
+
+		size_t bytes = 0;
+		unsigned int baked = 0;
+		for (const DecodeResult& result : results)
+		{
+			bytes += result.bytes;
+			baked += result.baked ? 1 : 0;
+		}
+		printf("  %2u threads %9.1f ms  %5.2fx  %7.1f MB/s out  (%u baked)\n", threads, bestMs, singleThreadMs / bestMs,
+			bytes / (1024.0 * 1024.0) / (bestMs / 1000.0), baked);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int maxThreads = std::thread::hardware_concurrency();
+	unsigned int rounds = 3;
+	std::vector<std::string> inputs;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			maxThreads = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			rounds = (unsigned int)atoi(argv[++i]);
+		else
+			inputs.push_back(argv[i]);
+	}
+	if (maxThreads == 0)
+		maxThreads = 1;
+	if (inputs.empty() || rounds == 0)
+	{
+		fprintf(stderr, "Usage: DecodeBenchmark [-t max threads] [-r rounds] image.png [image2.png ...]\n");
+		return 1;
+	}
+
+	// DecodeImages takes paths relative to one directory, the way a model's materials refer to its textures
+	const size_t slash = inputs[0].find_last_of("/\\");
+	const std::string directory = slash == std::string::npos ? "." : inputs[0].substr(0, slash);
+	std::vector<std::string> paths;
+	for (const std::string& input : inputs)
+	{
+		if (slash == std::string::npos ? input.find_first_of("/\\") != std::string::npos : input.compare(0, slash + 1, inputs[0], 0, slash + 1) != 0)
+		{
+			fprintf(stderr, "The images have to be in one directory, %s isn't in %s\n", input.c_str(), directory.c_str());
+			return 1;
+		}
+		paths.push_back(slash == std::string::npos ? input : input.substr(slash + 1));
+	}
+
+	// DecodeImages logs every run
+	Logger::ReportingLevel() = WARNING;
+
+	CheckDecode(directory, paths, maxThreads);
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	TimeDecode(directory, paths, maxThreads, rounds);
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,447 @@
+/**
+*  @file DrawListBenchmark.cpp
+*  @brief Command line tool that checks the DrawList sort and the DeviceStateCache, and times the sort.
+*
+*  RadixSort has to order keys exactly as std::stable_sort does, equal keys included, for keys that differ
+*  in every byte, in one byte only, or not at all. Then a scene laid out like a model, most meshes in a
+*  GeometryArena and the rest with their own buffers, sharing a few texture sets, is submitted through a
+*  DeviceStateCache on a NullGraphicsDevice in the order it was added and sorted. Every draw has to see
+*  the buffers and textures its mesh binds on its own, and the cache has to make exactly the changes the
+*  order needs, no more and no fewer. Prints the state changes each order makes, and the sort's time
+*  against std::sort and std::stable_sort.
+*  Only uses the C++ standard library and glm, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -pthread -I../TestApp -I../inc DrawListBenchmark.cpp ../TestApp/DrawList.cpp ../TestApp/DeviceStateCache.cpp ../TestApp/Mesh.cpp ../TestApp/VBO.cpp ../TestApp/IndexBuffer.cpp ../TestApp/Texture.cpp ../TestApp/GeometryArena.cpp ../TestApp/RangeAllocator.cpp ../TestApp/VertexPacking.cpp ../TestApp/NullGraphicsDevice.cpp ../TestApp/LogQueue.cpp ../TestApp/BinaryLog.cpp -o DrawListBenchmark
+*
+*  Usage: DrawListBenchmark [meshes]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+#include "DrawList.h"
+#include "Mesh.h"
+#include "NullGraphicsDevice.h"
+#include "Texture.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/**
+*  @brief The state a draw was made with.
+*/
+struct DrawState
+{
+	GraphicsBuffer* mpVertexBuffer;
+	GraphicsBuffer* mpIndexBuffer;
+	GraphicsTexture* mpTextures[2];
+
+	bool operator==(const DrawState& other) const
+	{
+		return mpVertexBuffer == other.mpVertexBuffer && mpIndexBuffer == other.mpIndexBuffer &&
+			mpTextures[0] == other.mpTextures[0] && mpTextures[1] == other.mpTextures[1];
+	}
+	bool operator!=(const DrawState& other) const { return !(*this == other); }
+};
+
+/**
+*  @brief A NullGraphicsDevice that remembers what is bound, and records it at every draw.
+*/
+class TrackingDevice : public NullGraphicsDevice
+{
+public:
+	TrackingDevice() : mBound(), miVertexBufferChanges(0), miIndexBufferChanges(0), miTextureChanges(0) {}
+
+	virtual void SetVertexBuffer(GraphicsBuffer* buffer, unsigned int stride)
+	{
+		NullGraphicsDevice::SetVertexBuffer(buffer, stride);
+		mBound.mpVertexBuffer = buffer;
+		miVertexBufferChanges++;
+	}
+
+	virtual void SetIndexBuffer(GraphicsBuffer* buffer, IndexFormat format)
+	{
+		NullGraphicsDevice::SetIndexBuffer(buffer, format);
+		mBound.mpIndexBuffer = buffer;
+		miIndexBufferChanges++;
+	}
+
+	virtual void SetPSTexture(unsigned int slot, GraphicsTexture* texture)
+	{
+		NullGraphicsDevice::SetPSTexture(slot, texture);
+		if (slot < 2)
+			mBound.mpTextures[slot] = texture;
+		miTextureChanges++;
+	}
+
+	virtual void DrawIndexed(unsigned int numIndices, unsigned int firstIndex, int baseVertex)
+	{
+		NullGraphicsDevice::DrawIndexed(numIndices, firstIndex, baseVertex);
+		mDraws.push_back(mBound);
+	}
+
+	/**
+	*  @brief Starts counting again, forgetting what's bound so a texture left from before isn't taken as one a draw set.
+	*/
+	void ResetTracking()
+	{
+		mBound = DrawState();
+		mDraws.clear();
+		miVertexBufferChanges = miIndexBufferChanges = miTextureChanges = 0;
+	}
+
+	DrawState mBound;
+	std::vector<DrawState> mDraws;
+	unsigned int miVertexBufferChanges;
+	unsigned int miIndexBufferChanges;
+	unsigned int miTextureChanges;
+};
+
+/**
+*  @brief Sorts items by key with RadixSort and with std::stable_sort, and checks they agree item for item.
+*
+*  Each item's mesh pointer is only used to tell the items apart, it's never dereferenced.
+*/
+static void CheckSortMatches(const std::vector<uint64_t>& keys)
+{
+	std::vector<int> ids(keys.size());
+	std::vector<DrawItem> items(keys.size());
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		items[i].mKey = keys[i];
+		items[i].mpMesh = reinterpret_cast<Mesh*>(&ids[i]);
+	}
+
+	std::vector<DrawItem> expected = items;
+	std::stable_sort(expected.begin(), expected.end(), [](const DrawItem& a, const DrawItem& b) { return a.mKey < b.mKey; });
+	std::vector<DrawItem> scratch;
+	DrawList::RadixSort(items, scratch);
+
+	bool same = items.size() == expected.size();
+	for (size_t i = 0; same && i < items.size(); i++)
+		same = items[i].mKey == expected[i].mKey && items[i].mpMesh == expected[i].mpMesh;
+	CHECK(same);
+}
+
+static void CheckSort(std::mt19937_64& random)
+{
+	// Nothing to sort, and lists the sort returns early on
+	for (size_t count : { 0u, 1u, 2u, 3u })
+	{
+		std::vector<uint64_t> keys;
+		for (size_t i = 0; i < count; i++)
+			keys.push_back(count - i);
+		CheckSortMatches(keys);
+	}
+
+	// Every key the same, the order has to be left alone
+	CheckSortMatches(std::vector<uint64_t>(1000, 0x123456789abcdefull));
+
+	// Keys differing in one byte only take one pass, leaving the result in the scratch buffer, two passes don't
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		std::vector<uint64_t> oneByte, twoBytes;
+		for (int i = 0; i < 1000; i++)
+		{
+			oneByte.push_back(0x0101010101010101ull ^ ((random() & 0xff) << shift));
+			twoBytes.push_back(((random() & 0xff) << shift) | ((random() & 0x3) << ((shift + 24) % 64)));
+		}
+		CheckSortMatches(oneByte);
+		CheckSortMatches(twoBytes);
+	}
+
+	// Few distinct keys, so lots of ties, and keys with every bit random
+	for (int round = 0; round < 20; round++)
+	{
+		std::vector<uint64_t> fewKeys, randomKeys;
+		const size_t count = 1 + random() % 5000;
+		for (size_t i = 0; i < count; i++)
+		{
+			fewKeys.push_back(DrawList::MakeKey(0, random() % 3, random() % 5, random() % 2));
+			randomKeys.push_back(random());
+		}
+		CheckSortMatches(fewKeys);
+		CheckSortMatches(randomKeys);
+	}
+
+	// Each field is masked to its width, and sorts above the ones below it
+	CHECK(DrawList::MakeKey(0, 1u << DrawList::GEOMETRY_BITS, 1u << DrawList::TEXTURE_SET_BITS, 1u << DrawList::DEPTH_BITS) == 0);
+	CHECK(DrawList::MakeKey(1, 0, 0, 0) > DrawList::MakeKey(0, ~0u, ~0u, ~0u));
+	CHECK(DrawList::MakeKey(0, 1, 0, 0) > DrawList::MakeKey(0, 0, ~0u, ~0u));
+	CHECK(DrawList::MakeKey(0, 0, 1, 0) > DrawList::MakeKey(0, 0, 0, ~0u));
+
+	// Nearer draws get smaller buckets, clamped at both ends
+	CHECK(DrawList::DepthBucket(-1.0f, 100.0f) == 0);
+	CHECK(DrawList::DepthBucket(0.0f, 100.0f) == 0);
+	CHECK(DrawList::DepthBucket(100.0f, 100.0f) == (1u << DrawList::DEPTH_BITS) - 1);
+	CHECK(DrawList::DepthBucket(1e9f, 100.0f) == (1u << DrawList::DEPTH_BITS) - 1);
+	bool increasing = true;
+	for (float distance = 0.0f; distance < 100.0f; distance += 0.01f)
+		increasing = increasing && DrawList::DepthBucket(distance, 100.0f) <= DrawList::DepthBucket(distance + 0.01f, 100.0f);
+	CHECK(increasing);
+}
+
+/**
+*  @brief Meshes laid out like a model's: most in an arena, some with their own buffers, sharing a few texture sets.
+*/
+struct Scene
+{
+	std::vector<Texture*> mTextures;
+	std::vector<Mesh*> mMeshes;
+	std::vector<unsigned int> mTextureSets;
+	std::vector<float> mDistances;
+	GeometryArena mArena;
+};
+
+static void CreateScene(TrackingDevice& device, unsigned int numMeshes, std::mt19937_64& random, Scene& scene)
+{
+	const unsigned int numTextures = 40;
+	const unsigned int numTextureSets = 25;
+	for (unsigned int i = 0; i < numTextures; i++)
+	{
+		Texture* texture = new Texture();
+		texture->SetDimensions(4, 4);
+		texture->Initialise(&device);
+		scene.mTextures.push_back(texture);
+	}
+
+	// Each set is a diffuse texture and maybe a specular one, some sets share their diffuse
+	std::vector<std::vector<Texture*>> sets(numTextureSets);
+	for (unsigned int i = 0; i < numTextureSets; i++)
+	{
+		sets[i].push_back(scene.mTextures[random() % (numTextures / 2)]);
+		if (i % 3 != 0)
+			sets[i].push_back(scene.mTextures[numTextures / 2 + random() % (numTextures / 2)]);
+	}
+
+	scene.mArena.Create(&device, sizeof(Vertex), numMeshes * 4, numMeshes * 6);
+	std::uniform_real_distribution<float> distance(1.0f, 1000.0f);
+	for (unsigned int i = 0; i < numMeshes; i++)
+	{
+		const std::vector<Vertex> vertices(4, Vertex(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f));
+		const std::vector<unsigned int> indices = { 0, 1, 2, 2, 1, 3 };
+		const unsigned int set = random() % numTextureSets;
+		std::vector<TextureDetail> details;
+		for (Texture* texture : sets[set])
+			details.push_back(TextureDetail(texture, details.empty() ? "texture_diffuse" : "texture_specular", ""));
+
+		Mesh* mesh = new Mesh(vertices, indices, details);
+		mesh->SetupMesh(&device, random() % 4 != 0 ? &scene.mArena : nullptr);
+		scene.mMeshes.push_back(mesh);
+		scene.mTextureSets.push_back(set);
+		scene.mDistances.push_back(distance(random));
+	}
+}
+
+static void ReleaseScene(Scene& scene)
+{
+	for (Mesh* mesh : scene.mMeshes)
+	{
+		mesh->Release();
+		delete mesh;
+	}
+	for (Texture* texture : scene.mTextures)
+	{
+		texture->Release();
+		delete texture;
+	}
+	scene.mArena.Release();
+}
+
+/**
+*  @brief Adds every mesh the way Model::AddToDrawList does.
+*/
+static void FillDrawList(const Scene& scene, DrawList& drawList)
+{
+	drawList.Clear();
+	for (unsigned int i = 0; i < scene.mMeshes.size(); i++)
+	{
+		const unsigned int geometry = scene.mMeshes[i]->IsInArena() ? 0 : i + 1;
+		const unsigned int bucket = DrawList::DepthBucket(scene.mDistances[i], 1000.0f);
+		drawList.Add(DrawList::MakeKey(DrawList::PASS_GBUFFER, geometry, scene.mTextureSets[i], bucket), scene.mMeshes[i]);
+	}
+}
+
+/**
+*  @brief The state changes a list of draws needs at the least, starting from nothing bound.
+*/
+static unsigned int CountNeededChanges(const std::vector<DrawState>& draws, unsigned int& vertexBuffers, unsigned int& indexBuffers, unsigned int& textures)
+{
+	vertexBuffers = indexBuffers = textures = 0;
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		vertexBuffers += i == 0 || draws[i].mpVertexBuffer != draws[i - 1].mpVertexBuffer ? 1 : 0;
+		indexBuffers += i == 0 || draws[i].mpIndexBuffer != draws[i - 1].mpIndexBuffer ? 1 : 0;
+		for (int slot = 0; slot < 2; slot++)
+		{
+			// A draw without a specular texture leaves the last one bound, it doesn't unbind it
+			const GraphicsTexture* previous = nullptr;
+			for (size_t j = i; j-- > 0 && !previous; )
+				previous = draws[j].mpTextures[slot];
+			textures += draws[i].mpTextures[slot] && draws[i].mpTextures[slot] != previous ? 1 : 0;
+		}
+	}
+	// Plus the topology, set once
+	return vertexBuffers + indexBuffers + textures + (draws.empty() ? 0 : 1);
+}
+
+/**
+*  @brief Submits the list through the cache, checking each draw's state and that only the needed changes are made.
+*
+*  @return The number of state changes made.
+*/
+static unsigned int CheckSubmit(TrackingDevice& device, const DrawList& drawList, const std::map<Mesh*, DrawState>& expected, DeviceStateCache& stateCache)
+{
+	device.ResetTracking();
+	stateCache.Invalidate();
+	stateCache.ResetStats();
+	drawList.Submit(&device, stateCache);
+
+	const std::vector<DrawItem>& items = drawList.GetItems();
+	CHECK(device.mDraws.size() == items.size());
+	bool correct = device.mDraws.size() == items.size();
+	std::vector<DrawState> wanted;
+	for (size_t i = 0; correct && i < items.size(); i++)
+	{
+		wanted.push_back(expected.at(items[i].mpMesh));
+		// Textures a mesh doesn't bind are whatever the draws before left
+		for (int slot = 0; slot < 2; slot++)
+		{
+			if (!wanted.back().mpTextures[slot])
+				wanted.back().mpTextures[slot] = device.mDraws[i].mpTextures[slot];
+		}
+		correct = device.mDraws[i] == wanted.back();
+	}
+	CHECK(correct);
+
+	unsigned int vertexBuffers, indexBuffers, textures;
+	const unsigned int needed = CountNeededChanges(device.mDraws, vertexBuffers, indexBuffers, textures);
+	CHECK(device.miVertexBufferChanges == vertexBuffers);
+	CHECK(device.miIndexBufferChanges == indexBuffers);
+	CHECK(device.miTextureChanges == textures);
+	const DeviceStateStats& stats = stateCache.GetStats();
+	CHECK(stats.miDraws == items.size());
+	CHECK(stats.miStateChanges == needed);
+	return stats.miStateChanges;
+}
+
+static void CheckStateChanges(unsigned int numMeshes, std::mt19937_64& random)
+{
+	TrackingDevice device;
+	Scene scene;
+	CreateScene(device, numMeshes, random, scene);
+	CHECK(scene.mArena.GetVertexAllocator().GetUsed() > 0);
+
+	// What each mesh binds when drawn on its own, without the cache
+	std::map<Mesh*, DrawState> expected;
+	for (Mesh* mesh : scene.mMeshes)
+	{
+		device.ResetTracking();
+		if (mesh->IsInArena())
+			scene.mArena.Bind();
+		mesh->Draw(&device);
+		CHECK(device.mDraws.size() == 1);
+		if (!device.mDraws.empty())
+			expected[mesh] = device.mDraws[0];
+	}
+
+	DeviceStateCache stateCache;
+	DrawList drawList;
+	FillDrawList(scene, drawList);
+	const unsigned int unsorted = CheckSubmit(device, drawList, expected, stateCache);
+
+	// Sorted, the arena and each set of textures are bound once, a few meshes that kept their own buffers aside
+	drawList.Sort();
+	bool ordered = true;
+	for (unsigned int i = 1; i < drawList.Size(); i++)
+		ordered = ordered && drawList.GetItems()[i - 1].mKey <= drawList.GetItems()[i].mKey;
+	CHECK(ordered);
+	const unsigned int sorted = CheckSubmit(device, drawList, expected, stateCache);
+	CHECK(sorted <= unsorted);
+
+	unsigned int ownBuffers = 0;
+	for (Mesh* mesh : scene.mMeshes)
+		ownBuffers += mesh->IsInArena() ? 0 : 1;
+	CHECK(device.miVertexBufferChanges == ownBuffers + 1);
+
+	// Something outside the cache unbinds what a mesh drew with, after Invalidate drawing it again has to set it all again
+	Mesh* mesh = scene.mMeshes[0];
+	mesh->Draw(&device, stateCache);
+	device.mDraws.clear();
+	device.SetVertexBuffer(nullptr, 0);
+	device.SetIndexBuffer(nullptr, INDEX_FORMAT_32);
+	device.SetPSTexture(0, nullptr);
+	device.SetPSTexture(1, nullptr);
+	stateCache.Invalidate();
+	mesh->Draw(&device, stateCache);
+	CHECK(device.mDraws.size() == 1 && device.mDraws[0] == expected[mesh]);
+
+	printf("%u meshes, %u in the arena, state changes submitting them:\n", numMeshes, numMeshes - ownBuffers);
+	printf("  In the order added  %6u\n", unsorted);
+	printf("  Sorted              %6u\n", sorted);
+	ReleaseScene(scene);
+	CHECK(device.GetStats().miLiveBuffers == 0 && device.GetStats().miLiveTextures == 0);
+}
+
+/**
+*  @brief Prints the best time of a few rounds to sort model like keys with RadixSort, std::sort and std::stable_sort.
+*/
+static void TimeSort(std::mt19937_64& random)
+{
+	printf("Sorting draws, best of 5 rounds:\n");
+	printf("  %8s %12s %12s %12s\n", "draws", "radix", "std::sort", "stable_sort");
+	for (unsigned int count : { 1000u, 10000u, 100000u })
+	{
+		std::vector<DrawItem> unsorted(count);
+		for (DrawItem& item : unsorted)
+		{
+			item.mKey = DrawList::MakeKey(0, random() % 300, random() % 30, random() % (1u << DrawList::DEPTH_BITS));
+			item.mpMesh = nullptr;
+		}
+
+		double best[3] = { 0.0, 0.0, 0.0 };
+		std::vector<DrawItem> scratch;
+		for (int round = 0; round < 5; round++)
+		{
+			for (int method = 0; method < 3; method++)
+			{
+				std::vector<DrawItem> items = unsorted;
+				const auto start = std::chrono::steady_clock::now();
+				if (method == 0)
+					DrawList::RadixSort(items, scratch);
+				else if (method == 1)
+					std::sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.mKey < b.mKey; });
+				else
+					std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.mKey < b.mKey; });
+				const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+				if (round == 0 || us < best[method])
+					best[method] = us;
+			}
+		}
+		printf("  %8u %9.1f us %9.1f us %9.1f us\n", count, best[0], best[1], best[2]);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const int numMeshes = argc > 1 ? atoi(argv[1]) : 400;
+	if (numMeshes <= 0)
+	{
+		fprintf(stderr, "Usage: DrawListBenchmark [meshes]\n");
+		return 1;
+	}
+
+	std::mt19937_64 random(1234);
+	CheckSort(random);
+	CheckStateChanges((unsigned int)numMeshes, random);
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	TimeSort(random);
+	return gFailures == 0 ? 0 : 1;
+}
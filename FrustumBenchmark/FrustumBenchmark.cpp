@@ -0,0 +1,270 @@
+/**
+*  @file FrustumBenchmark.cpp
+*  @brief Command line tool that checks the SIMD frustum culling against the scalar version, and times both.
+*
+*  The frustum's planes have to point inwards and be normalised. Boxes placed against each plane, just
+*  outside, touching it and straddling it, have to be culled or kept the same by CullBoxes,
+*  CullBoxesReference and ClassifyBox. Then every count from 0 to 13 boxes, so the last group of 4 is
+*  partly padding, and a hundred thousand boxes seen from random cameras, have to give CullBoxes the same
+*  visibility as CullBoxesReference box for box, and the same count, which never includes the padding.
+*  Finally times both over 1000 up to a million boxes.
+*  Only uses the C++ standard library and glm, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -msse2 -I../TestApp -I../inc FrustumBenchmark.cpp ../TestApp/Frustum.cpp -o FrustumBenchmark
+*
+*  Usage: FrustumBenchmark [rounds]
+*
+*  @bug No known bugs.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Frustum.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+static const float NEAR_DISTANCE = 0.1f;
+static const float FAR_DISTANCE = 1000.0f;
+
+static Frustum MakeFrustum(const glm::vec3& position, const glm::vec3& target)
+{
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, NEAR_DISTANCE, FAR_DISTANCE);
+	return Frustum(projection * glm::lookAt(position, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+}
+
+static float PlaneDistance(const Frustum& frustum, unsigned int plane, const glm::vec3& point)
+{
+	return glm::dot(glm::vec3(frustum.GetPlane(plane)), point) + frustum.GetPlane(plane).w;
+}
+
+/**
+*  @brief Runs both kernels on the boxes, checking they agree on every entry, padding included, and on the count.
+*
+*  @return The number of visible boxes.
+*/
+static unsigned int CheckCull(const Frustum& frustum, const BoundingBoxesSoA& boxes, std::vector<uint8_t>& visible)
+{
+	std::vector<uint8_t> reference(boxes.PaddedSize(), 2);
+	visible.assign(boxes.PaddedSize(), 2);
+	const unsigned int numVisible = frustum.CullBoxes(boxes, visible.data());
+	const unsigned int numReference = frustum.CullBoxesReference(boxes, reference.data());
+	CHECK(numVisible == numReference);
+	CHECK(visible == reference);
+
+	unsigned int counted = 0;
+	for (unsigned int i = 0; i < boxes.Size(); i++)
+		counted += visible[i];
+	CHECK(numVisible == counted);
+	return numVisible;
+}
+
+/**
+*  @brief Checks the planes of a camera looking down -z, and points just either side of each.
+*/
+static void CheckPlanes()
+{
+	const Frustum frustum = MakeFrustum(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+	for (unsigned int p = 0; p < Frustum::PLANE_COUNT; p++)
+		CHECK(fabsf(glm::length(glm::vec3(frustum.GetPlane(p))) - 1.0f) < 1e-5f);
+
+	// Every plane has the middle of the view on its inside
+	const glm::vec3 middle(0.0f, 0.0f, -FAR_DISTANCE * 0.5f);
+	for (unsigned int p = 0; p < Frustum::PLANE_COUNT; p++)
+		CHECK(PlaneDistance(frustum, p, middle) > 0.0f);
+
+	CHECK(fabsf(PlaneDistance(frustum, Frustum::PLANE_NEAR, glm::vec3(0.0f, 0.0f, -NEAR_DISTANCE))) < 1e-4f);
+	// The far plane comes from subtracting two nearly equal rows, so it's only good to a part in a thousand
+	CHECK(fabsf(PlaneDistance(frustum, Frustum::PLANE_FAR, glm::vec3(0.0f, 0.0f, -FAR_DISTANCE))) < FAR_DISTANCE * 1e-3f);
+	CHECK(PlaneDistance(frustum, Frustum::PLANE_NEAR, glm::vec3(0.0f, 0.0f, 1.0f)) < 0.0f);
+	CHECK(PlaneDistance(frustum, Frustum::PLANE_FAR, glm::vec3(0.0f, 0.0f, -FAR_DISTANCE * 1.01f)) < 0.0f);
+	CHECK(PlaneDistance(frustum, Frustum::PLANE_LEFT, glm::vec3(-FAR_DISTANCE, 0.0f, -1.0f)) < 0.0f);
+	CHECK(PlaneDistance(frustum, Frustum::PLANE_RIGHT, glm::vec3(FAR_DISTANCE, 0.0f, -1.0f)) < 0.0f);
+	CHECK(PlaneDistance(frustum, Frustum::PLANE_BOTTOM, glm::vec3(0.0f, -FAR_DISTANCE, -1.0f)) < 0.0f);
+	CHECK(PlaneDistance(frustum, Frustum::PLANE_TOP, glm::vec3(0.0f, FAR_DISTANCE, -1.0f)) < 0.0f);
+
+	CHECK(frustum.IntersectsSphere(middle, 1.0f));
+	CHECK(!frustum.IntersectsSphere(glm::vec3(0.0f, 0.0f, 10.0f), 1.0f));
+	CHECK(frustum.IntersectsSphere(glm::vec3(0.0f, 0.0f, 10.0f), 11.0f));
+}
+
+/**
+*  @brief Puts small boxes against each plane, at a point on it inside all the others.
+*
+*  Each box's corner furthest inside the plane is a little either side of it, so the box is just outside or straddling.
+*/
+static void CheckPlaneBoxes(const glm::vec3& position, const glm::vec3& target)
+{
+	const Frustum frustum = MakeFrustum(position, target);
+	const glm::vec3 middle = position + glm::normalize(target - position) * 50.0f;
+	const glm::vec3 extent(0.02f, 0.03f, 0.01f);
+	const float offsets[] = { -0.01f, -0.001f, 0.001f, 0.01f };
+	const unsigned int numOffsets = sizeof(offsets) / sizeof(offsets[0]);
+
+	BoundingBoxesSoA boxes;
+	boxes.Resize(Frustum::PLANE_COUNT * numOffsets + 1);
+	for (unsigned int p = 0; p < Frustum::PLANE_COUNT; p++)
+	{
+		const glm::vec3 normal(frustum.GetPlane(p));
+		const float radius = glm::dot(glm::abs(normal), extent);
+		const glm::vec3 onPlane = middle - normal * PlaneDistance(frustum, p, middle);
+		for (unsigned int o = 0; o < numOffsets; o++)
+		{
+			const glm::vec3 centre = onPlane + normal * (offsets[o] - radius);
+			boxes.Set(p * numOffsets + o, centre - extent, centre + extent);
+
+			const Frustum::Containment containment = frustum.ClassifyBox(centre - extent, centre + extent);
+			CHECK(containment == (offsets[o] < 0.0f ? Frustum::OUTSIDE : Frustum::INTERSECTING));
+			CHECK(frustum.IntersectsBox(centre - extent, centre + extent) == (offsets[o] > 0.0f));
+		}
+	}
+	boxes.Set(boxes.Size() - 1, middle - extent, middle + extent);
+	CHECK(frustum.ClassifyBox(middle - extent, middle + extent) == Frustum::INSIDE);
+
+	std::vector<uint8_t> visible;
+	CHECK(CheckCull(frustum, boxes, visible) == Frustum::PLANE_COUNT * numOffsets / 2 + 1);
+	for (unsigned int i = 0; i < boxes.Size() - 1; i++)
+		CHECK(visible[i] == (offsets[i % numOffsets] > 0.0f ? 1 : 0));
+}
+
+static void SetRandomBox(BoundingBoxesSoA& boxes, unsigned int i, std::mt19937& random, float range)
+{
+	std::uniform_real_distribution<float> position(-range, range);
+	std::uniform_real_distribution<float> size(0.0f, range * 0.05f);
+	const glm::vec3 centre(position(random), position(random) * 0.2f, position(random));
+	const glm::vec3 extent(size(random), size(random), size(random));
+	boxes.Set(i, centre - extent, centre + extent);
+}
+
+/**
+*  @brief Checks every count that leaves the last group of 4 part full, and that the padding is never counted.
+*/
+static void CheckCounts(std::mt19937& random)
+{
+	// The camera sees the origin, where the padding boxes are, so padding comes back visible and mustn't be counted
+	const Frustum frustum = MakeFrustum(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f));
+	std::vector<uint8_t> visible;
+	for (unsigned int count = 0; count <= 13; count++)
+	{
+		BoundingBoxesSoA boxes;
+		boxes.Resize(count);
+		CHECK(boxes.PaddedSize() % 4 == 0 && boxes.PaddedSize() >= count && boxes.PaddedSize() < count + 4);
+
+		// Behind the camera, all culled
+		for (unsigned int i = 0; i < count; i++)
+			boxes.Set(i, glm::vec3(-1.0f, -1.0f, 20.0f + i), glm::vec3(1.0f, 1.0f, 21.0f + i));
+		CHECK(CheckCull(frustum, boxes, visible) == 0);
+		for (unsigned int i = count; i < boxes.PaddedSize(); i++)
+			CHECK(visible[i] == 1);
+
+		// In front of it, all kept
+		for (unsigned int i = 0; i < count; i++)
+			boxes.Set(i, glm::vec3(-1.0f, -1.0f, -1.0f - i), glm::vec3(1.0f, 1.0f, -i * 1.0f));
+		CHECK(CheckCull(frustum, boxes, visible) == count);
+
+		for (unsigned int round = 0; round < 20; round++)
+		{
+			for (unsigned int i = 0; i < count; i++)
+				SetRandomBox(boxes, i, random, 50.0f);
+			CheckCull(frustum, boxes, visible);
+		}
+	}
+}
+
+/**
+*  @brief Checks a hundred thousand boxes against cameras placed and aimed at random.
+*/
+static void CheckRandom(std::mt19937& random)
+{
+	const unsigned int count = 100001;
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	BoundingBoxesSoA boxes;
+	boxes.Resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		SetRandomBox(boxes, i, random, 1000.0f);
+
+	std::vector<uint8_t> visible;
+	for (unsigned int round = 0; round < 20; round++)
+	{
+		const glm::vec3 eye(position(random) * 0.1f, 50.0f, position(random) * 0.1f);
+		const Frustum frustum = MakeFrustum(eye, glm::vec3(position(random), 0.0f, position(random)));
+		const unsigned int numVisible = CheckCull(frustum, boxes, visible);
+		CHECK(numVisible > 0 && numVisible < count);
+
+		// Boxes clear of every plane have to agree with the single box test too
+		bool agrees = true;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const glm::vec3 centre(boxes.mCentreX[i], boxes.mCentreY[i], boxes.mCentreZ[i]);
+			const glm::vec3 extent(boxes.mExtentX[i], boxes.mExtentY[i], boxes.mExtentZ[i]);
+			bool nearPlane = false;
+			for (unsigned int p = 0; p < Frustum::PLANE_COUNT; p++)
+			{
+				const float radius = glm::dot(glm::abs(glm::vec3(frustum.GetPlane(p))), extent);
+				nearPlane = nearPlane || fabsf(PlaneDistance(frustum, p, centre) + radius) < 0.01f;
+			}
+			if (!nearPlane)
+				agrees = agrees && visible[i] == (frustum.IntersectsBox(centre - extent, centre + extent) ? 1 : 0);
+		}
+		CHECK(agrees);
+	}
+}
+
+/**
+*  @brief Prints the best time of a few rounds for each kernel, over a camera seeing part of the boxes.
+*/
+static void TimeCull(std::mt19937& random, unsigned int rounds)
+{
+	const Frustum frustum = MakeFrustum(glm::vec3(0.0f, 50.0f, 0.0f), glm::vec3(300.0f, 0.0f, -200.0f));
+	printf("Culling boxes, best of %u rounds:\n", rounds);
+	printf("  %8s %12s %12s %8s\n", "boxes", "CullBoxes", "Reference", "speedup");
+	for (unsigned int count : { 1000u, 10000u, 100000u, 1000000u })
+	{
+		BoundingBoxesSoA boxes;
+		boxes.Resize(count);
+		for (unsigned int i = 0; i < count; i++)
+			SetRandomBox(boxes, i, random, 1000.0f);
+		std::vector<uint8_t> visible(boxes.PaddedSize());
+
+		double best[2] = { 0.0, 0.0 };
+		unsigned int numVisible = 0;
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			for (int kernel = 0; kernel < 2; kernel++)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				numVisible = kernel == 0 ? frustum.CullBoxes(boxes, visible.data()) : frustum.CullBoxesReference(boxes, visible.data());
+				const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+				if (round == 0 || us < best[kernel])
+					best[kernel] = us;
+			}
+		}
+		printf("  %8u %9.1f us %9.1f us %7.2fx  (%u visible)\n", count, best[0], best[1], best[1] / best[0], numVisible);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const int rounds = argc > 1 ? atoi(argv[1]) : 5;
+	if (rounds <= 0)
+	{
+		fprintf(stderr, "Usage: FrustumBenchmark [rounds]\n");
+		return 1;
+	}
+
+	std::mt19937 random(1234);
+	CheckPlanes();
+	CheckPlaneBoxes(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+	CheckPlaneBoxes(glm::vec3(10.0f, 20.0f, 30.0f), glm::vec3(-40.0f, 5.0f, -7.0f));
+	CheckCounts(random);
+	CheckRandom(random);
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	TimeCull(random, (unsigned int)rounds);
+	return gFailures == 0 ? 0 : 1;
+}
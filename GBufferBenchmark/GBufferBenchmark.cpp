@@ -0,0 +1,301 @@
+/**
+*  @file GBufferBenchmark.cpp
+*  @brief Command line tool that checks the compact G-buffer's encodings against their error bounds.
+*
+*  Round trips random normals through the octahedral RG16 snorm encoding, colours through RGBA8, and
+*  world positions through a 24 bit depth buffer and back with the inverse projection and view, all
+*  with the GBufferPacking functions the shaders mirror. Each is compared with what storing it in
+*  the full G-buffer's RGBA16F targets loses, and the memory both layouts take at 1080p is printed.
+*  Only uses the C++ standard library and glm, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -I../TestApp -I../inc GBufferBenchmark.cpp ../TestApp/GBufferPacking.cpp -o GBufferBenchmark
+*
+*  Usage: GBufferBenchmark [samples]
+*
+*  @bug No known bugs.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "GBufferPacking.h"
+#include "GraphicsDevice.h"
+
+// The camera TestApp draws with
+static const float FOV_DEGREES = 60.0f;
+static const float NEAR_PLANE = 0.1f;
+static const float FAR_PLANE = 10000.0f;
+static const unsigned int WIDTH = 1920;
+static const unsigned int HEIGHT = 1080;
+
+/// The bounds GBufferPacking.h promises.
+static const float MAX_NORMAL_ERROR_DEGREES = 0.05f;
+static const float MAX_COLOUR_ERROR = 0.5f / 255.0f;
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/**
+*  @brief Rounds to the nearest half float, the precision an RGBA16F target keeps.
+*/
+static float RoundToHalf(float value)
+{
+	const float magnitude = fabsf(value);
+	if (magnitude == 0.0f)
+		return value;
+	int exponent;
+	frexpf(magnitude, &exponent);
+	// Halves have 10 bits of mantissa, and no smaller spacing than their subnormals' 2^-24
+	const float spacing = ldexpf(1.0f, exponent - 11 > -24 ? exponent - 11 : -24);
+	return nearbyintf(value / spacing) * spacing;
+}
+
+static glm::vec3 RoundToHalf(const glm::vec3& value)
+{
+	return glm::vec3(RoundToHalf(value.x), RoundToHalf(value.y), RoundToHalf(value.z));
+}
+
+/**
+*  @brief Rounds to a 24 bit unorm, the precision the depth buffer keeps, then to the float a shader samples.
+*/
+static float RoundToDepth24(double depth)
+{
+	const double maxValue = 16777215.0;
+	return (float)(llrint(depth * maxValue) / maxValue);
+}
+
+static float AngleDegrees(const glm::vec3& a, const glm::vec3& b)
+{
+	const float cosine = glm::dot(glm::normalize(a), glm::normalize(b));
+	return glm::degrees(acosf(cosine > 1.0f ? 1.0f : (cosine < -1.0f ? -1.0f : cosine)));
+}
+
+static glm::vec3 RandomDirection(std::mt19937& random)
+{
+	std::normal_distribution<float> gaussian;
+	glm::vec3 direction;
+	do
+	{
+		direction = glm::vec3(gaussian(random), gaussian(random), gaussian(random));
+	} while (glm::dot(direction, direction) < 1e-6f);
+	return glm::normalize(direction);
+}
+
+static void CheckNormals(std::mt19937& random, int samples)
+{
+	std::vector<glm::vec3> normals;
+	// The axes and the octahedron's edges and seams, where the folding switches over
+	const float edge = 0.70710678f;
+	const glm::vec3 edgeCases[] =
+	{
+		glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1),
+		glm::vec3(edge, edge, 0), glm::vec3(-edge, edge, 0), glm::vec3(edge, -edge, 0), glm::vec3(-edge, -edge, 0),
+		glm::vec3(edge, 0, -edge), glm::vec3(-edge, 0, -edge), glm::vec3(0, edge, -edge), glm::vec3(0, -edge, -edge),
+		glm::vec3(1e-7f, 1e-7f, -1), glm::vec3(-1e-7f, -1e-7f, -1), glm::vec3(1, 1e-7f, -1e-7f),
+	};
+	for (const glm::vec3& normal : edgeCases)
+		normals.push_back(glm::normalize(normal));
+	for (int i = 0; i < samples; i++)
+		normals.push_back(RandomDirection(random));
+
+	float maxCompact = 0.0f, maxFull = 0.0f;
+	for (const glm::vec3& normal : normals)
+	{
+		const PackedNormal packed = GBufferPacking::EncodeNormal(normal);
+		const glm::vec3 decoded = GBufferPacking::DecodeNormal(packed);
+		CHECK(fabsf(glm::length(decoded) - 1.0f) < 1e-5f);
+		CHECK(packed.x != -32768 && packed.y != -32768);
+
+		maxCompact = fmaxf(maxCompact, AngleDegrees(normal, decoded));
+		maxFull = fmaxf(maxFull, AngleDegrees(normal, RoundToHalf(normal)));
+	}
+	CHECK(maxCompact < MAX_NORMAL_ERROR_DEGREES);
+
+	// A zero normal still decodes to something valid
+	CHECK(fabsf(glm::length(GBufferPacking::DecodeNormal(GBufferPacking::EncodeNormal(glm::vec3(0.0f)))) - 1.0f) < 1e-5f);
+
+	printf("Normals, %zu:      octahedral RG16 snorm max %.4f degrees, RGBA16F max %.4f degrees\n", normals.size(), maxCompact, maxFull);
+}
+
+static void CheckColours(std::mt19937& random, int samples)
+{
+	// Every 8 bit value, which is all a RGBA8 or BC texture can give before filtering, comes back exactly
+	for (unsigned int value = 0; value < 256; value++)
+	{
+		const float channel = value / 255.0f;
+		const uint32_t packed = GBufferPacking::EncodeDiffuseSpecular(glm::vec3(channel, channel, channel), channel);
+		CHECK(packed == value * 0x01010101u);
+		CHECK(GBufferPacking::DecodeDiffuseSpecular(packed) == glm::vec4(channel));
+	}
+
+	// Out of range values clamp
+	CHECK(GBufferPacking::EncodeDiffuseSpecular(glm::vec3(-1.0f, 2.0f, 0.0f), 1.5f) == 0xff00ff00u);
+
+	// Channels stay in order, red in the low byte
+	CHECK(GBufferPacking::EncodeDiffuseSpecular(glm::vec3(1.0f / 255.0f, 2.0f / 255.0f, 3.0f / 255.0f), 4.0f / 255.0f) == 0x04030201u);
+
+	// Filtered values land between texels, those round
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	float maxCompact = 0.0f, maxFull = 0.0f;
+	for (int i = 0; i < samples; i++)
+	{
+		const glm::vec4 colour(unit(random), unit(random), unit(random), unit(random));
+		const glm::vec4 decoded = GBufferPacking::DecodeDiffuseSpecular(GBufferPacking::EncodeDiffuseSpecular(glm::vec3(colour), colour.a));
+		for (int c = 0; c < 4; c++)
+		{
+			maxCompact = fmaxf(maxCompact, fabsf(decoded[c] - colour[c]));
+			maxFull = fmaxf(maxFull, fabsf(RoundToHalf(colour[c]) - colour[c]));
+		}
+	}
+	CHECK(maxCompact <= MAX_COLOUR_ERROR + 1e-6f);
+
+	printf("Colours, %d:      RGBA8 max %.6f, RGBA16F max %.6f\n", samples, maxCompact, maxFull);
+}
+
+/**
+*  @brief The furthest a reconstructed position can be from where it was drawn.
+*
+*  The depth buffer rounds by up to half of 2^-24, sampling it as a float and the cancellation in the
+*  inverse projection as much again, so up to 2^-23 in all. The projection turns that into
+*  distance^2 / (2 near) per unit of depth along the view axis, scaled up by how far off axis the ray
+*  is. Float rounding in the matrices adds a little more, relative to the size of the coordinates.
+*
+*  @param viewDistance How far in front of the camera the point is, along its view axis.
+*  @param rayScale How much longer the ray to the point is than its view distance.
+*  @param magnitude The largest coordinate involved, the point's or the camera's.
+*/
+static double PositionErrorBound(double viewDistance, double rayScale, double magnitude)
+{
+	const double depthError = 2.0 / 16777216.0;
+	const double projectionSlope = viewDistance * viewDistance * (FAR_PLANE - NEAR_PLANE) / (2.0 * NEAR_PLANE * FAR_PLANE);
+	return depthError * projectionSlope * rayScale + 1e-6 * magnitude;
+}
+
+static void CheckPositions(std::mt19937& random, int samples)
+{
+	// The positions and the projection are worked out in double, the rasteriser's depth is closer to that than to float
+	const glm::dmat4 projection = glm::perspective(glm::radians((double)FOV_DEGREES), (double)WIDTH / HEIGHT, (double)NEAR_PLANE, (double)FAR_PLANE);
+	const glm::mat4 inverseProjection = glm::inverse(glm::mat4(projection));
+	const double tanHalfFov = tan(glm::radians((double)FOV_DEGREES) * 0.5);
+	const double aspect = (double)WIDTH / HEIGHT;
+
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<double> logDistance(log(0.25), log(4000.0));
+
+	// Distances the camera sees in Sponza, up to the length of the model and past it
+	const float bucketEnds[] = { 10.0f, 100.0f, 1000.0f, 4000.0f };
+	const int numBuckets = 4;
+	double maxCompact[numBuckets] = {}, maxFull[numBuckets] = {};
+	int counts[numBuckets] = {};
+
+	for (int i = 0; i < samples; i++)
+	{
+		// A camera somewhere in and around the model, looking any way
+		const glm::vec3 eye((unit(random) - 0.5f) * 3000.0f, unit(random) * 1000.0f, (unit(random) - 0.5f) * 1400.0f);
+		glm::vec3 forward = RandomDirection(random);
+		if (fabsf(forward.y) > 0.99f)
+			forward = glm::normalize(glm::vec3(forward.x, 0.5f, forward.z + 0.5f));
+		const glm::mat4 view = glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::dmat4 inverseView = glm::inverse(glm::dmat4(view));
+
+		// A point somewhere on screen, the camera looks down -z
+		const double viewDistance = exp(logDistance(random));
+		const glm::dvec2 ndc(unit(random) * 2.0 - 1.0, unit(random) * 2.0 - 1.0);
+		const glm::dvec4 viewPosition(ndc.x * viewDistance * tanHalfFov * aspect, ndc.y * viewDistance * tanHalfFov, -viewDistance, 1.0);
+		const glm::dvec3 world = glm::dvec3(inverseView * viewPosition);
+
+		// Draw it, keeping what the depth buffer would
+		const glm::dvec4 clip = projection * viewPosition;
+		const double depth = clip.z / clip.w;
+		if (depth < 0.0 || depth > 1.0)
+			continue;
+		const glm::vec2 texcoord((float)((ndc.x + 1.0) * 0.5), (float)((1.0 - ndc.y) * 0.5));
+
+		const glm::vec3 compact = GBufferPacking::ReconstructWorldPosition(texcoord, RoundToDepth24(depth), inverseProjection, glm::inverse(view));
+		const double rayScale = glm::length(glm::dvec3(viewPosition)) / viewDistance;
+		const double magnitude = glm::max(glm::length(world), (double)glm::length(eye));
+		const double compactError = glm::length(glm::dvec3(compact) - world);
+		const double fullError = glm::length(glm::dvec3(RoundToHalf(glm::vec3(world))) - world);
+		CHECK(compactError <= PositionErrorBound(viewDistance, rayScale, magnitude));
+
+		int bucket = 0;
+		while (bucket < numBuckets - 1 && viewDistance >= bucketEnds[bucket])
+			bucket++;
+		maxCompact[bucket] = glm::max(maxCompact[bucket], compactError);
+		maxFull[bucket] = glm::max(maxFull[bucket], fullError);
+		counts[bucket]++;
+	}
+
+	printf("Positions, %d:\n", samples);
+	float bucketStart = 0.0f;
+	for (int b = 0; b < numBuckets; b++)
+	{
+		printf("  %4.0f to %4.0f away, %7d: from 24 bit depth max %8.4f, RGBA16F max %8.4f\n", bucketStart, bucketEnds[b], counts[b], maxCompact[b], maxFull[b]);
+		bucketStart = bucketEnds[b];
+	}
+}
+
+/**
+*  @brief Prints the G-buffer targets each layout needs, and what the G-buffer and PostFx passes write and read per pixel.
+*/
+static void PrintMemory()
+{
+	const size_t full = 3 * TextureSizeInBytes(TEXTURE_FORMAT_RGBA16_FLOAT, WIDTH, HEIGHT, 1);
+	const size_t compact = TextureSizeInBytes(TEXTURE_FORMAT_RG16_SNORM, WIDTH, HEIGHT, 1) + TextureSizeInBytes(TEXTURE_FORMAT_RGBA8, WIDTH, HEIGHT, 1);
+	CHECK(full == (size_t)WIDTH * HEIGHT * 24);
+	CHECK(compact == (size_t)WIDTH * HEIGHT * 8);
+
+	// PostFx reads the depth buffer in both, 4 bytes a pixel
+	const size_t pixels = (size_t)WIDTH * HEIGHT;
+	printf("G-buffer at %ux%u: full %.1f MB, compact %.1f MB\n", WIDTH, HEIGHT, full / (1024.0 * 1024.0), compact / (1024.0 * 1024.0));
+	printf("Bytes per pixel written then read by PostFx: full %zu, compact %zu\n", (full * 2 + pixels * 4) / pixels, (compact * 2 + pixels * 4) / pixels);
+}
+
+/**
+*  @brief Times encoding and decoding a screen's worth of normals, to put the CPU references' cost in context.
+*/
+static void TimeNormals(std::mt19937& random)
+{
+	const size_t pixels = (size_t)WIDTH * HEIGHT;
+	std::vector<glm::vec3> normals(pixels);
+	for (glm::vec3& normal : normals)
+		normal = RandomDirection(random);
+	std::vector<PackedNormal> packed(pixels);
+
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < pixels; i++)
+		packed[i] = GBufferPacking::EncodeNormal(normals[i]);
+	const auto encoded = std::chrono::steady_clock::now();
+	glm::vec3 sum(0.0f);
+	for (size_t i = 0; i < pixels; i++)
+		sum += GBufferPacking::DecodeNormal(packed[i]);
+	const auto decoded = std::chrono::steady_clock::now();
+
+	printf("Encode %zu normals: %.2f ms, decode: %.2f ms (%g)\n", pixels,
+		std::chrono::duration<double, std::milli>(encoded - start).count(),
+		std::chrono::duration<double, std::milli>(decoded - encoded).count(), sum.x + sum.y + sum.z);
+}
+
+int main(int argc, char** argv)
+{
+	const int samples = argc > 1 ? atoi(argv[1]) : 1000000;
+	if (samples <= 0)
+	{
+		fprintf(stderr, "Usage: GBufferBenchmark [samples]\n");
+		return 1;
+	}
+
+	std::mt19937 random(1234);
+	CheckNormals(random, samples);
+	CheckColours(random, samples);
+	CheckPositions(random, samples);
+	PrintMemory();
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	TimeNormals(random);
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,470 @@
+/**
+*  @file GeometryArenaBenchmark.cpp
+*  @brief Command line tool that checks RangeAllocator and GeometryArena, and times allocating from a fragmented range.
+*
+*  Works RangeAllocator through hand picked cases: exact fits, first fit, running out of space, every
+*  order of freeing neighbours, and fragmentation leaving no block big enough for a range that would
+*  fit in the total free. Then churns it against a plain bitmap, which has to agree on every offset
+*  handed out and on the free blocks left. GeometryArena is run on a NullGraphicsDevice that keeps
+*  a copy of each buffer, checking every mesh's vertices and indices land in its own ranges and stay
+*  intact as others come and go.
+*  Only uses the C++ standard library, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -pthread -I../TestApp GeometryArenaBenchmark.cpp ../TestApp/RangeAllocator.cpp ../TestApp/GeometryArena.cpp ../TestApp/NullGraphicsDevice.cpp ../TestApp/LogQueue.cpp ../TestApp/BinaryLog.cpp -o GeometryArenaBenchmark
+*
+*  Usage: GeometryArenaBenchmark [live ranges]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+#include "GeometryArena.h"
+#include "Log.h"
+#include "NullGraphicsDevice.h"
+#include "RangeAllocator.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/**
+*  @brief A NullGraphicsDevice that keeps a copy of every buffer, so what was written where can be checked.
+*/
+class RecordingDevice : public NullGraphicsDevice
+{
+public:
+	RecordingDevice() : miBadUpdates(0) {}
+
+	virtual GraphicsBuffer* CreateBuffer(const BufferDesc& desc, const void* data)
+	{
+		GraphicsBuffer* buffer = NullGraphicsDevice::CreateBuffer(desc, data);
+		std::vector<unsigned char>& contents = mContents[buffer];
+		contents.assign(desc.miSize, 0);
+		if (data)
+			memcpy(contents.data(), data, desc.miSize);
+		return buffer;
+	}
+
+	virtual void UpdateBuffer(GraphicsBuffer* buffer, unsigned int offset, const void* data, unsigned int size)
+	{
+		NullGraphicsDevice::UpdateBuffer(buffer, offset, data, size);
+		std::map<GraphicsBuffer*, std::vector<unsigned char>>::iterator it = mContents.find(buffer);
+		if (it == mContents.end() || offset + size > it->second.size())
+		{
+			miBadUpdates++;
+			return;
+		}
+		memcpy(it->second.data() + offset, data, size);
+	}
+
+	virtual void ReleaseBuffer(GraphicsBuffer* buffer)
+	{
+		mContents.erase(buffer);
+		NullGraphicsDevice::ReleaseBuffer(buffer);
+	}
+
+	const std::vector<unsigned char>& GetContents(GraphicsBuffer* buffer) { return mContents[buffer]; }
+	unsigned int GetBadUpdates() const { return miBadUpdates; }
+
+private:
+	std::map<GraphicsBuffer*, std::vector<unsigned char>> mContents;
+	unsigned int miBadUpdates;
+};
+
+/**
+*  @brief The free runs of a bitmap of used units, what RangeAllocator's free blocks should be once merged.
+*/
+static std::map<unsigned int, unsigned int> FreeRuns(const std::vector<bool>& used)
+{
+	std::map<unsigned int, unsigned int> runs;
+	for (unsigned int i = 0; i < used.size(); )
+	{
+		if (used[i])
+		{
+			i++;
+			continue;
+		}
+		unsigned int end = i;
+		while (end < used.size() && !used[end])
+			end++;
+		runs[i] = end - i;
+		i = end;
+	}
+	return runs;
+}
+
+/**
+*  @brief The first fit offset for a range in the bitmap, or INVALID_OFFSET if no run is big enough.
+*/
+static unsigned int FirstFit(const std::map<unsigned int, unsigned int>& runs, unsigned int size)
+{
+	for (std::map<unsigned int, unsigned int>::const_iterator it = runs.begin(); it != runs.end(); ++it)
+	{
+		if (it->second >= size)
+			return it->first;
+	}
+	return RangeAllocator::INVALID_OFFSET;
+}
+
+static void CheckAllocate()
+{
+	RangeAllocator allocator(100);
+	CHECK(allocator.GetCapacity() == 100 && allocator.GetUsed() == 0);
+	CHECK(allocator.GetNumFreeBlocks() == 1 && allocator.GetLargestFreeBlock() == 100);
+
+	// Ranges are handed out back to back, and an exact fit uses the block up
+	CHECK(allocator.Allocate(10) == 0);
+	CHECK(allocator.Allocate(20) == 10);
+	CHECK(allocator.Allocate(70) == 30);
+	CHECK(allocator.GetUsed() == 100 && allocator.GetNumFreeBlocks() == 0 && allocator.GetLargestFreeBlock() == 0);
+
+	// Out of space, and sizes that are never valid
+	CHECK(allocator.Allocate(1) == RangeAllocator::INVALID_OFFSET);
+	CHECK(allocator.Allocate(0) == RangeAllocator::INVALID_OFFSET);
+	CHECK(allocator.GetUsed() == 100);
+
+	// A freed range is reused by the first request that fits in it, and nothing bigger
+	allocator.Free(10, 20);
+	CHECK(allocator.GetUsed() == 80 && allocator.GetLargestFreeBlock() == 20);
+	CHECK(allocator.Allocate(21) == RangeAllocator::INVALID_OFFSET);
+	CHECK(allocator.Allocate(15) == 10);
+	CHECK(allocator.Allocate(5) == 25);
+	CHECK(allocator.GetNumFreeBlocks() == 0);
+
+	// Freeing nothing does nothing
+	allocator.Free(RangeAllocator::INVALID_OFFSET, 10);
+	allocator.Free(50, 0);
+	CHECK(allocator.GetUsed() == 100 && allocator.GetNumFreeBlocks() == 0);
+
+	// Too big for the whole range, and an empty allocator
+	RangeAllocator small(8);
+	CHECK(small.Allocate(9) == RangeAllocator::INVALID_OFFSET);
+	CHECK(small.Allocate(8) == 0);
+	small.Reset(0);
+	CHECK(small.GetCapacity() == 0 && small.GetNumFreeBlocks() == 0);
+	CHECK(small.Allocate(1) == RangeAllocator::INVALID_OFFSET);
+
+	// Reset frees everything
+	allocator.Reset(50);
+	CHECK(allocator.GetUsed() == 0 && allocator.GetNumFreeBlocks() == 1 && allocator.GetLargestFreeBlock() == 50);
+	CHECK(allocator.Allocate(50) == 0);
+}
+
+/**
+*  @brief Frees four neighbouring ranges in every order, they always have to merge back into one block.
+*/
+static void CheckCoalescing()
+{
+	const unsigned int sizes[4] = { 3, 7, 1, 13 };
+	unsigned int order[4] = { 0, 1, 2, 3 };
+	do
+	{
+		RangeAllocator allocator(24);
+		unsigned int offsets[4];
+		for (int i = 0; i < 4; i++)
+			offsets[i] = allocator.Allocate(sizes[i]);
+
+		std::vector<bool> used(24, true);
+		bool merged = true;
+		for (int i = 0; i < 4; i++)
+		{
+			const unsigned int range = order[i];
+			allocator.Free(offsets[range], sizes[range]);
+			for (unsigned int unit = offsets[range]; unit < offsets[range] + sizes[range]; unit++)
+				used[unit] = false;
+
+			const std::map<unsigned int, unsigned int> runs = FreeRuns(used);
+			unsigned int largest = 0;
+			for (std::map<unsigned int, unsigned int>::const_iterator it = runs.begin(); it != runs.end(); ++it)
+				largest = std::max(largest, it->second);
+			merged = merged && allocator.GetNumFreeBlocks() == runs.size() && allocator.GetLargestFreeBlock() == largest;
+		}
+		CHECK(merged);
+		CHECK(allocator.GetUsed() == 0 && allocator.GetNumFreeBlocks() == 1 && allocator.GetLargestFreeBlock() == 24);
+		CHECK(allocator.Allocate(24) == 0);
+	} while (std::next_permutation(order, order + 4));
+}
+
+/**
+*  @brief Frees every other range, leaving plenty of space in total but none in one piece.
+*/
+static void CheckFragmentation()
+{
+	RangeAllocator allocator(100);
+	for (unsigned int i = 0; i < 10; i++)
+		CHECK(allocator.Allocate(10) == i * 10);
+	for (unsigned int i = 0; i < 10; i += 2)
+		allocator.Free(i * 10, 10);
+
+	CHECK(allocator.GetUsed() == 50);
+	CHECK(allocator.GetNumFreeBlocks() == 5 && allocator.GetLargestFreeBlock() == 10);
+	CHECK(allocator.Allocate(11) == RangeAllocator::INVALID_OFFSET);
+	CHECK(allocator.GetUsed() == 50);
+
+	// Small ranges go in the first hole, freeing the ranges between the holes joins them up
+	CHECK(allocator.Allocate(4) == 0);
+	CHECK(allocator.Allocate(6) == 4);
+	CHECK(allocator.Allocate(10) == 20);
+	allocator.Free(30, 10);
+	allocator.Free(50, 10);
+	CHECK(allocator.GetLargestFreeBlock() == 40);
+	CHECK(allocator.Allocate(40) == 30);
+	CHECK(allocator.GetNumFreeBlocks() == 1 && allocator.GetLargestFreeBlock() == 10);
+}
+
+/**
+*  @brief Random allocations and frees, checked against a bitmap after every step.
+*/
+static void CheckAgainstBitmap(std::mt19937& random)
+{
+	for (int round = 0; round < 20; round++)
+	{
+		const unsigned int capacity = 50 + random() % 2000;
+		const unsigned int maxSize = 1 + random() % (capacity / 4);
+		RangeAllocator allocator(capacity);
+		std::vector<bool> used(capacity, false);
+		std::vector<std::pair<unsigned int, unsigned int>> live;
+
+		bool sameOffsets = true, sameBlocks = true, sameUsed = true;
+		for (int step = 0; step < 5000; step++)
+		{
+			if (live.empty() || random() % 100 < 55)
+			{
+				const unsigned int size = 1 + random() % maxSize;
+				const unsigned int expected = FirstFit(FreeRuns(used), size);
+				const unsigned int offset = allocator.Allocate(size);
+				sameOffsets = sameOffsets && offset == expected;
+				if (offset != RangeAllocator::INVALID_OFFSET && offset == expected)
+				{
+					for (unsigned int unit = offset; unit < offset + size; unit++)
+						used[unit] = true;
+					live.push_back(std::make_pair(offset, size));
+				}
+			}
+			else
+			{
+				const size_t index = random() % live.size();
+				allocator.Free(live[index].first, live[index].second);
+				for (unsigned int unit = live[index].first; unit < live[index].first + live[index].second; unit++)
+					used[unit] = false;
+				live[index] = live.back();
+				live.pop_back();
+			}
+
+			const std::map<unsigned int, unsigned int> runs = FreeRuns(used);
+			unsigned int largest = 0;
+			for (std::map<unsigned int, unsigned int>::const_iterator it = runs.begin(); it != runs.end(); ++it)
+				largest = std::max(largest, it->second);
+			sameBlocks = sameBlocks && allocator.GetNumFreeBlocks() == runs.size() && allocator.GetLargestFreeBlock() == largest;
+			sameUsed = sameUsed && allocator.GetUsed() == (unsigned int)std::count(used.begin(), used.end(), true);
+		}
+		CHECK(sameOffsets);
+		CHECK(sameBlocks);
+		CHECK(sameUsed);
+
+		for (const std::pair<unsigned int, unsigned int>& range : live)
+			allocator.Free(range.first, range.second);
+		CHECK(allocator.GetUsed() == 0 && allocator.GetNumFreeBlocks() == 1 && allocator.GetLargestFreeBlock() == capacity);
+	}
+}
+
+/**
+*  @brief A mesh's geometry, filled with values unique to it so overwrites by another mesh show up.
+*/
+struct TestMesh
+{
+	std::vector<unsigned char> mVertices;
+	std::vector<uint16_t> mIndices;
+	GeometryAllocation mAllocation;
+};
+
+static void MakeMesh(unsigned int id, unsigned int numVertices, unsigned int numIndices, unsigned int stride, TestMesh& mesh)
+{
+	mesh.mVertices.resize(numVertices * stride);
+	for (size_t i = 0; i < mesh.mVertices.size(); i++)
+		mesh.mVertices[i] = (unsigned char)(id * 31 + i);
+	mesh.mIndices.resize(numIndices);
+	for (unsigned int i = 0; i < numIndices; i++)
+		mesh.mIndices[i] = (uint16_t)((id * 7 + i) % numVertices);
+	mesh.mAllocation = GeometryAllocation();
+}
+
+/**
+*  @brief Whether the arena's buffers hold the mesh's geometry where its allocation says.
+*/
+static bool MeshIntact(RecordingDevice& device, GeometryArena& arena, const TestMesh& mesh)
+{
+	const GeometryAllocation& allocation = mesh.mAllocation;
+	const std::vector<unsigned char>& vertices = device.GetContents(arena.GetVertexBuffer());
+	const std::vector<unsigned char>& indices = device.GetContents(arena.GetIndexBuffer());
+	const size_t vertexOffset = (size_t)allocation.miBaseVertex * arena.GetVertexStride();
+	const size_t indexOffset = (size_t)allocation.miFirstIndex * sizeof(uint16_t);
+	return allocation.IsValid() &&
+		allocation.miNumVertices * arena.GetVertexStride() == mesh.mVertices.size() &&
+		allocation.miNumIndices == mesh.mIndices.size() &&
+		vertexOffset + mesh.mVertices.size() <= vertices.size() &&
+		indexOffset + mesh.mIndices.size() * sizeof(uint16_t) <= indices.size() &&
+		memcmp(vertices.data() + vertexOffset, mesh.mVertices.data(), mesh.mVertices.size()) == 0 &&
+		memcmp(indices.data() + indexOffset, mesh.mIndices.data(), mesh.mIndices.size() * sizeof(uint16_t)) == 0;
+}
+
+static bool Allocate(GeometryArena& arena, TestMesh& mesh)
+{
+	const unsigned int numVertices = (unsigned int)mesh.mVertices.size() / arena.GetVertexStride();
+	return arena.Allocate(mesh.mVertices.data(), numVertices, mesh.mIndices.data(), (unsigned int)mesh.mIndices.size(), mesh.mAllocation);
+}
+
+static void CheckArena(std::mt19937& random)
+{
+	RecordingDevice device;
+	{
+		// An odd number of indices still makes a buffer a multiple of 4 bytes
+		const unsigned int stride = 16;
+		GeometryArena arena;
+		CHECK(arena.Create(&device, stride, 1000, 3001));
+		CHECK(device.GetStats().miLiveBuffers == 2);
+		CHECK(device.GetContents(arena.GetVertexBuffer()).size() == 16000);
+		CHECK(device.GetContents(arena.GetIndexBuffer()).size() == 6004);
+
+		TestMesh a, b, c;
+		MakeMesh(1, 300, 900, stride, a);
+		MakeMesh(2, 500, 1500, stride, b);
+		MakeMesh(3, 300, 300, stride, c);
+		CHECK(Allocate(arena, a));
+		CHECK(Allocate(arena, b));
+		CHECK(a.mAllocation.miBaseVertex == 0 && a.mAllocation.miFirstIndex == 0);
+		CHECK(b.mAllocation.miBaseVertex == 300 && b.mAllocation.miFirstIndex == 900);
+		CHECK(MeshIntact(device, arena, a) && MeshIntact(device, arena, b));
+
+		// Not enough vertices left, then not enough indices, which mustn't keep the vertices it got
+		CHECK(!Allocate(arena, c));
+		CHECK(!c.mAllocation.IsValid());
+		TestMesh d;
+		MakeMesh(4, 100, 700, stride, d);
+		CHECK(!Allocate(arena, d));
+		CHECK(!d.mAllocation.IsValid());
+		CHECK(arena.GetVertexAllocator().GetUsed() == 800 && arena.GetIndexAllocator().GetUsed() == 2400);
+
+		// Freeing one makes room, and its space is reused without touching the other
+		arena.Free(a.mAllocation);
+		CHECK(!a.mAllocation.IsValid());
+		arena.Free(a.mAllocation);
+		CHECK(arena.GetVertexAllocator().GetUsed() == 500 && arena.GetIndexAllocator().GetUsed() == 1500);
+		CHECK(Allocate(arena, c));
+		CHECK(c.mAllocation.miBaseVertex == 0 && c.mAllocation.miFirstIndex == 0);
+		CHECK(MeshIntact(device, arena, b) && MeshIntact(device, arena, c));
+		CHECK(device.GetBadUpdates() == 0);
+
+		arena.Release();
+		CHECK(device.GetStats().miLiveBuffers == 0);
+		CHECK(arena.GetVertexAllocator().GetCapacity() == 0 && arena.GetIndexAllocator().GetCapacity() == 0);
+	}
+
+	// Meshes coming and going, every one still there has to be intact after each step
+	{
+		const unsigned int stride = 12;
+		GeometryArena arena;
+		CHECK(arena.Create(&device, stride, 20000, 60000));
+		std::vector<TestMesh> meshes;
+		unsigned int failed = 0, nextId = 0;
+		bool intact = true;
+		for (int step = 0; step < 3000; step++)
+		{
+			if (meshes.empty() || random() % 100 < 55)
+			{
+				TestMesh mesh;
+				const unsigned int numVertices = 3 + random() % 1000;
+				MakeMesh(nextId++, numVertices, 3 * (1 + random() % numVertices), stride, mesh);
+				if (Allocate(arena, mesh))
+					meshes.push_back(mesh);
+				else
+					failed++;
+			}
+			else
+			{
+				const size_t index = random() % meshes.size();
+				arena.Free(meshes[index].mAllocation);
+				meshes[index] = meshes.back();
+				meshes.pop_back();
+			}
+			if (step % 10 == 0)
+			{
+				for (const TestMesh& mesh : meshes)
+					intact = intact && MeshIntact(device, arena, mesh);
+			}
+		}
+		CHECK(intact);
+		CHECK(failed > 0);
+		CHECK(device.GetBadUpdates() == 0);
+
+		for (TestMesh& mesh : meshes)
+			arena.Free(mesh.mAllocation);
+		CHECK(arena.GetVertexAllocator().GetUsed() == 0 && arena.GetVertexAllocator().GetNumFreeBlocks() == 1);
+		CHECK(arena.GetIndexAllocator().GetUsed() == 0 && arena.GetIndexAllocator().GetNumFreeBlocks() == 1);
+	}
+	CHECK(device.GetStats().miLiveBuffers == 0);
+}
+
+/**
+*  @brief Times freeing and allocating a range with the given number of ranges live, leaving holes to search.
+*/
+static void TimeChurn(unsigned int liveRanges, std::mt19937& random)
+{
+	const unsigned int maxSize = 64;
+	RangeAllocator allocator(liveRanges * maxSize * 2);
+	std::vector<std::pair<unsigned int, unsigned int>> live;
+	while (live.size() < liveRanges)
+	{
+		const unsigned int size = 1 + random() % maxSize;
+		live.push_back(std::make_pair(allocator.Allocate(size), size));
+	}
+
+	const unsigned int operations = 200000;
+	unsigned int failed = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < operations; i++)
+	{
+		std::pair<unsigned int, unsigned int>& range = live[random() % live.size()];
+		allocator.Free(range.first, range.second);
+		range.second = 1 + random() % maxSize;
+		range.first = allocator.Allocate(range.second);
+		failed += range.first == RangeAllocator::INVALID_OFFSET ? 1 : 0;
+	}
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	printf("  %6u live  %5u free blocks  %8.1f ns per free and allocate  (%u failed)\n", liveRanges,
+		allocator.GetNumFreeBlocks(), ms * 1000000.0 / operations, failed);
+}
+
+int main(int argc, char** argv)
+{
+	const int liveRanges = argc > 1 ? atoi(argv[1]) : 10000;
+	if (liveRanges <= 0)
+	{
+		fprintf(stderr, "Usage: GeometryArenaBenchmark [live ranges]\n");
+		return 1;
+	}
+
+	// NullGraphicsDevice logs the updates it rejects, the checks count them instead
+	Logger::ReportingLevel() = WARNING;
+
+	std::mt19937 random(1234);
+	CheckAllocate();
+	CheckCoalescing();
+	CheckFragmentation();
+	CheckAgainstBitmap(random);
+	CheckArena(random);
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	printf("First fit allocation, ranges of 1 to 64 in twice the space they need:\n");
+	for (unsigned int live = 10; live < (unsigned int)liveRanges; live *= 10)
+		TimeChurn(live, random);
+	TimeChurn((unsigned int)liveRanges, random);
+	return gFailures == 0 ? 0 : 1;
+}
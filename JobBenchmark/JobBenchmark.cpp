@@ -0,0 +1,199 @@
+/**
+*  @file JobBenchmark.cpp
+*  @brief Command line tool that stress tests the JobSystem and measures how it scales with more workers.
+*
+*  Runs floods of tiny jobs, jobs that spawn jobs, chains and diamonds of dependencies, more jobs than
+*  the pools and deques hold, and ParallelFor, checking every job ran exactly once and in order where it
+*  had to. Then times a ParallelFor over a fixed amount of work with 1 to N workers. Only uses the C++
+*  standard library, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -pthread -I../TestApp JobBenchmark.cpp ../TestApp/JobSystem.cpp ../TestApp/Profiler.cpp ../TestApp/LogQueue.cpp ../TestApp/BinaryLog.cpp -o JobBenchmark
+*
+*  Usage: JobBenchmark [max workers] [stress rounds]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "JobSystem.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/**
+*  @brief Spawns two children until depth runs out, counting every job that runs.
+*/
+static void SpawnTree(JobSystem& jobs, unsigned int depth, std::atomic<unsigned int>& ran, JobCounter& counter)
+{
+	ran.fetch_add(1, std::memory_order_relaxed);
+	if (depth == 0)
+		return;
+
+	JobSystem* pJobs = &jobs;
+	std::atomic<unsigned int>* pRan = &ran;
+	JobCounter* pCounter = &counter;
+	for (int i = 0; i < 2; i++)
+		jobs.Run([pJobs, depth, pRan, pCounter]() { SpawnTree(*pJobs, depth - 1, *pRan, *pCounter); }, &counter);
+}
+
+static void StressTest(unsigned int workers)
+{
+	JobSystem jobs(workers);
+
+	// A flood of tiny jobs, far more than a pool or a deque holds at once
+	{
+		const unsigned int count = 200000;
+		std::atomic<unsigned int> ran(0);
+		std::atomic<unsigned int>* pRan = &ran;
+		JobCounter counter;
+		for (unsigned int i = 0; i < count; i++)
+			jobs.Run([pRan]() { pRan->fetch_add(1, std::memory_order_relaxed); }, &counter);
+		jobs.Wait(counter);
+		CHECK(ran.load() == count);
+		CHECK(counter.IsDone());
+	}
+
+	// Jobs that spawn jobs, 2^15 - 1 of them
+	{
+		const unsigned int depth = 14;
+		std::atomic<unsigned int> ran(0);
+		JobCounter counter;
+		SpawnTree(jobs, depth, ran, counter);
+		jobs.Wait(counter);
+		CHECK(ran.load() == (1u << (depth + 1)) - 1);
+	}
+
+	// A chain, each link only starts once the one before has finished
+	{
+		const unsigned int links = 100;
+		std::vector<unsigned int> order;
+		std::vector<unsigned int>* pOrder = &order;
+		std::vector<JobCounter> counters(links);
+		for (unsigned int i = 0; i < links; i++)
+		{
+			if (i == 0)
+				jobs.Run([pOrder, i]() { pOrder->push_back(i); }, &counters[i]);
+			else
+				jobs.RunAfter(counters[i - 1], [pOrder, i]() { pOrder->push_back(i); }, &counters[i]);
+		}
+		jobs.Wait(counters[links - 1]);
+		for (JobCounter& counter : counters)
+			jobs.Wait(counter);
+		CHECK(order.size() == links);
+		for (unsigned int i = 0; i < order.size(); i++)
+			CHECK(order[i] == i);
+	}
+
+	// A diamond, both middle jobs wait on the first and the last waits on both of them
+	{
+		std::atomic<int> first(0), middle(0), last(0);
+		std::atomic<int>* pFirst = &first;
+		std::atomic<int>* pMiddle = &middle;
+		std::atomic<int>* pLast = &last;
+		JobCounter top, sides, bottom;
+		jobs.Run([pFirst]() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); pFirst->store(1); }, &top);
+		for (int i = 0; i < 2; i++)
+			jobs.RunAfter(top, [pFirst, pMiddle]() { if (pFirst->load() == 1) pMiddle->fetch_add(1); }, &sides);
+		jobs.RunAfter(sides, [pMiddle, pLast]() { pLast->store(pMiddle->load()); }, &bottom);
+		jobs.Wait(bottom);
+		CHECK(last.load() == 2);
+	}
+
+	// Every index exactly once, whatever the grain
+	{
+		const unsigned int count = 100003;
+		std::vector<std::atomic<unsigned char>> visits(count);
+		for (std::atomic<unsigned char>& visit : visits)
+			visit.store(0);
+		for (unsigned int grain : { 1u, 7u, 1000u, 200000u })
+		{
+			jobs.ParallelFor(0, count, grain, [&visits](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int i = begin; i < end; i++)
+					visits[i].fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+		unsigned int wrong = 0;
+		for (std::atomic<unsigned char>& visit : visits)
+			wrong += visit.load() != 4;
+		CHECK(wrong == 0);
+	}
+
+	// Jobs started from a thread that isn't a worker run there and then
+	{
+		bool ranInline = false;
+		std::thread outsider([&jobs, &ranInline]()
+		{
+			std::thread::id id = std::this_thread::get_id();
+			bool* pRanInline = &ranInline;
+			JobCounter counter;
+			jobs.Run([id, pRanInline]() { *pRanInline = std::this_thread::get_id() == id; }, &counter);
+			jobs.Wait(counter);
+		});
+		outsider.join();
+		CHECK(ranInline);
+	}
+}
+
+/**
+*  @brief Some arithmetic that takes a while, standing in for culling or animating one object.
+*/
+static float Work(unsigned int i)
+{
+	float value = (float)i;
+	for (int step = 0; step < 50; step++)
+		value = sqrtf(value * value + 1.0f) * 0.999f + sinf(value) * 0.001f;
+	return value;
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int hardware = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+	const unsigned int maxWorkers = argc > 1 ? (unsigned int)atoi(argv[1]) : (hardware > 4 ? hardware : 4);
+	const unsigned int rounds = argc > 2 ? (unsigned int)atoi(argv[2]) : 3;
+	if (maxWorkers == 0)
+	{
+		fprintf(stderr, "Usage: JobBenchmark [max workers] [stress rounds]\n");
+		return 1;
+	}
+
+	printf("%u hardware threads\n", hardware);
+	for (unsigned int round = 0; round < rounds; round++)
+	{
+		for (unsigned int workers = 1; workers <= maxWorkers; workers *= 2)
+			StressTest(workers - 1);
+	}
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	const unsigned int count = 1 << 17;
+	std::vector<float> results(count);
+	double baseline = 0.0;
+	for (unsigned int workers = 1; workers <= maxWorkers; workers++)
+	{
+		JobSystem jobs(workers - 1);
+		const int repeats = 5;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < repeats; repeat++)
+		{
+			jobs.ParallelFor(0, count, 256, [&results](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int i = begin; i < end; i++)
+					results[i] = Work(i);
+			});
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / repeats;
+		if (workers == 1)
+			baseline = seconds;
+
+		printf("%2u workers: %8.2f ms  %5.2fx  %8llu jobs, %6.1f%% stolen\n", workers, seconds * 1e3, baseline / seconds,
+			(unsigned long long)jobs.GetJobsRun(), jobs.GetJobsRun() ? 100.0 * jobs.GetJobsStolen() / jobs.GetJobsRun() : 0.0);
+	}
+
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+/**
+*  @file LogBenchmark.cpp
+*  @brief Command line tool that measures LOG_INFO throughput from several threads.
+*
+*  Logs the same lines with the LogQueue writing them from its own thread, then with every line written
+*  out by the thread that logged it as the logger used to, and prints how long the logging threads
+*  were held up and how long until everything was on disk. Then times single log calls of each kind
+*  and counts how many allocations each one makes. Only uses the C++ standard library, so it
+*  builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -pthread -I../TestApp LogBenchmark.cpp ../TestApp/LogQueue.cpp ../TestApp/BinaryLog.cpp -o LogBenchmark
+*
+*  Usage: LogBenchmark [threads] [lines per thread] [output.log]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// Verbose calls are compiled out, to check their arguments aren't evaluated
+#define FILELOG_MAX_LEVEL LOG_LEVEL_DEBUG
+#include "Log.h"
+#include "LogQueue.h"
+
+/// Every allocation the process makes.
+static std::atomic<uint64_t> gAllocations(0);
+
+void* operator new(size_t size)
+{
+	gAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+struct BenchmarkResult
+{
+	/// Seconds until every logging thread had finished.
+	double mLoggingSeconds;
+	/// Seconds until every line had been written and flushed.
+	double mTotalSeconds;
+	uint64_t miDropped;
+};
+
+static BenchmarkResult Run(bool asynchronous, unsigned int threadCount, unsigned int linesPerThread)
+{
+	LogQueue::Get().SetAsynchronous(asynchronous);
+	const uint64_t droppedBefore = LogQueue::Get().GetDroppedCount();
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([t, linesPerThread]()
+		{
+			for (unsigned int i = 0; i < linesPerThread; i++)
+			{
+				LOG_INFO << "Benchmark line " << i << " from thread " << t << ", value " << i * 0.5f;
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	const std::chrono::steady_clock::time_point logged = std::chrono::steady_clock::now();
+	LogQueue::Get().Flush();
+	const std::chrono::steady_clock::time_point flushed = std::chrono::steady_clock::now();
+
+	BenchmarkResult result;
+	result.mLoggingSeconds = std::chrono::duration<double>(logged - start).count();
+	result.mTotalSeconds = std::chrono::duration<double>(flushed - start).count();
+	result.miDropped = LogQueue::Get().GetDroppedCount() - droppedBefore;
+	return result;
+}
+
+static void Report(const char* name, const BenchmarkResult& result, unsigned int lines)
+{
+	const double written = (double)(lines - result.miDropped);
+	printf("%-13s %9.1f ms logging (%7.0f ns/line)  %9.1f ms until flushed (%10.0f lines/s)  %llu dropped\n",
+		name,
+		result.mLoggingSeconds * 1000.0, result.mLoggingSeconds * 1e9 / lines,
+		result.mTotalSeconds * 1000.0, written / result.mTotalSeconds,
+		(unsigned long long)result.miDropped);
+}
+
+/**
+*  @brief Formats a line the way the logger used to, through an ostringstream, for comparison.
+*/
+static void LogWithStringStream(unsigned int i, float value)
+{
+	std::ostringstream os;
+	std::string levelString = "INFO";
+	levelString += std::string(levelString.length() < 7 ? 7 - levelString.length() : 0, ' ');
+	os << levelString << " " << "[" << __FUNCTION__ << ":" << __LINE__ << "] ";
+	os << "Benchmark line " << i << ", value " << value << std::endl;
+	const std::string line = os.str();
+	Output::Print(line.c_str(), line.size(), INFO);
+}
+
+static unsigned int gExpensiveCalls = 0;
+
+static float Expensive()
+{
+	gExpensiveCalls++;
+	return 1.0f;
+}
+
+/**
+*  @brief Times one kind of log call made calls times on this thread, and counts its allocations.
+*/
+template <typename LogCall>
+static void TimeCalls(const char* name, unsigned int calls, LogCall logCall)
+{
+	LogQueue::Get().Flush();
+	const uint64_t allocationsBefore = gAllocations.load();
+	const uint64_t droppedBefore = LogQueue::Get().GetDroppedCount();
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (unsigned int i = 0; i < calls; i++)
+		logCall(i);
+
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	const uint64_t allocations = gAllocations.load() - allocationsBefore;
+	LogQueue::Get().Flush();
+
+	printf("%-28s %7.0f ns/call  %6.2f allocations/call  %llu dropped\n", name,
+		std::chrono::duration<double, std::nano>(end - start).count() / calls,
+		(double)allocations / calls,
+		(unsigned long long)(LogQueue::Get().GetDroppedCount() - droppedBefore));
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int threadCount = argc > 1 ? (unsigned int)atoi(argv[1]) : 4;
+	const unsigned int linesPerThread = argc > 2 ? (unsigned int)atoi(argv[2]) : 50000;
+	const char* path = argc > 3 ? argv[3] : "LogBenchmark.log";
+
+	if (threadCount == 0 || linesPerThread == 0)
+	{
+		fprintf(stderr, "Usage: LogBenchmark [threads] [lines per thread] [output.log]\n");
+		return 1;
+	}
+
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		fprintf(stderr, "Couldn't open %s\n", path);
+		return 1;
+	}
+	Output::Stream() = file;
+	Output::EchoToStderr() = false;
+
+	const unsigned int lines = threadCount * linesPerThread;
+	printf("%u threads, %u lines each, writing to %s\n", threadCount, linesPerThread, path);
+
+	// Warm up the file and the writer thread
+	Run(true, 1, 1000);
+
+	Report("Synchronous", Run(false, threadCount, linesPerThread), lines);
+	Report("Asynchronous", Run(true, threadCount, linesPerThread), lines);
+
+	// Single calls, queued for the writer thread
+	printf("\n");
+	const unsigned int calls = 2000;
+	TimeCalls("ostringstream (old logger)", calls, [](unsigned int i) { LogWithStringStream(i, i * 0.5f); });
+	TimeCalls("LOG_INFO <<", calls, [](unsigned int i) { LOG_INFO << "Benchmark line " << i << ", value " << i * 0.5f; });
+	TimeCalls("LOGF_INFO", calls, [](unsigned int i) { LOGF_INFO("Benchmark line %u, value %g", i, i * 0.5f); });
+
+	Logger::ReportingLevel() = INFO;
+	TimeCalls("LOG_DEBUG below the level", calls, [](unsigned int i) { LOG_DEBUG << "Benchmark line " << i << ", value " << Expensive(); });
+	Logger::ReportingLevel() = VERBOSE;
+	TimeCalls("LOG_VERBOSE compiled out", calls, [](unsigned int i) { LOG_VERBOSE << "Benchmark line " << i << ", value " << Expensive(); });
+	printf("Filtered calls evaluated their arguments %u times\n", gExpensiveCalls);
+
+	// The same call written as a binary record instead of text
+	if (BinaryLog::Get().Open(std::string(path) + "_binary", 64 * 1024 * 1024, 1))
+	{
+		TimeCalls("LOG_INFO << to binary log", calls, [](unsigned int i) { LOG_INFO << "Benchmark line " << i << ", value " << i * 0.5f; });
+		BinaryLog::Get().Close();
+	}
+
+	LogQueue::Get().Flush();
+	LogQueue::Get().SetAsynchronous(false);
+	Output::Stream() = stderr;
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,396 @@
+/**
+*  @file LogDecoder.cpp
+*  @brief Command line tool that turns binary log files back into text lines.
+*
+*  Reads the .blog files written by BinaryLog and prints the lines that pass the filters, in the same
+*  layout as the text log with the time since the log was opened and the thread in front. Only uses
+*  the C++ standard library, so it builds on Linux, e.g.
+*      g++ -O2 -std=c++14 -I../TestApp LogDecoder.cpp -o LogDecoder
+*
+*  Usage: LogDecoder [-l level] [-from seconds] [-to seconds] [-site id|text] [-thread id] [-sites] file.blog [file.blog ...]
+*      -l        Only lines at this level or more severe: ERROR, WARNING, INFO, DEBUG or VERBOSE.
+*      -from/-to Only lines logged in this range, in seconds since the log was opened.
+*      -site     Only lines from the call site with this id, or whose function or file:line contains the text.
+*      -thread   Only lines from this thread.
+*      -sites    List the call sites and how many lines passed the filters from each, instead of the lines.
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BinaryLogFormat.h"
+
+static const char* const LEVEL_NAMES[] = { "ERROR", "WARNING", "INFO", "DEBUG", "VERBOSE" };
+static const unsigned int NUM_LEVELS = 5;
+
+struct Site
+{
+	Site() : miLevel(0), miLine(0), miCount(0) {}
+
+	unsigned int miLevel;
+	uint64_t miLine;
+	std::string mFunction;
+	std::string mFile;
+	uint64_t miCount;
+};
+
+struct Filters
+{
+	unsigned int miMaxLevel;
+	double mFrom;
+	double mTo;
+	/// 0 for any.
+	uint64_t miSiteId;
+	std::string mSiteText;
+	/// 0 for any.
+	uint64_t miThread;
+	bool mbListSites;
+};
+
+/**
+*  @brief Reads through one record's payload, failing once anything runs past the end.
+*/
+struct Reader
+{
+	const unsigned char* mpPos;
+	const unsigned char* mpEnd;
+	bool mbFailed;
+
+	Reader(const unsigned char* begin, const unsigned char* end) : mpPos(begin), mpEnd(end), mbFailed(false) {}
+
+	bool AtEnd() const { return mbFailed || mpPos >= mpEnd; }
+
+	uint64_t Varint()
+	{
+		uint64_t value = 0;
+		const unsigned int length = BinaryLogReadVarint(mpPos, mpEnd, value);
+		if (length == 0)
+			mbFailed = true;
+		mpPos += length;
+		return value;
+	}
+
+	unsigned char Byte()
+	{
+		if (mpPos >= mpEnd)
+		{
+			mbFailed = true;
+			return 0;
+		}
+		return *mpPos++;
+	}
+
+	void Bytes(void* out, size_t size)
+	{
+		if ((size_t)(mpEnd - mpPos) < size)
+		{
+			mbFailed = true;
+			memset(out, 0, size);
+			return;
+		}
+		memcpy(out, mpPos, size);
+		mpPos += size;
+	}
+
+	std::string String()
+	{
+		const uint64_t length = Varint();
+		if (mbFailed || (uint64_t)(mpEnd - mpPos) < length)
+		{
+			mbFailed = true;
+			return std::string();
+		}
+		std::string text((const char*)mpPos, (size_t)length);
+		mpPos += length;
+		return text;
+	}
+};
+
+/**
+*  @brief Turns a message's arguments back into the text the logger would have written.
+*/
+static void AppendArguments(Reader& reader, std::string& text)
+{
+	char number[64];
+	while (!reader.AtEnd())
+	{
+		switch (reader.Byte())
+		{
+		case BINARY_ARG_STRING:
+			text += reader.String();
+			break;
+		case BINARY_ARG_SIGNED:
+			snprintf(number, sizeof(number), "%lld", (long long)BinaryLogUnZigZag(reader.Varint()));
+			text += number;
+			break;
+		case BINARY_ARG_UNSIGNED:
+			snprintf(number, sizeof(number), "%llu", (unsigned long long)reader.Varint());
+			text += number;
+			break;
+		case BINARY_ARG_FLOAT:
+		{
+			float value;
+			reader.Bytes(&value, sizeof(value));
+			snprintf(number, sizeof(number), "%g", value);
+			text += number;
+			break;
+		}
+		case BINARY_ARG_DOUBLE:
+		{
+			double value;
+			reader.Bytes(&value, sizeof(value));
+			snprintf(number, sizeof(number), "%g", value);
+			text += number;
+			break;
+		}
+		case BINARY_ARG_CHAR:
+			text += (char)reader.Byte();
+			break;
+		case BINARY_ARG_BOOL:
+			text += reader.Byte() ? "1" : "0";
+			break;
+		case BINARY_ARG_POINTER:
+		{
+			uint64_t value;
+			reader.Bytes(&value, sizeof(value));
+			snprintf(number, sizeof(number), "0x%llx", (unsigned long long)value);
+			text += number;
+			break;
+		}
+		default:
+			// Can't know how long an unknown argument is, so the rest of the line is lost
+			text += "<?>";
+			return;
+		}
+	}
+}
+
+static bool SiteMatches(uint64_t id, const Site* site, const Filters& filters)
+{
+	if (filters.miSiteId != 0)
+		return id == filters.miSiteId;
+	if (filters.mSiteText.empty())
+		return true;
+	if (!site)
+		return false;
+
+	char location[32];
+	snprintf(location, sizeof(location), ":%llu", (unsigned long long)site->miLine);
+	return site->mFunction.find(filters.mSiteText) != std::string::npos
+		|| (site->mFile + location).find(filters.mSiteText) != std::string::npos;
+}
+
+/**
+*  @brief Prints the lines in one file that pass the filters.
+*  @return false if the file couldn't be read.
+*/
+static bool DecodeFile(const char* path, const Filters& filters, std::map<uint64_t, Site>& sites, uint64_t& firstStartTime)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		fprintf(stderr, "Couldn't open %s\n", path);
+		return false;
+	}
+	std::vector<unsigned char> data;
+	unsigned char chunk[64 * 1024];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data.insert(data.end(), chunk, chunk + read);
+	fclose(file);
+
+	BinaryLogHeader header;
+	if (data.size() < sizeof(header))
+	{
+		fprintf(stderr, "%s is too short to be a binary log\n", path);
+		return false;
+	}
+	memcpy(&header, &data[0], sizeof(header));
+	if (header.miMagic != BINARY_LOG_MAGIC || header.miVersion != BINARY_LOG_VERSION || header.miHeaderSize > data.size())
+	{
+		fprintf(stderr, "%s isn't a version %u binary log\n", path, BINARY_LOG_VERSION);
+		return false;
+	}
+
+	// Times are printed relative to the first file, so a run split over several files lines up
+	if (firstStartTime == 0)
+	{
+		firstStartTime = header.miStartTime;
+		const time_t seconds = (time_t)(header.miStartTime / 1000000);
+		char date[64];
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+		fprintf(stderr, "Log opened %s\n", date);
+	}
+	const double offset = ((double)header.miStartTime - (double)firstStartTime) / 1e6;
+
+	const unsigned char* pos = &data[0] + header.miHeaderSize;
+	const unsigned char* end = &data[0] + data.size();
+	std::string text;
+	while (pos + BINARY_LOG_RECORD_HEADER <= end && *pos != BINARY_LOG_END)
+	{
+		const unsigned char type = pos[0];
+		const size_t payload = pos[1] | (pos[2] << 8);
+		const unsigned char* payloadEnd = pos + BINARY_LOG_RECORD_HEADER + payload;
+		if (payloadEnd > end)
+		{
+			fprintf(stderr, "%s ends part way through a record\n", path);
+			break;
+		}
+		Reader reader(pos + BINARY_LOG_RECORD_HEADER, payloadEnd);
+		pos = payloadEnd;
+
+		if (type == BINARY_LOG_SITE)
+		{
+			const uint64_t id = reader.Varint();
+			Site& site = sites[id];
+			site.miLevel = reader.Byte();
+			site.miLine = reader.Varint();
+			site.mFunction = reader.String();
+			site.mFile = reader.String();
+		}
+		else if (type == BINARY_LOG_MESSAGE)
+		{
+			const uint64_t id = reader.Varint();
+			const unsigned int level = reader.Byte();
+			const double seconds = offset + reader.Varint() / 1e6;
+			const uint64_t thread = reader.Varint();
+
+			if (level > filters.miMaxLevel || seconds < filters.mFrom || seconds > filters.mTo)
+				continue;
+			if (filters.miThread != 0 && thread != filters.miThread)
+				continue;
+			std::map<uint64_t, Site>::iterator site = sites.find(id);
+			Site* pSite = site != sites.end() ? &site->second : nullptr;
+			if (!SiteMatches(id, pSite, filters))
+				continue;
+
+			if (pSite)
+				pSite->miCount++;
+			if (filters.mbListSites)
+				continue;
+
+			text.clear();
+			AppendArguments(reader, text);
+			if (pSite)
+			{
+				printf("%12.6f [T%llu] %-7s [%s:%llu] %s\n", seconds, (unsigned long long)thread, LEVEL_NAMES[level < NUM_LEVELS ? level : NUM_LEVELS - 1],
+					pSite->mFunction.c_str(), (unsigned long long)pSite->miLine, text.c_str());
+			}
+			else
+			{
+				printf("%12.6f [T%llu] %-7s %s\n", seconds, (unsigned long long)thread, LEVEL_NAMES[level < NUM_LEVELS ? level : NUM_LEVELS - 1], text.c_str());
+			}
+		}
+		else if (type == BINARY_LOG_DROPPED)
+		{
+			const double seconds = offset + reader.Varint() / 1e6;
+			const uint64_t count = reader.Varint();
+			if (!filters.mbListSites && seconds >= filters.mFrom && seconds <= filters.mTo)
+				printf("%12.6f Log queue full, dropped %llu lines\n", seconds, (unsigned long long)count);
+		}
+	}
+	return true;
+}
+
+static void PrintUsage()
+{
+	fprintf(stderr, "Usage: LogDecoder [-l level] [-from seconds] [-to seconds] [-site id|text] [-thread id] [-sites] file.blog [file.blog ...]\n");
+}
+
+int main(int argc, char** argv)
+{
+	Filters filters;
+	filters.miMaxLevel = NUM_LEVELS - 1;
+	filters.mFrom = 0.0;
+	filters.mTo = 1e300;
+	filters.miSiteId = 0;
+	filters.miThread = 0;
+	filters.mbListSites = false;
+
+	std::vector<const char*> paths;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "-l") == 0 && hasValue)
+		{
+			const char* name = argv[++i];
+			filters.miMaxLevel = NUM_LEVELS;
+			for (unsigned int level = 0; level < NUM_LEVELS; level++)
+			{
+				if (strcmp(name, LEVEL_NAMES[level]) == 0)
+					filters.miMaxLevel = level;
+			}
+			if (filters.miMaxLevel == NUM_LEVELS)
+			{
+				fprintf(stderr, "Unknown level %s\n", name);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-from") == 0 && hasValue)
+		{
+			filters.mFrom = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-to") == 0 && hasValue)
+		{
+			filters.mTo = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-site") == 0 && hasValue)
+		{
+			const char* site = argv[++i];
+			char* numberEnd;
+			const unsigned long long id = strtoull(site, &numberEnd, 10);
+			if (*site && *numberEnd == '\0')
+				filters.miSiteId = id;
+			else
+				filters.mSiteText = site;
+		}
+		else if (strcmp(argv[i], "-thread") == 0 && hasValue)
+		{
+			filters.miThread = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "-sites") == 0)
+		{
+			filters.mbListSites = true;
+		}
+		else if (argv[i][0] == '-')
+		{
+			PrintUsage();
+			return 1;
+		}
+		else
+		{
+			paths.push_back(argv[i]);
+		}
+	}
+
+	if (paths.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::map<uint64_t, Site> sites;
+	uint64_t firstStartTime = 0;
+	bool ok = true;
+	for (size_t i = 0; i < paths.size(); i++)
+		ok = DecodeFile(paths[i], filters, sites, firstStartTime) && ok;
+
+	if (filters.mbListSites)
+	{
+		for (std::map<uint64_t, Site>::const_iterator it = sites.begin(); it != sites.end(); ++it)
+		{
+			const Site& site = it->second;
+			if (site.miCount == 0)
+				continue;
+			printf("%5llu %-7s %10llu  %s (%s:%llu)\n", (unsigned long long)it->first, LEVEL_NAMES[site.miLevel < NUM_LEVELS ? site.miLevel : NUM_LEVELS - 1],
+				(unsigned long long)site.miCount, site.mFunction.c_str(), site.mFile.c_str(), (unsigned long long)site.miLine);
+		}
+	}
+	return ok ? 0 : 1;
+}
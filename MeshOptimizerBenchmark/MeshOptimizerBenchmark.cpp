@@ -0,0 +1,438 @@
+/**
+*  @file MeshOptimizerBenchmark.cpp
+*  @brief Command line tool that checks the MeshOptimizer passes and times them on a large grid.
+*
+*  Compares AnalyzeVertexCache with a plain FIFO queue over random triangle lists and cache sizes,
+*  and against the ACMR of a strip and a grid worked out by hand. Each pass is run on shuffled grids
+*  and random meshes, checking its output holds the same triangles, winding included, as its input.
+*  Meshes too big for 16 bit indices are split, checking each piece fits and every triangle, including
+*  those whose vertices are shared with the piece before, comes out the same and in order.
+*  Only uses the C++ standard library, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -I../TestApp MeshOptimizerBenchmark.cpp ../TestApp/MeshOptimizer.cpp -o MeshOptimizerBenchmark
+*
+*  Usage: MeshOptimizerBenchmark [grid size]
+*
+*  @bug No known bugs.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <vector>
+#include "MeshOptimizer.h"
+
+/// Mesh::MAX_SHORT_INDEX_VERTICES, the most vertices 16 bit indices can address.
+static const unsigned int SHORT_INDEX_VERTICES = 65536;
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/**
+*  @brief A triangle rotated so its smallest index comes first, which keeps its winding.
+*/
+struct Triangle
+{
+	unsigned int v[3];
+
+	bool operator<(const Triangle& other) const { return std::lexicographical_compare(v, v + 3, other.v, other.v + 3); }
+	bool operator==(const Triangle& other) const { return std::equal(v, v + 3, other.v); }
+};
+
+static Triangle MakeTriangle(unsigned int a, unsigned int b, unsigned int c)
+{
+	Triangle triangle;
+	if (a <= b && a <= c)
+		triangle = { { a, b, c } };
+	else if (b <= a && b <= c)
+		triangle = { { b, c, a } };
+	else
+		triangle = { { c, a, b } };
+	return triangle;
+}
+
+/**
+*  @brief The triangles of a list in sorted order, so two lists holding the same triangles compare equal.
+*/
+static std::vector<Triangle> SortedTriangles(const std::vector<unsigned int>& indices)
+{
+	std::vector<Triangle> triangles;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		triangles.push_back(MakeTriangle(indices[i], indices[i + 1], indices[i + 2]));
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+/**
+*  @brief A grid of quads, each split into two triangles, in row order or shuffled.
+*
+*  Each vertex's u holds its index, so it can be followed through OptimizeVertexFetch.
+*/
+static void MakeGrid(unsigned int width, unsigned int height, bool shuffle, std::mt19937& random, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	vertices.clear();
+	indices.clear();
+	for (unsigned int y = 0; y <= height; y++)
+	{
+		for (unsigned int x = 0; x <= width; x++)
+			vertices.push_back(Vertex((float)x, (float)y, 0.0f, 0.0f, 0.0f, 1.0f, (float)vertices.size(), 0.0f));
+	}
+
+	std::vector<Triangle> triangles;
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			const unsigned int a = y * (width + 1) + x;
+			const unsigned int b = a + 1;
+			const unsigned int c = a + width + 1;
+			const unsigned int d = c + 1;
+			triangles.push_back({ { a, c, b } });
+			triangles.push_back({ { b, c, d } });
+		}
+	}
+	if (shuffle)
+		std::shuffle(triangles.begin(), triangles.end(), random);
+	for (const Triangle& triangle : triangles)
+		indices.insert(indices.end(), triangle.v, triangle.v + 3);
+}
+
+/**
+*  @brief Triangles between random vertices on a sphere, so there's little reuse for the passes to find.
+*/
+static void MakeRandomMesh(unsigned int vertexCount, unsigned int triangleCount, std::mt19937& random, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	std::normal_distribution<float> normal;
+	std::uniform_int_distribution<unsigned int> pick(0, vertexCount - 1);
+	vertices.clear();
+	indices.clear();
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		const float x = normal(random), y = normal(random), z = normal(random);
+		vertices.push_back(Vertex(x, y, z, x, y, z, (float)i, 0.0f));
+	}
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+		indices.push_back(pick(random));
+}
+
+/**
+*  @brief The number of vertices transformed by a FIFO cache of the given size, simulated with a queue.
+*/
+static unsigned int CountMisses(const std::vector<unsigned int>& indices, unsigned int cacheSize)
+{
+	std::deque<unsigned int> cache;
+	unsigned int misses = 0;
+	for (unsigned int v : indices)
+	{
+		if (std::find(cache.begin(), cache.end(), v) != cache.end())
+			continue;
+		misses++;
+		cache.push_back(v);
+		if (cache.size() > cacheSize)
+			cache.pop_front();
+	}
+	return misses;
+}
+
+static void CheckCacheSimulation(std::mt19937& random)
+{
+	// Reusing a vertex with exactly cacheSize others put in since is a hit, one more is a miss
+	const std::vector<unsigned int> twice = { 0, 1, 2, 0, 1, 2 };
+	CHECK(MeshOptimizer::AnalyzeVertexCache(twice, 3, 3).acmr == 1.5f);
+	CHECK(MeshOptimizer::AnalyzeVertexCache(twice, 3, 2).acmr == 3.0f);
+	const std::vector<unsigned int> fourApart = { 0, 1, 2, 3, 0, 1 };
+	CHECK(MeshOptimizer::AnalyzeVertexCache(fourApart, 4, 4).acmr == 2.0f);
+	CHECK(MeshOptimizer::AnalyzeVertexCache(fourApart, 4, 3).acmr == 3.0f);
+
+	// A strip as a list transforms each vertex once with any cache of 3 or more, (n + 2) / n
+	const unsigned int stripTriangles = 100;
+	std::vector<unsigned int> strip;
+	for (unsigned int t = 0; t < stripTriangles; t++)
+	{
+		strip.push_back(t);
+		strip.push_back(t + 1);
+		strip.push_back(t + 2);
+	}
+	for (unsigned int cacheSize : { 3u, 16u, 32u })
+	{
+		const VertexCacheStats stats = MeshOptimizer::AnalyzeVertexCache(strip, stripTriangles + 2, cacheSize);
+		CHECK(stats.acmr == (float)(stripTriangles + 2) / (float)stripTriangles);
+		CHECK(stats.atvr == 1.0f);
+	}
+
+	// A grid drawn a row at a time keeps the row above in a cache that holds two rows of vertices,
+	// so each vertex is transformed once. A cache of one row loses it and transforms every vertex twice
+	// but the first row's and the last one's.
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	const unsigned int width = 7, height = 10;
+	MakeGrid(width, height, false, random, vertices, indices);
+	const unsigned int rowVertices = width + 1;
+	const float triangles = (float)(width * height * 2);
+	CHECK(MeshOptimizer::AnalyzeVertexCache(indices, (unsigned int)vertices.size(), 2 * rowVertices).acmr == (float)vertices.size() / triangles);
+	CHECK(MeshOptimizer::AnalyzeVertexCache(indices, (unsigned int)vertices.size(), 2 * rowVertices).atvr == 1.0f);
+	CHECK(MeshOptimizer::AnalyzeVertexCache(indices, (unsigned int)vertices.size(), rowVertices).acmr == (float)(rowVertices * 2 * height) / triangles);
+
+	// Random lists against the queue
+	for (int round = 0; round < 200; round++)
+	{
+		const unsigned int vertexCount = 3 + random() % 60;
+		const unsigned int cacheSize = 3 + random() % 30;
+		std::vector<unsigned int> list(3 * (1 + random() % 300));
+		for (unsigned int& index : list)
+			index = random() % vertexCount;
+		const VertexCacheStats stats = MeshOptimizer::AnalyzeVertexCache(list, vertexCount, cacheSize);
+		CHECK(stats.acmr == (float)CountMisses(list, cacheSize) / (float)(list.size() / 3));
+	}
+}
+
+/**
+*  @brief Runs each pass on its own and all of them together, checking no triangle is lost, added or turned over.
+*/
+static void CheckPermutations(std::mt19937& random)
+{
+	for (int round = 0; round < 20; round++)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		if (round % 2 == 0)
+			MakeGrid(5 + random() % 60, 5 + random() % 60, true, random, vertices, indices);
+		else
+			MakeRandomMesh(10 + random() % 2000, 10 + random() % 4000, random, vertices, indices);
+		const std::vector<Triangle> input = SortedTriangles(indices);
+		const unsigned int vertexCount = (unsigned int)vertices.size();
+
+		std::vector<unsigned int> cacheOrder = indices;
+		MeshOptimizer::OptimizeVertexCache(cacheOrder, vertexCount);
+		CHECK(SortedTriangles(cacheOrder) == input);
+
+		std::vector<unsigned int> overdrawOrder = cacheOrder;
+		MeshOptimizer::OptimizeOverdraw(overdrawOrder, vertices);
+		CHECK(SortedTriangles(overdrawOrder) == input);
+
+		// Vertex fetch renumbers the vertices, their u still holds the original index
+		std::vector<Vertex> optimisedVertices = vertices;
+		std::vector<unsigned int> optimised = indices;
+		MeshOptimizer::Optimize(optimisedVertices, optimised);
+		CHECK(optimised.size() == indices.size());
+		CHECK(optimisedVertices.size() <= vertices.size());
+		for (unsigned int& index : optimised)
+			index = (unsigned int)optimisedVertices[index].u;
+		CHECK(SortedTriangles(optimised) == input);
+	}
+}
+
+/**
+*  @brief Checks the pieces SplitMesh made hold every triangle of the mesh in order, each addressable with maxVertices.
+*
+*  Each vertex's u has to hold its index in the whole mesh.
+*
+*  @return The number of extra copies of vertices shared between pieces.
+*/
+static unsigned int CheckSplitPieces(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int maxVertices,
+	const std::vector<std::vector<Vertex>>& splitVertices, const std::vector<std::vector<unsigned int>>& splitIndices)
+{
+	CHECK(splitVertices.size() == splitIndices.size());
+	std::vector<unsigned int> joined;
+	std::vector<unsigned int> piecesUsing(vertices.size(), 0);
+	for (size_t i = 0; i < splitVertices.size() && i < splitIndices.size(); i++)
+	{
+		const std::vector<Vertex>& pieceVertices = splitVertices[i];
+		const std::vector<unsigned int>& pieceIndices = splitIndices[i];
+		CHECK(!pieceIndices.empty() && pieceIndices.size() % 3 == 0);
+		CHECK(pieceVertices.size() <= maxVertices);
+
+		// Every vertex in the piece is used, once, and is a copy of the one it came from
+		std::vector<bool> used(pieceVertices.size(), false);
+		std::vector<bool> seen(vertices.size(), false);
+		bool inRange = true, copied = true, unique = true;
+		for (unsigned int index : pieceIndices)
+		{
+			if (index >= pieceVertices.size())
+			{
+				inRange = false;
+				continue;
+			}
+			used[index] = true;
+			joined.push_back((unsigned int)pieceVertices[index].u);
+		}
+		for (const Vertex& vertex : pieceVertices)
+		{
+			const unsigned int original = (unsigned int)vertex.u;
+			copied = copied && original < vertices.size() && memcmp(&vertex, &vertices[original], sizeof(Vertex)) == 0;
+			if (original < vertices.size())
+			{
+				unique = unique && !seen[original];
+				seen[original] = true;
+				piecesUsing[original]++;
+			}
+		}
+		CHECK(inRange);
+		CHECK(copied);
+		CHECK(unique);
+		CHECK(std::find(used.begin(), used.end(), false) == used.end());
+	}
+	CHECK(joined == indices);
+
+	unsigned int copies = 0;
+	for (unsigned int pieces : piecesUsing)
+		copies += pieces > 1 ? pieces - 1 : 0;
+	return copies;
+}
+
+/**
+*  @brief Splits meshes on both sides of the 16 bit limit, small meshes at small limits, and random meshes.
+*/
+static void CheckSplit(std::mt19937& random)
+{
+	std::vector<std::vector<Vertex>> splitVertices;
+	std::vector<std::vector<unsigned int>> splitIndices;
+
+	// A strip shares two vertices between each triangle and the next, so a piece takes maxVertices - 2
+	// triangles and the next one starts with copies of the last two vertices
+	for (unsigned int triangles : { 1u, 2u, 3u, 10u, 11u, 100u })
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		for (unsigned int v = 0; v < triangles + 2; v++)
+			vertices.push_back(Vertex((float)v, (float)(v % 2), 0.0f, 0.0f, 0.0f, 1.0f, (float)v, 0.0f));
+		for (unsigned int t = 0; t < triangles; t++)
+		{
+			indices.push_back(t);
+			indices.push_back(t % 2 ? t + 2 : t + 1);
+			indices.push_back(t % 2 ? t + 1 : t + 2);
+		}
+		for (unsigned int maxVertices : { 3u, 4u, 5u, 12u })
+		{
+			MeshOptimizer::SplitMesh(vertices, indices, maxVertices, splitVertices, splitIndices);
+			const unsigned int perPiece = maxVertices - 2;
+			const unsigned int pieces = (triangles + perPiece - 1) / perPiece;
+			CHECK(splitVertices.size() == pieces);
+			for (size_t i = 0; i + 1 < splitVertices.size(); i++)
+				CHECK(splitVertices[i].size() == maxVertices);
+			CHECK(CheckSplitPieces(vertices, indices, maxVertices, splitVertices, splitIndices) == 2 * (pieces - 1));
+		}
+	}
+
+	// A fan shares its centre with every triangle, so every piece needs a copy of it
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		const unsigned int triangles = 50;
+		for (unsigned int v = 0; v < triangles + 2; v++)
+			vertices.push_back(Vertex(cosf((float)v), sinf((float)v), 0.0f, 0.0f, 0.0f, 1.0f, (float)v, 0.0f));
+		for (unsigned int t = 0; t < triangles; t++)
+		{
+			indices.push_back(0);
+			indices.push_back(t + 1);
+			indices.push_back(t + 2);
+		}
+		MeshOptimizer::SplitMesh(vertices, indices, 7, splitVertices, splitIndices);
+		CHECK(splitVertices.size() == 10);
+		for (const std::vector<Vertex>& pieceVertices : splitVertices)
+			CHECK(!pieceVertices.empty() && pieceVertices[0].u == 0.0f);
+		CheckSplitPieces(vertices, indices, 7, splitVertices, splitIndices);
+	}
+
+	// Strips with exactly as many vertices as 16 bit indices address, and one more
+	for (unsigned int extra : { 0u, 1u })
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		for (unsigned int v = 0; v < SHORT_INDEX_VERTICES + extra; v++)
+			vertices.push_back(Vertex((float)v, (float)(v % 2), 0.0f, 0.0f, 0.0f, 1.0f, (float)v, 0.0f));
+		for (unsigned int t = 0; t + 2 < vertices.size(); t++)
+		{
+			indices.push_back(t);
+			indices.push_back(t + 1);
+			indices.push_back(t + 2);
+		}
+		MeshOptimizer::SplitMesh(vertices, indices, SHORT_INDEX_VERTICES, splitVertices, splitIndices);
+		CHECK(splitVertices.size() == 1 + extra);
+		CHECK(splitVertices.back().size() == (extra ? 3 : SHORT_INDEX_VERTICES));
+		CheckSplitPieces(vertices, indices, SHORT_INDEX_VERTICES, splitVertices, splitIndices);
+	}
+
+	// An optimised grid over the limit, the way Model splits big meshes, then random meshes at random limits
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		MakeGrid(300, 300, true, random, vertices, indices);
+		MeshOptimizer::Optimize(vertices, indices);
+		CHECK(vertices.size() > SHORT_INDEX_VERTICES);
+		for (unsigned int v = 0; v < vertices.size(); v++)
+			vertices[v].u = (float)v;
+		MeshOptimizer::SplitMesh(vertices, indices, SHORT_INDEX_VERTICES, splitVertices, splitIndices);
+		CHECK(splitVertices.size() == 2);
+		CHECK(CheckSplitPieces(vertices, indices, SHORT_INDEX_VERTICES, splitVertices, splitIndices) > 0);
+	}
+	for (int round = 0; round < 50; round++)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		MakeRandomMesh(10 + random() % 500, 1 + random() % 1000, random, vertices, indices);
+		const unsigned int maxVertices = 3 + random() % 200;
+		MeshOptimizer::SplitMesh(vertices, indices, maxVertices, splitVertices, splitIndices);
+		CheckSplitPieces(vertices, indices, maxVertices, splitVertices, splitIndices);
+	}
+}
+
+/**
+*  @brief Optimises a shuffled grid, printing the ACMR before and after each pass and the time taken.
+*/
+static void TimeGrid(unsigned int size, std::mt19937& random)
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	MakeGrid(size, size, true, random, vertices, indices);
+	const unsigned int vertexCount = (unsigned int)vertices.size();
+	const VertexCacheStats shuffled = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+
+	const auto start = std::chrono::steady_clock::now();
+	MeshOptimizer::OptimizeVertexCache(indices, vertexCount);
+	const auto cacheDone = std::chrono::steady_clock::now();
+	const VertexCacheStats cache = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+	MeshOptimizer::OptimizeOverdraw(indices, vertices);
+	const auto overdrawDone = std::chrono::steady_clock::now();
+	const VertexCacheStats overdraw = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+	MeshOptimizer::OptimizeVertexFetch(vertices, indices);
+	const auto fetchDone = std::chrono::steady_clock::now();
+	std::vector<std::vector<Vertex>> splitVertices;
+	std::vector<std::vector<unsigned int>> splitIndices;
+	MeshOptimizer::SplitMesh(vertices, indices, SHORT_INDEX_VERTICES, splitVertices, splitIndices);
+	const auto splitDone = std::chrono::steady_clock::now();
+
+	// Forsyth gets a grid well under 1 with a 16 entry cache, and cluster sorting should barely move it
+	CHECK(cache.acmr < 0.8f);
+	CHECK(overdraw.acmr < cache.acmr * 1.05f);
+
+	printf("%ux%u grid, %u triangles, ACMR with a %u entry FIFO:\n", size, size, (unsigned int)(indices.size() / 3), MeshOptimizer::ANALYSIS_CACHE_SIZE);
+	printf("  Shuffled          %.3f\n", shuffled.acmr);
+	printf("  Vertex cache      %.3f  %8.2f ms\n", cache.acmr, std::chrono::duration<double, std::milli>(cacheDone - start).count());
+	printf("  Overdraw          %.3f  %8.2f ms\n", overdraw.acmr, std::chrono::duration<double, std::milli>(overdrawDone - cacheDone).count());
+	printf("  Vertex fetch             %8.2f ms\n", std::chrono::duration<double, std::milli>(fetchDone - overdrawDone).count());
+	printf("  Split, %zu pieces         %8.2f ms\n", splitVertices.size(), std::chrono::duration<double, std::milli>(splitDone - fetchDone).count());
+}
+
+int main(int argc, char** argv)
+{
+	const int size = argc > 1 ? atoi(argv[1]) : 300;
+	if (size <= 0)
+	{
+		fprintf(stderr, "Usage: MeshOptimizerBenchmark [grid size]\n");
+		return 1;
+	}
+
+	std::mt19937 random(1234);
+	CheckCacheSimulation(random);
+	CheckPermutations(random);
+	CheckSplit(random);
+	TimeGrid((unsigned int)size, random);
+	printf("%s\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+/**
+*  @file ModelCacheBenchmark.cpp
+*  @brief Command line tool that checks a model loads the same from the model cache as from assimp, and times both.
+*
+*  First writes a small cache whose source depends on a material library, and checks editing or deleting
+*  that library makes the cache out of date as surely as editing the source. Then loads a model twice
+*  headless through a NullGraphicsDevice, the first time with the cache deleted so assimp imports it, and
+*  checks every mesh's vertices, indices, textures and bounds come back bit for bit the same from the cache.
+*  Needs assimp and the Win32 file mapping ModelCache uses, so it only builds on Windows.
+*
+*  Usage: ModelCacheBenchmark [model path]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "Model.h"
+#include "ModelCache.h"
+#include "NullGraphicsDevice.h"
+#include "TextureCache.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+static const char* DEFAULT_MODEL = "../Resources/Models/Sponza/sponza.obj";
+
+static bool WriteTextFile(const std::string& path, const char* text)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	const bool written = fwrite(text, 1, strlen(text), file) == strlen(text);
+	fclose(file);
+	return written;
+}
+
+static bool FileExists(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+	fclose(file);
+	return true;
+}
+
+static bool SameTextures(const std::vector<TextureDetail>& a, const std::vector<TextureDetail>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (a[i].mType != b[i].mType || a[i].mPath != b[i].mPath)
+			return false;
+	}
+	return true;
+}
+
+/**
+*  @brief Round trips a couple of made up meshes through a cache file, then edits the files it depends on.
+*/
+static void CheckCacheFile()
+{
+	const std::string source = "ModelCacheBenchmark.obj";
+	const std::string material = "ModelCacheBenchmark.mtl";
+	const std::string cachePath = ModelCache::GetCachePath(source);
+	const unsigned int importFlags = 0x1234;
+	CHECK(WriteTextFile(source, "mtllib ModelCacheBenchmark.mtl\n"));
+	CHECK(WriteTextFile(material, "newmtl stone\nmap_Kd stone.png\n"));
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> value(-100.0f, 100.0f);
+	std::vector<std::vector<Vertex>> vertices(2);
+	std::vector<std::vector<unsigned int>> indices(2);
+	std::vector<CachedMeshData> meshes(2);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		for (unsigned int v = 0; v < 100 + i * 50; v++)
+			vertices[i].push_back(Vertex(value(random), value(random), value(random), value(random), value(random), value(random), value(random), value(random)));
+		for (unsigned int t = 0; t < 300; t++)
+			indices[i].push_back(random() % vertices[i].size());
+		meshes[i].mpVertices = vertices[i].data();
+		meshes[i].miNumVertices = (unsigned int)vertices[i].size();
+		meshes[i].mpIndices = indices[i].data();
+		meshes[i].miNumIndices = (unsigned int)indices[i].size();
+	}
+	meshes[1].mTextures.push_back(TextureDetail(nullptr, "texture_diffuse", "stone.png"));
+	meshes[1].mTextures.push_back(TextureDetail(nullptr, "texture_normal", "stone_bump.png"));
+
+	uint64_t sourceHash = 0;
+	CHECK(ModelCache::HashFile(source, sourceHash));
+	CHECK(ModelCache::Write(cachePath, sourceHash, importFlags, std::vector<std::string>(1, material), meshes));
+
+	ModelCache cache;
+	CHECK(cache.Open(cachePath, sourceHash, importFlags));
+	CHECK(cache.NumMeshes() == meshes.size());
+	for (unsigned int i = 0; cache.IsOpen() && i < cache.NumMeshes(); i++)
+	{
+		unsigned int numVertices = 0;
+		unsigned int numIndices = 0;
+		const Vertex* cachedVertices = cache.GetVertices(i, numVertices);
+		const unsigned int* cachedIndices = cache.GetIndices(i, numIndices);
+		CHECK(numVertices == vertices[i].size() && memcmp(cachedVertices, vertices[i].data(), sizeof(Vertex) * numVertices) == 0);
+		CHECK(numIndices == indices[i].size() && memcmp(cachedIndices, indices[i].data(), sizeof(unsigned int) * numIndices) == 0);
+		CHECK(SameTextures(cache.GetTextures(i), meshes[i].mTextures));
+	}
+	CHECK(cache.GetDependencies() == std::vector<std::string>(1, material));
+	cache.Close();
+
+	CHECK(!cache.Open(cachePath, sourceHash + 1, importFlags));
+	CHECK(!cache.Open(cachePath, sourceHash, importFlags + 1));
+
+	// The source hasn't changed, only what it pulls in
+	CHECK(WriteTextFile(material, "newmtl stone\nmap_Kd marble.png\n"));
+	CHECK(!cache.Open(cachePath, sourceHash, importFlags));
+	CHECK(WriteTextFile(material, "newmtl stone\nmap_Kd stone.png\n"));
+	CHECK(cache.Open(cachePath, sourceHash, importFlags));
+	cache.Close();
+	remove(material.c_str());
+	CHECK(!cache.Open(cachePath, sourceHash, importFlags));
+
+	// A model that reads nothing else
+	CHECK(ModelCache::Write(cachePath, sourceHash, importFlags, std::vector<std::string>(), meshes));
+	CHECK(cache.Open(cachePath, sourceHash, importFlags));
+	CHECK(cache.GetDependencies().empty());
+	cache.Close();
+
+	remove(cachePath.c_str());
+	remove(source.c_str());
+}
+
+/**
+*  @brief Imports a model with assimp, loads it again from the cache that wrote, and compares the two.
+*/
+static void CheckModel(GraphicsDevice& device, const std::string& path)
+{
+	const std::string cachePath = ModelCache::GetCachePath(path);
+	remove(cachePath.c_str());
+
+	const auto start = std::chrono::steady_clock::now();
+	Model imported(&device, path, 0, true, false);
+	const auto importDone = std::chrono::steady_clock::now();
+	Model cached(&device, path, 0, true, false);
+	const auto cacheDone = std::chrono::steady_clock::now();
+
+	CHECK(imported.GetLoadState() == MODEL_LOADED && !imported.IsFromCache());
+	CHECK(cached.GetLoadState() == MODEL_LOADED && cached.IsFromCache());
+	CHECK(imported.GetNumMeshes() > 0);
+	CHECK(imported.GetNumMeshes() == cached.GetNumMeshes());
+
+	unsigned int matching = 0;
+	for (unsigned int i = 0; i < imported.GetNumMeshes() && i < cached.GetNumMeshes(); i++)
+	{
+		const Mesh& a = *imported.mMeshes[i];
+		const Mesh& b = *cached.mMeshes[i];
+		std::vector<unsigned int> indicesA, indicesB;
+		a.GetIndices(indicesA);
+		b.GetIndices(indicesB);
+
+		const bool same = a.GetVertices().size() == b.GetVertices().size() &&
+			memcmp(a.GetVertices().data(), b.GetVertices().data(), sizeof(Vertex) * a.GetVertices().size()) == 0 &&
+			indicesA == indicesB &&
+			a.GetIndexBufferSize() == b.GetIndexBufferSize() &&
+			SameTextures(a.GetTextureDetails(), b.GetTextureDetails()) &&
+			memcmp(&a.GetBoundsMin(), &b.GetBoundsMin(), sizeof(glm::vec3)) == 0 &&
+			memcmp(&a.GetBoundsMax(), &b.GetBoundsMax(), sizeof(glm::vec3)) == 0;
+		CHECK(same);
+		matching += same ? 1 : 0;
+	}
+	CHECK(imported.mTextureSets == cached.mTextureSets);
+	CHECK(imported.mTriangleOffsets == cached.mTriangleOffsets);
+
+	printf("%s: %u meshes, %u the same from the cache\n", path.c_str(), imported.GetNumMeshes(), matching);
+	printf("  Import with assimp  %8.1f ms\n", std::chrono::duration<double, std::milli>(importDone - start).count());
+	printf("  Load from cache     %8.1f ms\n", std::chrono::duration<double, std::milli>(cacheDone - importDone).count());
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = argc > 1 ? argv[1] : DEFAULT_MODEL;
+
+	CheckCacheFile();
+	if (FileExists(path))
+	{
+		// The cached textures go back to the device, so it has to outlive them
+		NullGraphicsDevice device;
+		CheckModel(device, path);
+		TextureCache::Get().EvictUnreferenced();
+		TextureCache::Get().Clear();
+	}
+	else
+	{
+		printf("Skipped comparing loads, %s doesn't exist\n", path.c_str());
+	}
+	printf("%s\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,430 @@
+/**
+*  @file OcclusionBenchmark.cpp
+*  @brief Command line tool that checks the occlusion culler never hides a visible box along camera paths, and times it.
+*
+*  Builds a small town of box shaped buildings as occluders, with props in the streets, on the roofs, poking
+*  out of walls and shut inside buildings. Then walks a camera down the streets, flies it over the roofs and
+*  slides it along a wall close enough for the wall to cross the near plane. At every frame each prop is
+*  checked by casting rays at it through a BVH of the occluders, with no rasterizing: a prop with a patch
+*  of at least a few pixels in plain sight is visible, and IsBoxVisibleReference and IsBoxVisible must
+*  both say so. IsBoxVisible must keep every box the reference keeps, and CullBoxes must agree with it,
+*  over the whole list and split into ranges. Prints how many props each test kept along each path, and
+*  the time to render the occluders and cull the props.
+*  Only uses the C++ standard library and glm, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -msse2 -I../TestApp -I../inc OcclusionBenchmark.cpp ../TestApp/OcclusionCuller.cpp ../TestApp/BVH.cpp ../TestApp/Frustum.cpp -o OcclusionBenchmark
+*
+*  Usage: OcclusionBenchmark [props]
+*
+*  @bug No known bugs.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "BVH.h"
+#include "OcclusionCuller.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+static const float FIELD_OF_VIEW = 60.0f;
+static const float NEAR_DISTANCE = 0.1f;
+static const float FAR_DISTANCE = 1000.0f;
+/// The town is BLOCKS x BLOCKS buildings, each BLOCK_SIZE across with STREET_WIDTH between them.
+static const unsigned int BLOCKS = 6;
+static const float BLOCK_SIZE = 20.0f;
+static const float STREET_WIDTH = 10.0f;
+static const float EYE_HEIGHT = 1.7f;
+/// A prop counts as visible if rays to this many pixels either side of a point on it are clear too.
+static const float VISIBLE_PIXELS = 1.5f;
+
+/**
+*  @brief The occluders as triangles, and the props to cull.
+*/
+struct Town
+{
+	std::vector<glm::vec3> mPositions;
+	std::vector<uint32_t> mIndices;
+	std::vector<glm::vec3> mPropMin;
+	std::vector<glm::vec3> mPropMax;
+	BVH mOccluderBVH;
+};
+
+static void AddBuilding(Town& town, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	const uint32_t base = (uint32_t)town.mPositions.size();
+	for (int corner = 0; corner < 8; corner++)
+		town.mPositions.push_back(glm::vec3(corner & 1 ? boundsMax.x : boundsMin.x, corner & 2 ? boundsMax.y : boundsMin.y, corner & 4 ? boundsMax.z : boundsMin.z));
+
+	// Two triangles per face, the culler doesn't mind the winding
+	const uint32_t faces[6][4] = { { 0, 2, 6, 4 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 5, 7, 6 } };
+	for (const uint32_t* face : faces)
+	{
+		const uint32_t quad[6] = { face[0], face[1], face[2], face[0], face[2], face[3] };
+		for (uint32_t index : quad)
+			town.mIndices.push_back(base + index);
+	}
+}
+
+static float BlockStart(unsigned int block)
+{
+	return block * (BLOCK_SIZE + STREET_WIDTH);
+}
+
+static void BuildTown(Town& town, unsigned int numProps, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> height(4.0f, 30.0f);
+	std::vector<float> heights;
+	for (unsigned int z = 0; z < BLOCKS; z++)
+	{
+		for (unsigned int x = 0; x < BLOCKS; x++)
+		{
+			heights.push_back(height(random));
+			AddBuilding(town, glm::vec3(BlockStart(x), 0.0f, BlockStart(z)), glm::vec3(BlockStart(x) + BLOCK_SIZE, heights.back(), BlockStart(z) + BLOCK_SIZE));
+		}
+	}
+
+	std::uniform_real_distribution<float> across(-STREET_WIDTH, BlockStart(BLOCKS));
+	std::uniform_real_distribution<float> inBlock(1.0f, BLOCK_SIZE - 1.0f);
+	std::uniform_real_distribution<float> size(0.2f, 1.5f);
+	std::uniform_int_distribution<unsigned int> block(0, BLOCKS - 1);
+	while (town.mPropMin.size() < numProps)
+	{
+		const glm::vec3 extent(size(random), size(random), size(random));
+		const unsigned int bx = block(random);
+		const unsigned int bz = block(random);
+		const float roof = heights[bz * BLOCKS + bx];
+		glm::vec3 centre;
+		switch (town.mPropMin.size() % 4)
+		{
+		case 0:
+			// Anywhere in the streets, kept out of the buildings
+			centre = glm::vec3(across(random), extent.y, across(random));
+			if (fmodf(centre.x + STREET_WIDTH, BLOCK_SIZE + STREET_WIDTH) > STREET_WIDTH - extent.x &&
+				fmodf(centre.z + STREET_WIDTH, BLOCK_SIZE + STREET_WIDTH) > STREET_WIDTH - extent.z)
+				continue;
+			break;
+		case 1:
+			// On a roof
+			centre = glm::vec3(BlockStart(bx) + inBlock(random), roof + extent.y, BlockStart(bz) + inBlock(random));
+			break;
+		case 2:
+			// Halfway out of a wall
+			centre = glm::vec3(BlockStart(bx), extent.y, BlockStart(bz) + inBlock(random));
+			break;
+		default:
+			// Inside a building, never visible from outside
+			centre = glm::vec3(BlockStart(bx) + BLOCK_SIZE * 0.5f, std::min(roof * 0.5f, 2.0f), BlockStart(bz) + BLOCK_SIZE * 0.5f);
+			break;
+		}
+		town.mPropMin.push_back(centre - extent);
+		town.mPropMax.push_back(centre + extent);
+	}
+
+	town.mOccluderBVH.BuildFromTriangles(town.mPositions, town.mIndices);
+}
+
+/**
+*  @brief A camera's position and what it looks at.
+*/
+struct CameraFrame
+{
+	glm::vec3 mEye;
+	glm::vec3 mTarget;
+};
+
+/**
+*  @brief Walks down a street, looking ahead and glancing down the side streets.
+*/
+static std::vector<CameraFrame> StreetPath()
+{
+	std::vector<CameraFrame> frames;
+	const float street = BlockStart(1) - STREET_WIDTH * 0.5f;
+	for (float x = -STREET_WIDTH; x < BlockStart(BLOCKS); x += 3.0f)
+	{
+		const float glance = sinf(x * 0.1f) * 1.2f;
+		const glm::vec3 eye(x, EYE_HEIGHT, street);
+		frames.push_back({ eye, eye + glm::vec3(cosf(glance), 0.0f, sinf(glance)) });
+	}
+	const float avenue = BlockStart(3) - STREET_WIDTH * 0.5f;
+	for (float z = BlockStart(BLOCKS); z > -STREET_WIDTH; z -= 3.0f)
+	{
+		const glm::vec3 eye(avenue, EYE_HEIGHT, z);
+		frames.push_back({ eye, eye + glm::vec3(sinf(z * 0.07f), 0.1f, -1.0f) });
+	}
+	return frames;
+}
+
+/**
+*  @brief Circles above the town, looking down at its middle.
+*/
+static std::vector<CameraFrame> FlyoverPath()
+{
+	std::vector<CameraFrame> frames;
+	const glm::vec3 middle(BlockStart(BLOCKS) * 0.5f, 0.0f, BlockStart(BLOCKS) * 0.5f);
+	for (unsigned int i = 0; i < 60; i++)
+	{
+		const float angle = i * 6.2831853f / 60.0f;
+		const float height = 15.0f + 25.0f * (i % 3);
+		frames.push_back({ middle + glm::vec3(cosf(angle) * 150.0f, height, sinf(angle) * 150.0f), middle });
+	}
+	return frames;
+}
+
+/**
+*  @brief Slides along a wall just in front of it, turning from along the wall to nearly facing it.
+*/
+static std::vector<CameraFrame> WallPath()
+{
+	std::vector<CameraFrame> frames;
+	const float wall = BlockStart(2) + BLOCK_SIZE;
+	for (unsigned int i = 0; i < 40; i++)
+	{
+		const glm::vec3 eye(wall + 0.05f + (i % 4) * 0.02f, EYE_HEIGHT, BlockStart(2) + i * 0.5f);
+		const float turn = i * 1.5f / 40.0f;
+		frames.push_back({ eye, eye + glm::vec3(-sinf(turn), 0.0f, cosf(turn)) });
+	}
+	return frames;
+}
+
+/**
+*  @brief Tells whether a ray from the eye reaches a point without hitting an occluder.
+*/
+static bool IsPointClear(const Town& town, const glm::vec3& eye, const glm::vec3& point)
+{
+	BVHRayHit hit;
+	return !town.mOccluderBVH.Raycast(eye, point - eye, 1.0f - 1e-4f, hit);
+}
+
+/**
+*  @brief Tells whether a patch of a box at least a few pixels across is in plain sight, by casting rays at points on its faces.
+*/
+static bool IsPropInSight(const Town& town, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const CameraFrame& frame,
+	const glm::mat4& viewProjection, unsigned int screenHeight)
+{
+	const glm::vec3 forward = glm::normalize(frame.mTarget - frame.mEye);
+	const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+	const glm::vec3 up = glm::cross(right, forward);
+	const float pixelsPerUnit = screenHeight / (2.0f * tanf(glm::radians(FIELD_OF_VIEW) * 0.5f));
+
+	const float steps[] = { 0.1f, 0.5f, 0.9f };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int side = 0; side < 2; side++)
+		{
+			for (float u : steps)
+			{
+				for (float v : steps)
+				{
+					glm::vec3 point;
+					point[axis] = side ? boundsMax[axis] : boundsMin[axis];
+					point[(axis + 1) % 3] = glm::mix(boundsMin[(axis + 1) % 3], boundsMax[(axis + 1) % 3], u);
+					point[(axis + 2) % 3] = glm::mix(boundsMin[(axis + 2) % 3], boundsMax[(axis + 2) % 3], v);
+
+					// Well inside the view, away from its edges and the near plane
+					const glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+					if (clip.w <= NEAR_DISTANCE * 2.0f || fabsf(clip.x) > clip.w * 0.95f || fabsf(clip.y) > clip.w * 0.95f || clip.z > clip.w)
+						continue;
+
+					const float offset = VISIBLE_PIXELS * glm::dot(point - frame.mEye, forward) / pixelsPerUnit;
+					if (IsPointClear(town, frame.mEye, point) &&
+						IsPointClear(town, frame.mEye, point + right * offset) && IsPointClear(town, frame.mEye, point - right * offset) &&
+						IsPointClear(town, frame.mEye, point + up * offset) && IsPointClear(town, frame.mEye, point - up * offset))
+					{
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/**
+*  @brief What each test kept over a path.
+*/
+struct PathStats
+{
+	unsigned int miFrames;
+	unsigned int miInFrustum;
+	unsigned int miInSight;
+	unsigned int miReference;
+	unsigned int miPyramid;
+	double mRenderUs;
+	double mCullUs;
+};
+
+/**
+*  @brief Renders the occluders at every frame of a path and checks what each test keeps.
+*/
+static PathStats CheckPath(const Town& town, OcclusionCuller& culler, const std::vector<CameraFrame>& frames)
+{
+	const unsigned int numProps = (unsigned int)town.mPropMin.size();
+	BoundingBoxesSoA boxes;
+	boxes.Resize(numProps);
+	for (unsigned int i = 0; i < numProps; i++)
+		boxes.Set(i, town.mPropMin[i], town.mPropMax[i]);
+
+	const float aspect = (float)culler.GetWidth() / culler.GetHeight();
+	const glm::mat4 projection = glm::perspective(glm::radians(FIELD_OF_VIEW), aspect, NEAR_DISTANCE, FAR_DISTANCE);
+	PathStats stats = { 0, 0, 0, 0, 0, 0.0, 0.0 };
+	std::vector<uint8_t> visible(boxes.PaddedSize()), visibleRanges(boxes.PaddedSize());
+	for (const CameraFrame& frame : frames)
+	{
+		const glm::mat4 viewProjection = projection * glm::lookAt(frame.mEye, frame.mTarget, glm::vec3(0.0f, 1.0f, 0.0f));
+		const auto start = std::chrono::steady_clock::now();
+		culler.RenderOccluders(viewProjection);
+		const auto rendered = std::chrono::steady_clock::now();
+
+		// Frustum culling first, as Model does
+		const Frustum frustum(viewProjection);
+		const unsigned int inFrustum = frustum.CullBoxes(boxes, visible.data());
+		const auto culling = std::chrono::steady_clock::now();
+		const unsigned int numVisible = culler.CullBoxes(boxes, visible.data());
+		const auto culled = std::chrono::steady_clock::now();
+		stats.mRenderUs += std::chrono::duration<double, std::micro>(rendered - start).count();
+		stats.mCullUs += std::chrono::duration<double, std::micro>(culled - culling).count();
+
+		// Split in uneven ranges, the way the jobs split it
+		frustum.CullBoxes(boxes, visibleRanges.data());
+		unsigned int numVisibleRanges = 0;
+		for (unsigned int begin = 0; begin < numProps; begin += 37)
+			numVisibleRanges += culler.CullBoxes(boxes, visibleRanges.data(), begin, std::min(numProps, begin + 37));
+		CHECK(numVisibleRanges == numVisible);
+		CHECK(std::equal(visible.begin(), visible.begin() + numProps, visibleRanges.begin()));
+
+		unsigned int inSight = 0, reference = 0, pyramid = 0;
+		bool noFalseCulls = true, referenceNoFalseCulls = true, pyramidKeepsReference = true, batchMatches = true;
+		for (unsigned int i = 0; i < numProps; i++)
+		{
+			if (!frustum.IntersectsBox(town.mPropMin[i], town.mPropMax[i]))
+				continue;
+
+			const bool isInSight = IsPropInSight(town, town.mPropMin[i], town.mPropMax[i], frame, viewProjection, culler.GetHeight());
+			const bool isReference = culler.IsBoxVisibleReference(town.mPropMin[i], town.mPropMax[i]);
+			const bool isPyramid = culler.IsBoxVisible(town.mPropMin[i], town.mPropMax[i]);
+			referenceNoFalseCulls = referenceNoFalseCulls && (!isInSight || isReference);
+			noFalseCulls = noFalseCulls && (!isInSight || isPyramid);
+			pyramidKeepsReference = pyramidKeepsReference && (!isReference || isPyramid);
+			batchMatches = batchMatches && visible[i] == (isPyramid ? 1 : 0);
+			inSight += isInSight ? 1 : 0;
+			reference += isReference ? 1 : 0;
+			pyramid += isPyramid ? 1 : 0;
+		}
+		CHECK(referenceNoFalseCulls);
+		CHECK(noFalseCulls);
+		CHECK(pyramidKeepsReference);
+		CHECK(batchMatches);
+		CHECK(pyramid == numVisible);
+
+		stats.miFrames++;
+		stats.miInFrustum += inFrustum;
+		stats.miInSight += inSight;
+		stats.miReference += reference;
+		stats.miPyramid += pyramid;
+	}
+	return stats;
+}
+
+/**
+*  @brief Checks a box behind a wall is hidden, and ones in front of it, past its edge, around the camera or touching it aren't.
+*/
+static void CheckSimpleCases()
+{
+	OcclusionCuller culler;
+	const glm::vec3 wall[4] = { glm::vec3(-2.0f, -2.0f, -5.0f), glm::vec3(2.0f, -2.0f, -5.0f), glm::vec3(2.0f, 2.0f, -5.0f), glm::vec3(-2.0f, 2.0f, -5.0f) };
+	const uint32_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+	culler.AddOccluder(wall, 4, indices, 6);
+	CHECK(culler.NumOccluderTriangles() == 2);
+
+	const float aspect = (float)culler.GetWidth() / culler.GetHeight();
+	const glm::mat4 projection = glm::perspective(glm::radians(FIELD_OF_VIEW), aspect, NEAR_DISTANCE, FAR_DISTANCE);
+	culler.RenderOccluders(projection);
+	CHECK(culler.NumTrianglesRasterized() == 2);
+
+	const glm::vec3 extent(0.5f);
+	const glm::vec3 behind(0.0f, 0.0f, -8.0f), inFront(0.0f, 0.0f, -3.0f), pastEdge(-10.0f, 0.0f, -20.0f);
+	CHECK(!culler.IsBoxVisible(behind - extent, behind + extent));
+	CHECK(!culler.IsBoxVisibleReference(behind - extent, behind + extent));
+	CHECK(culler.IsBoxVisible(inFront - extent, inFront + extent));
+	CHECK(culler.IsBoxVisible(pastEdge - extent, pastEdge + extent));
+	CHECK(culler.IsBoxVisible(glm::vec3(-1.0f), glm::vec3(1.0f)));
+	CHECK(culler.IsBoxVisible(glm::vec3(-1.0f, -1.0f, -8.0f), glm::vec3(1.0f, 1.0f, 1.0f)));
+
+	// Touching the wall, the box's front is at the wall's depth and has to be kept
+	CHECK(culler.IsBoxVisible(glm::vec3(-1.0f, -1.0f, -6.0f), glm::vec3(1.0f, 1.0f, -5.0f)));
+
+	// Reaching over the first pixel centre past the wall's right edge it's kept, stopping well short of the edge it's hidden
+	const glm::vec4 edge = projection * glm::vec4(2.0f, 0.0f, -5.0f, 1.0f);
+	const float edgePixel = (edge.x / edge.w * 0.5f + 0.5f) * culler.GetWidth();
+	const float firstClear = floorf(edgePixel - 0.5f) + 1.5f - edgePixel;
+	const float reaches[] = { -2.0f, -1.5f, firstClear + 0.05f, 1.0f, 2.0f, 3.0f };
+	for (float pixels : reaches)
+	{
+		// A box whose nearest face is at z = -8 reaches x where that depth projects to the pixel
+		const float ndc = (edgePixel + pixels) / culler.GetWidth() * 2.0f - 1.0f;
+		const glm::vec3 boundsMin(0.0f, -0.5f, -8.5f), boundsMax(ndc * 8.0f / projection[0][0], 0.5f, -8.0f);
+		if (pixels > 0.0f)
+		{
+			CHECK(culler.IsBoxVisibleReference(boundsMin, boundsMax) && culler.IsBoxVisible(boundsMin, boundsMax));
+		}
+		else
+		{
+			CHECK(!culler.IsBoxVisibleReference(boundsMin, boundsMax));
+		}
+	}
+
+	// Off screen is hidden, frustum culling would have dropped it anyway
+	CHECK(!culler.IsBoxVisible(glm::vec3(-100.0f, -1.0f, -11.0f), glm::vec3(-99.0f, 1.0f, -10.0f)));
+
+	// Moved away, nothing occludes and nothing is hidden
+	culler.ClearOccluders();
+	culler.RenderOccluders(projection);
+	CHECK(culler.IsBoxVisible(behind - extent, behind + extent));
+}
+
+int main(int argc, char** argv)
+{
+	const int numProps = argc > 1 ? atoi(argv[1]) : 400;
+	if (numProps <= 0)
+	{
+		fprintf(stderr, "Usage: OcclusionBenchmark [props]\n");
+		return 1;
+	}
+
+	CheckSimpleCases();
+
+	std::mt19937 random(1234);
+	Town town;
+	BuildTown(town, (unsigned int)numProps, random);
+	OcclusionCuller culler;
+	culler.AddOccluder(town.mPositions.data(), (unsigned int)town.mPositions.size(), town.mIndices.data(), (unsigned int)town.mIndices.size());
+
+	const struct
+	{
+		const char* mName;
+		std::vector<CameraFrame> mFrames;
+	} paths[] = { { "Street", StreetPath() }, { "Flyover", FlyoverPath() }, { "Wall", WallPath() } };
+
+	std::vector<PathStats> results;
+	for (const auto& path : paths)
+		results.push_back(CheckPath(town, culler, path.mFrames));
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	printf("%u props, %u occluder triangles, %ux%u depth buffer, props kept per frame:\n", numProps, culler.NumOccluderTriangles(), culler.GetWidth(), culler.GetHeight());
+	printf("  %-8s %7s %8s %9s %10s %8s %11s %9s\n", "path", "frames", "frustum", "in sight", "reference", "pyramid", "render", "cull");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const PathStats& stats = results[i];
+		const double frames = stats.miFrames;
+		printf("  %-8s %7u %8.1f %9.1f %10.1f %8.1f %8.1f us %6.1f us\n", paths[i].mName, stats.miFrames, stats.miInFrustum / frames,
+			stats.miInSight / frames, stats.miReference / frames, stats.miPyramid / frames, stats.mRenderUs / frames, stats.mCullUs / frames);
+	}
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,309 @@
+/**
+*  @file PipelineBenchmark.cpp
+*  @brief Command line tool that checks the FramePipeline hands every frame over intact, and times it against a serial loop.
+*
+*  A small deterministic scene is updated at a fixed timestep, culled into a visible list and drawn through a
+*  NullGraphicsDevice, the same way TestAppGame hands its FrameState over. Every frame drawn is hashed, and
+*  the hashes have to match between the serial loop, a double and a triple buffered pipeline, and a run that
+*  switches the render thread on and off as it goes. Then times the loops with some made up update and render work.
+*  Only uses the C++ standard library, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -pthread -I../TestApp PipelineBenchmark.cpp ../TestApp/FramePipeline.cpp ../TestApp/NullGraphicsDevice.cpp ../TestApp/Profiler.cpp ../TestApp/LogQueue.cpp ../TestApp/BinaryLog.cpp -o PipelineBenchmark
+*
+*  Usage: PipelineBenchmark [frames] [update us] [render us]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "FramePipeline.h"
+#include "NullGraphicsDevice.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+static const unsigned int NUM_OBJECTS = 2000;
+static const float TIMESTEP = 1.0f / 60.0f;
+static const float VIEW_DISTANCE = 20.0f;
+
+/**
+*  @brief Stands in for TestAppGame's PerFrameBuffer.
+*/
+struct PerFrame
+{
+	float mCameraPosition[4];
+	float mTime;
+	uint32_t miFrame;
+	float mPadding[2];
+};
+
+/**
+*  @brief Stands in for TestAppGame's FrameState, written by the update and read by the render.
+*/
+struct FrameState
+{
+	PerFrame mPerFrame;
+	/// The objects that passed culling.
+	std::vector<uint32_t> mVisible;
+
+	/// Set while each side has the slot, to catch them both having it at once.
+	std::atomic<bool> mbWriting;
+	std::atomic<bool> mbDrawing;
+};
+
+/**
+*  @brief Some arithmetic that takes about the given time, standing in for the rest of an update or a render.
+*/
+static void BusyWork(unsigned int microseconds)
+{
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+	volatile float sink = 0.0f;
+	while (std::chrono::steady_clock::now() < end)
+	{
+		for (int i = 0; i < 64; i++)
+			sink = sink + sqrtf((float)i);
+	}
+}
+
+/**
+*  @brief A scene of drifting objects and a camera flying around them, updated into the pipeline's slots and drawn from them.
+*/
+class Scene
+{
+public:
+	Scene(unsigned int slots, unsigned int updateMicroseconds, unsigned int renderMicroseconds) :
+		mPipeline([this](float deltaTime) { Render(deltaTime); }, slots),
+		mbOutOfOrder(false),
+		mbOverlapped(false),
+		miUpdateMicroseconds(updateMicroseconds),
+		miRenderMicroseconds(renderMicroseconds),
+		miRendered(0),
+		mTime(0.0f)
+	{
+		// The same scene every time
+		uint32_t random = 12345;
+		for (unsigned int i = 0; i < NUM_OBJECTS; i++)
+		{
+			float values[4];
+			for (float& value : values)
+			{
+				random = random * 1664525u + 1013904223u;
+				value = (float)(random >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+			}
+			mPositionX.push_back(values[0] * 50.0f);
+			mPositionZ.push_back(values[1] * 50.0f);
+			mVelocityX.push_back(values[2]);
+			mVelocityZ.push_back(values[3]);
+		}
+		for (FrameState& frame : mFrames)
+		{
+			frame.mbWriting.store(false);
+			frame.mbDrawing.store(false);
+		}
+
+		BufferDesc desc;
+		desc.miSize = sizeof(PerFrame);
+		desc.meType = BUFFER_CONSTANT;
+		desc.meUsage = USAGE_DYNAMIC;
+		mpPerFrameBuffer = mDevice.CreateBuffer(desc, nullptr);
+		desc.miSize = 36 * 12;
+		desc.meType = BUFFER_VERTEX;
+		desc.meUsage = USAGE_IMMUTABLE;
+		std::vector<float> cube(36 * 3, 0.0f);
+		mpVertexBuffer = mDevice.CreateBuffer(desc, cube.data());
+		mpVertexShader = mDevice.CreateVertexShader("vs", 2);
+		mpPixelShader = mDevice.CreatePixelShader("ps", 2);
+		const VertexElement position = { "POSITION", VERTEX_FORMAT_FLOAT3, 0 };
+		mpLayout = mDevice.CreateInputLayout(&position, 1, "vs", 2);
+	}
+
+	~Scene()
+	{
+		mPipeline.SetThreaded(false);
+		mDevice.ReleaseBuffer(mpPerFrameBuffer);
+		mDevice.ReleaseBuffer(mpVertexBuffer);
+		mDevice.ReleaseVertexShader(mpVertexShader);
+		mDevice.ReleasePixelShader(mpPixelShader);
+		mDevice.ReleaseInputLayout(mpLayout);
+	}
+
+	/**
+	*  @brief Runs frames the way Game::Run does, switching the render thread on and off every switchEvery frames if it isn't 0.
+	*/
+	void Run(unsigned int frames, bool threaded, unsigned int switchEvery)
+	{
+		mPipeline.SetThreaded(threaded);
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			if (switchEvery > 0 && frame % switchEvery == switchEvery - 1)
+				mPipeline.SetThreaded(!mPipeline.IsThreaded());
+
+			mPipeline.BeginUpdate();
+			Update(TIMESTEP);
+			mPipeline.EndUpdate(TIMESTEP);
+		}
+		mPipeline.Flush();
+	}
+
+	FramePipeline mPipeline;
+	NullGraphicsDevice mDevice;
+	/// A hash of everything each frame drew, in the order they were drawn.
+	std::vector<uint64_t> mFrameHashes;
+	std::atomic<bool> mbOutOfOrder;
+	std::atomic<bool> mbOverlapped;
+
+private:
+	void Update(float deltaTime)
+	{
+		FrameState& frame = mFrames[mPipeline.GetUpdateSlot()];
+		if (frame.mbDrawing.load() || frame.mbWriting.exchange(true))
+			mbOverlapped = true;
+
+		mTime += deltaTime;
+		for (unsigned int i = 0; i < NUM_OBJECTS; i++)
+		{
+			mPositionX[i] += mVelocityX[i] * deltaTime;
+			mPositionZ[i] += mVelocityZ[i] * deltaTime;
+		}
+		const float cameraX = cosf(mTime * 0.5f) * 30.0f;
+		const float cameraZ = sinf(mTime * 0.5f) * 30.0f;
+
+		frame.mPerFrame.mCameraPosition[0] = cameraX;
+		frame.mPerFrame.mCameraPosition[1] = 2.0f;
+		frame.mPerFrame.mCameraPosition[2] = cameraZ;
+		frame.mPerFrame.mCameraPosition[3] = 1.0f;
+		frame.mPerFrame.mTime = mTime;
+		frame.mPerFrame.miFrame = (uint32_t)mPipeline.GetFramesUpdated();
+		frame.mPerFrame.mPadding[0] = frame.mPerFrame.mPadding[1] = 0.0f;
+
+		frame.mVisible.clear();
+		for (unsigned int i = 0; i < NUM_OBJECTS; i++)
+		{
+			const float x = mPositionX[i] - cameraX;
+			const float z = mPositionZ[i] - cameraZ;
+			if (x * x + z * z < VIEW_DISTANCE * VIEW_DISTANCE)
+				frame.mVisible.push_back(i);
+		}
+		BusyWork(miUpdateMicroseconds);
+
+		frame.mbWriting.store(false);
+	}
+
+	void Render(float /*deltaTime*/)
+	{
+		FrameState& frame = mFrames[mPipeline.GetRenderSlot()];
+		if (frame.mbWriting.load() || frame.mbDrawing.exchange(true))
+			mbOverlapped = true;
+		if (frame.mPerFrame.miFrame != miRendered)
+			mbOutOfOrder = true;
+
+		mDevice.ClearScreen();
+		mDevice.UpdateBuffer(mpPerFrameBuffer, 0, &frame.mPerFrame, sizeof(PerFrame));
+		mDevice.SetVSConstantBuffer(1, mpPerFrameBuffer);
+		mDevice.SetVertexShader(mpVertexShader);
+		mDevice.SetPixelShader(mpPixelShader);
+		mDevice.SetInputLayout(mpLayout);
+		mDevice.SetPrimitiveTopology(TOPOLOGY_TRIANGLE_LIST);
+		mDevice.SetVertexBuffer(mpVertexBuffer, 12);
+
+		// FNV-1a over what was uploaded and drawn
+		uint64_t hash = 14695981039346656037ull;
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&frame.mPerFrame);
+		for (size_t i = 0; i < sizeof(PerFrame); i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		for (uint32_t object : frame.mVisible)
+		{
+			mDevice.Draw(36, 0);
+			hash = (hash ^ object) * 1099511628211ull;
+		}
+		BusyWork(miRenderMicroseconds);
+		mDevice.SwapBuffers();
+
+		mFrameHashes.push_back(hash);
+		miRendered++;
+		frame.mbDrawing.store(false);
+	}
+
+	FrameState mFrames[FramePipeline::MAX_SLOTS];
+	unsigned int miUpdateMicroseconds;
+	unsigned int miRenderMicroseconds;
+	uint32_t miRendered;
+
+	std::vector<float> mPositionX, mPositionZ;
+	std::vector<float> mVelocityX, mVelocityZ;
+	float mTime;
+
+	GraphicsBuffer* mpPerFrameBuffer;
+	GraphicsBuffer* mpVertexBuffer;
+	GraphicsVertexShader* mpVertexShader;
+	GraphicsPixelShader* mpPixelShader;
+	GraphicsInputLayout* mpLayout;
+};
+
+/**
+*  @brief Runs the scene and checks every frame was drawn once, in order, alone, and as the serial loop drew it.
+*/
+static void CheckRun(const char* name, unsigned int frames, unsigned int slots, bool threaded, unsigned int switchEvery, std::vector<uint64_t>& expected)
+{
+	Scene scene(slots, 0, 0);
+	scene.Run(frames, threaded, switchEvery);
+
+	const NullGraphicsStats& stats = scene.mDevice.GetStats();
+	CHECK(scene.mPipeline.GetFramesRendered() == frames);
+	CHECK(stats.miFrames == frames);
+	CHECK(stats.miInvalidDraws == 0);
+	CHECK(!scene.mbOutOfOrder);
+	CHECK(!scene.mbOverlapped);
+	CHECK(scene.mFrameHashes.size() == frames);
+
+	if (expected.empty())
+		expected = scene.mFrameHashes;
+	unsigned int different = 0;
+	for (size_t i = 0; i < expected.size() && i < scene.mFrameHashes.size(); i++)
+		different += expected[i] != scene.mFrameHashes[i];
+	CHECK(different == 0);
+
+	printf("%-28s %u frames, %u draws, %u frames differ from serial\n", name, frames, stats.miDraws, different);
+}
+
+static void TimeRun(const char* name, unsigned int frames, unsigned int slots, bool threaded, unsigned int updateMicroseconds, unsigned int renderMicroseconds)
+{
+	Scene scene(slots, updateMicroseconds, renderMicroseconds);
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	scene.Run(frames, threaded, 0);
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("%-28s %7.3f ms/frame  update waited %7.1f ms, render waited %7.1f ms\n", name, ms / frames,
+		scene.mPipeline.GetUpdateWaitMs(), scene.mPipeline.GetRenderWaitMs());
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int frames = argc > 1 ? (unsigned int)atoi(argv[1]) : 600;
+	const unsigned int updateMicroseconds = argc > 2 ? (unsigned int)atoi(argv[2]) : 2000;
+	const unsigned int renderMicroseconds = argc > 3 ? (unsigned int)atoi(argv[3]) : 2000;
+	if (frames == 0)
+	{
+		fprintf(stderr, "Usage: PipelineBenchmark [frames] [update us] [render us]\n");
+		return 1;
+	}
+
+	std::vector<uint64_t> expected;
+	CheckRun("Serial", frames, 3, false, 0, expected);
+	CheckRun("Render thread, 2 slots", frames, 2, true, 0, expected);
+	CheckRun("Render thread, 3 slots", frames, 3, true, 0, expected);
+	CheckRun("Switching every 37 frames", frames, 3, false, 37, expected);
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	printf("%u us of update and %u us of render work a frame\n", updateMicroseconds, renderMicroseconds);
+	const unsigned int timedFrames = frames < 200 ? frames : 200;
+	TimeRun("Serial", timedFrames, 3, false, updateMicroseconds, renderMicroseconds);
+	TimeRun("Render thread, 2 slots", timedFrames, 2, true, updateMicroseconds, renderMicroseconds);
+	TimeRun("Render thread, 3 slots", timedFrames, 3, true, updateMicroseconds, renderMicroseconds);
+
+	return gFailures == 0 ? 0 : 1;
+}
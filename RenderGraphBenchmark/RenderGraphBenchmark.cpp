@@ -0,0 +1,522 @@
+/**
+*  @file RenderGraphBenchmark.cpp
+*  @brief Command line tool that checks what the RenderGraph compiles to, and times compiling it.
+*
+*  Builds TestAppGame's frame with and without PostFx, a longer frame with a bloom chain, and random
+*  graphs, then runs them through a NullGraphicsDevice that checks no texture is bound as an input
+*  and a render target at once. Each pass marks the textures it renders as holding its outputs and
+*  checks its inputs still hold what was written to them, so a target sharing a texture with one
+*  still in use is caught. Prints the render target memory with and without sharing.
+*  Only uses the C++ standard library, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -pthread -I../TestApp RenderGraphBenchmark.cpp ../TestApp/RenderGraph.cpp ../TestApp/NullGraphicsDevice.cpp ../TestApp/LogQueue.cpp ../TestApp/BinaryLog.cpp -o RenderGraphBenchmark
+*
+*  Usage: RenderGraphBenchmark [random graphs] [width] [height]
+*
+*  @bug No known bugs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+#include "RenderGraph.h"
+#include "NullGraphicsDevice.h"
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/// TestAppGame's G-buffer used to be five of these, created once at full resolution.
+static const unsigned int OLD_RENDER_TARGETS = 5;
+
+/**
+*  @brief A NullGraphicsDevice that catches a texture bound as an input and a render target at once.
+*
+*  D3D11 quietly unbinds one of them when that happens, so the pass would read black or draw nowhere.
+*/
+class CheckingDevice : public NullGraphicsDevice
+{
+public:
+	CheckingDevice() : miHazards(0) {}
+
+	virtual void SetPSTexture(unsigned int slot, GraphicsTexture* texture)
+	{
+		NullGraphicsDevice::SetPSTexture(slot, texture);
+		if (texture)
+		{
+			for (size_t i = 0; i < mTargets.size(); i++)
+			{
+				if (mTargets[i] == texture)
+					miHazards++;
+			}
+			mInputs[slot] = texture;
+		}
+		else
+		{
+			mInputs.erase(slot);
+		}
+	}
+
+	virtual void SetRenderTargets(GraphicsTexture* const* targets, unsigned int numTargets, GraphicsTexture* depth)
+	{
+		NullGraphicsDevice::SetRenderTargets(targets, numTargets, depth);
+		mTargets.assign(targets, targets + numTargets);
+		if (depth)
+			mTargets.push_back(depth);
+		for (size_t i = 0; i < mTargets.size(); i++)
+		{
+			for (std::map<unsigned int, GraphicsTexture*>::const_iterator it = mInputs.begin(); it != mInputs.end(); ++it)
+			{
+				if (it->second == mTargets[i])
+					miHazards++;
+			}
+		}
+	}
+
+	unsigned int NumInputsBound() const { return (unsigned int)mInputs.size(); }
+
+	unsigned int miHazards;
+
+private:
+	std::map<unsigned int, GraphicsTexture*> mInputs;
+	std::vector<GraphicsTexture*> mTargets;
+};
+
+/**
+*  @brief Stands in for drawing: records which resource each texture now holds, and checks the inputs weren't overwritten.
+*/
+class ContentsChecker
+{
+public:
+	void Pass(RenderGraph& graph, const std::vector<RenderGraphResource>& inputs, const std::vector<RenderGraphResource>& outputs)
+	{
+		for (size_t i = 0; i < inputs.size(); i++)
+		{
+			GraphicsTexture* texture = graph.GetTexture(inputs[i]);
+			CHECK(texture != nullptr);
+			CHECK(mContents.count(texture) && mContents[texture] == inputs[i]);
+		}
+		for (size_t i = 0; i < outputs.size(); i++)
+		{
+			GraphicsTexture* texture = graph.GetTexture(outputs[i]);
+			CHECK(texture != nullptr);
+			mContents[texture] = outputs[i];
+		}
+	}
+
+	void Clear() { mContents.clear(); }
+
+private:
+	std::map<GraphicsTexture*, RenderGraphResource> mContents;
+};
+
+/**
+*  @brief Declares TestAppGame's frame: the G-buffer, PostFx if it's on, and the copy to the back buffer.
+*
+*  @param declareBackwards Declare the passes last to first, the graph has to order them itself.
+*/
+static void DeclareTestAppFrame(RenderGraph& graph, ContentsChecker& contents, CheckingDevice& device, unsigned int width, unsigned int height, bool postFx, bool declareBackwards)
+{
+	const RenderGraphTargetDesc desc(width, height, TEXTURE_FORMAT_RGBA16_FLOAT);
+	const RenderGraphResource backBuffer = graph.Import("Back buffer", device.GetBackBufferTexture());
+	const RenderGraphResource depth = graph.Import("Depth", device.GetDepthTexture());
+	const RenderGraphResource position = graph.CreateTarget("Position", desc);
+	const RenderGraphResource normal = graph.CreateTarget("Normal", desc);
+	const RenderGraphResource diffuse = graph.CreateTarget("Diffuse", desc);
+	const RenderGraphResource postFxTarget = graph.CreateTarget("PostFx", desc);
+	const RenderGraphResource colour = graph.CreateTarget("Colour", desc);
+	const RenderGraphResource final = postFx ? postFxTarget : diffuse;
+	(void)colour;
+
+	for (int step = 0; step < 3; step++)
+	{
+		const int which = declareBackwards ? 2 - step : step;
+		if (which == 0)
+		{
+			const unsigned int pass = graph.AddPass("G-buffer", [&graph, &contents, position, normal, diffuse](GraphicsDevice*)
+			{
+				contents.Pass(graph, std::vector<RenderGraphResource>(), { position, normal, diffuse });
+			});
+			graph.Write(pass, position);
+			graph.Write(pass, normal);
+			graph.Write(pass, diffuse);
+			graph.WriteDepth(pass, depth);
+		}
+		else if (which == 1)
+		{
+			const unsigned int pass = graph.AddPass("PostFx", [&graph, &contents, position, normal, diffuse, postFxTarget](GraphicsDevice*)
+			{
+				contents.Pass(graph, { diffuse, position, normal }, { postFxTarget });
+			});
+			graph.Read(pass, diffuse, 0);
+			graph.Read(pass, position, 1);
+			graph.Read(pass, normal, 2);
+			graph.Read(pass, depth, 3);
+			graph.Write(pass, postFxTarget);
+		}
+		else
+		{
+			const unsigned int pass = graph.AddPass("Copy to back buffer", [&graph, &contents, final](GraphicsDevice*)
+			{
+				contents.Pass(graph, { final }, std::vector<RenderGraphResource>());
+			});
+			graph.Read(pass, final, 0);
+			graph.Write(pass, backBuffer);
+		}
+	}
+}
+
+static std::vector<std::string> PassNames(const RenderGraph& graph)
+{
+	std::vector<std::string> names;
+	for (size_t i = 0; i < graph.GetOrder().size(); i++)
+		names.push_back(graph.GetPassName(graph.GetOrder()[i]));
+	return names;
+}
+
+static void PrintMemory(const char* name, const RenderGraphStats& stats)
+{
+	printf("%-28s %u passes, %u culled, %u targets in %u textures, %7.1f MB unshared, %7.1f MB shared, %7.1f MB peak live, %u unbinds\n",
+		name, stats.miPasses, stats.miCulledPasses, stats.miTransients, stats.miTextures,
+		stats.miTransientBytes / (1024.0 * 1024.0), stats.miAliasedBytes / (1024.0 * 1024.0), stats.miPeakLiveBytes / (1024.0 * 1024.0), stats.miUnbinds);
+}
+
+static void CheckTestAppFrame(unsigned int width, unsigned int height)
+{
+	const size_t targetBytes = TextureSizeInBytes(TEXTURE_FORMAT_RGBA16_FLOAT, width, height, 1);
+	printf("%-28s %u targets, %7.1f MB\n", "Fixed render targets", OLD_RENDER_TARGETS, OLD_RENDER_TARGETS * targetBytes / (1024.0 * 1024.0));
+
+	for (int backwards = 0; backwards < 2; backwards++)
+	{
+		for (int postFx = 1; postFx >= 0; postFx--)
+		{
+			CheckingDevice device;
+			RenderGraph graph;
+			ContentsChecker contents;
+			DeclareTestAppFrame(graph, contents, device, width, height, postFx != 0, backwards != 0);
+			CHECK(graph.Compile());
+
+			const std::vector<std::string> names = PassNames(graph);
+			if (postFx)
+			{
+				CHECK(names.size() == 3 && names[0] == "G-buffer" && names[1] == "PostFx" && names[2] == "Copy to back buffer");
+				CHECK(graph.GetStats().miCulledPasses == 0);
+				CHECK(graph.GetStats().miTransients == 4);
+			}
+			else
+			{
+				CHECK(names.size() == 2 && names[0] == "G-buffer" && names[1] == "Copy to back buffer");
+				CHECK(graph.GetStats().miCulledPasses == 1);
+				CHECK(graph.GetStats().miTransients == 3);
+			}
+			// Every target is read while the others are live, so none can share
+			CHECK(graph.GetStats().miAliasedBytes == graph.GetStats().miTransients * targetBytes);
+
+			graph.Execute(&device);
+			CHECK(device.miHazards == 0);
+			CHECK(device.NumInputsBound() == 0);
+			CHECK(device.GetStats().miClears == graph.GetStats().miTransients);
+			graph.ReleaseTextures(&device);
+			CHECK(device.GetStats().miLiveTextures == 0);
+
+			if (!backwards)
+				PrintMemory(postFx ? "TestApp with PostFx" : "TestApp without PostFx", graph.GetStats());
+		}
+	}
+}
+
+/**
+*  @brief A deferred frame with a bloom chain at half resolution, where most targets have short lives.
+*/
+static void CheckBloomFrame(unsigned int width, unsigned int height)
+{
+	const RenderGraphTargetDesc full(width, height, TEXTURE_FORMAT_RGBA16_FLOAT);
+	const RenderGraphTargetDesc half(width / 2, height / 2, TEXTURE_FORMAT_RGBA16_FLOAT);
+	const RenderGraphTargetDesc ldr(width, height, TEXTURE_FORMAT_RGBA8);
+
+	size_t unshared[2] = { 0, 0 };
+	size_t shared[2] = { 0, 0 };
+	for (int aliasing = 0; aliasing < 2; aliasing++)
+	{
+		CheckingDevice device;
+		RenderGraph graph;
+		ContentsChecker contents;
+		graph.SetAliasing(aliasing != 0);
+
+		const RenderGraphResource backBuffer = graph.Import("Back buffer", device.GetBackBufferTexture());
+		const RenderGraphResource position = graph.CreateTarget("Position", full);
+		const RenderGraphResource normal = graph.CreateTarget("Normal", full);
+		const RenderGraphResource diffuse = graph.CreateTarget("Diffuse", full);
+		const RenderGraphResource hdr = graph.CreateTarget("Lit", full);
+		const RenderGraphResource bright = graph.CreateTarget("Bright", half);
+		const RenderGraphResource blurX = graph.CreateTarget("Blur X", half);
+		const RenderGraphResource blurY = graph.CreateTarget("Blur Y", half);
+		const RenderGraphResource combined = graph.CreateTarget("Combined", full);
+		const RenderGraphResource toneMapped = graph.CreateTarget("Tone mapped", ldr);
+		const RenderGraphResource unused = graph.CreateTarget("Debug view", full);
+
+		struct Step { const char* mpName; std::vector<RenderGraphResource> mInputs; std::vector<RenderGraphResource> mOutputs; };
+		const Step steps[] =
+		{
+			{ "G-buffer", {}, { position, normal, diffuse } },
+			{ "Lighting", { position, normal, diffuse }, { hdr } },
+			{ "Bright pass", { hdr }, { bright } },
+			{ "Blur X", { bright }, { blurX } },
+			{ "Blur Y", { blurX }, { blurY } },
+			{ "Combine", { hdr, blurY }, { combined } },
+			{ "Tone map", { combined }, { toneMapped } },
+			{ "Debug view", { normal }, { unused } },
+			{ "Copy to back buffer", { toneMapped }, { backBuffer } },
+		};
+		for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++)
+		{
+			const Step& step = steps[s];
+			const unsigned int pass = graph.AddPass(step.mpName, [&graph, &contents, &step, backBuffer](GraphicsDevice*)
+			{
+				std::vector<RenderGraphResource> outputs;
+				for (size_t i = 0; i < step.mOutputs.size(); i++)
+				{
+					if (step.mOutputs[i] != backBuffer)
+						outputs.push_back(step.mOutputs[i]);
+				}
+				contents.Pass(graph, step.mInputs, outputs);
+			});
+			for (size_t i = 0; i < step.mInputs.size(); i++)
+				graph.Read(pass, step.mInputs[i], (unsigned int)i);
+			for (size_t i = 0; i < step.mOutputs.size(); i++)
+				graph.Write(pass, step.mOutputs[i]);
+		}
+
+		CHECK(graph.Compile());
+		CHECK(graph.GetStats().miCulledPasses == 1);
+		CHECK(graph.IsCulled(7));
+		const RenderGraphStats& stats = graph.GetStats();
+		CHECK(stats.miTransients == 9);
+		CHECK(stats.miAliasedBytes >= stats.miPeakLiveBytes);
+		CHECK(stats.miAliasedBytes <= stats.miTransientBytes);
+		if (aliasing)
+		{
+			CHECK(stats.miAliasedBytes < stats.miTransientBytes);
+			// Bright's life ends as Blur Y's starts
+			CHECK(graph.GetTextureIndex(blurY) == graph.GetTextureIndex(bright));
+		}
+		else
+		{
+			CHECK(stats.miTextures == stats.miTransients);
+		}
+
+		// Nothing is created after the first frame
+		for (int frame = 0; frame < 3; frame++)
+		{
+			contents.Clear();
+			graph.Execute(&device);
+			CHECK(device.miHazards == 0);
+			CHECK(device.NumInputsBound() == 0);
+			CHECK(device.GetStats().miLiveTextures == stats.miTextures);
+		}
+		graph.ReleaseTextures(&device);
+		CHECK(device.GetStats().miLiveTextures == 0);
+
+		unshared[aliasing] = stats.miTransientBytes;
+		shared[aliasing] = stats.miAliasedBytes;
+		PrintMemory(aliasing ? "Bloom frame, shared" : "Bloom frame, not shared", stats);
+	}
+	CHECK(unshared[0] == unshared[1] && shared[0] == unshared[0] && shared[1] < shared[0]);
+}
+
+/**
+*  @brief Textures left unused for a while are released, and nothing new is made while a graph stays the same.
+*/
+static void CheckTextureReuse(unsigned int width, unsigned int height)
+{
+	CheckingDevice device;
+	RenderGraph graph;
+	ContentsChecker contents;
+
+	DeclareTestAppFrame(graph, contents, device, width, height, true, false);
+	CHECK(graph.Compile());
+	graph.Execute(&device);
+	CHECK(device.GetStats().miLiveTextures == 4);
+
+	// PostFx's texture is kept for a while in case it's turned back on
+	for (unsigned int frame = 0; frame <= RenderGraph::UNUSED_FRAMES_BEFORE_RELEASE; frame++)
+	{
+		if (frame == 1)
+		{
+			CHECK(device.GetStats().miLiveTextures == 4);
+		}
+		graph.Reset();
+		contents.Clear();
+		DeclareTestAppFrame(graph, contents, device, width, height, false, false);
+		CHECK(graph.Compile());
+		graph.Execute(&device);
+	}
+	CHECK(device.GetStats().miLiveTextures == 3);
+
+	// A new size needs new textures, the old ones go once they've been unused for long enough
+	for (unsigned int frame = 0; frame <= RenderGraph::UNUSED_FRAMES_BEFORE_RELEASE; frame++)
+	{
+		graph.Reset();
+		contents.Clear();
+		DeclareTestAppFrame(graph, contents, device, width / 2, height / 2, false, false);
+		CHECK(graph.Compile());
+		graph.Execute(&device);
+		CHECK(device.miHazards == 0);
+	}
+	CHECK(device.GetStats().miLiveTextures == 3);
+	graph.ReleaseTextures(&device);
+	CHECK(device.GetStats().miLiveTextures == 0);
+}
+
+static void CheckCycle()
+{
+	CheckingDevice device;
+	RenderGraph graph;
+	const RenderGraphResource backBuffer = graph.Import("Back buffer", device.GetBackBufferTexture());
+	const RenderGraphResource target = graph.CreateTarget("Target", RenderGraphTargetDesc(64, 64, TEXTURE_FORMAT_RGBA8));
+	const unsigned int pass = graph.AddPass("Reads what it writes", RenderGraph::ExecuteFunction());
+	graph.Read(pass, target, 0);
+	graph.Write(pass, target);
+	graph.Write(pass, backBuffer);
+	CHECK(!graph.Compile());
+
+	// Execute does nothing after a failed compile
+	graph.Execute(&device);
+	CHECK(device.GetStats().miLiveTextures == 0);
+}
+
+/**
+*  @brief Random graphs, each pass reading some of the targets written before it, at a few sizes and formats.
+*
+*  @return The microseconds a compile took on average.
+*/
+static double CheckRandomGraphs(unsigned int numGraphs)
+{
+	std::mt19937 random(12345);
+	const RenderGraphTargetDesc descs[] =
+	{
+		RenderGraphTargetDesc(256, 256, TEXTURE_FORMAT_RGBA16_FLOAT),
+		RenderGraphTargetDesc(256, 256, TEXTURE_FORMAT_RGBA8),
+		RenderGraphTargetDesc(128, 128, TEXTURE_FORMAT_RGBA16_FLOAT),
+	};
+
+	double compileMicroseconds = 0.0;
+	unsigned int numCompiles = 0;
+	for (unsigned int g = 0; g < numGraphs; g++)
+	{
+		const unsigned int numPasses = 2 + random() % 40;
+		for (int aliasing = 0; aliasing < 2; aliasing++)
+		{
+			std::mt19937 shape(g);
+			CheckingDevice device;
+			RenderGraph graph;
+			ContentsChecker contents;
+			graph.SetAliasing(aliasing != 0);
+			const RenderGraphResource backBuffer = graph.Import("Back buffer", device.GetBackBufferTexture());
+
+			std::vector<RenderGraphResource> written;
+			std::vector<std::vector<RenderGraphResource>> inputs(numPasses), outputs(numPasses);
+			for (unsigned int p = 0; p < numPasses; p++)
+			{
+				const unsigned int numInputs = written.empty() ? 0 : shape() % 4;
+				for (unsigned int i = 0; i < numInputs; i++)
+				{
+					const RenderGraphResource input = written[written.size() - 1 - shape() % std::min<size_t>(written.size(), 6)];
+					if (std::find(inputs[p].begin(), inputs[p].end(), input) == inputs[p].end())
+						inputs[p].push_back(input);
+				}
+				const unsigned int numOutputs = 1 + shape() % 3;
+				for (unsigned int o = 0; o < numOutputs; o++)
+				{
+					outputs[p].push_back(graph.CreateTarget("Target", descs[shape() % 3]));
+					written.push_back(outputs[p].back());
+				}
+
+				const std::vector<RenderGraphResource>& in = inputs[p];
+				const std::vector<RenderGraphResource>& out = outputs[p];
+				const unsigned int pass = graph.AddPass("Pass", [&graph, &contents, &in, &out](GraphicsDevice*)
+				{
+					contents.Pass(graph, in, out);
+				});
+				for (size_t i = 0; i < in.size(); i++)
+					graph.Read(pass, in[i], (unsigned int)i);
+				for (size_t o = 0; o < out.size(); o++)
+					graph.Write(pass, out[o]);
+				// Some passes are the frame's output, the rest may be culled
+				if (p + 1 == numPasses || shape() % 5 == 0)
+					graph.Write(pass, backBuffer);
+			}
+
+			const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			const bool compiled = graph.Compile();
+			compileMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+			numCompiles++;
+			CHECK(compiled);
+
+			const RenderGraphStats& stats = graph.GetStats();
+			CHECK(stats.miAliasedBytes >= stats.miPeakLiveBytes);
+			CHECK(stats.miAliasedBytes <= stats.miTransientBytes);
+			CHECK(stats.miPasses - stats.miCulledPasses == graph.GetOrder().size());
+			if (!aliasing)
+			{
+				CHECK(stats.miAliasedBytes == stats.miTransientBytes);
+			}
+
+			graph.Execute(&device);
+			CHECK(device.miHazards == 0);
+			CHECK(device.NumInputsBound() == 0);
+			graph.ReleaseTextures(&device);
+		}
+	}
+	return numCompiles > 0 ? compileMicroseconds / numCompiles : 0.0;
+}
+
+/**
+*  @brief How long declaring and compiling TestAppGame's frame takes, as it's done every frame.
+*/
+static double TimeTestAppFrame(unsigned int width, unsigned int height)
+{
+	static const unsigned int FRAMES = 20000;
+	CheckingDevice device;
+	RenderGraph graph;
+	ContentsChecker contents;
+
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < FRAMES; i++)
+	{
+		graph.Reset();
+		DeclareTestAppFrame(graph, contents, device, width, height, true, false);
+		graph.Compile();
+	}
+	const double microseconds = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	graph.ReleaseTextures(&device);
+	return microseconds / FRAMES;
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int numGraphs = argc > 1 ? (unsigned int)atoi(argv[1]) : 500;
+	const unsigned int width = argc > 2 ? (unsigned int)atoi(argv[2]) : 1920;
+	const unsigned int height = argc > 3 ? (unsigned int)atoi(argv[3]) : 1080;
+
+	printf("Render targets at %ux%u\n", width, height);
+	CheckTestAppFrame(width, height);
+	CheckBloomFrame(width, height);
+	CheckTextureReuse(width, height);
+	CheckCycle();
+	const double randomCompile = CheckRandomGraphs(numGraphs);
+
+	printf("Declare and compile TestApp's frame: %.2f us\n", TimeTestAppFrame(width, height));
+	printf("Compile a random graph of up to 41 passes: %.2f us\n", randomCompile);
+
+	if (gFailures > 0)
+	{
+		printf("%d checks failed\n", gFailures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,35 @@
+// Encoding shared by the shaders that write and read the G-buffer, GBufferPacking mirrors it on the CPU
+
+float2 SignNotZero(float2 v)
+{
+	return float2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Projects a normal onto the octahedron and folds the lower half over, written to a snorm target
+float2 EncodeOctahedron(float3 normal)
+{
+	normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+	float2 oct = normal.xy;
+	if (normal.z < 0.0)
+		oct = (1.0 - abs(normal.yx)) * SignNotZero(normal.xy);
+	return oct;
+}
+
+// Unfolds an octahedral encoded normal
+float3 DecodeOctahedron(float2 oct)
+{
+	float3 normal = float3(oct.x, oct.y, 1.0 - abs(oct.x) - abs(oct.y));
+	float fold = saturate(-normal.z);
+	normal.x += normal.x >= 0.0 ? -fold : fold;
+	normal.y += normal.y >= 0.0 ? -fold : fold;
+	return normalize(normal);
+}
+
+// The world position a pixel's depth came from, texcoord is (0, 0) at the top left of the screen
+float4 ReconstructWorldPosition(float2 texcoord, float depth, float4x4 inverseProjection, float4x4 inverseView)
+{
+	float4 clip = float4(texcoord.x * 2.0 - 1.0, 1.0 - texcoord.y * 2.0, depth, 1.0);
+	float4 view = mul(inverseProjection, clip);
+	view /= view.w;
+	return mul(inverseView, view);
+}
@@ -0,0 +1,3 @@
+// GBuffer_PixelShader for the compact G-buffer, see TestAppGame::Render
+#define COMPACT_GBUFFER
+#include "GBuffer_PixelShader.hlsl"
@@ -0,0 +1,44 @@
+#include "GBuffer.hlsli"
+
+cbuffer PerFrameBuffer: register(b1)
+{
+	float4x4 VM;
+	float4x4 VM_Inv;
+	float4x4 PM;
+	float4x4 PM_Inv;
+	float4 CameraPosition;
+};
+
+// Maps the mesh's quantised positions back into model space
+cbuffer PerMeshBuffer: register(b2)
+{
+	float4 QuantizationOffset;
+	float4 QuantizationScale;
+};
+
+struct VOut
+{
+	float4 position : SV_POSITION;
+	float4 normal : NORMAL;
+	float2 texcoord : TEXCOORD0;
+	float4 worldPos : TEXCOORD1;
+};
+
+// The input assembler expands R16G16B16A16_UNORM positions, R16G16_SNORM normals and R16G16_FLOAT texcoords
+VOut main(float4 position : POSITION, float2 normal : NORMAL, float2 texcoord : TEXCOORD)
+{
+	VOut output;
+	position.xyz = QuantizationOffset.xyz + position.xyz * QuantizationScale.xyz;
+	position.w = 1.0;
+
+	//position = mul(MM, position); // Uncomment when the MM gets added
+	output.worldPos = position;
+	output.position = mul(VM, position);
+
+	output.position = mul(PM, output.position);
+
+	output.normal = float4(DecodeOctahedron(normal), 0.0);
+	output.texcoord = texcoord;
+
+	return output;
+}
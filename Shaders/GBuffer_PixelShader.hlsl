@@ -12,12 +12,23 @@ struct VOut
 	float4 worldPos : TEXCOORD1;
 };
 
+#ifdef COMPACT_GBUFFER
+#include "GBuffer.hlsli"
+
+// Positions come from the depth buffer, normals go to an RG16 snorm target and colours to RGBA8
+struct PSOut
+{
+	float2 Normal			: SV_Target0;
+	float4 DiffuseSpecular  : SV_Target1;
+};
+#else
 struct PSOut
 {
 	float4 Position			: SV_Target0;
 	float4 Normal			: SV_Target1;
 	float4 DiffuseSpecular  : SV_Target2;
 };
+#endif
 
 
 PSOut main(VOut IN) : SV_TARGET
@@ -30,9 +41,13 @@ PSOut main(VOut IN) : SV_TARGET
 	float specularColour = specularTexture.Sample(SampleType, IN.texcoord).x;
 
 
+#ifdef COMPACT_GBUFFER
+	output.Normal = EncodeOctahedron(IN.normal.xyz);
+#else
 	output.Position = IN.worldPos;
 	output.Normal = IN.normal;
 	output.Normal.a = 1.0f;
+#endif
 	output.DiffuseSpecular = textureColour;
 	output.DiffuseSpecular.a = specularColour;
 
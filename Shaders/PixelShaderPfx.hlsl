@@ -1,5 +1,6 @@
 
 #include "SSR.hlsli"
+#include "GBuffer.hlsli"
 
 // Texture
 Texture2D diffuseTexture : register(t0);
@@ -28,9 +29,21 @@ struct VOut
 float4 main(VOut IN) : SV_TARGET
 {
 	float4 textureColour = diffuseTexture.Sample(SampleType, IN.texcoord);
+	float depth = depthTexture.Sample(SampleType, IN.texcoord).r;
+#ifdef COMPACT_GBUFFER
+	// No position or full normal targets, rebuild them from the depth and the octahedral encoding.
+	// Where nothing was drawn use what the full G-buffer's targets are cleared to, so both layouts draw the same.
+	float4 world_position = float4(0.0, 0.0, 0.0, 1.0);
+	float4 normal = float4(0.0, 0.0, 0.0, 1.0);
+	if (depth < 1.0)
+	{
+		world_position = ReconstructWorldPosition(IN.texcoord, depth, PM_Inv, VM_Inv); // world space
+		normal = float4(DecodeOctahedron(normalTexture.Sample(SampleType, IN.texcoord).xy), 1.0); // world space, a is 1 like the full G-buffer's
+	}
+#else
 	float4 world_position = positionTexture.Sample(SampleType, IN.texcoord); // world space
 	float4 normal = normalTexture.Sample(SampleType, IN.texcoord); // world space
-	float depth = depthTexture.Sample(SampleType, IN.texcoord).r;
+#endif
 
 	float4 view_ray = world_position - CameraPosition;
 	float4 view_dir = normalize(view_ray);
@@ -0,0 +1,3 @@
+// PixelShaderPfx for the compact G-buffer, see TestAppGame::Render
+#define COMPACT_GBUFFER
+#include "PixelShaderPfx.hlsl"
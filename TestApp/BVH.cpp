@@ -0,0 +1,539 @@
+/**
+*  @file BVH.cpp
+*  @brief Bounding volume hierarchy over boxes or triangles, for culling and ray queries.
+*
+*  Built top down with a binned surface area heuristic and stored as a flat, depth first array
+*  of 32 byte nodes, which can be written to and read back from a file as is.
+*
+*  @bug No known bugs.
+*/
+#include "BVH.h"
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode is written to files as is");
+
+const float BVH::SAH_TRAVERSAL_COST = 1.0f;
+
+static const uint32_t BVH_MAGIC = 0x31485642; // "BVH1"
+/// Deep enough for any tree built from 32 bit primitive counts with the median fallback.
+static const unsigned int MAX_STACK_DEPTH = 128;
+
+struct BVHFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t numNodes;
+	uint32_t numPrimitives;
+	uint32_t hasTriangles;
+	uint32_t padding;
+};
+
+static float SurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	const glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+/**
+*  @brief Slab test, returns the entry distance or FLT_MAX if the ray misses the box within maxDistance.
+*/
+static float IntersectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+{
+	const glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+	const glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+	const float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+BVH::BVH()
+{
+}
+
+void BVH::Clear()
+{
+	mNodes.clear();
+	mPrimitives.clear();
+	mPrimitiveMin.clear();
+	mPrimitiveMax.clear();
+	mTriangles.clear();
+}
+
+/**
+*  @brief Builds the hierarchy over a set of boxes.
+*
+*  @param boundsMin The minimum corner of each primitive.
+*  @param boundsMax The maximum corner of each primitive.
+*  @param maxLeafSize The most primitives a leaf can hold, leaves can be smaller when the SAH says so.
+*/
+void BVH::Build(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax, unsigned int maxLeafSize)
+{
+	Clear();
+	const uint32_t count = (uint32_t)boundsMin.size();
+	if (count == 0)
+		return;
+
+	mPrimitives.resize(count);
+	mCentroids.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		mPrimitives[i] = i;
+		mCentroids[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+	}
+
+	// The builder partitions mPrimitives in place, the boxes are looked up through it
+	mPrimitiveMin = boundsMin;
+	mPrimitiveMax = boundsMax;
+	mNodes.reserve(count * 2);
+	BuildNode(0, count, maxLeafSize < 1 ? 1 : maxLeafSize);
+
+	// Put the boxes in leaf order so queries read them sequentially
+	std::vector<glm::vec3> orderedMin(count), orderedMax(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		orderedMin[i] = boundsMin[mPrimitives[i]];
+		orderedMax[i] = boundsMax[mPrimitives[i]];
+	}
+	mPrimitiveMin.swap(orderedMin);
+	mPrimitiveMax.swap(orderedMax);
+
+	mCentroids.clear();
+	mCentroids.shrink_to_fit();
+}
+
+/**
+*  @brief Builds the hierarchy over a triangle list, so rays hit the triangles themselves.
+*
+*  @param positions The vertex positions.
+*  @param indices Three indices per triangle, the primitive indices are triangle numbers.
+*  @param maxLeafSize The most triangles a leaf can hold.
+*/
+void BVH::BuildFromTriangles(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, unsigned int maxLeafSize)
+{
+	const size_t numTriangles = indices.size() / 3;
+	std::vector<glm::vec3> boundsMin(numTriangles), boundsMax(numTriangles);
+	for (size_t i = 0; i < numTriangles; i++)
+	{
+		const glm::vec3& a = positions[indices[i * 3]];
+		const glm::vec3& b = positions[indices[i * 3 + 1]];
+		const glm::vec3& c = positions[indices[i * 3 + 2]];
+		boundsMin[i] = glm::min(a, glm::min(b, c));
+		boundsMax[i] = glm::max(a, glm::max(b, c));
+	}
+
+	Build(boundsMin, boundsMax, maxLeafSize);
+
+	mTriangles.resize(mPrimitives.size() * 3);
+	for (size_t i = 0; i < mPrimitives.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+			mTriangles[i * 3 + k] = positions[indices[mPrimitives[i] * 3 + k]];
+	}
+}
+
+uint32_t BVH::BuildNode(uint32_t first, uint32_t count, unsigned int maxLeafSize)
+{
+	const uint32_t nodeIndex = (uint32_t)mNodes.size();
+	mNodes.push_back(BVHNode());
+
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const uint32_t primitive = mPrimitives[i];
+		boundsMin = glm::min(boundsMin, mPrimitiveMin[primitive]);
+		boundsMax = glm::max(boundsMax, mPrimitiveMax[primitive]);
+		centroidMin = glm::min(centroidMin, mCentroids[primitive]);
+		centroidMax = glm::max(centroidMax, mCentroids[primitive]);
+	}
+	mNodes[nodeIndex].mBoundsMin = boundsMin;
+	mNodes[nodeIndex].mBoundsMax = boundsMax;
+
+	// Evaluate the binned SAH on every axis
+	int bestAxis = -1;
+	unsigned int bestSplit = 0;
+	float bestCost = FLT_MAX;
+	if (count > 1)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0.0f)
+				continue;
+
+			unsigned int binCounts[SAH_BINS] = { 0 };
+			glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+			for (unsigned int b = 0; b < SAH_BINS; b++)
+			{
+				binMin[b] = glm::vec3(FLT_MAX);
+				binMax[b] = glm::vec3(-FLT_MAX);
+			}
+
+			const float scale = SAH_BINS / extent;
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const uint32_t primitive = mPrimitives[i];
+				const unsigned int bin = std::min(SAH_BINS - 1, (unsigned int)((mCentroids[primitive][axis] - centroidMin[axis]) * scale));
+				binCounts[bin]++;
+				binMin[bin] = glm::min(binMin[bin], mPrimitiveMin[primitive]);
+				binMax[bin] = glm::max(binMax[bin], mPrimitiveMax[primitive]);
+			}
+
+			// Sweep from the right to get the cost of everything after each split, then from the left
+			float rightArea[SAH_BINS];
+			unsigned int rightCount[SAH_BINS];
+			glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+			unsigned int sweepCount = 0;
+			for (unsigned int b = SAH_BINS - 1; b > 0; b--)
+			{
+				sweepMin = glm::min(sweepMin, binMin[b]);
+				sweepMax = glm::max(sweepMax, binMax[b]);
+				sweepCount += binCounts[b];
+				rightArea[b] = SurfaceArea(sweepMin, sweepMax);
+				rightCount[b] = sweepCount;
+			}
+
+			sweepMin = glm::vec3(FLT_MAX);
+			sweepMax = glm::vec3(-FLT_MAX);
+			sweepCount = 0;
+			for (unsigned int b = 0; b < SAH_BINS - 1; b++)
+			{
+				sweepMin = glm::min(sweepMin, binMin[b]);
+				sweepMax = glm::max(sweepMax, binMax[b]);
+				sweepCount += binCounts[b];
+				if (sweepCount == 0 || rightCount[b + 1] == 0)
+					continue;
+
+				const float cost = SurfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[b + 1] * rightCount[b + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b + 1;
+				}
+			}
+		}
+	}
+
+	// Make a leaf if splitting isn't cheaper than intersecting everything here
+	const float area = SurfaceArea(boundsMin, boundsMax);
+	if (count <= maxLeafSize && (bestAxis < 0 || bestCost + SAH_TRAVERSAL_COST * area >= area * count))
+	{
+		mNodes[nodeIndex].miRightOrFirst = first;
+		mNodes[nodeIndex].miCount = count;
+		return nodeIndex;
+	}
+
+	uint32_t leftCount = 0;
+	if (bestAxis >= 0)
+	{
+		const float scale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		const float axisMin = centroidMin[bestAxis];
+		const std::vector<glm::vec3>& centroids = mCentroids;
+		uint32_t* middle = std::partition(&mPrimitives[first], &mPrimitives[first] + count, [&](uint32_t primitive)
+		{
+			return std::min(SAH_BINS - 1, (unsigned int)((centroids[primitive][bestAxis] - axisMin) * scale)) < bestSplit;
+		});
+		leftCount = (uint32_t)(middle - &mPrimitives[first]);
+	}
+
+	if (leftCount == 0 || leftCount == count)
+	{
+		// Every centroid is in the same place, just halve the list
+		leftCount = count / 2;
+	}
+
+	BuildNode(first, leftCount, maxLeafSize);
+	const uint32_t right = BuildNode(first + leftCount, count - leftCount, maxLeafSize);
+	mNodes[nodeIndex].miRightOrFirst = right;
+	mNodes[nodeIndex].miCount = 0;
+	return nodeIndex;
+}
+
+bool BVH::IntersectPrimitive(uint32_t slot, const glm::vec3& origin, const glm::vec3& direction, float& distance) const
+{
+	if (mTriangles.empty())
+	{
+		const glm::vec3 inverseDirection = 1.0f / direction;
+		distance = IntersectBox(mPrimitiveMin[slot], mPrimitiveMax[slot], origin, inverseDirection, FLT_MAX);
+		return distance != FLT_MAX;
+	}
+
+	// Moller-Trumbore, double sided
+	const glm::vec3& a = mTriangles[slot * 3];
+	const glm::vec3 edge1 = mTriangles[slot * 3 + 1] - a;
+	const glm::vec3 edge2 = mTriangles[slot * 3 + 2] - a;
+	const glm::vec3 p = glm::cross(direction, edge2);
+	const float determinant = glm::dot(edge1, p);
+	if (fabsf(determinant) < 1e-12f)
+		return false;
+
+	const float inverseDeterminant = 1.0f / determinant;
+	const glm::vec3 t = origin - a;
+	const float u = glm::dot(t, p) * inverseDeterminant;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	const glm::vec3 q = glm::cross(t, edge1);
+	const float v = glm::dot(direction, q) * inverseDeterminant;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	distance = glm::dot(edge2, q) * inverseDeterminant;
+	return distance >= 0.0f;
+}
+
+/**
+*  @brief Finds the closest primitive along a ray.
+*
+*  @param origin The start of the ray.
+*  @param direction The direction of the ray, doesn't need to be normalised, distances are in multiples of it.
+*  @param maxDistance Hits further than this are ignored.
+*  @param hit Receives the original index of the primitive hit and its distance.
+*  @return true if anything was hit.
+*/
+bool BVH::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BVHRayHit& hit) const
+{
+	if (mNodes.empty())
+		return false;
+
+	const glm::vec3 inverseDirection = 1.0f / direction;
+	float closest = maxDistance;
+	bool found = false;
+
+	uint32_t stack[MAX_STACK_DEPTH];
+	unsigned int stackSize = 0;
+	if (IntersectBox(mNodes[0].mBoundsMin, mNodes[0].mBoundsMax, origin, inverseDirection, closest) != FLT_MAX)
+		stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BVHNode& node = mNodes[stack[--stackSize]];
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.miRightOrFirst; i < node.miRightOrFirst + node.miCount; i++)
+			{
+				float distance;
+				if (IntersectPrimitive(i, origin, direction, distance) && distance < closest)
+				{
+					closest = distance;
+					hit.miPrimitive = mPrimitives[i];
+					hit.mDistance = distance;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first, so the far one is more likely to be skipped
+		const uint32_t left = (uint32_t)(&node - &mNodes[0]) + 1;
+		const uint32_t right = node.miRightOrFirst;
+		const float leftDistance = IntersectBox(mNodes[left].mBoundsMin, mNodes[left].mBoundsMax, origin, inverseDirection, closest);
+		const float rightDistance = IntersectBox(mNodes[right].mBoundsMin, mNodes[right].mBoundsMax, origin, inverseDirection, closest);
+		const bool leftFirst = leftDistance <= rightDistance;
+		const float nearDistance = leftFirst ? leftDistance : rightDistance;
+		const float farDistance = leftFirst ? rightDistance : leftDistance;
+
+		if (farDistance != FLT_MAX && stackSize < MAX_STACK_DEPTH)
+			stack[stackSize++] = leftFirst ? right : left;
+		if (nearDistance != FLT_MAX && stackSize < MAX_STACK_DEPTH)
+			stack[stackSize++] = leftFirst ? left : right;
+	}
+	return found;
+}
+
+/**
+*  @brief Finds every primitive whose box intersects the frustum.
+*
+*  Subtrees entirely inside the frustum are added without testing anything below them.
+*
+*  @param frustum The frustum to test against.
+*  @param primitives Receives the original indices of the primitives, in leaf order.
+*/
+void BVH::QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& primitives) const
+{
+	primitives.clear();
+	if (mNodes.empty())
+		return;
+
+	struct StackEntry
+	{
+		uint32_t node;
+		bool inside;
+	};
+	StackEntry stack[MAX_STACK_DEPTH];
+	unsigned int stackSize = 0;
+	stack[stackSize].node = 0;
+	stack[stackSize++].inside = false;
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		const BVHNode& node = mNodes[entry.node];
+
+		bool inside = entry.inside;
+		if (!inside)
+		{
+			const Frustum::Containment containment = frustum.ClassifyBox(node.mBoundsMin, node.mBoundsMax);
+			if (containment == Frustum::OUTSIDE)
+				continue;
+			inside = containment == Frustum::INSIDE;
+		}
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.miRightOrFirst; i < node.miRightOrFirst + node.miCount; i++)
+			{
+				if (inside || frustum.IntersectsBox(mPrimitiveMin[i], mPrimitiveMax[i]))
+					primitives.push_back(mPrimitives[i]);
+			}
+			continue;
+		}
+
+		if (stackSize + 2 <= MAX_STACK_DEPTH)
+		{
+			stack[stackSize].node = node.miRightOrFirst;
+			stack[stackSize++].inside = inside;
+			stack[stackSize].node = entry.node + 1;
+			stack[stackSize++].inside = inside;
+		}
+	}
+}
+
+/**
+*  @brief Writes the hierarchy into a buffer.
+*
+*  @param key Stored with the data, Deserialize only accepts data with the same key. Use it to identify the source.
+*  @param data Receives the serialised hierarchy.
+*/
+void BVH::Serialize(uint64_t key, std::vector<unsigned char>& data) const
+{
+	BVHFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = BVH_MAGIC;
+	header.version = VERSION;
+	header.key = key;
+	header.numNodes = (uint32_t)mNodes.size();
+	header.numPrimitives = (uint32_t)mPrimitives.size();
+	header.hasTriangles = mTriangles.empty() ? 0 : 1;
+
+	const size_t nodeBytes = mNodes.size() * sizeof(BVHNode);
+	const size_t primitiveBytes = mPrimitives.size() * sizeof(uint32_t);
+	const size_t boxBytes = mPrimitives.size() * sizeof(glm::vec3);
+	const size_t triangleBytes = mTriangles.size() * sizeof(glm::vec3);
+
+	data.resize(sizeof(header) + nodeBytes + primitiveBytes + boxBytes * 2 + triangleBytes);
+	unsigned char* write = data.data();
+	memcpy(write, &header, sizeof(header)); write += sizeof(header);
+	if (nodeBytes) { memcpy(write, mNodes.data(), nodeBytes); write += nodeBytes; }
+	if (primitiveBytes) { memcpy(write, mPrimitives.data(), primitiveBytes); write += primitiveBytes; }
+	if (boxBytes) { memcpy(write, mPrimitiveMin.data(), boxBytes); write += boxBytes; }
+	if (boxBytes) { memcpy(write, mPrimitiveMax.data(), boxBytes); write += boxBytes; }
+	if (triangleBytes) { memcpy(write, mTriangles.data(), triangleBytes); }
+}
+
+/**
+*  @brief Reads a hierarchy written by Serialize.
+*
+*  @param key Must match the key it was written with.
+*  @param data The serialised hierarchy.
+*  @param size The size of the data in bytes.
+*  @return false if the data is for another key or version, or is truncated.
+*/
+bool BVH::Deserialize(uint64_t key, const unsigned char* data, size_t size)
+{
+	Clear();
+
+	BVHFileHeader header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != BVH_MAGIC || header.version != VERSION || header.key != key)
+		return false;
+
+	const size_t nodeBytes = (size_t)header.numNodes * sizeof(BVHNode);
+	const size_t primitiveBytes = (size_t)header.numPrimitives * sizeof(uint32_t);
+	const size_t boxBytes = (size_t)header.numPrimitives * sizeof(glm::vec3);
+	const size_t triangleBytes = header.hasTriangles ? boxBytes * 3 : 0;
+	if (size != sizeof(header) + nodeBytes + primitiveBytes + boxBytes * 2 + triangleBytes)
+		return false;
+
+	const unsigned char* read = data + sizeof(header);
+	mNodes.resize(header.numNodes);
+	mPrimitives.resize(header.numPrimitives);
+	mPrimitiveMin.resize(header.numPrimitives);
+	mPrimitiveMax.resize(header.numPrimitives);
+	mTriangles.resize(header.hasTriangles ? header.numPrimitives * 3 : 0);
+	if (nodeBytes) { memcpy(mNodes.data(), read, nodeBytes); read += nodeBytes; }
+	if (primitiveBytes) { memcpy(mPrimitives.data(), read, primitiveBytes); read += primitiveBytes; }
+	if (boxBytes) { memcpy(mPrimitiveMin.data(), read, boxBytes); read += boxBytes; }
+	if (boxBytes) { memcpy(mPrimitiveMax.data(), read, boxBytes); read += boxBytes; }
+	if (triangleBytes) { memcpy(mTriangles.data(), read, triangleBytes); }
+
+	// Don't trust child and primitive references from disk
+	for (size_t i = 0; i < mNodes.size(); i++)
+	{
+		const BVHNode& node = mNodes[i];
+		const bool valid = node.IsLeaf()
+			? (uint64_t)node.miRightOrFirst + node.miCount <= mPrimitives.size()
+			: node.miRightOrFirst > i + 1 && node.miRightOrFirst < mNodes.size() && i + 1 < mNodes.size();
+		if (!valid)
+		{
+			Clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+bool BVH::Save(const std::string& path, uint64_t key) const
+{
+	std::vector<unsigned char> data;
+	Serialize(key, data);
+
+	FILE* file = nullptr;
+#if defined _WIN32
+	if (fopen_s(&file, path.c_str(), "wb") != 0)
+		file = nullptr;
+#else
+	file = fopen(path.c_str(), "wb");
+#endif
+	if (!file)
+		return false;
+	const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	return written;
+}
+
+bool BVH::Load(const std::string& path, uint64_t key)
+{
+	FILE* file = nullptr;
+#if defined _WIN32
+	if (fopen_s(&file, path.c_str(), "rb") != 0)
+		file = nullptr;
+#else
+	file = fopen(path.c_str(), "rb");
+#endif
+	if (!file)
+		return false;
+
+	std::vector<unsigned char> data;
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size > 0)
+	{
+		data.resize((size_t)size);
+		if (fread(data.data(), 1, data.size(), file) != data.size())
+			data.clear();
+	}
+	fclose(file);
+
+	return !data.empty() && Deserialize(key, data.data(), data.size());
+}
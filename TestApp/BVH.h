@@ -0,0 +1,86 @@
+/**
+*  @file BVH.h
+*  @brief Bounding volume hierarchy over boxes or triangles, for culling and ray queries.
+*
+*  Built top down with a binned surface area heuristic and stored as a flat, depth first array
+*  of 32 byte nodes, which can be written to and read back from a file as is.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+/**
+*  @brief One node of the flattened hierarchy.
+*
+*  Interior nodes have their left child straight after them and miRightOrFirst pointing at the right child.
+*  Leaves have miCount > 0 primitives starting at miRightOrFirst in the primitive index array.
+*/
+struct BVHNode
+{
+	glm::vec3 mBoundsMin;
+	uint32_t miRightOrFirst;
+	glm::vec3 mBoundsMax;
+	uint32_t miCount;
+
+	bool IsLeaf() const { return miCount > 0; }
+};
+
+/**
+*  @brief The closest primitive a ray hit.
+*/
+struct BVHRayHit
+{
+	uint32_t miPrimitive;
+	float mDistance;
+};
+
+class BVH
+{
+public:
+	static const uint32_t VERSION = 1;
+	/// Number of bins the SAH evaluates split planes at, per axis.
+	static const unsigned int SAH_BINS = 16;
+	/// Cost of visiting a node relative to intersecting one primitive.
+	static const float SAH_TRAVERSAL_COST;
+
+	BVH();
+
+	void Build(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax, unsigned int maxLeafSize = 4);
+	void BuildFromTriangles(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, unsigned int maxLeafSize = 4);
+	void Clear();
+
+	bool IsEmpty() const { return mNodes.empty(); }
+	unsigned int NumNodes() const { return (unsigned int)mNodes.size(); }
+	unsigned int NumPrimitives() const { return (unsigned int)mPrimitives.size(); }
+	const std::vector<BVHNode>& GetNodes() const { return mNodes; }
+
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BVHRayHit& hit) const;
+	void QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& primitives) const;
+
+	void Serialize(uint64_t key, std::vector<unsigned char>& data) const;
+	bool Deserialize(uint64_t key, const unsigned char* data, size_t size);
+	bool Save(const std::string& path, uint64_t key) const;
+	bool Load(const std::string& path, uint64_t key);
+
+private:
+	uint32_t BuildNode(uint32_t first, uint32_t count, unsigned int maxLeafSize);
+	bool IntersectPrimitive(uint32_t slot, const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+
+	std::vector<BVHNode> mNodes;
+	/// The original index of each primitive, in leaf order.
+	std::vector<uint32_t> mPrimitives;
+	/// Each primitive's box, in leaf order.
+	std::vector<glm::vec3> mPrimitiveMin;
+	std::vector<glm::vec3> mPrimitiveMax;
+	/// Three corners per primitive in leaf order, only for BVHs built from triangles.
+	std::vector<glm::vec3> mTriangles;
+
+	/// Primitive centroids, only needed while building.
+	std::vector<glm::vec3> mCentroids;
+};
@@ -0,0 +1,392 @@
+/**
+*  @file BinaryLog.cpp
+*  @brief Writes log calls as compact binary records, for long runs that log a lot.
+*
+*  @bug No known bugs.
+*/
+#include "BinaryLog.h"
+#include "BinaryLogFormat.h"
+#include "Log.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+
+#if defined _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() :
+	mpData(nullptr),
+	miSize(0),
+#if defined _WIN32
+	mpFile(INVALID_HANDLE_VALUE),
+	mpMapping(nullptr)
+#else
+	miFile(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	if (IsOpen())
+		Close(miSize);
+}
+
+/**
+*  @brief Creates the file at the given size, zeroed, and maps all of it.
+*/
+bool MappedFile::Open(const std::string& path, size_t size)
+{
+#if defined _WIN32
+	mpFile = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mpFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Mapping more than the file's size grows it
+	mpMapping = CreateFileMappingA(mpFile, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFF), nullptr);
+	if (mpMapping)
+		mpData = (unsigned char*)MapViewOfFile(mpMapping, FILE_MAP_WRITE, 0, 0, size);
+
+	if (!mpData)
+	{
+		if (mpMapping)
+			CloseHandle(mpMapping);
+		CloseHandle(mpFile);
+		mpMapping = nullptr;
+		mpFile = INVALID_HANDLE_VALUE;
+		return false;
+	}
+#else
+	miFile = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (miFile < 0)
+		return false;
+
+	void* data = MAP_FAILED;
+	if (ftruncate(miFile, (off_t)size) == 0)
+		data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, miFile, 0);
+
+	if (data == MAP_FAILED)
+	{
+		close(miFile);
+		miFile = -1;
+		return false;
+	}
+	mpData = (unsigned char*)data;
+#endif
+
+	miSize = size;
+	return true;
+}
+
+void MappedFile::Close(size_t used)
+{
+	if (!IsOpen())
+		return;
+
+#if defined _WIN32
+	UnmapViewOfFile(mpData);
+	CloseHandle(mpMapping);
+	LARGE_INTEGER end;
+	end.QuadPart = (LONGLONG)used;
+	SetFilePointerEx(mpFile, end, nullptr, FILE_BEGIN);
+	SetEndOfFile(mpFile);
+	CloseHandle(mpFile);
+	mpMapping = nullptr;
+	mpFile = INVALID_HANDLE_VALUE;
+#else
+	munmap(mpData, miSize);
+	if (ftruncate(miFile, (off_t)used) != 0)
+	{
+		LOG_WARNING << "Failed to trim the binary log file";
+	}
+	close(miFile);
+	miFile = -1;
+#endif
+
+	mpData = nullptr;
+	miSize = 0;
+}
+
+BinaryLog::BinaryLog() :
+	mbOpen(false),
+	miTextLevel(WARNING),
+	mpQueue(nullptr),
+	miFileSize(0),
+	miMaxFiles(0),
+	miFileIndex(0),
+	miStartTime(0),
+	miUsed(0),
+	miSitesWritten(0)
+{
+}
+
+BinaryLog::~BinaryLog()
+{
+	Close();
+	delete mpQueue;
+}
+
+/**
+*  @brief Starts writing binary records, to files named basePath_date-time.index.blog.
+*
+*  @param basePath The path and start of the file names, the directory has to exist.
+*  @param fileSize How big each file is allowed to get before the next is started.
+*  @param maxFiles How many files to keep, the oldest is deleted when another is started. 0 keeps them all.
+*  @return false if the first file couldn't be created.
+*/
+bool BinaryLog::Open(const std::string& basePath, size_t fileSize, unsigned int maxFiles)
+{
+	Close();
+
+	{
+		std::lock_guard<std::mutex> lock(mFileMutex);
+
+		char date[32];
+		const time_t now = time(nullptr);
+		struct tm local;
+#if defined _WIN32
+		localtime_s(&local, &now);
+#else
+		localtime_r(&now, &local);
+#endif
+		strftime(date, sizeof(date), "_%Y%m%d-%H%M%S", &local);
+
+		mBasePath = basePath + date;
+		miFileSize = fileSize > MIN_FILE_SIZE ? fileSize : MIN_FILE_SIZE;
+		miMaxFiles = maxFiles;
+		miFileIndex = 0;
+		mFiles.clear();
+
+		// Record times are relative to the start of the steady clock behind Now()
+		const uint64_t wallTime = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		miStartTime = wallTime - Now();
+
+		if (!OpenNextFile())
+		{
+			LOG_WARNING << "Failed to create the binary log: " << mCurrentPath;
+			return false;
+		}
+	}
+
+	if (!mpQueue)
+		mpQueue = new LogQueue(this);
+
+	mbOpen.store(true);
+	LOG_INFO << "Writing the binary log to " << mBasePath << ".*.blog";
+	return true;
+}
+
+/**
+*  @brief Writes out what's queued and closes the file. Log calls go back to the text log.
+*/
+void BinaryLog::Close()
+{
+	if (!mbOpen.exchange(false))
+		return;
+
+	mpQueue->Flush();
+
+	std::lock_guard<std::mutex> lock(mFileMutex);
+	CloseFile();
+}
+
+/**
+*  @brief Queues a record made by a LogStream.
+*/
+bool BinaryLog::Push(const unsigned char* record, size_t length, bool mustSucceed)
+{
+	return mpQueue->Push((const char*)record, length, mustSucceed);
+}
+
+void BinaryLog::Flush()
+{
+	if (mpQueue)
+		mpQueue->Flush();
+}
+
+unsigned int BinaryLog::RegisterSite(const LogSite* site)
+{
+	std::lock_guard<std::mutex> lock(mSitesMutex);
+	mSites.push_back(site);
+	return (unsigned int)mSites.size();
+}
+
+uint64_t BinaryLog::Now()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned int BinaryLog::ThreadId()
+{
+	static std::atomic<unsigned int> nextId(1);
+	thread_local unsigned int id = nextId.fetch_add(1);
+	return id;
+}
+
+/**
+*  @brief Writes a batch of records, starting a new file whenever the next record doesn't fit.
+*/
+void BinaryLog::Write(const char* data, size_t length)
+{
+	std::lock_guard<std::mutex> lock(mFileMutex);
+	if (!mFile.IsOpen())
+		return;
+
+	// Sites first, the records in the batch could refer to them
+	WriteNewSites();
+
+	const unsigned char* record = (const unsigned char*)data;
+	const unsigned char* end = record + length;
+	while (record + BINARY_LOG_RECORD_HEADER <= end)
+	{
+		const size_t recordLength = BINARY_LOG_RECORD_HEADER + (record[1] | (record[2] << 8));
+		if (record + recordLength > end)
+			break;
+
+		WriteRecord(record, recordLength);
+		record += recordLength;
+	}
+}
+
+void BinaryLog::Dropped(uint64_t count)
+{
+	std::lock_guard<std::mutex> lock(mFileMutex);
+	if (!mFile.IsOpen())
+		return;
+
+	unsigned char record[BINARY_LOG_RECORD_HEADER + 2 * BINARY_LOG_MAX_VARINT];
+	unsigned int length = BINARY_LOG_RECORD_HEADER;
+	length += BinaryLogWriteVarint(record + length, Now());
+	length += BinaryLogWriteVarint(record + length, count);
+	record[0] = BINARY_LOG_DROPPED;
+	record[1] = (unsigned char)(length - BINARY_LOG_RECORD_HEADER);
+	record[2] = 0;
+	WriteRecord(record, length);
+}
+
+/**
+*  @brief Starts the next file, with the header and every site defined so far.
+*/
+bool BinaryLog::OpenNextFile()
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%u.blog", miFileIndex);
+	mCurrentPath = mBasePath + suffix;
+
+	if (!mFile.Open(mCurrentPath, miFileSize))
+		return false;
+
+	BinaryLogHeader header;
+	memset(&header, 0, sizeof(header));
+	header.miMagic = BINARY_LOG_MAGIC;
+	header.miVersion = BINARY_LOG_VERSION;
+	header.miHeaderSize = sizeof(BinaryLogHeader);
+	header.miStartTime = miStartTime;
+	header.miFileIndex = miFileIndex;
+	memcpy(mFile.GetData(), &header, sizeof(header));
+	miUsed = sizeof(header);
+	miFileIndex++;
+
+	mFiles.push_back(mCurrentPath);
+	while (miMaxFiles > 0 && mFiles.size() > miMaxFiles)
+	{
+		remove(mFiles.front().c_str());
+		mFiles.pop_front();
+	}
+
+	// Each file stands alone, so it gets every site again
+	miSitesWritten = 0;
+	WriteNewSites();
+	return true;
+}
+
+void BinaryLog::CloseFile()
+{
+	mFile.Close(miUsed);
+	miUsed = 0;
+}
+
+/**
+*  @brief Makes sure there's room for length more bytes, moving on to the next file if there isn't.
+*  @return false if there's no file to write to.
+*/
+bool BinaryLog::Reserve(size_t length)
+{
+	if (!mFile.IsOpen())
+		return false;
+	if (miUsed + length <= mFile.GetSize())
+		return true;
+
+	CloseFile();
+	return OpenNextFile() && miUsed + length <= mFile.GetSize();
+}
+
+void BinaryLog::WriteRecord(const unsigned char* record, size_t length)
+{
+	if (!Reserve(length))
+		return;
+	memcpy(mFile.GetData() + miUsed, record, length);
+	miUsed += length;
+}
+
+/**
+*  @brief Writes a site's record, unless making room for it started a new file.
+*
+*  A new file gets every site when it's opened, this one included, so writing it again would repeat it.
+*  @return false if the site wasn't written here.
+*/
+bool BinaryLog::WriteSite(const LogSite* site)
+{
+	const size_t functionLength = strlen(site->mpFunction);
+	const size_t fileLength = strlen(site->mpFile);
+
+	std::vector<unsigned char> record(BINARY_LOG_RECORD_HEADER + 4 * BINARY_LOG_MAX_VARINT + 1 + functionLength + fileLength);
+	size_t length = BINARY_LOG_RECORD_HEADER;
+	length += BinaryLogWriteVarint(&record[length], site->miId);
+	record[length++] = (unsigned char)site->meLevel;
+	length += BinaryLogWriteVarint(&record[length], (uint64_t)site->miLine);
+	length += BinaryLogWriteVarint(&record[length], functionLength);
+	memcpy(&record[length], site->mpFunction, functionLength);
+	length += functionLength;
+	length += BinaryLogWriteVarint(&record[length], fileLength);
+	memcpy(&record[length], site->mpFile, fileLength);
+	length += fileLength;
+
+	const size_t payload = length - BINARY_LOG_RECORD_HEADER;
+	record[0] = BINARY_LOG_SITE;
+	record[1] = (unsigned char)(payload & 0xFF);
+	record[2] = (unsigned char)(payload >> 8);
+
+	const unsigned int fileIndex = miFileIndex;
+	if (!Reserve(length) || miFileIndex != fileIndex)
+		return false;
+	memcpy(mFile.GetData() + miUsed, &record[0], length);
+	miUsed += length;
+	return true;
+}
+
+void BinaryLog::WriteNewSites()
+{
+	while (mFile.IsOpen())
+	{
+		const LogSite* site;
+		{
+			std::lock_guard<std::mutex> lock(mSitesMutex);
+			if (miSitesWritten >= mSites.size())
+				return;
+			site = mSites[miSitesWritten];
+		}
+
+		// Only counted once it's in this file, a new file writes every site itself and moves miSitesWritten on
+		if (WriteSite(site))
+			miSitesWritten++;
+	}
+}
@@ -0,0 +1,132 @@
+/**
+*  @file BinaryLog.h
+*  @brief Writes log calls as compact binary records, for long runs that log a lot.
+*
+*  Instead of formatting text, a log call records its call site id, level, time, thread and its
+*  arguments tagged by type. The records go through their own LogQueue to a memory mapped file,
+*  which is rotated once full. The LogDecoder tool turns the files back into text.
+*  The layout is in BinaryLogFormat.h.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "LogQueue.h"
+
+struct LogSite;
+
+/**
+*  @brief A file mapped into memory, that's written to through the mapping.
+*/
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& path, size_t size);
+	/// Unmaps the file and cuts it down to used bytes.
+	void Close(size_t used);
+
+	bool IsOpen() const { return mpData != nullptr; }
+	unsigned char* GetData() const { return mpData; }
+	size_t GetSize() const { return miSize; }
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	unsigned char* mpData;
+	size_t miSize;
+#if defined _WIN32
+	void* mpFile;
+	void* mpMapping;
+#else
+	int miFile;
+#endif
+};
+
+/**
+*  @brief The binary log, and the list of every log call site it refers to by id.
+*/
+class BinaryLog : public LogSink
+{
+public:
+	/// Files are at least this big, so the site definitions at the start of each always fit.
+	static const size_t MIN_FILE_SIZE = 1024 * 1024;
+
+	static BinaryLog& Get()
+	{
+		static BinaryLog instance;
+		return instance;
+	}
+
+	bool Open(const std::string& basePath, size_t fileSize, unsigned int maxFiles);
+	void Close();
+	bool IsOpen() const { return mbOpen.load(std::memory_order_relaxed); }
+
+	/**
+	*  @brief Sets the least severe level that still goes to the text log as well while this is open.
+	*  @param level A Severity, by default only errors and warnings are written as text too.
+	*/
+	void SetTextLevel(int level) { miTextLevel = level; }
+	int GetTextLevel() const { return miTextLevel; }
+
+	bool Push(const unsigned char* record, size_t length, bool mustSucceed);
+	void Flush();
+
+	/// Gives a call site its id, which is what the records refer to it by.
+	unsigned int RegisterSite(const LogSite* site);
+
+	/// Microseconds on a monotonic clock, from when it was first called.
+	static uint64_t Now();
+	/// A small number for the calling thread, in the order threads first log.
+	static unsigned int ThreadId();
+
+	// LogSink, called on the queue's writer thread
+	virtual void Write(const char* data, size_t length);
+	virtual void Dropped(uint64_t count);
+
+private:
+	BinaryLog();
+	~BinaryLog();
+	BinaryLog(const BinaryLog&) = delete;
+	BinaryLog& operator=(const BinaryLog&) = delete;
+
+	bool OpenNextFile();
+	void CloseFile();
+	bool Reserve(size_t length);
+	void WriteRecord(const unsigned char* record, size_t length);
+	bool WriteSite(const LogSite* site);
+	void WriteNewSites();
+
+	std::atomic<bool> mbOpen;
+	int miTextLevel;
+
+	/// Created by the first Open and kept, so logging threads never see it go away.
+	LogQueue* mpQueue;
+
+	/// Every call site, a site's id is its index plus 1.
+	std::mutex mSitesMutex;
+	std::vector<const LogSite*> mSites;
+
+	/// Guards everything below, which is otherwise only touched by the writer thread.
+	std::mutex mFileMutex;
+	std::string mBasePath;
+	size_t miFileSize;
+	unsigned int miMaxFiles;
+	unsigned int miFileIndex;
+	uint64_t miStartTime;
+	MappedFile mFile;
+	size_t miUsed;
+	std::string mCurrentPath;
+	/// The files written so far that haven't been deleted, oldest first.
+	std::deque<std::string> mFiles;
+	/// How many of mSites the current file has definitions for.
+	size_t miSitesWritten;
+};
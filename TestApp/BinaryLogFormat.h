@@ -0,0 +1,109 @@
+/**
+*  @file BinaryLogFormat.h
+*  @brief The layout of binary log files, shared by the BinaryLog writer and the LogDecoder tool.
+*
+*  A file is a BinaryLogHeader followed by records. Every record starts with a one byte type and
+*  a two byte little endian payload length, so readers can skip types they don't know. A type of 0
+*  marks the end, as files are written into a zeroed mapping that may not have been filled.
+*
+*  Record payloads:
+*      BINARY_LOG_SITE     varint id, u8 level, varint line, string function, string file
+*      BINARY_LOG_MESSAGE  varint site id (0 for none), u8 level, varint microseconds since the header's start time,
+*                          varint thread id, then arguments until the end of the payload
+*      BINARY_LOG_DROPPED  varint microseconds, varint lines dropped because the queue was full
+*
+*  Each argument is a one byte BinaryLogArgument tag followed by its value. Strings are a varint length
+*  then the bytes. Signed integers are zigzag encoded varints, floats and doubles are their raw little endian bits.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+/// "BLOG"
+static const uint32_t BINARY_LOG_MAGIC = 0x474F4C42;
+static const uint16_t BINARY_LOG_VERSION = 1;
+
+/**
+*  @brief The start of every binary log file.
+*/
+struct BinaryLogHeader
+{
+	uint32_t miMagic;
+	uint16_t miVersion;
+	uint16_t miHeaderSize;
+	/// Microseconds since 1970 when the log was opened, which record times are relative to.
+	uint64_t miStartTime;
+	/// The position of this file in the run, from 0.
+	uint32_t miFileIndex;
+	uint32_t miPadding;
+};
+
+enum BinaryLogRecordType
+{
+	BINARY_LOG_END = 0,
+	BINARY_LOG_SITE = 1,
+	BINARY_LOG_MESSAGE = 2,
+	BINARY_LOG_DROPPED = 3
+};
+
+enum BinaryLogArgument
+{
+	BINARY_ARG_STRING = 1,
+	BINARY_ARG_SIGNED = 2,
+	BINARY_ARG_UNSIGNED = 3,
+	BINARY_ARG_FLOAT = 4,
+	BINARY_ARG_DOUBLE = 5,
+	BINARY_ARG_CHAR = 6,
+	BINARY_ARG_BOOL = 7,
+	BINARY_ARG_POINTER = 8
+};
+
+/// The type and payload length at the start of every record.
+static const unsigned int BINARY_LOG_RECORD_HEADER = 3;
+/// The longest a varint gets.
+static const unsigned int BINARY_LOG_MAX_VARINT = 10;
+
+/**
+*  @brief Writes value 7 bits at a time, low bits first, with the top bit set on all but the last byte.
+*  @return The number of bytes written, at most BINARY_LOG_MAX_VARINT.
+*/
+inline unsigned int BinaryLogWriteVarint(unsigned char* out, uint64_t value)
+{
+	unsigned int length = 0;
+	while (value >= 0x80)
+	{
+		out[length++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[length++] = (unsigned char)value;
+	return length;
+}
+
+/**
+*  @brief Reads a varint written by BinaryLogWriteVarint.
+*  @return The number of bytes read, or 0 if it runs past end.
+*/
+inline unsigned int BinaryLogReadVarint(const unsigned char* in, const unsigned char* end, uint64_t& value)
+{
+	value = 0;
+	for (unsigned int i = 0; i < BINARY_LOG_MAX_VARINT && in + i < end; i++)
+	{
+		value |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+		if ((in[i] & 0x80) == 0)
+			return i + 1;
+	}
+	return 0;
+}
+
+/// Maps small negative and positive numbers to small unsigned ones, so they make short varints.
+inline uint64_t BinaryLogZigZag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t BinaryLogUnZigZag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
@@ -3,17 +3,18 @@
 #include <glm/gtx/rotate_vector.hpp>
 
 
-Camera::Camera() : _forward(0, 0, 1), _up(0, 1, 0), _fov(glm::radians(60.0f)), _boost(false), _pan(0,0,0), _tilt(0,0,0), _position(0,0,0), _rotation(0,0,0)
+Camera::Camera() : _forward(0, 0, 1), _up(0, 1, 0), _fov(glm::radians(60.0f)), _nearPlane(0.1f), _farPlane(10000.0f), _boost(false), _pan(0,0,0), _tilt(0,0,0), _position(0,0,0), _rotation(0,0,0)
 {
 	// 2D
 	_orthographicMatrix = glm::ortho(0.0f, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT, 0.0f, 0.1f, 1.1f);
 	_view2dMatrix = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0));
 	// 3D
-	_projectionMatrix = glm::perspective(_fov, (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 10000.0f);
+	_projectionMatrix = glm::perspective(_fov, (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, _nearPlane, _farPlane);
 	_viewMatrix = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0));
 
-	_moveSpeed = 8.0f;
-	_rotationSpeed = 0.016f;
+	// Per second
+	_moveSpeed = 480.0f;
+	_rotationSpeed = 1.0f;
 }
 
 
@@ -28,15 +29,12 @@ Camera::~Camera()
 */
 void Camera::Update(double deltaTime)
 {
-	ImGui::SliderFloat("Move Speed", &_moveSpeed, 1.0f, 100.0f);
-	ImGui::SliderFloat("Rotation Speed", &_rotationSpeed, 0.001f, 100.0f);
-
 	float multiplier = 1.0f;
 	if (_boost) multiplier *= 2.0f;
 
 	
 	// Set Camera Rotations
-	_rotation += _tilt * _rotationSpeed;
+	_rotation += _tilt * _rotationSpeed * (float)deltaTime;
 	if (_rotation.x > glm::radians(88.0f))
 		_rotation.x = glm::radians(88.0f);
 	if (_rotation.x < glm::radians(-88.0f))
@@ -51,7 +49,7 @@ void Camera::Update(double deltaTime)
 
 
 	glm::vec3 rotatedPan = glm::vec3(lookAt * glm::vec4(_pan, 1));
-	_position += rotatedPan * multiplier * _moveSpeed;
+	_position += rotatedPan * multiplier * _moveSpeed * (float)deltaTime;
 
 	glm::mat4 view = glm::lookAt(GetPosition(), GetPosition() + rotation, GetUp());
 
@@ -59,6 +57,17 @@ void Camera::Update(double deltaTime)
 	SetViewMatrix(view);
 }
 
+/*
+*  Draws the camera's settings, only call it when ImGui is set up.
+*/
+void Camera::DrawUI()
+{
+#if defined D_USE_IMGUI
+	ImGui::SliderFloat("Move Speed", &_moveSpeed, 10.0f, 2000.0f);
+	ImGui::SliderFloat("Rotation Speed", &_rotationSpeed, 0.1f, 5.0f);
+#endif
+}
+
 bool Camera::OnKeyPress(int key, bool down)
 {
 	bool used = false;
@@ -10,6 +10,7 @@ public:
 
 	void Initialise() {}
 	void Update(double deltaTime);
+	void DrawUI();
 	void End() {}
 
 	// Getters/Setters
@@ -19,6 +20,8 @@ public:
 	const glm::mat4& GetProjectionMatrix() { return _projectionMatrix; }
 	void SetProjectionMatrix(const glm::mat4& pm) { _projectionMatrix = pm; }
 
+	glm::mat4 GetViewProjectionMatrix() const { return _projectionMatrix * _viewMatrix; }
+
 	const glm::mat4& GetOrthographicMatrix() { return _orthographicMatrix; }
 	void SetOrthographicMatrix(const glm::mat4& om) { _orthographicMatrix = om; }
 
@@ -33,6 +36,9 @@ public:
 	const float& GetFOV() const { return _fov; }
 	void SetFOV(const float& fov) { _fov = fov; }
 
+	float GetNearPlane() const { return _nearPlane; }
+	float GetFarPlane() const { return _farPlane; }
+
 	const glm::vec3& GetPosition() const { return _position; }
 	void SetPosition(const glm::vec3& pos) { _position = pos; }
 
@@ -56,6 +62,9 @@ private:
 	glm::vec3 _up;
 	/// Field of View
 	float _fov;
+	/// Near and far clip distances
+	float _nearPlane;
+	float _farPlane;
 
 	/// Position
 	glm::vec3 _position;
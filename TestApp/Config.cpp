@@ -5,7 +5,7 @@
 *  Loads in settings from a file in the format: key=pair
 *
 *
-*  Values can be retrieved as an Int, float, double, bool, or string but the user must know what format to ask for
+*  Values are parsed once, when the file is read, and can be retrieved as an Int, float, double, bool, or string
 *
 *  @author Sam Murphy
 *  @bug No known bugs.
@@ -13,12 +13,84 @@
 
 #pragma once
 #include "Config.h"
-#include <iostream>
-#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include <fstream>
 
+const std::chrono::milliseconds Config::WATCH_INTERVAL(500);
 
-Config::Config()
+/// The hash table starts this big, it's kept at most three quarters full.
+static const size_t INITIAL_SLOTS = 64;
+
+/**
+*  Cuts the spaces, tabs and carriage returns off both ends of text.
+*/
+static std::string Trim(const std::string& text)
+{
+	const char* whitespace = " \t\r\n";
+	const size_t first = text.find_first_not_of(whitespace);
+	if (first == std::string::npos)
+		return std::string();
+	const size_t last = text.find_last_not_of(whitespace);
+	return text.substr(first, last - first + 1);
+}
+
+ConfigValue::ConfigValue() :
+	meType(CONFIG_STRING),
+	mbNumber(false),
+	mbPresent(false),
+	mbBool(false),
+	miInt(0),
+	mdFloat(0.0)
+{
+}
+
+/**
+*  Works out every way the text can be read. Numbers are read from the start of the text, as stoi and stof read them,
+*  and "true" in any of its usual cases is the only thing that's true.
+*
+*  @param text The value, with the whitespace around it already trimmed.
+*/
+void ConfigValue::Parse(const std::string& text)
+{
+	mText = text;
+	mbPresent = true;
+
+	const char* begin = mText.c_str();
+	const char* end = begin + mText.size();
+
+	char* intEnd;
+	long long i = strtoll(begin, &intEnd, 10);
+	if (i > INT_MAX)
+		i = INT_MAX;
+	if (i < INT_MIN)
+		i = INT_MIN;
+	miInt = (int)i;
+
+	char* floatEnd;
+	mdFloat = strtod(begin, &floatEnd);
+	mbNumber = floatEnd != begin;
+
+	mbBool = mText == "true" || mText == "True" || mText == "TRUE";
+	const bool isBool = mbBool || mText == "false" || mText == "False" || mText == "FALSE";
+
+	if (intEnd == end && intEnd != begin)
+		meType = CONFIG_INT;
+	else if (floatEnd == end && mbNumber)
+		meType = CONFIG_FLOAT;
+	else if (isBool)
+		meType = CONFIG_BOOL;
+	else
+		meType = CONFIG_STRING;
+}
+
+Config::Config() :
+	mSlots(INITIAL_SLOTS, 0),
+	miNextCallbackId(1),
+	mLastCheck(std::chrono::steady_clock::now())
 {
 }
 
@@ -28,128 +100,364 @@ Config::~Config()
 }
 
 /**
-*  Reads in the config file from "filePath", and stores all the settings in configValues. Values must be in the format: key=value.
-*  Lines beggining with '#' are ignored as comments.
+*  Reads in the config file from "filePath", and stores all the settings. Values must be in the format: key=value.
+*  Lines beggining with '#' are ignored as comments, and whitespace around keys and values is ignored.
+*  Settings already read from other files are kept, unless this file has them too. The file is watched for changes by Update.
 *
 *  @param filePath The path including file extension to the config file.
+*  @return false if the file couldn't be opened.
 */
-void Config::ReadInFromFile(const std::string & filePath)
+bool Config::ReadInFromFile(const std::string & filePath)
 {
-	std::ifstream fileStream;
-	fileStream.open(filePath);	
-	std::string line;
+	WatchedFile file;
+	file.mPath = filePath;
+	if (!GetFileTime(filePath, file.miModified, file.miSize))
+		file.miModified = file.miSize = -1;
 
-	if (fileStream.is_open())
+	bool watched = false;
+	for (WatchedFile& existing : mFiles)
 	{
-		while (std::getline(fileStream, line))
+		if (existing.mPath == filePath)
 		{
-			std::istringstream is_line(line);
-			std::string key;
-			if (std::getline(is_line, key, '='))
-			{
-				std::string value;
-				if (key[0] == '#')
-					continue;
-
-				if (std::getline(is_line, value))
-				{
-					configValues[key] = value;
-				}
-			}
+			existing = file;
+			watched = true;
 		}
 	}
+	if (!watched)
+		mFiles.push_back(file);
+
+	KeyValues values;
+	if (!ParseFile(filePath, values))
+		return false;
+
+	std::vector<unsigned int> changed;
+	for (const std::pair<std::string, std::string>& keyValue : values)
+	{
+		const uint32_t hash = Hash(keyValue.first.c_str(), keyValue.first.size());
+		int index = Find(keyValue.first.c_str(), keyValue.first.size(), hash);
+		if (index < 0)
+			index = (int)Insert(keyValue.first, hash);
+		if (Set((unsigned int)index, keyValue.second))
+			changed.push_back((unsigned int)index);
+	}
+
+	Notify(changed);
+	return true;
+}
+
+/**
+*  Retrieves the value with the key "key".
+*
+*  @param key The key value of the setting you're looking for in string format.
+*  @return The value with the key "key" as a string, returns an empty string if no value is found.
+*/
+const std::string& Config::GetValue(const std::string& key) const
+{
+	const int index = Find(key.c_str(), key.size(), Hash(key.c_str(), key.size()));
+	return index >= 0 ? mEntries[index].mValue.mText : mMissing.mText;
 }
 
 /**
-*  Retrieves the value with the key "key" from configValues as an int.
+*  Retrieves the value with the key "key" as an int.
 *
 *  @param key The key value of the setting you're looking for in string format.
 *  @return The value with the key "key" as an int, returns 0 if no value is found.
 */
-int Config::GetValueAsInt(const std::string & key)
+int Config::GetValueAsInt(const std::string & key) const
 {
-	std::string value = GetValue(key);
+	const int index = Find(key.c_str(), key.size(), Hash(key.c_str(), key.size()));
+	const ConfigValue& value = index >= 0 ? mEntries[index].mValue : mMissing;
 
-	int i = 0;
+	if (value.mbPresent && !value.mbNumber)
+		printf("failed to parse %s value to int\n", key.c_str());
+	return value.AsInt();
+}
+
+/**
+*  Retrieves the value with the key "key" as an float.
+*
+*  @param key The key value of the setting you're looking for in string format.
+*  @return The value with the key "key" as an float, returns 0.0f if no value is found.
+*/
+float Config::GetValueAsFloat(const std::string & key) const
+{
+	const int index = Find(key.c_str(), key.size(), Hash(key.c_str(), key.size()));
+	const ConfigValue& value = index >= 0 ? mEntries[index].mValue : mMissing;
+
+	if (value.mbPresent && !value.mbNumber)
+		printf("failed to parse %s value to float\n", key.c_str());
+	return value.AsFloat();
+}
+
+/**
+*  Retrieves the value with the key "key" as an double.
+*
+*  @param key The key value of the setting you're looking for in string format.
+*  @return The value with the key "key" as an double, returns 0.0 if no value is found.
+*/
+double Config::GetValueAsDouble(const std::string & key) const
+{
+	const int index = Find(key.c_str(), key.size(), Hash(key.c_str(), key.size()));
+	const ConfigValue& value = index >= 0 ? mEntries[index].mValue : mMissing;
+
+	if (value.mbPresent && !value.mbNumber)
+		printf("failed to parse %s value to double\n", key.c_str());
+	return value.AsDouble();
+}
+
+/**
+*  Retrieves the value with the key "key" as a bool.
+*
+*  @param key The key value of the setting you're looking for in string format.
+*  @return The value with the key "key" as an bool, returns false if no value is found.
+*/
+bool Config::GetValueAsBool(const std::string& key) const
+{
+	const int index = Find(key.c_str(), key.size(), Hash(key.c_str(), key.size()));
+	return index >= 0 ? mEntries[index].mValue.AsBool() : false;
+}
+
+ConfigHandle Config::GetHandle(const std::string& key)
+{
+	const uint32_t hash = Hash(key.c_str(), key.size());
+	const int index = Find(key.c_str(), key.size(), hash);
+	return ConfigHandle(index >= 0 ? (unsigned int)index : Insert(key, hash));
+}
+
+unsigned int Config::AddCallback(ConfigHandle handle, ConfigCallback callback)
+{
+	Callback entry;
+	entry.miId = miNextCallbackId++;
+	entry.miIndex = handle.miIndex;
+	entry.mCallback = callback;
+	mCallbacks.push_back(entry);
+	return entry.miId;
+}
 
-	try
+void Config::RemoveCallback(unsigned int id)
+{
+	for (size_t i = 0; i < mCallbacks.size(); i++)
 	{
-		i = std::stoi(value);
+		if (mCallbacks[i].miId == id)
+		{
+			mCallbacks.erase(mCallbacks.begin() + i);
+			return;
+		}
 	}
-	catch(...)
+}
+
+bool Config::Update()
+{
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - mLastCheck < WATCH_INTERVAL)
+		return false;
+	mLastCheck = now;
+
+	for (const WatchedFile& file : mFiles)
 	{
-		printf("failed to parse %s value to int\n", key.c_str());
-		return 0;
+		int64_t modified = -1, size = -1;
+		GetFileTime(file.mPath, modified, size);
+		if (modified != file.miModified || size != file.miSize)
+		{
+			Reload();
+			return true;
+		}
 	}
-
-	return i;
+	return false;
 }
 
 /**
-*  Retrieves the value with the key "key" from configValues as an float.
-*
-*  @param key The key value of the setting you're looking for in string format.
-*  @return The value with the key "key" as an float, returns 0.0f if no value is found.
+*  Reads every file in again, in the order they were first read. Settings that aren't in any of them any more are marked missing.
 */
-float Config::GetValueAsFloat(const std::string & key)
+void Config::Reload()
 {
-	std::string value = GetValue(key);
+	std::vector<bool> seen(mEntries.size(), false);
+	std::vector<unsigned int> changed;
+
+	for (WatchedFile& file : mFiles)
+	{
+		if (!GetFileTime(file.mPath, file.miModified, file.miSize))
+			file.miModified = file.miSize = -1;
+
+		KeyValues values;
+		if (!ParseFile(file.mPath, values))
+		{
+			printf("failed to reload %s\n", file.mPath.c_str());
+			continue;
+		}
 
-	float f = 0;
+		for (const std::pair<std::string, std::string>& keyValue : values)
+		{
+			const uint32_t hash = Hash(keyValue.first.c_str(), keyValue.first.size());
+			int index = Find(keyValue.first.c_str(), keyValue.first.size(), hash);
+			if (index < 0)
+			{
+				index = (int)Insert(keyValue.first, hash);
+				seen.resize(mEntries.size(), false);
+			}
+			seen[index] = true;
+			if (Set((unsigned int)index, keyValue.second))
+				changed.push_back((unsigned int)index);
+		}
+	}
 
-	try
+	for (size_t i = 0; i < seen.size(); i++)
 	{
-		f = std::stof(value);
+		if (!seen[i] && mEntries[i].mValue.mbPresent)
+		{
+			mEntries[i].mValue = ConfigValue();
+			changed.push_back((unsigned int)i);
+		}
 	}
-	catch (...)
+
+	// A key in more than one file changes once per file, only call back for it once
+	std::vector<bool> notified(mEntries.size(), false);
+	std::vector<unsigned int> unique;
+	for (unsigned int index : changed)
 	{
-		printf("failed to parse %s value to float\n", key.c_str());
-		return 0;
+		if (!notified[index])
+			unique.push_back(index);
+		notified[index] = true;
 	}
+	Notify(unique);
+}
 
-	return f;
+/**
+*  FNV-1a, the hash every key is stored under.
+*/
+uint32_t Config::Hash(const char* key, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619u;
+	}
+	return hash;
 }
 
 /**
-*  Retrieves the value with the key "key" from configValues as an double.
+*  Reads the key=value lines of a file.
 *
-*  @param key The key value of the setting you're looking for in string format.
-*  @return The value with the key "key" as an double, returns 0.0 if no value is found.
+*  @return false if the file couldn't be opened.
 */
-double Config::GetValueAsDouble(const std::string & key)
+bool Config::ParseFile(const std::string& filePath, KeyValues& values)
 {
-	std::string value = GetValue(key);
-
-	double d = 0;
+	std::ifstream fileStream;
+	fileStream.open(filePath);
+	if (!fileStream.is_open())
+		return false;
 
-	try
+	std::string line;
+	while (std::getline(fileStream, line))
 	{
-		d = std::stod(value);
+		const size_t equals = line.find('=');
+		if (equals == std::string::npos)
+			continue;
+
+		std::string key = Trim(line.substr(0, equals));
+		if (key.empty() || key[0] == '#')
+			continue;
+
+		values.push_back(std::make_pair(key, Trim(line.substr(equals + 1))));
 	}
-	catch (...)
+	return true;
+}
+
+bool Config::GetFileTime(const std::string& filePath, int64_t& modified, int64_t& size)
+{
+#if defined _WIN32
+	struct _stat64 info;
+	if (_stat64(filePath.c_str(), &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(filePath.c_str(), &info) != 0)
+		return false;
+#endif
+	modified = (int64_t)info.st_mtime;
+	size = (int64_t)info.st_size;
+	return true;
+}
+
+/**
+*  @return The index of the key in mEntries, or -1 if it isn't there.
+*/
+int Config::Find(const char* key, size_t length, uint32_t hash) const
+{
+	const size_t mask = mSlots.size() - 1;
+	for (size_t slot = hash & mask; mSlots[slot] != 0; slot = (slot + 1) & mask)
 	{
-		printf("failed to parse %s value to double\n", key.c_str());
-		return 0;
+		const Entry& entry = mEntries[mSlots[slot] - 1];
+		if (entry.miHash == hash && entry.mKey.size() == length && memcmp(entry.mKey.data(), key, length) == 0)
+			return (int)(mSlots[slot] - 1);
 	}
-
-	return d;
+	return -1;
 }
 
 /**
-*  Retrieves the value with the key "key" from configValues as a bool.
+*  Adds a key that isn't there yet, as missing.
 *
-*  @param key The key value of the setting you're looking for in string format.
-*  @return The value with the key "key" as an bool, returns false if no value is found.
+*  @return Its index in mEntries.
 */
-bool Config::GetValueAsBool(const std::string& key)
+unsigned int Config::Insert(const std::string& key, uint32_t hash)
 {
-	std::string value = GetValue(key);
+	if ((mEntries.size() + 1) * 4 > mSlots.size() * 3)
+		Grow();
 
-	if (value.compare("true") == 0 ||
-		value.compare("True") == 0 ||
-		value.compare("TRUE") == 0)
+	Entry entry;
+	entry.mKey = key;
+	entry.miHash = hash;
+	mEntries.push_back(entry);
+	const unsigned int index = (unsigned int)mEntries.size() - 1;
+
+	const size_t mask = mSlots.size() - 1;
+	size_t slot = hash & mask;
+	while (mSlots[slot] != 0)
+		slot = (slot + 1) & mask;
+	mSlots[slot] = index + 1;
+	return index;
+}
+
+void Config::Grow()
+{
+	std::vector<unsigned int> slots(mSlots.size() * 2, 0);
+	const size_t mask = slots.size() - 1;
+	for (unsigned int i = 0; i < mEntries.size(); i++)
 	{
-		return true;
+		size_t slot = mEntries[i].miHash & mask;
+		while (slots[slot] != 0)
+			slot = (slot + 1) & mask;
+		slots[slot] = i + 1;
+	}
+	mSlots.swap(slots);
+}
+
+/**
+*  @return true if the value changed.
+*/
+bool Config::Set(unsigned int index, const std::string& text)
+{
+	ConfigValue& value = mEntries[index].mValue;
+	if (value.mbPresent && value.mText == text)
+		return false;
+	value.Parse(text);
+	return true;
+}
+
+void Config::Notify(const std::vector<unsigned int>& changed)
+{
+	if (changed.empty() || mCallbacks.empty())
+		return;
+
+	// Callbacks can add and remove callbacks
+	const std::vector<Callback> callbacks = mCallbacks;
+	for (unsigned int index : changed)
+	{
+		for (const Callback& callback : callbacks)
+		{
+			if (callback.miIndex == index)
+				callback.mCallback(mEntries[index].mValue);
+		}
 	}
-	return false;
 }
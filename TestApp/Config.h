@@ -5,68 +5,164 @@
 *  Loads in settings from a file in the format: key=pair
 *
 *
-*  Values can be retrieved as an Int, float, double, bool, or string but the user must know what format to ask for
-*	
+*  Values are parsed once, when the file is read, into a ConfigValue holding them as an int, float, double, bool and string.
+*  They can be looked up by key, or through a ConfigHandle that goes straight to the value for reads every frame.
+*  The files read are watched, and read again when they change, calling back for the values that changed.
+*
 *  @author Sam Murphy
 *  @bug No known bugs.
 */
 
 #pragma once
-#include <map>
+#include <stdint.h>
+#include <chrono>
+#include <functional>
 #include <string>
+#include <vector>
+
+enum ConfigType
+{
+	CONFIG_STRING,
+	CONFIG_BOOL,
+	CONFIG_INT,
+	CONFIG_FLOAT
+};
+
+/**
+*  @brief A setting's value, parsed into every type it can be read as.
+*/
+struct ConfigValue
+{
+	ConfigValue();
+
+	void Parse(const std::string& text);
+
+	int AsInt() const { return miInt; }
+	float AsFloat() const { return (float)mdFloat; }
+	double AsDouble() const { return mdFloat; }
+	bool AsBool() const { return mbBool; }
+	const std::string& AsString() const { return mText; }
+
+	/// What the whole of the text is, e.g. "1.5" is a float though it can be read as the int 1.
+	ConfigType meType;
+	/// Whether the text starts with a number, as there's no other way to tell a 0 from a failure.
+	bool mbNumber;
+	/// Whether the key is in the file, missing values read as 0, false and empty.
+	bool mbPresent;
+	bool mbBool;
+	int miInt;
+	double mdFloat;
+	std::string mText;
+};
+
+/**
+*  @brief Refers straight to one setting in a Config, so reading it doesn't have to look the key up.
+*  Stays valid across reloads, and for keys that aren't in the file yet.
+*/
+class ConfigHandle
+{
+public:
+	ConfigHandle() : miIndex(INVALID) {}
+	bool IsValid() const { return miIndex != INVALID; }
+
+private:
+	friend class Config;
+	static const unsigned int INVALID = 0xFFFFFFFF;
+	explicit ConfigHandle(unsigned int index) : miIndex(index) {}
+
+	unsigned int miIndex;
+};
 
-typedef std::map<std::string, std::string> ConfigInfo;
-typedef std::map<std::string, std::string>::iterator ConfigInfoIterator;
+typedef std::function<void(const ConfigValue&)> ConfigCallback;
 
 /**
 *  Loads and stores key-value pair settings from a config file.
 *
-*
+*  Settings are kept in a flat, open addressed hash table of key hashes, pointing into the list of values.
 */
 class Config
 {
 public:
+	/// How often Update checks whether the files have changed.
+	static const std::chrono::milliseconds WATCH_INTERVAL;
+
 	Config();
 	~Config();
 
-	/// All key-value pair settings
-	ConfigInfo configValues;
+	bool ReadInFromFile(const std::string& filePath);
 
-	void ReadInFromFile(const std::string& filePath);
+	const std::string& GetValue(const std::string& key) const;
 
-	std::string& GetValue(const std::string& key);
+	int GetValueAsInt(const std::string& key) const;
+	float GetValueAsFloat(const std::string& key) const;
+	double GetValueAsDouble(const std::string& key) const;
+	bool GetValueAsBool(const std::string& key) const;
 
-	int GetValueAsInt(const std::string& key);
-	float GetValueAsFloat(const std::string& key);
-	double GetValueAsDouble(const std::string& key);
-	bool GetValueAsBool(const std::string& key);
+	/// The handle for key, which is added as missing if it hasn't been read yet.
+	ConfigHandle GetHandle(const std::string& key);
+	const ConfigValue& Get(ConfigHandle handle) const { return mEntries[handle.miIndex].mValue; }
 
+	/**
+	*  @brief Calls callback on the thread that calls Update whenever the setting changes, including when it's added or removed.
+	*  @return An id to remove the callback with.
+	*/
+	unsigned int AddCallback(ConfigHandle handle, ConfigCallback callback);
+	void RemoveCallback(unsigned int id);
 
+	/**
+	*  @brief Call once a frame. Reads the files in again if any have changed since they were read.
+	*  @return true if they were read in again.
+	*/
+	bool Update();
+	/// Reads every file in again, calling back for the settings that changed.
+	void Reload();
+
+	static uint32_t Hash(const char* key, size_t length);
 
 private:
-	/// Empty string, to return on failure.
-	std::string empty;
+	struct Entry
+	{
+		std::string mKey;
+		uint32_t miHash;
+		ConfigValue mValue;
+	};
 
-};
+	struct Callback
+	{
+		unsigned int miId;
+		unsigned int miIndex;
+		ConfigCallback mCallback;
+	};
 
-/**
-*  Retrieves the value with the key "key" from configValues, by iterating through the map
-*
-*  @param key The key value of the setting you're looking for in string format.
-*  @return The value with the key "key" as a string, returns an empty string if no value is found.
-*/
-inline std::string& Config::GetValue(const std::string& key)
-{
-	// Found
-	ConfigInfoIterator i = configValues.find(key);
-	if (i != configValues.end())
+	struct WatchedFile
 	{
-		return i->second;
-	}
-	// Not found
-	empty = "";
-	return empty;
-}
+		std::string mPath;
+		int64_t miModified;
+		int64_t miSize;
+	};
+
+	typedef std::vector<std::pair<std::string, std::string> > KeyValues;
 
+	static bool ParseFile(const std::string& filePath, KeyValues& values);
+	static bool GetFileTime(const std::string& filePath, int64_t& modified, int64_t& size);
 
+	int Find(const char* key, size_t length, uint32_t hash) const;
+	unsigned int Insert(const std::string& key, uint32_t hash);
+	void Grow();
+	bool Set(unsigned int index, const std::string& text);
+	void Notify(const std::vector<unsigned int>& changed);
 
+	/// Every key ever read or asked for, which handles index. They're never removed, only marked missing.
+	std::vector<Entry> mEntries;
+	/// The hash table, each slot is an index into mEntries plus 1, or 0 if it's empty. Its size is a power of 2.
+	std::vector<unsigned int> mSlots;
+
+	std::vector<Callback> mCallbacks;
+	unsigned int miNextCallbackId;
+
+	std::vector<WatchedFile> mFiles;
+	std::chrono::steady_clock::time_point mLastCheck;
+
+	/// Returned for keys that aren't there.
+	ConfigValue mMissing;
+};
@@ -0,0 +1,205 @@
+/**
+*  @file DDS.h
+*  @brief The subset of the DDS file format written by the TextureBaker.
+*
+*  Block compressed 2D textures with a full mip chain, identified by their FourCC.
+*  Has no platform dependencies so it is shared between the app and the baker.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+static const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+static const uint32_t DDSD_CAPS = 0x1;
+static const uint32_t DDSD_HEIGHT = 0x2;
+static const uint32_t DDSD_WIDTH = 0x4;
+static const uint32_t DDSD_PIXELFORMAT = 0x1000;
+static const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+static const uint32_t DDSD_LINEARSIZE = 0x80000;
+
+static const uint32_t DDPF_FOURCC = 0x4;
+
+static const uint32_t DDSCAPS_COMPLEX = 0x8;
+static const uint32_t DDSCAPS_TEXTURE = 0x1000;
+static const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+// The G-buffer pixel shader clips texels with less alpha than this, out of 255
+static const uint8_t DDS_ALPHA_CLIP_THRESHOLD = 128;
+
+// The baker tags the first two reserved words, so files from other tools aren't read as having its flags
+static const uint32_t DDS_BAKER_TAG = DDS_FOURCC('T', 'B', 'A', 'K');
+static const uint32_t DDS_BAKER_ALPHA_TESTED = 0x1;
+
+/**
+*  @brief The block compressed formats the baker can write.
+*/
+enum DDSFormat
+{
+	DDS_FORMAT_UNKNOWN = 0,
+	DDS_FORMAT_BC1,
+	DDS_FORMAT_BC3,
+	DDS_FORMAT_BC5,
+};
+
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t rBitMask;
+	uint32_t gBitMask;
+	uint32_t bBitMask;
+	uint32_t aBitMask;
+};
+
+struct DDSHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DDSPixelFormat pixelFormat;
+	uint32_t caps;
+	uint32_t caps2;
+	uint32_t caps3;
+	uint32_t caps4;
+	uint32_t reserved2;
+};
+
+/**
+*  @brief Where to find the mips of a parsed DDS file.
+*/
+struct DDSInfo
+{
+	DDSFormat format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+	/// Set if some texel would be clipped. Files the baker didn't tag count any BC3 as alpha tested.
+	bool alphaTested;
+	/// Offset of the top mip from the start of the file, the rest follow tightly packed.
+	size_t dataOffset;
+};
+
+/**
+*  @brief The number of bytes in one 4x4 block of a format.
+*/
+inline uint32_t DDSBlockBytes(DDSFormat format)
+{
+	return format == DDS_FORMAT_BC1 ? 8 : 16;
+}
+
+inline uint32_t DDSFourCC(DDSFormat format)
+{
+	switch (format)
+	{
+	case DDS_FORMAT_BC1: return DDS_FOURCC('D', 'X', 'T', '1');
+	case DDS_FORMAT_BC3: return DDS_FOURCC('D', 'X', 'T', '5');
+	case DDS_FORMAT_BC5: return DDS_FOURCC('A', 'T', 'I', '2');
+	default: return 0;
+	}
+}
+
+/**
+*  @brief The size in bytes of one mip level.
+*/
+inline size_t DDSMipSize(DDSFormat format, uint32_t width, uint32_t height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * DDSBlockBytes(format);
+}
+
+/**
+*  @brief The row pitch in bytes of one mip level.
+*/
+inline uint32_t DDSMipPitch(DDSFormat format, uint32_t width)
+{
+	return ((width + 3) / 4) * DDSBlockBytes(format);
+}
+
+/**
+*  @brief Fills in the header for a block compressed texture with a mip chain.
+*
+*  @param alphaTested Whether any texel has less alpha than DDS_ALPHA_CLIP_THRESHOLD.
+*/
+inline void DDSMakeHeader(DDSFormat format, uint32_t width, uint32_t height, uint32_t mipCount, bool alphaTested, DDSHeader& header)
+{
+	memset(&header, 0, sizeof(DDSHeader));
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = height;
+	header.width = width;
+	header.pitchOrLinearSize = (uint32_t)DDSMipSize(format, width, height);
+	header.mipMapCount = mipCount;
+	header.reserved1[0] = DDS_BAKER_TAG;
+	header.reserved1[1] = alphaTested ? DDS_BAKER_ALPHA_TESTED : 0;
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = DDSFourCC(format);
+	header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+}
+
+/**
+*  @brief Reads the header of a DDS file in memory and checks all the mips are present.
+*
+*  @param data The contents of the file.
+*  @param size The size of the file in bytes.
+*  @param info Filled in with the format, dimensions and where the data starts.
+*  @return false if the file isn't one of the supported formats, isn't a multiple of 4 in size, or is truncated.
+*/
+inline bool DDSParse(const unsigned char* data, size_t size, DDSInfo& info)
+{
+	if (size < sizeof(uint32_t) + sizeof(DDSHeader))
+		return false;
+
+	uint32_t magic;
+	memcpy(&magic, data, sizeof(uint32_t));
+	if (magic != DDS_MAGIC)
+		return false;
+
+	DDSHeader header;
+	memcpy(&header, data + sizeof(uint32_t), sizeof(DDSHeader));
+	if (header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & DDPF_FOURCC))
+		return false;
+
+	info.format = DDS_FORMAT_UNKNOWN;
+	if (header.pixelFormat.fourCC == DDSFourCC(DDS_FORMAT_BC1)) info.format = DDS_FORMAT_BC1;
+	if (header.pixelFormat.fourCC == DDSFourCC(DDS_FORMAT_BC3)) info.format = DDS_FORMAT_BC3;
+	if (header.pixelFormat.fourCC == DDSFourCC(DDS_FORMAT_BC5)) info.format = DDS_FORMAT_BC5;
+	if (info.format == DDS_FORMAT_UNKNOWN || header.width == 0 || header.height == 0)
+		return false;
+
+	// D3D11 only creates block compressed textures whose top mip is whole blocks
+	if (header.width % 4 != 0 || header.height % 4 != 0)
+		return false;
+
+	info.width = header.width;
+	info.height = header.height;
+	info.mipCount = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+	if (header.reserved1[0] == DDS_BAKER_TAG)
+		info.alphaTested = (header.reserved1[1] & DDS_BAKER_ALPHA_TESTED) != 0;
+	else
+		info.alphaTested = info.format == DDS_FORMAT_BC3;
+	info.dataOffset = sizeof(uint32_t) + sizeof(DDSHeader);
+
+	// Make sure every mip is actually there
+	size_t required = info.dataOffset;
+	uint32_t width = info.width;
+	uint32_t height = info.height;
+	for (uint32_t i = 0; i < info.mipCount; i++)
+	{
+		required += DDSMipSize(info.format, width, height);
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return required <= size;
+}
@@ -0,0 +1,117 @@
+/**
+*  @file DeviceStateCache.cpp
+*  @brief Remembers the pipeline state it last set so redundant device calls can be skipped.
+*
+*  @bug No known bugs.
+*/
+#include "DeviceStateCache.h"
+
+DeviceStateCache::DeviceStateCache()
+{
+	Invalidate();
+	ResetStats();
+}
+
+/**
+*  @brief Forgets the tracked state, so the next call for each slot always reaches the device.
+*/
+void DeviceStateCache::Invalidate()
+{
+	mpVertexBuffer = nullptr;
+	miVertexStride = 0;
+	mpIndexBuffer = nullptr;
+	meIndexFormat = INDEX_FORMAT_32;
+	meTopology = TOPOLOGY_UNDEFINED;
+	for (unsigned int i = 0; i < MAX_CONSTANT_BUFFERS; i++)
+		mpVSConstantBuffers[i] = nullptr;
+	for (unsigned int i = 0; i < MAX_SHADER_RESOURCES; i++)
+		mpPSTextures[i] = nullptr;
+	miValid = 0;
+}
+
+void DeviceStateCache::ResetStats()
+{
+	mStats.miDraws = 0;
+	mStats.miStateChanges = 0;
+	mStats.miSkippedStateChanges = 0;
+}
+
+void DeviceStateCache::SetVertexBuffer(GraphicsDevice* device, GraphicsBuffer* buffer, unsigned int stride)
+{
+	if ((miValid & VALID_VERTEX_BUFFER) && mpVertexBuffer == buffer && miVertexStride == stride)
+	{
+		mStats.miSkippedStateChanges++;
+		return;
+	}
+
+	device->SetVertexBuffer(buffer, stride);
+	mpVertexBuffer = buffer;
+	miVertexStride = stride;
+	miValid |= VALID_VERTEX_BUFFER;
+	mStats.miStateChanges++;
+}
+
+void DeviceStateCache::SetIndexBuffer(GraphicsDevice* device, GraphicsBuffer* buffer, IndexFormat format)
+{
+	if ((miValid & VALID_INDEX_BUFFER) && mpIndexBuffer == buffer && meIndexFormat == format)
+	{
+		mStats.miSkippedStateChanges++;
+		return;
+	}
+
+	device->SetIndexBuffer(buffer, format);
+	mpIndexBuffer = buffer;
+	meIndexFormat = format;
+	miValid |= VALID_INDEX_BUFFER;
+	mStats.miStateChanges++;
+}
+
+void DeviceStateCache::SetPrimitiveTopology(GraphicsDevice* device, PrimitiveTopology topology)
+{
+	if ((miValid & VALID_TOPOLOGY) && meTopology == topology)
+	{
+		mStats.miSkippedStateChanges++;
+		return;
+	}
+
+	device->SetPrimitiveTopology(topology);
+	meTopology = topology;
+	miValid |= VALID_TOPOLOGY;
+	mStats.miStateChanges++;
+}
+
+void DeviceStateCache::SetVSConstantBuffer(GraphicsDevice* device, unsigned int slot, GraphicsBuffer* buffer)
+{
+	const unsigned int validBit = VALID_VS_CONSTANT_BUFFER_0 << slot;
+	if (slot < MAX_CONSTANT_BUFFERS && (miValid & validBit) && mpVSConstantBuffers[slot] == buffer)
+	{
+		mStats.miSkippedStateChanges++;
+		return;
+	}
+
+	device->SetVSConstantBuffer(slot, buffer);
+	if (slot < MAX_CONSTANT_BUFFERS)
+	{
+		mpVSConstantBuffers[slot] = buffer;
+		miValid |= validBit;
+	}
+	mStats.miStateChanges++;
+}
+
+void DeviceStateCache::SetPSTexture(GraphicsDevice* device, unsigned int slot, GraphicsTexture* texture)
+{
+	const unsigned int validBit = VALID_PS_SHADER_RESOURCE_0 << slot;
+	if (slot < MAX_SHADER_RESOURCES && (miValid & validBit) && mpPSTextures[slot] == texture)
+	{
+		mStats.miSkippedStateChanges++;
+		return;
+	}
+
+	device->SetPSTexture(slot, texture);
+	if (slot < MAX_SHADER_RESOURCES)
+	{
+		mpPSTextures[slot] = texture;
+		miValid |= validBit;
+	}
+	mStats.miStateChanges++;
+}
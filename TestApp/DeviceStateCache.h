@@ -0,0 +1,68 @@
+/**
+*  @file DeviceStateCache.h
+*  @brief Remembers the pipeline state it last set so redundant device calls can be skipped.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include "GraphicsDevice.h"
+
+/**
+*  @brief Counts of the state changes made and skipped through a DeviceStateCache.
+*/
+struct DeviceStateStats
+{
+	unsigned int miDraws;
+	unsigned int miStateChanges;
+	unsigned int miSkippedStateChanges;
+};
+
+/**
+*  @brief Shadows the input assembler, vertex constant buffer and pixel shader resource state.
+*
+*  Only state set through the cache is tracked, so Invalidate must be called whenever
+*  anything else might have changed the bindings, at the latest at the start of each pass.
+*/
+class DeviceStateCache
+{
+public:
+	static const unsigned int MAX_SHADER_RESOURCES = 8;
+	static const unsigned int MAX_CONSTANT_BUFFERS = 4;
+
+	DeviceStateCache();
+
+	void Invalidate();
+	void ResetStats();
+
+	void SetVertexBuffer(GraphicsDevice* device, GraphicsBuffer* buffer, unsigned int stride);
+	void SetIndexBuffer(GraphicsDevice* device, GraphicsBuffer* buffer, IndexFormat format);
+	void SetPrimitiveTopology(GraphicsDevice* device, PrimitiveTopology topology);
+	void SetVSConstantBuffer(GraphicsDevice* device, unsigned int slot, GraphicsBuffer* buffer);
+	void SetPSTexture(GraphicsDevice* device, unsigned int slot, GraphicsTexture* texture);
+
+	void CountDraw() { mStats.miDraws++; }
+	const DeviceStateStats& GetStats() const { return mStats; }
+
+private:
+	GraphicsBuffer* mpVertexBuffer;
+	unsigned int miVertexStride;
+	GraphicsBuffer* mpIndexBuffer;
+	IndexFormat meIndexFormat;
+	PrimitiveTopology meTopology;
+	GraphicsBuffer* mpVSConstantBuffers[MAX_CONSTANT_BUFFERS];
+	GraphicsTexture* mpPSTextures[MAX_SHADER_RESOURCES];
+
+	enum ValidBits
+	{
+		VALID_VERTEX_BUFFER = 1 << 0,
+		VALID_INDEX_BUFFER = 1 << 1,
+		VALID_TOPOLOGY = 1 << 2,
+		VALID_VS_CONSTANT_BUFFER_0 = 1 << 3,
+		VALID_PS_SHADER_RESOURCE_0 = VALID_VS_CONSTANT_BUFFER_0 << MAX_CONSTANT_BUFFERS,
+	};
+
+	/// Which of the tracked values are known to match the device, ValidBits.
+	unsigned int miValid;
+
+	DeviceStateStats mStats;
+};
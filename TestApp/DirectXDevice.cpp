@@ -11,6 +11,8 @@
 #pragma once
 #include "DirectXDevice.h"
 #include <iostream>
+#include <vector>
+#include <float.h>
 #include "Window_DX.h"
 
 #include "ImGui\imgui.h"
@@ -25,9 +27,11 @@
 
 static const float clearColour[4] = { 227.0f / 255.0f, 0, 140.0f / 255.0f, 1.0f }; // Pinkish
 
-DirectXDevice::DirectXDevice(Window_DX* win) : _window(win)
+DirectXDevice::DirectXDevice(Window_DX* win) : _window(win), _uiDrawData(nullptr), _uiWidth(0.0f), _uiHeight(0.0f)
 {
 	_hWnd = win->GetHWND();
+	ZeroMemory(&_backBufferTexture, sizeof(_backBufferTexture));
+	ZeroMemory(&_depthTexture, sizeof(_depthTexture));
 }
 
 
@@ -220,14 +224,16 @@ void DirectXDevice::ClearScreen()
 
 /**
 *  @brief Swaps the buffers
-*  calls Present on the swap chain.
+*  draws the UI set by SetUIDrawData, then calls Present on the swap chain.
 */
 void DirectXDevice::SwapBuffers()
 {
 #if defined D_USE_IMGUI
-	_context->OMSetRenderTargets(1, &_backbuffer, _depthStencilView);
-	ImGui::Render();
-	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	if (_uiDrawData)
+	{
+		_context->OMSetRenderTargets(1, &_backbuffer, _depthStencilView);
+		ImGui_ImplDX11_RenderDrawData(_uiDrawData, ImVec2(_uiWidth, _uiHeight));
+	}
 #endif
 	_swapchain->Present(0, 0);
 }
@@ -673,4 +679,438 @@ int DirectXDevice::GetNumberOfMonitors()
 	lpFactory->Release();
 
 	return numberOfMonitors;
-}
\ No newline at end of file
+}
+
+/*----------------------------------------------------------------------------------------------------------------*/
+// GRAPHICS DEVICE
+/*----------------------------------------------------------------------------------------------------------------*/
+
+static DXGI_FORMAT ToDXGIFormat(TextureFormat format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_RGBA16_FLOAT: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+	case TEXTURE_FORMAT_RG16_SNORM: return DXGI_FORMAT_R16G16_SNORM;
+	case TEXTURE_FORMAT_BC1: return DXGI_FORMAT_BC1_UNORM;
+	case TEXTURE_FORMAT_BC3: return DXGI_FORMAT_BC3_UNORM;
+	case TEXTURE_FORMAT_BC5: return DXGI_FORMAT_BC5_UNORM;
+	default: return DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+static DXGI_FORMAT ToDXGIFormat(VertexElementFormat format)
+{
+	switch (format)
+	{
+	case VERTEX_FORMAT_FLOAT2: return DXGI_FORMAT_R32G32_FLOAT;
+	case VERTEX_FORMAT_FLOAT3: return DXGI_FORMAT_R32G32B32_FLOAT;
+	case VERTEX_FORMAT_UNORM16X4: return DXGI_FORMAT_R16G16B16A16_UNORM;
+	case VERTEX_FORMAT_SNORM16X2: return DXGI_FORMAT_R16G16_SNORM;
+	default: return DXGI_FORMAT_R16G16_FLOAT;
+	}
+}
+
+static D3D11_USAGE ToD3DUsage(ResourceUsage usage)
+{
+	switch (usage)
+	{
+	case USAGE_IMMUTABLE: return D3D11_USAGE_IMMUTABLE;
+	case USAGE_DYNAMIC: return D3D11_USAGE_DYNAMIC;
+	default: return D3D11_USAGE_DEFAULT;
+	}
+}
+
+GraphicsBuffer* DirectXDevice::CreateBuffer(const BufferDesc& desc, const void* data)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+	ZeroMemory(&bufferDesc, sizeof(bufferDesc));
+	bufferDesc.ByteWidth = desc.miSize;
+	bufferDesc.Usage = ToD3DUsage(desc.meUsage);
+	bufferDesc.CPUAccessFlags = desc.meUsage == USAGE_DYNAMIC ? D3D11_CPU_ACCESS_WRITE : 0;
+	switch (desc.meType)
+	{
+	case BUFFER_VERTEX: bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; break;
+	case BUFFER_INDEX: bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; break;
+	case BUFFER_CONSTANT: bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER; break;
+	}
+
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	initData.pSysMem = data;
+
+	ID3D11Buffer* buffer = nullptr;
+	HRESULT result = _device->CreateBuffer(&bufferDesc, data ? &initData : NULL, &buffer);
+	if (FAILED(result))
+	{
+		LOG_ERROR << "Failed to create a buffer of " << desc.miSize << " bytes";
+		return nullptr;
+	}
+	return reinterpret_cast<GraphicsBuffer*>(buffer);
+}
+
+/**
+*  @brief Writes into a buffer. Dynamic buffers are discarded so must be written whole, from offset 0.
+*/
+void DirectXDevice::UpdateBuffer(GraphicsBuffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	ID3D11Buffer* d3dBuffer = reinterpret_cast<ID3D11Buffer*>(buffer);
+	D3D11_BUFFER_DESC bufferDesc;
+	d3dBuffer->GetDesc(&bufferDesc);
+
+	if (bufferDesc.Usage == D3D11_USAGE_DYNAMIC)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		HRESULT result = _context->Map(d3dBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		if (FAILED(result))
+		{
+			LOG_ERROR << "Failed to map a buffer";
+			return;
+		}
+		memcpy((char*)mapped.pData + offset, data, size);
+		_context->Unmap(d3dBuffer, 0);
+	}
+	else if (bufferDesc.BindFlags & D3D11_BIND_CONSTANT_BUFFER)
+	{
+		// Constant buffers can only be updated whole
+		_context->UpdateSubresource(d3dBuffer, 0, NULL, data, 0, 0);
+	}
+	else
+	{
+		D3D11_BOX box;
+		box.left = offset;
+		box.right = offset + size;
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+		_context->UpdateSubresource(d3dBuffer, 0, &box, data, 0, 0);
+	}
+}
+
+void DirectXDevice::ReleaseBuffer(GraphicsBuffer* buffer)
+{
+	if (buffer)
+		reinterpret_cast<ID3D11Buffer*>(buffer)->Release();
+}
+
+/**
+*  @brief Creates a texture with a shader resource view, and a render target view if it is a render target.
+*
+*  @param desc The size, format and usage of the texture.
+*  @param mips The initial contents of the first numMips mips, or nullptr. Textures that generate their mips only take the first.
+*  @param numMips The number of mips in mips.
+*/
+GraphicsTexture* DirectXDevice::CreateTexture(const TextureDesc& desc, const SubresourceData* mips, unsigned int numMips)
+{
+	const bool generateMips = (desc.miFlags & TEXTURE_GENERATE_MIPS) != 0;
+	const bool renderTarget = (desc.miFlags & TEXTURE_RENDER_TARGET) != 0;
+
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = desc.miWidth;
+	textureDesc.Height = desc.miHeight;
+	textureDesc.Format = ToDXGIFormat(desc.meFormat);
+	textureDesc.MipLevels = desc.miMipLevels > 1 ? desc.miMipLevels : 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | (renderTarget || generateMips ? D3D11_BIND_RENDER_TARGET : 0);
+	textureDesc.CPUAccessFlags = desc.meUsage == USAGE_DYNAMIC ? D3D11_CPU_ACCESS_WRITE : 0;
+	textureDesc.MiscFlags = generateMips ? D3D11_RESOURCE_MISC_GENERATE_MIPS : 0;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = ToD3DUsage(desc.meUsage);
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initData(numMips);
+	for (unsigned int i = 0; i < numMips; i++)
+	{
+		initData[i].pSysMem = mips[i].mpData;
+		initData[i].SysMemPitch = mips[i].miRowPitch;
+		initData[i].SysMemSlicePitch = 0;
+	}
+
+	DirectXTexture* texture = new DirectXTexture();
+	ZeroMemory(texture, sizeof(DirectXTexture));
+	texture->meUsage = desc.meUsage;
+	texture->miHeight = desc.miHeight;
+
+	// Create Texture, when it generates its mips only the first is uploaded
+	HRESULT result;
+	if (mips && numMips > 0 && numMips >= textureDesc.MipLevels)
+	{
+		result = _device->CreateTexture2D(&textureDesc, &initData[0], &texture->mpTexture);
+	}
+	else
+	{
+		result = _device->CreateTexture2D(&textureDesc, NULL, &texture->mpTexture);
+		if (SUCCEEDED(result) && mips && numMips > 0)
+			_context->UpdateSubresource(texture->mpTexture, 0, NULL, initData[0].pSysMem, initData[0].SysMemPitch, 0);
+	}
+	_ASSERT(result == S_OK);
+	if (FAILED(result))
+	{
+		delete texture;
+		return nullptr;
+	}
+
+	// Create shader resource view
+	D3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc;
+	ZeroMemory(&shaderResourceViewDesc, sizeof(shaderResourceViewDesc));
+	shaderResourceViewDesc.Format = textureDesc.Format;
+	shaderResourceViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	shaderResourceViewDesc.Texture2D.MostDetailedMip = 0;
+	shaderResourceViewDesc.Texture2D.MipLevels = textureDesc.MipLevels;
+	result = _device->CreateShaderResourceView(texture->mpTexture, &shaderResourceViewDesc, &texture->mpShaderResourceView);
+	_ASSERT(result == S_OK);
+
+	// Creating a view of the texture to be used when binding it as a render target
+	if (renderTarget)
+	{
+		D3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc = {};
+		renderTargetViewDesc.Format = textureDesc.Format;
+		renderTargetViewDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+		renderTargetViewDesc.Texture2D.MipSlice = 0;
+		result = _device->CreateRenderTargetView(texture->mpTexture, &renderTargetViewDesc, &texture->mpRenderTargetView);
+		_ASSERT(result == S_OK);
+	}
+
+	return reinterpret_cast<GraphicsTexture*>(texture);
+}
+
+/**
+*  @brief Copies the top mip of a dynamic texture from the CPU.
+*
+*  @param texture The texture, created with USAGE_DYNAMIC.
+*  @param data The rows of texels.
+*  @param rowPitch The size of one row of data in bytes.
+*  @return false if the texture couldn't be mapped.
+*/
+bool DirectXDevice::UpdateTexture(GraphicsTexture* texture, const void* data, unsigned int rowPitch)
+{
+	DirectXTexture* d3dTexture = reinterpret_cast<DirectXTexture*>(texture);
+
+	// Map the texture.
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
+	HRESULT result = _context->Map(d3dTexture->mpTexture, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if (FAILED(result) || mappedResource.pData == NULL)
+	{
+		// Failed to map the texture, or problem accessing the textures data.
+		return false;
+	}
+
+	// Copy in the rows of data
+	const BYTE* pixels = reinterpret_cast<const BYTE*>(data);
+	BYTE* mappedData = reinterpret_cast<BYTE*>(mappedResource.pData);
+	for (unsigned int i = 0; i < d3dTexture->miHeight; i++)
+	{
+		memcpy(mappedData, pixels, rowPitch);
+		mappedData += mappedResource.RowPitch;
+		pixels += rowPitch;
+	}
+
+	_context->Unmap(d3dTexture->mpTexture, 0);
+	return true;
+}
+
+void DirectXDevice::GenerateMips(GraphicsTexture* texture)
+{
+	_context->GenerateMips(reinterpret_cast<DirectXTexture*>(texture)->mpShaderResourceView);
+}
+
+void DirectXDevice::ReleaseTexture(GraphicsTexture* texture)
+{
+	DirectXTexture* d3dTexture = reinterpret_cast<DirectXTexture*>(texture);
+	if (!d3dTexture || d3dTexture == &_backBufferTexture || d3dTexture == &_depthTexture)
+		return;
+
+	// Views first, the texture should be the last reference to go
+	if (d3dTexture->mpRenderTargetView)
+		d3dTexture->mpRenderTargetView->Release();
+	if (d3dTexture->mpShaderResourceView)
+		d3dTexture->mpShaderResourceView->Release();
+	if (d3dTexture->mpTexture)
+	{
+		ULONG refCount = d3dTexture->mpTexture->Release();
+		_ASSERT(refCount == 0);
+	}
+	delete d3dTexture;
+}
+
+GraphicsVertexShader* DirectXDevice::CreateVertexShader(const void* bytecode, size_t size)
+{
+	ID3D11VertexShader* shader = nullptr;
+	HRESULT result = _device->CreateVertexShader(bytecode, size, NULL, &shader);
+	_ASSERT(result == S_OK);
+	return reinterpret_cast<GraphicsVertexShader*>(shader);
+}
+
+GraphicsPixelShader* DirectXDevice::CreatePixelShader(const void* bytecode, size_t size)
+{
+	ID3D11PixelShader* shader = nullptr;
+	HRESULT result = _device->CreatePixelShader(bytecode, size, NULL, &shader);
+	_ASSERT(result == S_OK);
+	return reinterpret_cast<GraphicsPixelShader*>(shader);
+}
+
+GraphicsInputLayout* DirectXDevice::CreateInputLayout(const VertexElement* elements, unsigned int numElements, const void* vertexShaderBytecode, size_t size)
+{
+	std::vector<D3D11_INPUT_ELEMENT_DESC> inputElements(numElements);
+	for (unsigned int i = 0; i < numElements; i++)
+	{
+		inputElements[i].SemanticName = elements[i].mpSemantic;
+		inputElements[i].SemanticIndex = 0;
+		inputElements[i].Format = ToDXGIFormat(elements[i].meFormat);
+		inputElements[i].InputSlot = 0;
+		inputElements[i].AlignedByteOffset = elements[i].miOffset;
+		inputElements[i].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+		inputElements[i].InstanceDataStepRate = 0;
+	}
+
+	ID3D11InputLayout* layout = nullptr;
+	HRESULT result = _device->CreateInputLayout(inputElements.data(), numElements, vertexShaderBytecode, size, &layout);
+	_ASSERT(result == S_OK);
+	return reinterpret_cast<GraphicsInputLayout*>(layout);
+}
+
+/**
+*  @brief Creates a sampler that wraps in every direction.
+*/
+GraphicsSampler* DirectXDevice::CreateSampler(SamplerFilter filter, unsigned int maxAnisotropy)
+{
+	D3D11_SAMPLER_DESC samplerDesc;
+	samplerDesc.Filter = filter == SAMPLER_ANISOTROPIC ? D3D11_FILTER_ANISOTROPIC : D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.MipLODBias = 0.0f;
+	samplerDesc.MaxAnisotropy = maxAnisotropy;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	samplerDesc.BorderColor[0] = samplerDesc.BorderColor[1] = samplerDesc.BorderColor[2] = samplerDesc.BorderColor[3] = 0.0f;
+	samplerDesc.MinLOD = -FLT_MAX;
+	samplerDesc.MaxLOD = FLT_MAX;
+
+	ID3D11SamplerState* sampler = nullptr;
+	HRESULT result = _device->CreateSamplerState(&samplerDesc, &sampler);
+	_ASSERT(result == S_OK);
+	return reinterpret_cast<GraphicsSampler*>(sampler);
+}
+
+void DirectXDevice::ReleaseVertexShader(GraphicsVertexShader* shader)
+{
+	if (shader)
+		reinterpret_cast<ID3D11VertexShader*>(shader)->Release();
+}
+
+void DirectXDevice::ReleasePixelShader(GraphicsPixelShader* shader)
+{
+	if (shader)
+		reinterpret_cast<ID3D11PixelShader*>(shader)->Release();
+}
+
+void DirectXDevice::ReleaseInputLayout(GraphicsInputLayout* layout)
+{
+	if (layout)
+		reinterpret_cast<ID3D11InputLayout*>(layout)->Release();
+}
+
+void DirectXDevice::ReleaseSampler(GraphicsSampler* sampler)
+{
+	if (sampler)
+		reinterpret_cast<ID3D11SamplerState*>(sampler)->Release();
+}
+
+void DirectXDevice::SetVertexBuffer(GraphicsBuffer* buffer, unsigned int stride)
+{
+	ID3D11Buffer* d3dBuffer = reinterpret_cast<ID3D11Buffer*>(buffer);
+	UINT offset = 0;
+	_context->IASetVertexBuffers(0, 1, &d3dBuffer, &stride, &offset);
+}
+
+void DirectXDevice::SetIndexBuffer(GraphicsBuffer* buffer, IndexFormat format)
+{
+	_context->IASetIndexBuffer(reinterpret_cast<ID3D11Buffer*>(buffer), format == INDEX_FORMAT_16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+}
+
+void DirectXDevice::SetPrimitiveTopology(PrimitiveTopology topology)
+{
+	_context->IASetPrimitiveTopology(topology == TOPOLOGY_TRIANGLE_LIST ? D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST : D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED);
+}
+
+void DirectXDevice::SetInputLayout(GraphicsInputLayout* layout)
+{
+	_context->IASetInputLayout(reinterpret_cast<ID3D11InputLayout*>(layout));
+}
+
+void DirectXDevice::SetVertexShader(GraphicsVertexShader* shader)
+{
+	_context->VSSetShader(reinterpret_cast<ID3D11VertexShader*>(shader), 0, 0);
+}
+
+void DirectXDevice::SetPixelShader(GraphicsPixelShader* shader)
+{
+	_context->PSSetShader(reinterpret_cast<ID3D11PixelShader*>(shader), 0, 0);
+}
+
+void DirectXDevice::SetVSConstantBuffer(unsigned int slot, GraphicsBuffer* buffer)
+{
+	ID3D11Buffer* d3dBuffer = reinterpret_cast<ID3D11Buffer*>(buffer);
+	_context->VSSetConstantBuffers(slot, 1, &d3dBuffer);
+}
+
+void DirectXDevice::SetPSConstantBuffer(unsigned int slot, GraphicsBuffer* buffer)
+{
+	ID3D11Buffer* d3dBuffer = reinterpret_cast<ID3D11Buffer*>(buffer);
+	_context->PSSetConstantBuffers(slot, 1, &d3dBuffer);
+}
+
+void DirectXDevice::SetPSTexture(unsigned int slot, GraphicsTexture* texture)
+{
+	ID3D11ShaderResourceView* view = texture ? reinterpret_cast<DirectXTexture*>(texture)->mpShaderResourceView : NULL;
+	_context->PSSetShaderResources(slot, 1, &view);
+}
+
+void DirectXDevice::SetPSSampler(unsigned int slot, GraphicsSampler* sampler)
+{
+	ID3D11SamplerState* d3dSampler = reinterpret_cast<ID3D11SamplerState*>(sampler);
+	_context->PSSetSamplers(slot, 1, &d3dSampler);
+}
+
+void DirectXDevice::SetRenderTargets(GraphicsTexture* const* targets, unsigned int numTargets, GraphicsTexture* depth)
+{
+	ID3D11RenderTargetView* views[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+	if (numTargets > D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT)
+		numTargets = D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT;
+	for (unsigned int i = 0; i < numTargets; i++)
+		views[i] = targets && targets[i] ? reinterpret_cast<DirectXTexture*>(targets[i])->mpRenderTargetView : NULL;
+
+	ID3D11DepthStencilView* depthView = depth ? reinterpret_cast<DirectXTexture*>(depth)->mpDepthStencilView : NULL;
+	_context->OMSetRenderTargets(numTargets, views, depthView);
+}
+
+void DirectXDevice::ClearRenderTarget(GraphicsTexture* target, const float colour[4])
+{
+	_context->ClearRenderTargetView(reinterpret_cast<DirectXTexture*>(target)->mpRenderTargetView, colour);
+}
+
+void DirectXDevice::Draw(unsigned int numVertices, unsigned int firstVertex)
+{
+	_context->Draw(numVertices, firstVertex);
+}
+
+void DirectXDevice::DrawIndexed(unsigned int numIndices, unsigned int firstIndex, int baseVertex)
+{
+	_context->DrawIndexed(numIndices, firstIndex, baseVertex);
+}
+
+GraphicsTexture* DirectXDevice::GetBackBufferTexture()
+{
+	// The views are recreated when the window changes, so always hand out the current ones
+	_backBufferTexture.mpRenderTargetView = _backbuffer;
+	return reinterpret_cast<GraphicsTexture*>(&_backBufferTexture);
+}
+
+GraphicsTexture* DirectXDevice::GetDepthTexture()
+{
+	_depthTexture.mpTexture = _depthStencilBuffer;
+	_depthTexture.mpDepthStencilView = _depthStencilView;
+	_depthTexture.mpShaderResourceView = _depthStencilBufferSRV;
+	return reinterpret_cast<GraphicsTexture*>(&_depthTexture);
+}
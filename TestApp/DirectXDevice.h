@@ -11,16 +11,31 @@
 #pragma once
 #include <D3D11.h>
 #include <d3d11_1.h>
+#include "GraphicsDevice.h"
 
 // Forward declarations
 class Window_DX;
+struct ImDrawData;
+
+/**
+*  @brief The D3D objects behind a GraphicsTexture handle, views it wasn't created for are null.
+*/
+struct DirectXTexture
+{
+	ID3D11Texture2D* mpTexture;
+	ID3D11ShaderResourceView* mpShaderResourceView;
+	ID3D11RenderTargetView* mpRenderTargetView;
+	ID3D11DepthStencilView* mpDepthStencilView;
+	ResourceUsage meUsage;
+	unsigned int miHeight;
+};
 
 /**
 *  @brief The concrete DirectX implementation of GraphicsDevice
 *
 *  The concrete DirectX implementation of GraphicsDevice
 */
-class DirectXDevice
+class DirectXDevice : public GraphicsDevice
 {
 public:
 	DirectXDevice(Window_DX* win);
@@ -53,11 +68,53 @@ public:
 
 	int GetNumberOfMonitors();
 
+	/// The UI SwapBuffers draws on top of the back buffer, a copy taken by the update so it can be drawn on another thread. Can be null.
+	/// The size is the display size the update laid it out for.
+	void SetUIDrawData(ImDrawData* drawData, float width, float height) { _uiDrawData = drawData; _uiWidth = width; _uiHeight = height; }
+
 	ID3D11DepthStencilView* GetDepthStencilView() { return _depthStencilView; }
 	ID3D11ShaderResourceView** GetAddressOfDepthStencilSRV() { return &_depthStencilBufferSRV; }
 	ID3D11RenderTargetView* GetBackBuffer() { return _backbuffer; }
 	ID3D11RenderTargetView** GetAddressOfBackBuffer() { return &_backbuffer; }
 
+	// GraphicsDevice
+	virtual GraphicsBuffer* CreateBuffer(const BufferDesc& desc, const void* data);
+	virtual void UpdateBuffer(GraphicsBuffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	virtual void ReleaseBuffer(GraphicsBuffer* buffer);
+
+	virtual GraphicsTexture* CreateTexture(const TextureDesc& desc, const SubresourceData* mips, unsigned int numMips);
+	virtual bool UpdateTexture(GraphicsTexture* texture, const void* data, unsigned int rowPitch);
+	virtual void GenerateMips(GraphicsTexture* texture);
+	virtual void ReleaseTexture(GraphicsTexture* texture);
+
+	virtual GraphicsVertexShader* CreateVertexShader(const void* bytecode, size_t size);
+	virtual GraphicsPixelShader* CreatePixelShader(const void* bytecode, size_t size);
+	virtual GraphicsInputLayout* CreateInputLayout(const VertexElement* elements, unsigned int numElements, const void* vertexShaderBytecode, size_t size);
+	virtual GraphicsSampler* CreateSampler(SamplerFilter filter, unsigned int maxAnisotropy);
+	virtual void ReleaseVertexShader(GraphicsVertexShader* shader);
+	virtual void ReleasePixelShader(GraphicsPixelShader* shader);
+	virtual void ReleaseInputLayout(GraphicsInputLayout* layout);
+	virtual void ReleaseSampler(GraphicsSampler* sampler);
+
+	virtual void SetVertexBuffer(GraphicsBuffer* buffer, unsigned int stride);
+	virtual void SetIndexBuffer(GraphicsBuffer* buffer, IndexFormat format);
+	virtual void SetPrimitiveTopology(PrimitiveTopology topology);
+	virtual void SetInputLayout(GraphicsInputLayout* layout);
+	virtual void SetVertexShader(GraphicsVertexShader* shader);
+	virtual void SetPixelShader(GraphicsPixelShader* shader);
+	virtual void SetVSConstantBuffer(unsigned int slot, GraphicsBuffer* buffer);
+	virtual void SetPSConstantBuffer(unsigned int slot, GraphicsBuffer* buffer);
+	virtual void SetPSTexture(unsigned int slot, GraphicsTexture* texture);
+	virtual void SetPSSampler(unsigned int slot, GraphicsSampler* sampler);
+	virtual void SetRenderTargets(GraphicsTexture* const* targets, unsigned int numTargets, GraphicsTexture* depth);
+
+	virtual void ClearRenderTarget(GraphicsTexture* target, const float colour[4]);
+	virtual void Draw(unsigned int numVertices, unsigned int firstVertex);
+	virtual void DrawIndexed(unsigned int numIndices, unsigned int firstIndex, int baseVertex);
+
+	virtual GraphicsTexture* GetBackBufferTexture();
+	virtual GraphicsTexture* GetDepthTexture();
+
 protected:
 	/// The game window.
 	Window_DX * _window;
@@ -89,5 +146,12 @@ protected:
 	ID3D11BlendState* _alphaBlendingDisabledState;
 	/// Window handle
 	HWND _hWnd;
+	/// The back and depth buffers as GraphicsTexture handles, refreshed whenever they are asked for.
+	DirectXTexture _backBufferTexture;
+	DirectXTexture _depthTexture;
+	/// The UI to draw in SwapBuffers.
+	ImDrawData* _uiDrawData;
+	float _uiWidth;
+	float _uiHeight;
 };
 
@@ -0,0 +1,117 @@
+/**
+*  @file DrawList.cpp
+*  @brief A list of mesh draws sorted by a 64 bit key so state changes are grouped together.
+*
+*  @bug No known bugs.
+*/
+#include "DrawList.h"
+#include "Mesh.h"
+
+/**
+*  @brief Packs the sort key, each field is masked to its width.
+*
+*  @param pass The render pass, draws are grouped by this first.
+*  @param geometry Identifies the vertex and index buffers.
+*  @param textureSet Identifies the textures the draw binds.
+*  @param depthBucket The distance from the camera, from DepthBucket.
+*/
+uint64_t DrawList::MakeKey(unsigned int pass, unsigned int geometry, unsigned int textureSet, unsigned int depthBucket)
+{
+	const uint64_t passMask = (1ull << PASS_BITS) - 1;
+	const uint64_t geometryMask = (1ull << GEOMETRY_BITS) - 1;
+	const uint64_t textureSetMask = (1ull << TEXTURE_SET_BITS) - 1;
+	const uint64_t depthMask = (1ull << DEPTH_BITS) - 1;
+
+	return ((pass & passMask) << (GEOMETRY_BITS + TEXTURE_SET_BITS + DEPTH_BITS))
+		| ((geometry & geometryMask) << (TEXTURE_SET_BITS + DEPTH_BITS))
+		| ((textureSet & textureSetMask) << DEPTH_BITS)
+		| (depthBucket & depthMask);
+}
+
+/**
+*  @brief Quantises a view distance so nearer draws sort first.
+*
+*  @param distance The distance from the camera.
+*  @param farDistance The distance that maps to the last bucket, anything further is clamped to it.
+*/
+unsigned int DrawList::DepthBucket(float distance, float farDistance)
+{
+	const float maxBucket = (float)((1u << DEPTH_BITS) - 1);
+	if (distance <= 0.0f || farDistance <= 0.0f)
+		return 0;
+	if (distance >= farDistance)
+		return (unsigned int)maxBucket;
+	return (unsigned int)(distance / farDistance * maxBucket);
+}
+
+void DrawList::Add(uint64_t key, Mesh* mesh)
+{
+	DrawItem item;
+	item.mKey = key;
+	item.mpMesh = mesh;
+	mItems.push_back(item);
+}
+
+void DrawList::Sort()
+{
+	RadixSort(mItems, mScratch);
+}
+
+/**
+*  @brief Draws every item in order, leaving the state cache to skip what doesn't change.
+*/
+void DrawList::Submit(GraphicsDevice* device, DeviceStateCache& stateCache) const
+{
+	for (size_t i = 0; i < mItems.size(); i++)
+	{
+		mItems[i].mpMesh->Draw(device, stateCache);
+	}
+}
+
+/**
+*  @brief Stable least significant digit radix sort on the keys, a byte at a time.
+*
+*  Bytes that are the same in every key are skipped, so the unused high fields cost nothing.
+*
+*  @param items The items to sort.
+*  @param scratch Temporary storage, resized to fit.
+*/
+void DrawList::RadixSort(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch)
+{
+	const size_t count = items.size();
+	if (count < 2)
+		return;
+
+	scratch.resize(count);
+	DrawItem* source = items.data();
+	DrawItem* destination = scratch.data();
+
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		size_t offsets[256] = { 0 };
+		for (size_t i = 0; i < count; i++)
+			offsets[(source[i].mKey >> shift) & 0xff]++;
+
+		if (offsets[(source[0].mKey >> shift) & 0xff] == count)
+			continue;
+
+		size_t total = 0;
+		for (unsigned int digit = 0; digit < 256; digit++)
+		{
+			const size_t digitCount = offsets[digit];
+			offsets[digit] = total;
+			total += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			destination[offsets[(source[i].mKey >> shift) & 0xff]++] = source[i];
+
+		DrawItem* swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	// The sorted items ended up in the scratch buffer
+	if (source != items.data())
+		items.swap(scratch);
+}
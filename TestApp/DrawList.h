@@ -0,0 +1,62 @@
+/**
+*  @file DrawList.h
+*  @brief A list of mesh draws sorted by a 64 bit key so state changes are grouped together.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+#include "GraphicsDevice.h"
+#include "DeviceStateCache.h"
+
+class Mesh;
+
+/**
+*  @brief One mesh to draw and the key it sorts by.
+*/
+struct DrawItem
+{
+	uint64_t mKey;
+	Mesh* mpMesh;
+};
+
+/**
+*  @brief Collects draws for a frame, radix sorts them and submits them through a DeviceStateCache.
+*
+*  The key, from the most significant bits down, is the pass, the geometry buffers, the texture set
+*  and a front to back depth bucket. Draws that share buffers and textures end up next to each
+*  other, so the cache can skip rebinding them.
+*/
+class DrawList
+{
+public:
+	enum Pass
+	{
+		PASS_GBUFFER = 0,
+	};
+
+	static const unsigned int PASS_BITS = 4;
+	static const unsigned int GEOMETRY_BITS = 12;
+	static const unsigned int TEXTURE_SET_BITS = 24;
+	static const unsigned int DEPTH_BITS = 24;
+
+	static uint64_t MakeKey(unsigned int pass, unsigned int geometry, unsigned int textureSet, unsigned int depthBucket);
+	static unsigned int DepthBucket(float distance, float farDistance);
+
+	void Clear() { mItems.clear(); }
+	void Add(uint64_t key, Mesh* mesh);
+	void Sort();
+	void Submit(GraphicsDevice* device, DeviceStateCache& stateCache) const;
+
+	unsigned int Size() const { return (unsigned int)mItems.size(); }
+	const std::vector<DrawItem>& GetItems() const { return mItems; }
+
+	static void RadixSort(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch);
+
+private:
+	std::vector<DrawItem> mItems;
+	/// Reused between frames by the sort.
+	std::vector<DrawItem> mScratch;
+};
@@ -0,0 +1,165 @@
+/**
+*  @file FramePipeline.cpp
+*  @brief Hands each frame's state from the update to the render, optionally on a render thread of its own.
+*
+*  @bug No known bugs.
+*/
+#include "FramePipeline.h"
+#include "Profiler.h"
+#include <chrono>
+
+/// How many times a thread checks again before going to sleep, a frame is usually only a moment away.
+static const unsigned int SPINS_BEFORE_SLEEP = 64;
+/// The longest a thread sleeps for, in case it slept through being woken.
+static const std::chrono::milliseconds PIPELINE_SLEEP(10);
+
+FramePipeline::FramePipeline(const RenderFunction& render, unsigned int slots) :
+	mRender(render),
+	miSlots(slots < 2 ? 2 : (slots > MAX_SLOTS ? MAX_SLOTS : slots)),
+	miUpdated(0),
+	miRendered(0),
+	mbStopping(false),
+	miSleeping(0),
+	miUpdateWaitNs(0),
+	miRenderWaitNs(0)
+{
+	for (unsigned int i = 0; i < MAX_SLOTS; i++)
+		mDeltaTimes[i] = 0.0f;
+}
+
+FramePipeline::~FramePipeline()
+{
+	SetThreaded(false);
+}
+
+/**
+*  @brief Starts or stops the render thread. Stopping it draws whatever it had been given first.
+*/
+void FramePipeline::SetThreaded(bool threaded)
+{
+	if (threaded == IsThreaded())
+		return;
+
+	if (threaded)
+	{
+		mbStopping.store(false);
+		mThread = std::thread(&FramePipeline::RenderThread, this);
+		return;
+	}
+
+	Flush();
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mbStopping.store(true);
+	}
+	mWake.notify_all();
+	mThread.join();
+}
+
+/**
+*  @brief Waits until the slot the next frame goes in has been drawn.
+*
+*  Frame N goes in slot N % slots, so it's free once frame N - slots has been drawn.
+*  @return The slot to write.
+*/
+unsigned int FramePipeline::BeginUpdate()
+{
+	const uint64_t frame = miUpdated.load(std::memory_order_relaxed);
+	if (frame - miRendered.load(std::memory_order_acquire) >= miSlots)
+	{
+		PROFILE_SCOPE("Wait for a frame slot");
+		WaitUntil([this, frame]() { return frame - miRendered.load(std::memory_order_acquire) < miSlots; }, miUpdateWaitNs);
+	}
+	return (unsigned int)(frame % miSlots);
+}
+
+/**
+*  @brief Hands the slot written since BeginUpdate to the render thread, or draws it now if there isn't one.
+*/
+void FramePipeline::EndUpdate(float deltaTime)
+{
+	const uint64_t frame = miUpdated.load(std::memory_order_relaxed);
+	mDeltaTimes[frame % miSlots] = deltaTime;
+
+	// Everything written to the slot is visible to the render once it sees the new count
+	miUpdated.store(frame + 1, std::memory_order_release);
+	if (IsThreaded())
+		Wake();
+	else
+		RenderFrame();
+}
+
+/**
+*  @brief Waits until the render thread has drawn every frame it's been given.
+*/
+void FramePipeline::Flush()
+{
+	const uint64_t frames = miUpdated.load(std::memory_order_relaxed);
+	if (miRendered.load(std::memory_order_acquire) == frames)
+		return;
+
+	PROFILE_SCOPE("Wait for the render thread");
+	WaitUntil([this, frames]() { return miRendered.load(std::memory_order_acquire) == frames; }, miUpdateWaitNs);
+}
+
+void FramePipeline::RenderFrame()
+{
+	const uint64_t frame = miRendered.load(std::memory_order_relaxed);
+	mRender(mDeltaTimes[frame % miSlots]);
+
+	// The slot can be written again once the update sees the new count
+	miRendered.store(frame + 1, std::memory_order_release);
+}
+
+void FramePipeline::RenderThread()
+{
+	Profiler::Get().SetThreadName("Render");
+
+	for (;;)
+	{
+		const uint64_t frame = miRendered.load(std::memory_order_relaxed);
+		WaitUntil([this, frame]() { return miUpdated.load(std::memory_order_acquire) > frame || mbStopping.load(); }, miRenderWaitNs);
+		if (miUpdated.load(std::memory_order_acquire) == frame)
+			break;
+
+		RenderFrame();
+		Wake();
+	}
+}
+
+/**
+*  @brief Checks ready a few times, then sleeps until the other thread says something has changed.
+*  @param waitNs Where the time spent waiting is added up.
+*/
+void FramePipeline::WaitUntil(const std::function<bool()>& ready, std::atomic<uint64_t>& waitNs)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int spin = 0; !ready(); spin++)
+	{
+		if (spin < SPINS_BEFORE_SLEEP)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Wake only notifies if it sees a sleeper, so check again after saying so
+		std::unique_lock<std::mutex> lock(mWakeMutex);
+		miSleeping.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!ready())
+			mWake.wait_for(lock, PIPELINE_SLEEP);
+		miSleeping.fetch_sub(1);
+	}
+	waitNs.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+}
+
+void FramePipeline::Wake()
+{
+	// Pairs with the fence in WaitUntil, so either the sleeper sees the new count or this sees the sleeper
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (miSleeping.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mWake.notify_all();
+	}
+}
@@ -0,0 +1,87 @@
+/**
+*  @file FramePipeline.h
+*  @brief Hands each frame's state from the update to the render, optionally on a render thread of its own.
+*
+*  The update writes a frame's state into one of a few slots and hands it over, the render draws the
+*  slots in the same order. With a render thread the update writes frame N+1 while frame N is drawn.
+*  Slots are handed over by two counters, frames updated and frames rendered, so neither side takes a
+*  lock to do it. They only sleep on a condition variable once there's nothing to do.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class FramePipeline
+{
+public:
+	/// The most slots of frame state, 2 double buffers and 3 triple buffers.
+	static const unsigned int MAX_SLOTS = 3;
+
+	/// Draws the slot GetRenderSlot returns.
+	typedef std::function<void(float deltaTime)> RenderFunction;
+
+	/// @param slots How many frames of state there are, 2 or 3. The update can be this many frames ahead, counting the one being drawn.
+	explicit FramePipeline(const RenderFunction& render, unsigned int slots = MAX_SLOTS);
+	~FramePipeline();
+
+	/// Starts or stops the render thread, only between an EndUpdate and the next BeginUpdate. Without it frames are drawn in EndUpdate.
+	void SetThreaded(bool threaded);
+	bool IsThreaded() const { return mThread.joinable(); }
+	unsigned int GetSlotCount() const { return miSlots; }
+
+	/// Waits until the next slot has been drawn, so the update can write it.
+	unsigned int BeginUpdate();
+	/// Hands the slot to the render.
+	void EndUpdate(float deltaTime);
+	/// Waits until every frame handed over has been drawn, after which the update thread can use the device.
+	void Flush();
+
+	/// The slot being written, between BeginUpdate and EndUpdate.
+	unsigned int GetUpdateSlot() const { return (unsigned int)(miUpdated.load(std::memory_order_relaxed) % miSlots); }
+	/// The slot being drawn, from inside the render function.
+	unsigned int GetRenderSlot() const { return (unsigned int)(miRendered.load(std::memory_order_relaxed) % miSlots); }
+
+	uint64_t GetFramesUpdated() const { return miUpdated.load(std::memory_order_acquire); }
+	uint64_t GetFramesRendered() const { return miRendered.load(std::memory_order_acquire); }
+	/// The total time the update has spent waiting for a free slot, and the render thread for a frame to draw.
+	double GetUpdateWaitMs() const { return miUpdateWaitNs.load(std::memory_order_relaxed) / 1e6; }
+	double GetRenderWaitMs() const { return miRenderWaitNs.load(std::memory_order_relaxed) / 1e6; }
+
+private:
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	void RenderThread();
+	void RenderFrame();
+	void WaitUntil(const std::function<bool()>& ready, std::atomic<uint64_t>& waitNs);
+	void Wake();
+
+	RenderFunction mRender;
+	unsigned int miSlots;
+	/// The delta time each slot was updated with, passed on to the render.
+	float mDeltaTimes[MAX_SLOTS];
+
+	/// Frames handed to the render, only written by the update thread.
+	std::atomic<uint64_t> miUpdated;
+	/// Keeps the two counters off each other's cache line.
+	char mPadding[64];
+	/// Frames drawn, only written by whichever thread renders.
+	std::atomic<uint64_t> miRendered;
+
+	std::atomic<bool> mbStopping;
+	/// Threads that have run out of things to do and are waiting to be woken.
+	std::atomic<int> miSleeping;
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+
+	std::atomic<uint64_t> miUpdateWaitNs;
+	std::atomic<uint64_t> miRenderWaitNs;
+
+	std::thread mThread;
+};
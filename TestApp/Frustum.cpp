@@ -0,0 +1,218 @@
+/**
+*  @file Frustum.cpp
+*  @brief View frustum planes and SIMD culling of bounding boxes against them.
+*
+*  Boxes are stored structure of arrays so the kernel can test 4 at a time with SSE2.
+*  Has no D3D dependencies so it can be used by tools and headless code.
+*
+*  @bug No known bugs.
+*/
+#include "Frustum.h"
+#include <emmintrin.h>
+#include <math.h>
+
+/**
+*  @brief Sets the number of boxes, padding the arrays out to a multiple of 4.
+*/
+void BoundingBoxesSoA::Resize(unsigned int count)
+{
+	const unsigned int padded = (count + 3) & ~3u;
+	miCount = count;
+	mCentreX.assign(padded, 0.0f);
+	mCentreY.assign(padded, 0.0f);
+	mCentreZ.assign(padded, 0.0f);
+	mExtentX.assign(padded, 0.0f);
+	mExtentY.assign(padded, 0.0f);
+	mExtentZ.assign(padded, 0.0f);
+}
+
+void BoundingBoxesSoA::Set(unsigned int i, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	const glm::vec3 centre = (boundsMin + boundsMax) * 0.5f;
+	const glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+	mCentreX[i] = centre.x;
+	mCentreY[i] = centre.y;
+	mCentreZ[i] = centre.z;
+	mExtentX[i] = extent.x;
+	mExtentY[i] = extent.y;
+	mExtentZ[i] = extent.z;
+}
+
+Frustum::Frustum()
+{
+	for (unsigned int i = 0; i < PLANE_COUNT; i++)
+		mPlanes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	ExtractPlanes(viewProjection);
+}
+
+/**
+*  @brief Pulls the planes out of a view projection matrix (Gribb and Hartmann).
+*
+*  Expects glm's clip space, -w <= z <= w, which is what Camera's projection uses.
+*
+*  @param viewProjection The projection matrix multiplied by the view matrix.
+*/
+void Frustum::ExtractPlanes(const glm::mat4& viewProjection)
+{
+	// glm is column major, so row i is m[0][i], m[1][i], m[2][i], m[3][i]
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	mPlanes[PLANE_LEFT] = rows[3] + rows[0];
+	mPlanes[PLANE_RIGHT] = rows[3] - rows[0];
+	mPlanes[PLANE_BOTTOM] = rows[3] + rows[1];
+	mPlanes[PLANE_TOP] = rows[3] - rows[1];
+	mPlanes[PLANE_NEAR] = rows[3] + rows[2];
+	mPlanes[PLANE_FAR] = rows[3] - rows[2];
+
+	// Normalise so distances are in world units, the sphere test needs it
+	for (unsigned int i = 0; i < PLANE_COUNT; i++)
+	{
+		const float length = glm::length(glm::vec3(mPlanes[i]));
+		if (length > 0.0f)
+			mPlanes[i] /= length;
+	}
+}
+
+/**
+*  @brief Tests one box, conservatively, a box is only rejected if it is fully outside one plane.
+*/
+bool Frustum::IntersectsBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	const glm::vec3 centre = (boundsMin + boundsMax) * 0.5f;
+	const glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+	for (unsigned int i = 0; i < PLANE_COUNT; i++)
+	{
+		const glm::vec3 normal(mPlanes[i]);
+		const float distance = glm::dot(normal, centre) + mPlanes[i].w;
+		const float radius = glm::dot(glm::abs(normal), extent);
+		if (distance + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+/**
+*  @brief Tells whether a box is fully outside, fully inside or crossing the frustum.
+*/
+Frustum::Containment Frustum::ClassifyBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	const glm::vec3 centre = (boundsMin + boundsMax) * 0.5f;
+	const glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+	Containment containment = INSIDE;
+	for (unsigned int i = 0; i < PLANE_COUNT; i++)
+	{
+		const glm::vec3 normal(mPlanes[i]);
+		const float distance = glm::dot(normal, centre) + mPlanes[i].w;
+		const float radius = glm::dot(glm::abs(normal), extent);
+		if (distance + radius < 0.0f)
+			return OUTSIDE;
+		if (distance - radius < 0.0f)
+			containment = INTERSECTING;
+	}
+	return containment;
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& centre, float radius) const
+{
+	for (unsigned int i = 0; i < PLANE_COUNT; i++)
+	{
+		if (glm::dot(glm::vec3(mPlanes[i]), centre) + mPlanes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+/**
+*  @brief Tests every box against the frustum, 4 at a time.
+*
+*  @param boxes The boxes to test.
+*  @param visible Receives 1 for each box that may be visible and 0 for the rest, needs room for PaddedSize entries.
+*  @return The number of visible boxes, not counting padding.
+*/
+unsigned int Frustum::CullBoxes(const BoundingBoxesSoA& boxes, uint8_t* visible) const
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 planeX[PLANE_COUNT], planeY[PLANE_COUNT], planeZ[PLANE_COUNT], planeW[PLANE_COUNT];
+	__m128 absX[PLANE_COUNT], absY[PLANE_COUNT], absZ[PLANE_COUNT];
+	for (unsigned int p = 0; p < PLANE_COUNT; p++)
+	{
+		planeX[p] = _mm_set1_ps(mPlanes[p].x);
+		planeY[p] = _mm_set1_ps(mPlanes[p].y);
+		planeZ[p] = _mm_set1_ps(mPlanes[p].z);
+		planeW[p] = _mm_set1_ps(mPlanes[p].w);
+		absX[p] = _mm_andnot_ps(signMask, planeX[p]);
+		absY[p] = _mm_andnot_ps(signMask, planeY[p]);
+		absZ[p] = _mm_andnot_ps(signMask, planeZ[p]);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	unsigned int numVisible = 0;
+	for (unsigned int i = 0; i < boxes.PaddedSize(); i += 4)
+	{
+		const __m128 centreX = _mm_loadu_ps(&boxes.mCentreX[i]);
+		const __m128 centreY = _mm_loadu_ps(&boxes.mCentreY[i]);
+		const __m128 centreZ = _mm_loadu_ps(&boxes.mCentreZ[i]);
+		const __m128 extentX = _mm_loadu_ps(&boxes.mExtentX[i]);
+		const __m128 extentY = _mm_loadu_ps(&boxes.mExtentY[i]);
+		const __m128 extentZ = _mm_loadu_ps(&boxes.mExtentZ[i]);
+
+		// A box is outside if centre distance plus projected extent is negative for any plane
+		__m128 outside = _mm_setzero_ps();
+		for (unsigned int p = 0; p < PLANE_COUNT; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], centreX), planeW[p]);
+			distance = _mm_add_ps(distance, _mm_mul_ps(planeY[p], centreY));
+			distance = _mm_add_ps(distance, _mm_mul_ps(planeZ[p], centreZ));
+
+			__m128 radius = _mm_mul_ps(absX[p], extentX);
+			radius = _mm_add_ps(radius, _mm_mul_ps(absY[p], extentY));
+			radius = _mm_add_ps(radius, _mm_mul_ps(absZ[p], extentZ));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		const int outsideMask = _mm_movemask_ps(outside);
+		for (unsigned int lane = 0; lane < 4; lane++)
+		{
+			const uint8_t isVisible = (outsideMask >> lane) & 1 ? 0 : 1;
+			visible[i + lane] = isVisible;
+			if (i + lane < boxes.Size())
+				numVisible += isVisible;
+		}
+	}
+	return numVisible;
+}
+
+/**
+*  @brief The scalar version of CullBoxes, the results must match it exactly.
+*/
+unsigned int Frustum::CullBoxesReference(const BoundingBoxesSoA& boxes, uint8_t* visible) const
+{
+	unsigned int numVisible = 0;
+	for (unsigned int i = 0; i < boxes.PaddedSize(); i++)
+	{
+		bool outside = false;
+		for (unsigned int p = 0; p < PLANE_COUNT; p++)
+		{
+			// Same order of operations as the SIMD kernel so rounding matches
+			float distance = mPlanes[p].x * boxes.mCentreX[i] + mPlanes[p].w;
+			distance += mPlanes[p].y * boxes.mCentreY[i];
+			distance += mPlanes[p].z * boxes.mCentreZ[i];
+			float radius = fabsf(mPlanes[p].x) * boxes.mExtentX[i];
+			radius += fabsf(mPlanes[p].y) * boxes.mExtentY[i];
+			radius += fabsf(mPlanes[p].z) * boxes.mExtentZ[i];
+			if (distance + radius < 0.0f)
+				outside = true;
+		}
+		visible[i] = outside ? 0 : 1;
+		if (!outside && i < boxes.Size())
+			numVisible++;
+	}
+	return numVisible;
+}
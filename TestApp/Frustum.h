@@ -0,0 +1,73 @@
+/**
+*  @file Frustum.h
+*  @brief View frustum planes and SIMD culling of bounding boxes against them.
+*
+*  Boxes are stored structure of arrays so the kernel can test 4 at a time with SSE2.
+*  Has no D3D dependencies so it can be used by tools and headless code.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+*  @brief Axis aligned bounding boxes, stored as centres and half extents in separate arrays.
+*
+*  The arrays are padded to a multiple of 4 with empty boxes at the origin.
+*/
+struct BoundingBoxesSoA
+{
+	void Resize(unsigned int count);
+	void Set(unsigned int i, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	unsigned int Size() const { return miCount; }
+	unsigned int PaddedSize() const { return (unsigned int)mCentreX.size(); }
+
+	std::vector<float> mCentreX, mCentreY, mCentreZ;
+	std::vector<float> mExtentX, mExtentY, mExtentZ;
+	unsigned int miCount;
+};
+
+/**
+*  @brief The six planes of a view frustum, pointing inwards.
+*/
+class Frustum
+{
+public:
+	enum PlaneId
+	{
+		PLANE_LEFT,
+		PLANE_RIGHT,
+		PLANE_BOTTOM,
+		PLANE_TOP,
+		PLANE_NEAR,
+		PLANE_FAR,
+		PLANE_COUNT
+	};
+
+	enum Containment
+	{
+		OUTSIDE,
+		INTERSECTING,
+		INSIDE
+	};
+
+	Frustum();
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	void ExtractPlanes(const glm::mat4& viewProjection);
+	const glm::vec4& GetPlane(unsigned int plane) const { return mPlanes[plane]; }
+
+	bool IntersectsBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+	bool IntersectsSphere(const glm::vec3& centre, float radius) const;
+	Containment ClassifyBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+	unsigned int CullBoxes(const BoundingBoxesSoA& boxes, uint8_t* visible) const;
+	unsigned int CullBoxesReference(const BoundingBoxesSoA& boxes, uint8_t* visible) const;
+
+private:
+	/// xyz is the normal, w the distance, so a point p is inside when dot(xyz, p) + w >= 0.
+	glm::vec4 mPlanes[PLANE_COUNT];
+};
@@ -0,0 +1,88 @@
+/**
+*  @file GBufferPacking.cpp
+*  @brief CPU versions of the compact G-buffer's encodings, matching Shaders/GBuffer.hlsli.
+*
+*  Each function follows its HLSL counterpart step by step, plus the conversion the GPU does when
+*  it writes or samples the target, so the errors measured here are the ones the shaders see.
+*
+*  @bug No known bugs.
+*/
+#include "GBufferPacking.h"
+#include <math.h>
+
+static float SignNotZero(float value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+static float Clamp(float value, float low, float high)
+{
+	return value < low ? low : (value > high ? high : value);
+}
+
+/**
+*  @brief Projects the normal onto the octahedron, folding the lower half over, and rounds to 16 bit snorm.
+*/
+PackedNormal GBufferPacking::EncodeNormal(const glm::vec3& normal)
+{
+	const float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	const float inverseLength = length > 0.0f ? 1.0f / length : 1.0f;
+	float octX = normal.x * inverseLength;
+	float octY = normal.y * inverseLength;
+	if (normal.z < 0.0f)
+	{
+		const float foldedX = (1.0f - fabsf(octY)) * SignNotZero(octX);
+		const float foldedY = (1.0f - fabsf(octX)) * SignNotZero(octY);
+		octX = foldedX;
+		octY = foldedY;
+	}
+
+	PackedNormal packed;
+	packed.x = (int16_t)lrintf(Clamp(octX, -1.0f, 1.0f) * 32767.0f);
+	packed.y = (int16_t)lrintf(Clamp(octY, -1.0f, 1.0f) * 32767.0f);
+	return packed;
+}
+
+/**
+*  @brief Snorm decodes the way D3D does, then unfolds the octahedron.
+*/
+glm::vec3 GBufferPacking::DecodeNormal(PackedNormal packed)
+{
+	const float octX = fmaxf(packed.x / 32767.0f, -1.0f);
+	const float octY = fmaxf(packed.y / 32767.0f, -1.0f);
+	glm::vec3 normal(octX, octY, 1.0f - fabsf(octX) - fabsf(octY));
+	const float fold = Clamp(-normal.z, 0.0f, 1.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return glm::normalize(normal);
+}
+
+uint32_t GBufferPacking::EncodeDiffuseSpecular(const glm::vec3& diffuse, float specular)
+{
+	const float channels[4] = { diffuse.r, diffuse.g, diffuse.b, specular };
+	uint32_t packed = 0;
+	for (int i = 0; i < 4; i++)
+		packed |= (uint32_t)lrintf(Clamp(channels[i], 0.0f, 1.0f) * 255.0f) << (i * 8);
+	return packed;
+}
+
+glm::vec4 GBufferPacking::DecodeDiffuseSpecular(uint32_t packed)
+{
+	return glm::vec4((packed & 0xff) / 255.0f, ((packed >> 8) & 0xff) / 255.0f, ((packed >> 16) & 0xff) / 255.0f, (packed >> 24) / 255.0f);
+}
+
+/**
+*  @brief The world position a pixel's depth came from.
+*
+*  @param texcoord Where the pixel is on the screen, (0, 0) at the top left and (1, 1) at the bottom right.
+*  @param depth The depth buffer's value there, between 0 and 1.
+*  @param inverseProjection The inverse of the projection matrix the depth was drawn with.
+*  @param inverseView The inverse of the view matrix the depth was drawn with.
+*/
+glm::vec3 GBufferPacking::ReconstructWorldPosition(const glm::vec2& texcoord, float depth, const glm::mat4& inverseProjection, const glm::mat4& inverseView)
+{
+	const glm::vec4 clip(texcoord.x * 2.0f - 1.0f, 1.0f - texcoord.y * 2.0f, depth, 1.0f);
+	glm::vec4 view = inverseProjection * clip;
+	view /= view.w;
+	return glm::vec3(inverseView * view);
+}
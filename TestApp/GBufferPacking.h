@@ -0,0 +1,43 @@
+/**
+*  @file GBufferPacking.h
+*  @brief CPU versions of the compact G-buffer's encodings, matching Shaders/GBuffer.hlsli.
+*
+*  The compact G-buffer keeps no positions, they're rebuilt from the depth buffer with the inverse
+*  projection and view matrices. Normals are octahedral encoded into an RG16 snorm target and the
+*  diffuse colour and specular go into RGBA8. The GPU does the float to snorm and unorm conversions
+*  when it writes the targets, these round to nearest the same way.
+*
+*  Worst case decode error: normals under 0.05 degrees; colours half of 1/255; positions from a 24 bit
+*  depth buffer distance^2 / (2^24 * near) along the view ray. With the camera's 0.1 near plane that's
+*  under 0.01 units within 100 of the camera, where half float positions in Sponza lose up to 0.7,
+*  but it grows past theirs at about 1000 units away.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+/**
+*  @brief A normal as stored in the RG16 snorm target.
+*/
+struct PackedNormal
+{
+	int16_t x, y;
+};
+
+class GBufferPacking
+{
+public:
+	static PackedNormal EncodeNormal(const glm::vec3& normal);
+	static glm::vec3 DecodeNormal(PackedNormal packed);
+
+	/// Red in the low byte, the way an RGBA8 texel is laid out in memory.
+	static uint32_t EncodeDiffuseSpecular(const glm::vec3& diffuse, float specular);
+	static glm::vec4 DecodeDiffuseSpecular(uint32_t packed);
+
+	static glm::vec3 ReconstructWorldPosition(const glm::vec2& texcoord, float depth, const glm::mat4& inverseProjection, const glm::mat4& inverseView);
+
+private:
+	GBufferPacking() = delete;
+};
@@ -12,12 +12,15 @@
 #include "Game.h"
 #include "Window_DX.h"
 #include "Log.h"
+#include "Profiler.h"
+#include "JobSystem.h"
 /*----------------------------------------------------------------------------------------------------------------*/
 // CONSTRUCTORS
 /*----------------------------------------------------------------------------------------------------------------*/
 
 Game::Game()
-	: timer(), quitFlag(false)
+	: gameWindow(nullptr), timer(), quitFlag(false), mpDirectX(nullptr), mpGraphics(nullptr), mpJobs(nullptr),
+	mPipeline([this](float deltaTime) { Render(deltaTime); }), mbPipelined(false)
 {
 }
 
@@ -25,16 +28,20 @@ Game::Game()
 
 Game::~Game()
 {
+	delete mpJobs;
 }
 
 /**
 *  @brief Safely releases the games resources. 
 *
-*  Calls shutdown on all the managers and resources.
+*  Calls shutdown on all the managers and resources, and stops the job workers.
 *  
 */
 void Game::Shutdown()
 {
+	StopRenderThread();
+	delete mpJobs;
+	mpJobs = nullptr;
 }
 
 /*----------------------------------------------------------------------------------------------------------------*/
@@ -52,6 +59,23 @@ void Game::Shutdown()
 void Game::Initialise(Window_DX* win)
 {
 	gameWindow = win;
+	mpJobs = new JobSystem();
+
+	LoadAssets();
+}
+
+/**
+*  @brief Initialises the Game without a window.
+*
+*  Everything is rendered through the given device, e.g. a NullGraphicsDevice to measure the
+*  CPU cost of a frame on a machine without a GPU. Run() can then be called as normal.
+*  @param device The device to render with, owned by the caller.
+*/
+void Game::InitialiseHeadless(GraphicsDevice* device)
+{
+	gameWindow = nullptr;
+	mpGraphics = device;
+	mpJobs = new JobSystem();
 
 	LoadAssets();
 }
@@ -59,16 +83,45 @@ void Game::Initialise(Window_DX* win)
 /**
 *  @brief Called by the game loop, every iteration.
 *
-*  Updates the deltaTime and calls the update method.
+*  Updates the deltaTime, calls FixedUpdate for each fixed step that has built up if the
+*  timer has a fixed timestep, then calls the update and render methods. When pipelined,
+*  Render runs on the render thread and draws the previous Update while this one runs.
 */
 void Game::Run()
 {
-	timer.UpdateTime();
+	Profiler::Get().BeginFrame();
+	{
+		PROFILE_SCOPE("Game::Run");
 
-	// Do the update logic.
-	Update((float)timer.DeltaTime());
-	// Render the game.
-	Render((float)timer.DeltaTime());
+		timer.UpdateTime();
+
+		// Catch the fixed rate logic up with the time that's passed.
+		while (timer.ConsumeFixedStep())
+		{
+			FixedUpdate((float)timer.GetFixedTimestep());
+		}
+		// Start or stop the render thread between frames.
+		if (mPipeline.IsThreaded() != mbPipelined)
+		{
+			mPipeline.SetThreaded(mbPipelined);
+		}
+		// Do the update logic, into a slot the render has finished with.
+		mPipeline.BeginUpdate();
+		Update((float)timer.DeltaTime());
+		// Render the game, here or on the render thread while the next frame is updated.
+		mPipeline.EndUpdate((float)timer.DeltaTime());
+	}
+	Profiler::Get().EndFrame();
+}
+
+/**
+*  @brief Waits for the render thread to draw the frames it has been given, then stops it.
+*
+*  Called before anything Render uses is released. The thread starts again on the next Run if still pipelined.
+*/
+void Game::StopRenderThread()
+{
+	mPipeline.SetThreaded(false);
 }
 
 /**
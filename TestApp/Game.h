@@ -11,10 +11,13 @@
 #include "stdafx.h"
 #include <vector>
 #include "Timer.h"
+#include "FramePipeline.h"
 
 // Forward Declarations
 class Window_DX;
 class DirectXDevice;
+class GraphicsDevice;
+class JobSystem;
 
 /**
 *  @brief Class for specific game to inherit from.
@@ -34,6 +37,14 @@ protected:
 	/// If set to true, the game loop will end.
 	bool quitFlag;
 	DirectXDevice* mpDirectX;
+	/// The device everything renders through, mpDirectX when there is a window.
+	GraphicsDevice* mpGraphics;
+	/// Runs jobs across the worker threads, made before LoadAssets.
+	JobSystem* mpJobs;
+	/// Hands what Update writes to Render, which runs on a thread of its own when pipelined.
+	FramePipeline mPipeline;
+	/// Whether the render thread should be running, applied between frames.
+	bool mbPipelined;
 	
 // Constructors
 public:
@@ -51,15 +62,22 @@ public:
 	Window_DX* GetWindow()	{ return gameWindow; }
 	Timer* GetTimer() { return &timer; }
 	DirectXDevice* GetDevice() { return mpDirectX; }
+	GraphicsDevice* GetGraphicsDevice() { return mpGraphics; }
+	JobSystem* GetJobs() { return mpJobs; }
+	bool IsPipelined() const { return mbPipelined; }
+	void SetPipelined(bool pipelined) { mbPipelined = pipelined; }
 
 // Functions
 public:
 	virtual void Initialise(Window_DX* win);
+	virtual void InitialiseHeadless(GraphicsDevice* device);
 	virtual void LoadAssets() = 0;
 	virtual void Run();
+	virtual void FixedUpdate(float /*timestep*/) {}
 	virtual void Update(float deltaTime) = 0;
 	virtual void Render(float deltaTime) = 0;
 	virtual void Shutdown();
+	void StopRenderThread();
 	
 	virtual void OnKeypress(int key, bool down);
 	virtual void OnMouseDown(float x, float y, int button, bool down);
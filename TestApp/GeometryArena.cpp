@@ -0,0 +1,142 @@
+/**
+*  @file GeometryArena.cpp
+*  @brief One vertex buffer and one index buffer shared by many meshes.
+*
+*  @bug No known bugs.
+*/
+#include "GeometryArena.h"
+#include "Log.h"
+
+GeometryArena::GeometryArena() :
+	mpDevice(nullptr),
+	mpVertexBuffer(nullptr),
+	mpIndexBuffer(nullptr),
+	miVertexStride(0)
+{
+}
+
+GeometryArena::~GeometryArena()
+{
+	Release();
+}
+
+/**
+*  @brief Creates the buffers, empty until meshes are allocated in them.
+*
+*  @param device The device to create the buffers on.
+*  @param vertexStride The size of one vertex in bytes, every mesh in the arena must use the same format.
+*  @param vertexCapacity The number of vertices the arena can hold.
+*  @param indexCapacity The number of indices the arena can hold.
+*  @return true if the buffers were created.
+*/
+bool GeometryArena::Create(GraphicsDevice* device, unsigned int vertexStride, unsigned int vertexCapacity, unsigned int indexCapacity)
+{
+	Release();
+	mpDevice = device;
+
+	BufferDesc bufferDesc;
+	bufferDesc.meUsage = USAGE_DEFAULT;
+	bufferDesc.miSize = vertexStride * vertexCapacity;
+	bufferDesc.meType = BUFFER_VERTEX;
+
+	mpVertexBuffer = device->CreateBuffer(bufferDesc, nullptr);
+	if (!mpVertexBuffer)
+	{
+		LOG_ERROR << "Failed to create the geometry arena vertex buffer";
+		return false;
+	}
+
+	// Round up to a multiple of 4 bytes
+	bufferDesc.miSize = ((indexCapacity * sizeof(uint16_t)) + 3) & ~3u;
+	bufferDesc.meType = BUFFER_INDEX;
+
+	mpIndexBuffer = device->CreateBuffer(bufferDesc, nullptr);
+	if (!mpIndexBuffer)
+	{
+		LOG_ERROR << "Failed to create the geometry arena index buffer";
+		Release();
+		return false;
+	}
+
+	miVertexStride = vertexStride;
+	mVertexAllocator.Reset(vertexCapacity);
+	mIndexAllocator.Reset(indexCapacity);
+	return true;
+}
+
+void GeometryArena::Release()
+{
+	if (mpVertexBuffer)
+	{
+		mpDevice->ReleaseBuffer(mpVertexBuffer);
+		mpVertexBuffer = nullptr;
+	}
+	if (mpIndexBuffer)
+	{
+		mpDevice->ReleaseBuffer(mpIndexBuffer);
+		mpIndexBuffer = nullptr;
+	}
+	mVertexAllocator.Reset(0);
+	mIndexAllocator.Reset(0);
+}
+
+/**
+*  @brief Allocates space for a mesh and uploads its geometry.
+*
+*  @param vertices The vertex data, in the arena's vertex format.
+*  @param numVertices The number of vertices, at most 65536 so the indices fit in 16 bits.
+*  @param indices The indices, relative to the mesh's first vertex.
+*  @param numIndices The number of indices.
+*  @param allocation Receives where the mesh was put.
+*  @return false if the arena is too full.
+*/
+bool GeometryArena::Allocate(const void* vertices, unsigned int numVertices, const uint16_t* indices, unsigned int numIndices, GeometryAllocation& allocation)
+{
+	const unsigned int baseVertex = mVertexAllocator.Allocate(numVertices);
+	if (baseVertex == RangeAllocator::INVALID_OFFSET)
+	{
+		return false;
+	}
+
+	const unsigned int firstIndex = mIndexAllocator.Allocate(numIndices);
+	if (firstIndex == RangeAllocator::INVALID_OFFSET)
+	{
+		mVertexAllocator.Free(baseVertex, numVertices);
+		return false;
+	}
+
+	allocation.miBaseVertex = baseVertex;
+	allocation.miNumVertices = numVertices;
+	allocation.miFirstIndex = firstIndex;
+	allocation.miNumIndices = numIndices;
+
+	// Copy into just the allocated ranges
+	mpDevice->UpdateBuffer(mpVertexBuffer, baseVertex * miVertexStride, vertices, numVertices * miVertexStride);
+	mpDevice->UpdateBuffer(mpIndexBuffer, firstIndex * sizeof(uint16_t), indices, numIndices * sizeof(uint16_t));
+
+	return true;
+}
+
+/**
+*  @brief Gives a mesh's space back, the contents are left as they are until reused.
+*
+*  @param allocation The allocation to free, reset to invalid.
+*/
+void GeometryArena::Free(GeometryAllocation& allocation)
+{
+	if (!allocation.IsValid())
+		return;
+
+	mVertexAllocator.Free(allocation.miBaseVertex, allocation.miNumVertices);
+	mIndexAllocator.Free(allocation.miFirstIndex, allocation.miNumIndices);
+	allocation = GeometryAllocation();
+}
+
+/**
+*  @brief Binds the vertex and index buffers for the meshes in the arena to draw with.
+*/
+void GeometryArena::Bind()
+{
+	mpDevice->SetVertexBuffer(mpVertexBuffer, miVertexStride);
+	mpDevice->SetIndexBuffer(mpIndexBuffer, INDEX_FORMAT_16);
+}
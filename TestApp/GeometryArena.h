@@ -0,0 +1,65 @@
+/**
+*  @file GeometryArena.h
+*  @brief One vertex buffer and one index buffer shared by many meshes.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include "GraphicsDevice.h"
+#include "RangeAllocator.h"
+
+/**
+*  @brief Where a mesh's geometry lives inside a GeometryArena.
+*/
+struct GeometryAllocation
+{
+	GeometryAllocation() : miBaseVertex(RangeAllocator::INVALID_OFFSET), miNumVertices(0), miFirstIndex(RangeAllocator::INVALID_OFFSET), miNumIndices(0) {}
+
+	bool IsValid() const { return miBaseVertex != RangeAllocator::INVALID_OFFSET; }
+
+	unsigned int miBaseVertex;
+	unsigned int miNumVertices;
+	unsigned int miFirstIndex;
+	unsigned int miNumIndices;
+};
+
+/**
+*  @brief A vertex buffer and a 16 bit index buffer that meshes are sub-allocated from.
+*
+*  Every mesh's indices are relative to its own base vertex, so they stay 16 bit however big
+*  the arena is. Binding the arena once lets all of its meshes draw with just DrawIndexed.
+*/
+class GeometryArena
+{
+public:
+	GeometryArena();
+	~GeometryArena();
+
+	bool Create(GraphicsDevice* device, unsigned int vertexStride, unsigned int vertexCapacity, unsigned int indexCapacity);
+	void Release();
+
+	bool Allocate( const void* vertices, unsigned int numVertices, const uint16_t* indices, unsigned int numIndices, GeometryAllocation& allocation);
+	void Free(GeometryAllocation& allocation);
+
+	void Bind();
+
+	unsigned int GetVertexStride() const { return miVertexStride; }
+	GraphicsBuffer* GetVertexBuffer() const { return mpVertexBuffer; }
+	GraphicsBuffer* GetIndexBuffer() const { return mpIndexBuffer; }
+	const RangeAllocator& GetVertexAllocator() const { return mVertexAllocator; }
+	const RangeAllocator& GetIndexAllocator() const { return mIndexAllocator; }
+
+private:
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	GraphicsDevice* mpDevice;
+	GraphicsBuffer* mpVertexBuffer;
+	GraphicsBuffer* mpIndexBuffer;
+	/// The size of one vertex in bytes.
+	unsigned int miVertexStride;
+
+	RangeAllocator mVertexAllocator;
+	RangeAllocator mIndexAllocator;
+};
@@ -12,7 +12,7 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
 
-#include "ImGui\ImGuiAppLog.h"
+#include "ImGui/ImGuiAppLog.h"
 
 #define SCREEN_WIDTH \
 	GlobalSettings::Settings().screenWidth
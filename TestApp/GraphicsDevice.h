@@ -0,0 +1,205 @@
+/**
+*  @file GraphicsDevice.h
+*  @brief The interface the renderer creates resources and draws through.
+*
+*  Resources are opaque handles owned by the device that created them, each backend casts its own
+*  objects to and from them. DirectXDevice implements it with D3D11, NullGraphicsDevice only records
+*  what it is asked to do so the frame loop can run without a GPU or a window.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Opaque resource handles
+struct GraphicsBuffer;
+struct GraphicsTexture;
+struct GraphicsVertexShader;
+struct GraphicsPixelShader;
+struct GraphicsInputLayout;
+struct GraphicsSampler;
+
+enum BufferType
+{
+	BUFFER_VERTEX,
+	BUFFER_INDEX,
+	BUFFER_CONSTANT,
+};
+
+/**
+*  @brief How a resource is updated after it is created.
+*
+*  Default resources are updated by the GPU or with UpdateBuffer, immutable ones never,
+*  and dynamic ones are rewritten whole from the CPU.
+*/
+enum ResourceUsage
+{
+	USAGE_DEFAULT,
+	USAGE_IMMUTABLE,
+	USAGE_DYNAMIC,
+};
+
+enum IndexFormat
+{
+	INDEX_FORMAT_16,
+	INDEX_FORMAT_32,
+};
+
+enum PrimitiveTopology
+{
+	TOPOLOGY_UNDEFINED,
+	TOPOLOGY_TRIANGLE_LIST,
+};
+
+enum TextureFormat
+{
+	TEXTURE_FORMAT_RGBA8,
+	TEXTURE_FORMAT_RGBA16_FLOAT,
+	/// Two signed normalised channels, e.g. an octahedral encoded normal.
+	TEXTURE_FORMAT_RG16_SNORM,
+	TEXTURE_FORMAT_BC1,
+	TEXTURE_FORMAT_BC3,
+	TEXTURE_FORMAT_BC5,
+};
+
+enum TextureFlags
+{
+	/// Can be bound with SetRenderTargets as well as read by shaders.
+	TEXTURE_RENDER_TARGET = 0x1,
+	/// Only the top mip is provided, the rest are filled in with GenerateMips.
+	TEXTURE_GENERATE_MIPS = 0x2,
+};
+
+enum VertexElementFormat
+{
+	VERTEX_FORMAT_FLOAT2,
+	VERTEX_FORMAT_FLOAT3,
+	VERTEX_FORMAT_UNORM16X4,
+	VERTEX_FORMAT_SNORM16X2,
+	VERTEX_FORMAT_HALF2,
+};
+
+enum SamplerFilter
+{
+	SAMPLER_LINEAR,
+	SAMPLER_ANISOTROPIC,
+};
+
+struct BufferDesc
+{
+	unsigned int miSize;
+	BufferType meType;
+	ResourceUsage meUsage;
+};
+
+struct TextureDesc
+{
+	unsigned int miWidth;
+	unsigned int miHeight;
+	unsigned int miMipLevels;
+	TextureFormat meFormat;
+	ResourceUsage meUsage;
+	/// TextureFlags.
+	unsigned int miFlags;
+};
+
+/**
+*  @brief The initial contents of one mip level.
+*/
+struct SubresourceData
+{
+	const void* mpData;
+	/// The size of one row of pixels, or of blocks for compressed formats, in bytes.
+	unsigned int miRowPitch;
+};
+
+/**
+*  @brief One attribute of a vertex, all read from vertex buffer slot 0.
+*/
+struct VertexElement
+{
+	const char* mpSemantic;
+	VertexElementFormat meFormat;
+	unsigned int miOffset;
+};
+
+/**
+*  @brief The size in bytes of a texture with every one of its mips.
+*/
+inline size_t TextureSizeInBytes(TextureFormat format, unsigned int width, unsigned int height, unsigned int mipLevels)
+{
+	size_t size = 0;
+	for (unsigned int i = 0; i < (mipLevels > 0 ? mipLevels : 1); i++)
+	{
+		switch (format)
+		{
+		case TEXTURE_FORMAT_RGBA8:
+		case TEXTURE_FORMAT_RG16_SNORM: size += (size_t)width * height * 4; break;
+		case TEXTURE_FORMAT_RGBA16_FLOAT: size += (size_t)width * height * 8; break;
+		case TEXTURE_FORMAT_BC1: size += (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8; break;
+		default: size += (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16; break;
+		}
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return size;
+}
+
+/**
+*  @brief A graphics API the renderer can run on.
+*/
+class GraphicsDevice
+{
+public:
+	virtual ~GraphicsDevice() {}
+
+	// Resources
+	virtual GraphicsBuffer* CreateBuffer(const BufferDesc& desc, const void* data) = 0;
+	virtual void UpdateBuffer(GraphicsBuffer* buffer, unsigned int offset, const void* data, unsigned int size) = 0;
+	virtual void ReleaseBuffer(GraphicsBuffer* buffer) = 0;
+
+	virtual GraphicsTexture* CreateTexture(const TextureDesc& desc, const SubresourceData* mips, unsigned int numMips) = 0;
+	virtual bool UpdateTexture(GraphicsTexture* texture, const void* data, unsigned int rowPitch) = 0;
+	virtual void GenerateMips(GraphicsTexture* texture) = 0;
+	virtual void ReleaseTexture(GraphicsTexture* texture) = 0;
+
+	virtual GraphicsVertexShader* CreateVertexShader(const void* bytecode, size_t size) = 0;
+	virtual GraphicsPixelShader* CreatePixelShader(const void* bytecode, size_t size) = 0;
+	virtual GraphicsInputLayout* CreateInputLayout(const VertexElement* elements, unsigned int numElements, const void* vertexShaderBytecode, size_t size) = 0;
+	virtual GraphicsSampler* CreateSampler(SamplerFilter filter, unsigned int maxAnisotropy) = 0;
+	virtual void ReleaseVertexShader(GraphicsVertexShader* shader) = 0;
+	virtual void ReleasePixelShader(GraphicsPixelShader* shader) = 0;
+	virtual void ReleaseInputLayout(GraphicsInputLayout* layout) = 0;
+	virtual void ReleaseSampler(GraphicsSampler* sampler) = 0;
+
+	// Pipeline state
+	virtual void SetVertexBuffer(GraphicsBuffer* buffer, unsigned int stride) = 0;
+	virtual void SetIndexBuffer(GraphicsBuffer* buffer, IndexFormat format) = 0;
+	virtual void SetPrimitiveTopology(PrimitiveTopology topology) = 0;
+	virtual void SetInputLayout(GraphicsInputLayout* layout) = 0;
+	virtual void SetVertexShader(GraphicsVertexShader* shader) = 0;
+	virtual void SetPixelShader(GraphicsPixelShader* shader) = 0;
+	virtual void SetVSConstantBuffer(unsigned int slot, GraphicsBuffer* buffer) = 0;
+	virtual void SetPSConstantBuffer(unsigned int slot, GraphicsBuffer* buffer) = 0;
+	/// Binds a texture for the pixel shader to read, nullptr unbinds the slot.
+	virtual void SetPSTexture(unsigned int slot, GraphicsTexture* texture) = 0;
+	virtual void SetPSSampler(unsigned int slot, GraphicsSampler* sampler) = 0;
+	/// Binds render targets and a depth buffer, either can be empty.
+	virtual void SetRenderTargets(GraphicsTexture* const* targets, unsigned int numTargets, GraphicsTexture* depth) = 0;
+	virtual void EnableWireFrame(bool enable) = 0;
+	virtual void EnableDepthBuffering(bool enable) = 0;
+	virtual void EnableAlphaBlending(bool enable) = 0;
+
+	// Commands
+	virtual void ClearScreen() = 0;
+	virtual void ClearRenderTarget(GraphicsTexture* target, const float colour[4]) = 0;
+	virtual void Draw(unsigned int numVertices, unsigned int firstVertex) = 0;
+	virtual void DrawIndexed(unsigned int numIndices, unsigned int firstIndex, int baseVertex) = 0;
+	virtual void SwapBuffers() = 0;
+
+	/// The window's back buffer, as a render target.
+	virtual GraphicsTexture* GetBackBufferTexture() = 0;
+	/// The window's depth buffer, as a depth target that can also be read as a texture.
+	virtual GraphicsTexture* GetDepthTexture() = 0;
+};
@@ -1,62 +1,157 @@
 #pragma once
 #if defined D_USE_IMGUI
 #include "imgui.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
 
 
 // Usage:
-//  static ExampleAppLog my_log;
+//  static ImGuiAppLog my_log;
 //  my_log.AddLog("Hello %d world\n", 123);
 //  my_log.Draw("title");
+//
+// Keeps the last MAX_LINES lines, in a fixed ring of text. Lines start with the logger's level name, which
+// they're tagged with. The lines that pass the level checkboxes and text filter are kept in an index as
+// they're added, so drawing only touches the lines that are on screen, however many there are.
 struct ImGuiAppLog
 {
-	ImGuiTextBuffer     Buf;
+	enum
+	{
+		MAX_LINES = 64 * 1024,                  // Must be a power of 2
+		TEXT_CAPACITY = 4 * 1024 * 1024,        // Bytes of text kept, the oldest lines go when either runs out
+		MAX_LINE_LENGTH = 4096,                 // Longer lines are cut short
+		LEVEL_COUNT = 5                         // The logger's Severity levels, ERROR to VERBOSE
+	};
+
+	struct Line
+	{
+		unsigned long long  Start;              // Position in the text, counting from the first byte ever added
+		unsigned int        Length;
+		int                 Level;
+	};
+
+	std::vector<char>               Text;
+	std::vector<Line>               Lines;
+	std::vector<unsigned long long> Matches;    // Ring of the numbers of the lines that pass the filter, oldest first
+	unsigned long long  FirstLine;              // Number of the oldest line kept, Lines[number & (MAX_LINES - 1)]
+	unsigned long long  NextLine;
+	unsigned long long  FirstMatch;             // Matches[FirstMatch & (MAX_LINES - 1)] is the oldest match
+	unsigned long long  NextMatch;
+	unsigned long long  TextEnd;                // Where the next line's text goes
+	int                 LastLevel;              // Lines without a level name carry on the one before
 	ImGuiTextFilter     Filter;
-	ImVector<int>       LineOffsets;        // Index to lines offset
+	bool                ShowLevel[LEVEL_COUNT];
 	bool                ScrollToBottom;
+	std::mutex          Mutex;                  // Lines are added from the log writer thread while Draw runs on the main thread
+
+	ImGuiAppLog() :
+		Text(TEXT_CAPACITY),
+		Lines(MAX_LINES),
+		Matches(MAX_LINES),
+		FirstLine(0), NextLine(0), FirstMatch(0), NextMatch(0), TextEnd(0),
+		LastLevel(2),
+		ScrollToBottom(false)
+	{
+		for (int i = 0; i < LEVEL_COUNT; i++)
+			ShowLevel[i] = true;
+	}
 
-	void    Clear() { Buf.clear(); LineOffsets.clear(); }
+	static const char* LevelName(int level)
+	{
+		static const char* const names[LEVEL_COUNT] = { "ERROR", "WARNING", "INFO", "DEBUG", "VERBOSE" };
+		return names[level];
+	}
+
+	void    Clear()
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		FirstLine = NextLine;
+		FirstMatch = NextMatch;
+	}
 
 	void    AddLog(const char* fmt, ...) IM_FMTARGS(2)
 	{
-		int old_size = Buf.size();
+		char buf[1024];
 		va_list args;
 		va_start(args, fmt);
-		Buf.appendfv(fmt, args);
+		int length = vsnprintf(buf, sizeof(buf), fmt, args);
 		va_end(args);
-		for (int new_size = Buf.size(); old_size < new_size; old_size++)
-			if (Buf[old_size] == '\n')
-				LineOffsets.push_back(old_size);
+		if (length < 0)
+			return;
+		AddText(buf, (size_t)length < sizeof(buf) ? (size_t)length : sizeof(buf) - 1);
+	}
+
+	// Adds one or more lines. A last line without an end of line is still added as a whole line.
+	void    AddText(const char* text, size_t length)
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		const char* end = text + length;
+		while (text < end)
+		{
+			const char* line_end = (const char*)memchr(text, '\n', end - text);
+			if (!line_end)
+				line_end = end;
+			AddLine(text, line_end - text);
+			text = line_end + 1;
+		}
 		ScrollToBottom = true;
 	}
 
+	// Sets the text filter, the same as typing it in the window
+	void    SetFilter(const char* filter)
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		snprintf(Filter.InputBuf, IM_ARRAYSIZE(Filter.InputBuf), "%s", filter);
+		Filter.Build();
+		RebuildMatches();
+	}
+
+	void    SetLevelShown(int level, bool show)
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		ShowLevel[level] = show;
+		RebuildMatches();
+	}
+
+	// Lines that pass the filter, index 0 is the oldest. Call with Mutex locked, the text goes once more is added.
+	int     MatchCount() const { return (int)(NextMatch - FirstMatch); }
+	const Line& GetMatch(int index) const { return Lines[Matches[(FirstMatch + index) & (MAX_LINES - 1)] & (MAX_LINES - 1)]; }
+	const char* LineText(const Line& line) const { return &Text[line.Start % TEXT_CAPACITY]; }
+
 	void    Draw(const char* title, bool* p_open)
 	{
 		ImGui::SetNextWindowSize(ImVec2(500, 400), ImGuiCond_FirstUseEver);
 		ImGui::Begin(title, p_open);
 		if (ImGui::Button("Clear")) Clear();
+		std::lock_guard<std::mutex> lock(Mutex);
 		ImGui::SameLine();
 		bool copy = ImGui::Button("Copy");
-		ImGui::SameLine();
-		Filter.Draw("Filter", -100.0f);
+		bool changed = false;
+		for (int i = 0; i < LEVEL_COUNT; i++)
+		{
+			ImGui::SameLine();
+			changed |= ImGui::Checkbox(LevelName(i), &ShowLevel[i]);
+		}
+		changed |= Filter.Draw("Filter", -100.0f);
+		if (changed)
+			RebuildMatches();
 		ImGui::Separator();
 		ImGui::BeginChild("scrolling", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
 		if (copy) ImGui::LogToClipboard();
 
-		if (Filter.IsActive())
+		// Copying needs every line, otherwise only the ones in view are drawn
+		if (copy)
 		{
-			const char* buf_begin = Buf.begin();
-			const char* line = buf_begin;
-			for (int line_no = 0; line != NULL; line_no++)
-			{
-				const char* line_end = (line_no < LineOffsets.Size) ? buf_begin + LineOffsets[line_no] : NULL;
-				if (Filter.PassFilter(line, line_end))
-					ImGui::TextUnformatted(line, line_end);
-				line = line_end && line_end[1] ? line_end + 1 : NULL;
-			}
+			DrawLines(0, MatchCount());
 		}
 		else
 		{
-			ImGui::TextUnformatted(Buf.begin());
+			ImGuiListClipper clipper(MatchCount());
+			while (clipper.Step())
+				DrawLines(clipper.DisplayStart, clipper.DisplayEnd);
 		}
 
 		if (ScrollToBottom)
@@ -65,5 +160,91 @@ struct ImGuiAppLog
 		ImGui::EndChild();
 		ImGui::End();
 	}
+
+private:
+	void    DrawLines(int start, int end) const
+	{
+		static const ImVec4 level_colours[LEVEL_COUNT] =
+		{
+			ImVec4(1.0f, 0.4f, 0.4f, 1.0f),
+			ImVec4(1.0f, 0.8f, 0.3f, 1.0f),
+			ImVec4(0.0f, 0.0f, 0.0f, 0.0f),
+			ImVec4(0.7f, 0.7f, 0.7f, 1.0f),
+			ImVec4(0.5f, 0.5f, 0.5f, 1.0f)
+		};
+
+		for (int i = start; i < end; i++)
+		{
+			const Line& line = GetMatch(i);
+			const char* text = LineText(line);
+			// Info lines keep the normal text colour
+			const bool coloured = line.Level != 2;
+			if (coloured)
+				ImGui::PushStyleColor(ImGuiCol_Text, level_colours[line.Level]);
+			ImGui::TextUnformatted(text, text + line.Length);
+			if (coloured)
+				ImGui::PopStyleColor();
+		}
+	}
+
+	int     ParseLevel(const char* text, size_t length) const
+	{
+		for (int i = 0; i < LEVEL_COUNT; i++)
+		{
+			const size_t name_length = strlen(LevelName(i));
+			if (length > name_length && memcmp(text, LevelName(i), name_length) == 0 && (text[name_length] == ' ' || text[name_length] == ':'))
+				return i;
+		}
+		return -1;
+	}
+
+	bool    Passes(const Line& line) const
+	{
+		const char* text = LineText(line);
+		return ShowLevel[line.Level] && Filter.PassFilter(text, text + line.Length);
+	}
+
+	void    AddLine(const char* text, size_t length)
+	{
+		if (length > MAX_LINE_LENGTH)
+			length = MAX_LINE_LENGTH;
+
+		const int level = ParseLevel(text, length);
+		if (level >= 0)
+			LastLevel = level;
+
+		// Lines are never split around the end of the ring, the rest of it is skipped instead
+		unsigned long long start = TextEnd;
+		if (start % TEXT_CAPACITY + length > TEXT_CAPACITY)
+			start += TEXT_CAPACITY - start % TEXT_CAPACITY;
+		TextEnd = start + length;
+
+		// Drop the oldest lines, whose text is about to be written over or that there isn't room for
+		while (FirstLine < NextLine && (NextLine - FirstLine >= MAX_LINES || Lines[FirstLine & (MAX_LINES - 1)].Start + TEXT_CAPACITY < TextEnd))
+		{
+			if (FirstMatch < NextMatch && Matches[FirstMatch & (MAX_LINES - 1)] == FirstLine)
+				FirstMatch++;
+			FirstLine++;
+		}
+
+		memcpy(&Text[start % TEXT_CAPACITY], text, length);
+		Line& line = Lines[NextLine & (MAX_LINES - 1)];
+		line.Start = start;
+		line.Length = (unsigned int)length;
+		line.Level = LastLevel;
+
+		if (Passes(line))
+			Matches[NextMatch++ & (MAX_LINES - 1)] = NextLine;
+		NextLine++;
+	}
+
+	// Only needed when the filter changes, adding lines keeps the index up to date
+	void    RebuildMatches()
+	{
+		FirstMatch = NextMatch = 0;
+		for (unsigned long long i = FirstLine; i < NextLine; i++)
+			if (Passes(Lines[i & (MAX_LINES - 1)]))
+				Matches[NextMatch++ & (MAX_LINES - 1)] = i;
+	}
 };
-#endif
\ No newline at end of file
+#endif
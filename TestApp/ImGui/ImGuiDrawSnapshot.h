@@ -0,0 +1,70 @@
+#pragma once
+#if defined D_USE_IMGUI
+#include "imgui.h"
+#include <string.h>
+#include <vector>
+
+
+// Usage:
+//  ImGui::Render();
+//  snapshot.Capture(ImGui::GetDrawData(), ImGui::GetIO().DisplaySize);
+//  ...later, on another thread...
+//  ImGui_ImplDX11_RenderDrawData(snapshot.GetDrawData(), snapshot.DisplaySize);
+//
+// A copy of a frame's draw lists, so they can be drawn after the next ImGui::NewFrame has started
+// rebuilding ImGui's own. The buffers are kept between captures and only grow. The display size is
+// copied too, NewFrame rewrites ImGui's and the lists were laid out for this one.
+struct ImGuiDrawSnapshot
+{
+	std::vector<ImDrawList*>    Lists;
+	ImDrawData                  DrawData;
+	ImVec2                      DisplaySize;
+
+	ImGuiDrawSnapshot() : DisplaySize(0.0f, 0.0f) {}
+	~ImGuiDrawSnapshot()
+	{
+		for (ImDrawList* list : Lists)
+			IM_DELETE(list);
+	}
+
+	void Capture(const ImDrawData* drawData, const ImVec2& displaySize)
+	{
+		DrawData.Clear();
+		DisplaySize = displaySize;
+		if (!drawData || !drawData->Valid)
+			return;
+
+		while ((int)Lists.size() < drawData->CmdListsCount)
+			Lists.push_back(IM_NEW(ImDrawList)(nullptr));
+
+		for (int i = 0; i < drawData->CmdListsCount; i++)
+		{
+			const ImDrawList* source = drawData->CmdLists[i];
+			ImDrawList* copy = Lists[i];
+			CopyBuffer(copy->CmdBuffer, source->CmdBuffer);
+			CopyBuffer(copy->IdxBuffer, source->IdxBuffer);
+			CopyBuffer(copy->VtxBuffer, source->VtxBuffer);
+			copy->Flags = source->Flags;
+		}
+
+		DrawData.Valid = true;
+		DrawData.CmdLists = Lists.data();
+		DrawData.CmdListsCount = drawData->CmdListsCount;
+		DrawData.TotalIdxCount = drawData->TotalIdxCount;
+		DrawData.TotalVtxCount = drawData->TotalVtxCount;
+	}
+
+	// Null if nothing was captured.
+	ImDrawData* GetDrawData() { return DrawData.Valid ? &DrawData : nullptr; }
+
+	// ImVector's assignment frees and reallocates, this keeps the capacity.
+	template <typename T>
+	static void CopyBuffer(ImVector<T>& to, const ImVector<T>& from)
+	{
+		to.resize(from.Size);
+		if (from.Size > 0)
+			memcpy(to.Data, from.Data, (size_t)from.Size * sizeof(T));
+	}
+};
+
+#endif
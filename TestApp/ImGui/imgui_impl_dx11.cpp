@@ -64,7 +64,8 @@ struct VERTEX_CONSTANT_BUFFER
 
 // Render function
 // (this used to be set in io.RenderDrawListsFn and called by ImGui::Render(), but you can now call this directly from your main loop)
-void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
+// display_size is the size the draw data was laid out for, passed in as io.DisplaySize may already be the next frame's
+void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data, const ImVec2& display_size)
 {
     ID3D11DeviceContext* ctx = g_pd3dDeviceContext;
 
@@ -123,8 +124,8 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
             return;
         VERTEX_CONSTANT_BUFFER* constant_buffer = (VERTEX_CONSTANT_BUFFER*)mapped_resource.pData;
         float L = 0.0f;
-        float R = ImGui::GetIO().DisplaySize.x;
-        float B = ImGui::GetIO().DisplaySize.y;
+        float R = display_size.x;
+        float B = display_size.y;
         float T = 0.0f;
         float mvp[4][4] =
         {
@@ -182,8 +183,8 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
     // Setup viewport
     D3D11_VIEWPORT vp;
     memset(&vp, 0, sizeof(D3D11_VIEWPORT));
-    vp.Width = ImGui::GetIO().DisplaySize.x;
-    vp.Height = ImGui::GetIO().DisplaySize.y;
+    vp.Width = display_size.x;
+    vp.Height = display_size.y;
     vp.MinDepth = 0.0f;
     vp.MaxDepth = 1.0f;
     vp.TopLeftX = vp.TopLeftY = 0.0f;
@@ -14,7 +14,7 @@ struct ID3D11DeviceContext;
 IMGUI_API bool        ImGui_ImplDX11_Init(void* hwnd, ID3D11Device* device, ID3D11DeviceContext* device_context);
 IMGUI_API void        ImGui_ImplDX11_Shutdown();
 IMGUI_API void        ImGui_ImplDX11_NewFrame();
-IMGUI_API void        ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data);
+IMGUI_API void        ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data, const ImVec2& display_size);
 
 // Use if you want to reset your rendering device without losing ImGui state.
 IMGUI_API void        ImGui_ImplDX11_InvalidateDeviceObjects();
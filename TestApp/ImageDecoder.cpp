@@ -0,0 +1,181 @@
+/**
+*  @file ImageDecoder.cpp
+*  @brief Decodes a model's texture images on the CPU, on as many threads as asked.
+*
+*  Prefers the baked DDS the TextureBaker writes next to an image, unless the image is newer, otherwise decodes it with stb.
+*  Doesn't touch the device, so it can run on any thread and headless.
+*
+*  @bug No known bugs.
+*/
+#include "ImageDecoder.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include "Log.h"
+#include "Profiler.h"
+
+/**
+*  @brief Decodes the images on a pool of worker threads.
+*
+*  Each worker pulls the next undecoded image until there are none left, or the load is cancelled.
+*
+*  @param directory The directory the image paths are relative to.
+*  @param images The images to decode.
+*  @param numThreads The threads to decode on, counting the calling thread, or 0 for the hardware concurrency.
+*  @param cancel Checked before each image, the images not started yet are left undecoded once it is set.
+*  @param decoded Called with each image once it's decoded, it can move the image's contents out.
+*  @return The number of images decoded.
+*/
+unsigned int ImageDecoder::DecodeImages(const std::string& directory, std::vector<DecodedImage>& images, unsigned int numThreads,
+	const std::atomic<bool>& cancel, const DecodedCallback& decoded)
+{
+	if (images.empty()) return 0;
+
+	if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+	if (numThreads == 0) numThreads = 1;
+	if (numThreads > images.size()) numThreads = (unsigned int)images.size();
+
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	std::atomic<unsigned int> next(0);
+	std::atomic<unsigned int> numDecoded(0);
+	auto worker = [&directory, &images, &cancel, &decoded, &next, &numDecoded]()
+	{
+		PROFILE_SCOPE("Texture decode worker");
+		for (unsigned int i = next++; i < images.size() && !cancel.load(std::memory_order_relaxed); i = next++)
+		{
+			DecodeImage(directory, images[i]);
+			decoded(images[i]);
+			numDecoded++;
+		}
+	};
+
+	// The calling thread works too
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numThreads; i++)
+	{
+		threads.push_back(std::thread([&worker]()
+		{
+			Profiler::Get().SetThreadName("Texture decode");
+			worker();
+		}));
+	}
+	worker();
+	for (unsigned int i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	LOG_INFO << "Decoded " << numDecoded.load() << " textures on " << numThreads << " threads in " << ms << " ms";
+	return numDecoded.load();
+}
+
+/**
+*  @brief Whether a file was modified after another one.
+*
+*  @return false if either file is missing.
+*/
+static bool IsNewer(const std::string& filename, const std::string& than)
+{
+	struct stat file;
+	struct stat other;
+	if (stat(filename.c_str(), &file) != 0 || stat(than.c_str(), &other) != 0)
+		return false;
+	return file.st_mtime > other.st_mtime;
+}
+
+/**
+*  @brief Decodes one image with stb, safe to call from any thread.
+*
+*  @param directory The directory the image path is relative to.
+*  @param image The image to decode, mpData is left null on failure.
+*/
+void ImageDecoder::DecodeImage(const std::string& directory, DecodedImage& image)
+{
+	PROFILE_SCOPE("ImageDecoder::DecodeImage");
+
+	// Get the full file name
+	const std::string filename = directory + '/' + image.mPath;
+
+	// Prefer the DDS written by the TextureBaker, it's already compressed with every mip,
+	// unless the source was edited since it was baked
+	const size_t dot = filename.find_last_of('.');
+	if (dot != std::string::npos)
+	{
+		const std::string baked = filename.substr(0, dot) + ".dds";
+		if (IsNewer(filename, baked))
+			LOG_WARNING << filename << " is newer than " << baked << ", ignoring the baked texture";
+		else if (LoadBakedImage(baked, image))
+			return;
+	}
+
+	// Always decode to 4 components
+	int nrComponents = 0;
+	image.mpData = stbi_load(filename.c_str(), &image.miWidth, &image.miHeight, &nrComponents, 4);
+
+	// Look for texels the G-buffer pixel shader would clip
+	if (image.mpData && nrComponents == 4)
+	{
+		const size_t numPixels = (size_t)image.miWidth * image.miHeight;
+		for (size_t i = 0; i < numPixels && !image.mbHasAlpha; i++)
+			image.mbHasAlpha = image.mpData[i * 4 + 3] < DDS_ALPHA_CLIP_THRESHOLD;
+	}
+}
+
+/**
+*  @brief Reads a baked DDS file into memory, safe to call from any thread.
+*
+*  @param filename The path of the DDS file.
+*  @param image Filled in with the file contents if it is a supported DDS.
+*  @return true if the baked file exists and is valid.
+*/
+bool ImageDecoder::LoadBakedImage(const std::string& filename, DecodedImage& image)
+{
+	FILE* file = nullptr;
+#if defined _WIN32
+	if (fopen_s(&file, filename.c_str(), "rb") != 0)
+		file = nullptr;
+#else
+	file = fopen(filename.c_str(), "rb");
+#endif
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	bool loaded = false;
+	if (size > 0)
+	{
+		image.mFileData.resize((size_t)size);
+		loaded = fread(&image.mFileData[0], 1, image.mFileData.size(), file) == image.mFileData.size() &&
+			DDSParse(&image.mFileData[0], image.mFileData.size(), image.mDDS);
+	}
+	fclose(file);
+
+	if (!loaded)
+	{
+		image.mFileData.clear();
+		return false;
+	}
+
+	image.mbBaked = true;
+	image.mbHasAlpha = image.mDDS.alphaTested;
+	image.miWidth = (int)image.mDDS.width;
+	image.miHeight = (int)image.mDDS.height;
+	return true;
+}
+
+/**
+*  @brief Frees the pixels stb decoded, if any.
+*/
+void ImageDecoder::FreePixels(DecodedImage& image)
+{
+	stbi_image_free(image.mpData);
+	image.mpData = nullptr;
+}
@@ -0,0 +1,62 @@
+/**
+*  @file ImageDecoder.h
+*  @brief Decodes a model's texture images on the CPU, on as many threads as asked.
+*
+*  Prefers the baked DDS the TextureBaker writes next to an image, unless the image is newer, otherwise decodes it with stb.
+*  Doesn't touch the device, so it can run on any thread and headless.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "DDS.h"
+
+class Texture;
+
+/**
+*  @brief A texture decoded on the CPU, waiting to be uploaded.
+*/
+struct DecodedImage
+{
+	DecodedImage() : mpData(nullptr), miWidth(0), miHeight(0), mbHasAlpha(false), mbBaked(false), mpCached(nullptr) {}
+
+	std::string mPath;
+	/// The normalised path used as the texture cache key.
+	std::string mKey;
+	unsigned char* mpData;
+	int miWidth;
+	int miHeight;
+	/// Set if any texel is transparent enough to be clipped.
+	bool mbHasAlpha;
+
+	/// Set if a baked DDS was found, its contents are in mFileData instead of mpData.
+	bool mbBaked;
+	std::vector<unsigned char> mFileData;
+	DDSInfo mDDS;
+
+	/// Set if the texture was already in the cache with a reference acquired, nothing was decoded.
+	Texture* mpCached;
+};
+
+/**
+*  @brief Decodes texture images on the CPU.
+*/
+class ImageDecoder
+{
+public:
+	/// Called with each image as soon as it's decoded, on the thread that decoded it.
+	typedef std::function<void(DecodedImage& image)> DecodedCallback;
+
+	static unsigned int DecodeImages(const std::string& directory, std::vector<DecodedImage>& images, unsigned int numThreads,
+		const std::atomic<bool>& cancel, const DecodedCallback& decoded);
+	static void DecodeImage(const std::string& directory, DecodedImage& image);
+	static bool LoadBakedImage(const std::string& filename, DecodedImage& image);
+	static void FreePixels(DecodedImage& image);
+
+private:
+	ImageDecoder() = delete;
+};
@@ -3,7 +3,10 @@
 
 
 IndexBuffer::IndexBuffer() :
-	mpIndexBuffer(nullptr)
+	mpDevice(nullptr),
+	mpIndexBuffer(nullptr),
+	mNumberOfIndices(0),
+	meFormat(INDEX_FORMAT_32)
 {
 }
 
@@ -12,47 +15,58 @@ IndexBuffer::~IndexBuffer()
 {
 }
 
-void IndexBuffer::Create(DirectXDevice * device, std::vector<unsigned int> indicies)
+void IndexBuffer::Create(GraphicsDevice * device, std::vector<unsigned int> indicies)
 {
-	mNumberOfIndices = indicies.size();
+	Create(device, indicies.data(), (unsigned int)indicies.size(), INDEX_FORMAT_32);
+}
+
+void IndexBuffer::Create(GraphicsDevice* device, const std::vector<uint16_t>& indices)
+{
+	Create(device, indices.data(), (unsigned int)indices.size(), INDEX_FORMAT_16);
+}
+
+/**
+*  @brief Creates the index buffer.
+*
+*  @param device The device to create the buffer on.
+*  @param indices The index data.
+*  @param numIndices The number of indices.
+*  @param format INDEX_FORMAT_16 or INDEX_FORMAT_32, the width of each index.
+*/
+void IndexBuffer::Create(GraphicsDevice* device, const void* indices, unsigned int numIndices, IndexFormat format)
+{
+	mpDevice = device;
+	mNumberOfIndices = numIndices;
+	meFormat = format;
 
 	// Fill in a buffer description.
-	D3D11_BUFFER_DESC bufferDesc;
-	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	bufferDesc.ByteWidth = sizeof(unsigned int) * mNumberOfIndices;
-	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	bufferDesc.CPUAccessFlags = 0;
-	bufferDesc.MiscFlags = 0;
-	
-	// Define the resource data.
-	D3D11_SUBRESOURCE_DATA initData;
-	initData.pSysMem = &indicies[0];
-	initData.SysMemPitch = 0;
-	initData.SysMemSlicePitch = 0;
+	BufferDesc desc;
+	desc.miSize = GetSizeInBytes();
+	desc.meType = BUFFER_INDEX;
+	desc.meUsage = USAGE_DEFAULT;
 
 	// Create the buffer with the device.
-	HRESULT hr = device->GetDevice()->CreateBuffer(&bufferDesc, &initData, &mpIndexBuffer);
-	
-	if (FAILED(hr))
+	mpIndexBuffer = device->CreateBuffer(desc, indices);
+	if (!mpIndexBuffer)
 	{
 		LOG_ERROR << "Failed to create Index buffer";
 	}
 
 	// Set the buffer.
-	device->GetContext()->IASetIndexBuffer(mpIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	device->SetIndexBuffer(mpIndexBuffer, meFormat);
 }
 
 void IndexBuffer::Release()
 {
 	if (mpIndexBuffer)
 	{
-		mpIndexBuffer->Release();
+		mpDevice->ReleaseBuffer(mpIndexBuffer);
 		mpIndexBuffer = nullptr;
 	}
 }
 
-void IndexBuffer::SetIndexBuffer(DirectXDevice * device)
+void IndexBuffer::SetIndexBuffer(GraphicsDevice * device)
 {
 	// Set the buffer.
-	device->GetContext()->IASetIndexBuffer(mpIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
-}
+	device->SetIndexBuffer(mpIndexBuffer, meFormat);
+}
\ No newline at end of file
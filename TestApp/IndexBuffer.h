@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
-#include "DirectXDevice.h"
+#include <stdint.h>
+#include "GraphicsDevice.h"
 
 class IndexBuffer
 {
@@ -8,13 +9,21 @@ public:
 	IndexBuffer();
 	~IndexBuffer();
 
-	void Create(DirectXDevice* device, std::vector<unsigned int> indicies);
+	void Create(GraphicsDevice* device, std::vector<unsigned int> indicies);
+	void Create(GraphicsDevice* device, const std::vector<uint16_t>& indices);
+	void Create(GraphicsDevice* device, const void* indices, unsigned int numIndices, IndexFormat format);
 	void Release();
 
-	void SetIndexBuffer(DirectXDevice* device);
+	void SetIndexBuffer(GraphicsDevice* device);
+
+	IndexFormat GetFormat() const { return meFormat; }
+	GraphicsBuffer* GetBuffer() const { return mpIndexBuffer; }
+	unsigned int GetSizeInBytes() const { return mNumberOfIndices * (meFormat == INDEX_FORMAT_16 ? 2 : 4); }
 
 private:
-	ID3D11Buffer* mpIndexBuffer;
+	/// The device the buffer was created on.
+	GraphicsDevice* mpDevice;
+	GraphicsBuffer* mpIndexBuffer;
 	int mNumberOfIndices;
+	IndexFormat meFormat;
 };
-
@@ -0,0 +1,410 @@
+/**
+*  @file JobSystem.cpp
+*  @brief Runs small jobs across a pool of worker threads that steal work from each other.
+*
+*  @bug No known bugs.
+*/
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <stdio.h>
+#include <chrono>
+
+/// How many times an idle worker looks for work to steal before going to sleep.
+static const unsigned int SPINS_BEFORE_SLEEP = 64;
+/// The longest a worker sleeps for, in case it slept through being woken.
+static const std::chrono::milliseconds WORKER_SLEEP(10);
+
+namespace
+{
+	/// Which JobSystem the thread is a worker of, and its index in it.
+	struct WorkerContext
+	{
+		const JobSystem* mpSystem;
+		unsigned int miIndex;
+	};
+
+	thread_local WorkerContext tWorker = { nullptr, 0 };
+}
+
+/*----------------------------------------------------------------------------------------------------------------*/
+// JOB DEQUE
+/*----------------------------------------------------------------------------------------------------------------*/
+
+JobDeque::JobDeque() :
+	miTop(0),
+	miBottom(0)
+{
+	for (unsigned int i = 0; i < CAPACITY; i++)
+		mJobs[i].store(nullptr, std::memory_order_relaxed);
+}
+
+/**
+*  @brief Adds a job at the bottom. Only called by the owner.
+*/
+bool JobDeque::Push(Job* job)
+{
+	const int64_t bottom = miBottom.load(std::memory_order_relaxed);
+	const int64_t top = miTop.load(std::memory_order_acquire);
+	if (bottom - top >= (int64_t)CAPACITY)
+		return false;
+
+	mJobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	// The job has to be visible before a thief can see the new bottom
+	miBottom.store(bottom + 1, std::memory_order_release);
+	return true;
+}
+
+/**
+*  @brief Takes the job at the bottom, the one pushed most recently. Only called by the owner.
+*/
+Job* JobDeque::Pop()
+{
+	const int64_t bottom = miBottom.load(std::memory_order_relaxed) - 1;
+	miBottom.store(bottom, std::memory_order_relaxed);
+	// Claim the bottom before looking at the top, thieves do the opposite
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = miTop.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		// Empty
+		miBottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = mJobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (top == bottom)
+	{
+		// The last job, a thief could be taking it from the top at the same time
+		if (!miTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		miBottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+/**
+*  @brief Takes the job at the top, the oldest. Called by any other worker.
+*  @return null if it's empty, or another thread took the job first.
+*/
+Job* JobDeque::Steal()
+{
+	int64_t top = miTop.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const int64_t bottom = miBottom.load(std::memory_order_acquire);
+	if (top >= bottom)
+		return nullptr;
+
+	Job* job = mJobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (!miTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+bool JobDeque::IsEmpty() const
+{
+	return miBottom.load(std::memory_order_relaxed) <= miTop.load(std::memory_order_relaxed);
+}
+
+/*----------------------------------------------------------------------------------------------------------------*/
+// JOB SYSTEM
+/*----------------------------------------------------------------------------------------------------------------*/
+
+JobSystem::Worker::Worker() :
+	miNextJob(0),
+	miRandom(1),
+	miJobsRun(0),
+	miJobsStolen(0)
+{
+	for (unsigned int i = 0; i < JOB_POOL_SIZE; i++)
+	{
+		mPool[i].mpRun = nullptr;
+		mPool[i].mpCounter = nullptr;
+		mPool[i].mbFinished.store(true, std::memory_order_relaxed);
+	}
+}
+
+unsigned int JobSystem::DefaultWorkerThreads()
+{
+	const unsigned int threads = std::thread::hardware_concurrency();
+	return threads > 1 ? threads - 1 : 0;
+}
+
+/**
+*  @brief Starts the worker threads. The calling thread becomes worker 0.
+*/
+JobSystem::JobSystem(unsigned int workerThreads) :
+	mbStopping(false),
+	miSleeping(0)
+{
+	for (unsigned int i = 0; i <= workerThreads; i++)
+	{
+		mWorkers.push_back(new Worker());
+		mWorkers[i]->miRandom = i * 2654435761u + 1;
+	}
+
+	tWorker.mpSystem = this;
+	tWorker.miIndex = 0;
+
+	for (unsigned int i = 1; i <= workerThreads; i++)
+		mWorkers[i]->mThread = std::thread(&JobSystem::WorkerThread, this, i);
+}
+
+/**
+*  @brief Stops the workers. Anything still queued is never run, so wait for the jobs first.
+*/
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mbStopping.store(true);
+	}
+	mWake.notify_all();
+
+	for (Worker* worker : mWorkers)
+	{
+		if (worker->mThread.joinable())
+			worker->mThread.join();
+	}
+
+	if (tWorker.mpSystem == this)
+		tWorker.mpSystem = nullptr;
+
+	for (Worker* worker : mWorkers)
+		delete worker;
+}
+
+int JobSystem::GetWorkerIndex() const
+{
+	return tWorker.mpSystem == this ? (int)tWorker.miIndex : -1;
+}
+
+/**
+*  @brief Runs jobs on the calling thread until every job counted by counter has finished.
+*
+*  Threads that aren't workers just wait, though their jobs have already been run as they started them.
+*/
+void JobSystem::Wait(JobCounter& counter)
+{
+	const int index = GetWorkerIndex();
+	while (!counter.IsDone())
+	{
+		if (index < 0 || !RunOneJob((unsigned int)index))
+			std::this_thread::yield();
+	}
+}
+
+uint64_t JobSystem::GetJobsRun() const
+{
+	uint64_t total = 0;
+	for (const Worker* worker : mWorkers)
+		total += worker->miJobsRun.load(std::memory_order_relaxed);
+	return total;
+}
+
+uint64_t JobSystem::GetJobsStolen() const
+{
+	uint64_t total = 0;
+	for (const Worker* worker : mWorkers)
+		total += worker->miJobsStolen.load(std::memory_order_relaxed);
+	return total;
+}
+
+/**
+*  @brief Takes the next slot from the calling worker's pool.
+*
+*  If the slot's last job is still queued then every slot is in use, so this runs jobs until it has finished.
+*  @return null if the calling thread isn't a worker.
+*/
+Job* JobSystem::AllocateJob()
+{
+	const int index = GetWorkerIndex();
+	if (index < 0)
+		return nullptr;
+
+	Worker& worker = *mWorkers[index];
+	Job* job = &worker.mPool[worker.miNextJob++ & (JOB_POOL_SIZE - 1)];
+	while (!job->mbFinished.load(std::memory_order_acquire))
+	{
+		if (!RunOneJob((unsigned int)index))
+			std::this_thread::yield();
+	}
+
+	job->mbFinished.store(false, std::memory_order_relaxed);
+	job->mpCounter = nullptr;
+	return job;
+}
+
+void JobSystem::Submit(Job* job, JobCounter* counter)
+{
+	job->mpCounter = counter;
+	if (counter)
+		counter->miCount.fetch_add(1, std::memory_order_relaxed);
+	Push(job);
+}
+
+/**
+*  @brief Queues a job on the calling worker's deque, or runs it now if the deque is full, and wakes a sleeping worker.
+*/
+void JobSystem::Push(Job* job)
+{
+	Worker& worker = *mWorkers[GetWorkerIndex()];
+	if (!worker.mDeque.Push(job))
+	{
+		Execute(job);
+		worker.miJobsRun.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	// Pairs with the fence in WorkerThread, so either the sleeper sees the job or this sees the sleeper
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (miSleeping.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mWake.notify_one();
+	}
+}
+
+/**
+*  @brief Queues a job now if dependency has reached 0, otherwise leaves it with dependency to be queued once it does.
+*/
+void JobSystem::SubmitAfter(JobCounter& dependency, Job* job, JobCounter* counter)
+{
+	job->mpCounter = counter;
+	if (counter)
+		counter->miCount.fetch_add(1, std::memory_order_relaxed);
+
+	{
+		// The count can only reach 0 before this locks, or after this has added the job
+		std::lock_guard<std::mutex> lock(dependency.mMutex);
+		if (dependency.miCount.load(std::memory_order_acquire) > 0)
+		{
+			dependency.mContinuations.push_back(job);
+			return;
+		}
+	}
+	Push(job);
+}
+
+/**
+*  @brief Runs a job from the worker's own deque, or one stolen from another.
+*  @return false if there wasn't one to run.
+*/
+bool JobSystem::RunOneJob(unsigned int workerIndex)
+{
+	Worker& worker = *mWorkers[workerIndex];
+	Job* job = worker.mDeque.Pop();
+	if (!job)
+	{
+		job = StealJob(workerIndex);
+		if (!job)
+			return false;
+		worker.miJobsStolen.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Execute(job);
+	worker.miJobsRun.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+/**
+*  @brief Runs a job, counts it down and queues anything that was waiting for its counter to reach 0.
+*/
+void JobSystem::Execute(Job* job)
+{
+	// The slot can be reused as soon as the job starts, so everything needed from it is read first
+	JobCounter* counter = job->mpCounter;
+	job->mpRun(*job);
+	if (!counter)
+		return;
+
+	// Whoever's waiting on the counter can't destroy it until this is done with it
+	counter->miFinishing.fetch_add(1);
+	if (counter->miCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::vector<Job*> ready;
+		{
+			std::lock_guard<std::mutex> lock(counter->mMutex);
+			ready.swap(counter->mContinuations);
+		}
+		for (Job* continuation : ready)
+			Push(continuation);
+	}
+	counter->miFinishing.fetch_sub(1, std::memory_order_release);
+}
+
+/**
+*  @brief Tries to steal a job from each of the other workers in turn, starting from a random one.
+*/
+Job* JobSystem::StealJob(unsigned int workerIndex)
+{
+	const unsigned int count = (unsigned int)mWorkers.size();
+	if (count < 2)
+		return nullptr;
+
+	// xorshift
+	uint32_t& random = mWorkers[workerIndex]->miRandom;
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+
+	const unsigned int start = random % count;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const unsigned int victim = (start + i) % count;
+		if (victim == workerIndex)
+			continue;
+
+		Job* job = mWorkers[victim]->mDeque.Steal();
+		if (job)
+			return job;
+	}
+	return nullptr;
+}
+
+bool JobSystem::HasWork() const
+{
+	for (const Worker* worker : mWorkers)
+	{
+		if (!worker->mDeque.IsEmpty())
+			return true;
+	}
+	return false;
+}
+
+void JobSystem::WorkerThread(unsigned int workerIndex)
+{
+	tWorker.mpSystem = this;
+	tWorker.miIndex = workerIndex;
+
+	char name[32];
+	snprintf(name, sizeof(name), "Job worker %u", workerIndex);
+	Profiler::Get().SetThreadName(name);
+
+	unsigned int idle = 0;
+	while (!mbStopping.load(std::memory_order_relaxed))
+	{
+		if (RunOneJob(workerIndex))
+		{
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < SPINS_BEFORE_SLEEP)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Push only wakes workers if it sees one sleeping, so check there's no work after saying so
+		std::unique_lock<std::mutex> lock(mWakeMutex);
+		miSleeping.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!mbStopping.load() && !HasWork())
+			mWake.wait_for(lock, WORKER_SLEEP);
+		miSleeping.fetch_sub(1);
+		idle = 0;
+	}
+
+	tWorker.mpSystem = nullptr;
+}
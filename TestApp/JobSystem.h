@@ -0,0 +1,277 @@
+/**
+*  @file JobSystem.h
+*  @brief Runs small jobs across a pool of worker threads that steal work from each other.
+*
+*  Every worker, including the thread that made the JobSystem, has its own Chase-Lev deque. A worker pushes
+*  and pops jobs at the bottom of its own deque and steals from the top of the others when it runs out,
+*  so jobs that spawn more jobs mostly stay on one thread and only spread out when others are idle.
+*  Jobs are counted by a JobCounter, which can be waited on or have jobs set to start once it reaches 0.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class JobSystem;
+
+/**
+*  @brief A job, the function to call and its captures, stored in place so running one never allocates.
+*/
+struct Job
+{
+	/// The most bytes of captures a job can hold, capture a pointer to anything bigger.
+	static const size_t DATA_SIZE = 64;
+
+	/// Moves the function out of mData, marks the job finished and calls it.
+	void (*mpRun)(Job& job);
+	/// Counted down once the job has run, can be null.
+	class JobCounter* mpCounter;
+	/// False from when the job is allocated until it starts running, so its slot isn't reused while it's still queued.
+	std::atomic<bool> mbFinished;
+	alignas(16) unsigned char mData[DATA_SIZE];
+};
+
+/**
+*  @brief Counts jobs that haven't finished yet.
+*
+*  Incremented when a job is started with it and decremented when that job finishes. Must outlive the
+*  jobs it counts, which Wait makes sure of.
+*/
+class JobCounter
+{
+public:
+	JobCounter() : miCount(0), miFinishing(0) {}
+	~JobCounter() {}
+
+	/// True once every job started with it has finished.
+	bool IsDone() const { return miCount.load(std::memory_order_acquire) == 0 && miFinishing.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	std::atomic<int> miCount;
+	/// Workers between decrementing the count and being done with the counter.
+	std::atomic<int> miFinishing;
+	/// Guards mContinuations.
+	std::mutex mMutex;
+	/// Jobs waiting for the count to reach 0.
+	std::vector<Job*> mContinuations;
+};
+
+/**
+*  @brief A fixed size Chase-Lev work stealing deque of jobs.
+*
+*  Only the owning worker pushes and pops, at the bottom. Any other worker can steal from the top.
+*  See "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al. 2013.
+*/
+class JobDeque
+{
+public:
+	/// Jobs a deque holds, a power of 2.
+	static const unsigned int CAPACITY = 4096;
+
+	JobDeque();
+
+	/// @return false if it's full.
+	bool Push(Job* job);
+	Job* Pop();
+	Job* Steal();
+	/// A guess, it can be out of date by the time it returns.
+	bool IsEmpty() const;
+
+private:
+	std::atomic<int64_t> miTop;
+	/// Keeps the thieves' top off the owner's cache line.
+	char mPadding[64];
+	std::atomic<int64_t> miBottom;
+	std::atomic<Job*> mJobs[CAPACITY];
+};
+
+/**
+*  @brief The pool of worker threads, and the deques and job pools they run from.
+*
+*  The thread that makes the JobSystem is worker 0. It doesn't run jobs in the background, but does
+*  whenever it waits on a counter. Jobs started from any thread that isn't one of the workers are run
+*  straight away on that thread instead of being queued.
+*/
+class JobSystem
+{
+public:
+	/// Jobs each worker can have allocated at once, a power of 2.
+	static const unsigned int JOB_POOL_SIZE = 2048;
+
+	/// One fewer than the number of hardware threads, as the thread that makes the JobSystem works too.
+	static unsigned int DefaultWorkerThreads();
+
+	/// @param workerThreads How many threads to start, besides the calling thread.
+	explicit JobSystem(unsigned int workerThreads = DefaultWorkerThreads());
+	~JobSystem();
+
+	/// The number of workers, including the thread that made it.
+	unsigned int GetWorkerCount() const { return (unsigned int)mWorkers.size(); }
+	/// The calling thread's worker index, or -1 if it isn't one of the workers.
+	int GetWorkerIndex() const;
+
+	/**
+	*  @brief Queues function to be run by a worker.
+	*  @param function Called with no arguments. Its captures must fit in Job::DATA_SIZE.
+	*  @param counter Incremented now and decremented once function has run, can be null.
+	*/
+	template <typename Function>
+	void Run(Function&& function, JobCounter* counter = nullptr);
+
+	/**
+	*  @brief Queues function to be run once every job counted by dependency has finished.
+	*  @param counter Incremented now and decremented once function has run, can be null.
+	*/
+	template <typename Function>
+	void RunAfter(JobCounter& dependency, Function&& function, JobCounter* counter = nullptr);
+
+	/// Runs jobs on the calling thread until every job counted by counter has finished.
+	void Wait(JobCounter& counter);
+
+	/**
+	*  @brief Calls function(rangeBegin, rangeEnd) over [begin, end) split into ranges across the workers, and waits for them.
+	*
+	*  The range is halved until the halves are no more than grainSize long. The calling thread keeps one half and
+	*  leaves the other to be stolen, so the work only spreads out as far as there are idle workers to take it.
+	*/
+	template <typename Function>
+	void ParallelFor(unsigned int begin, unsigned int end, unsigned int grainSize, const Function& function);
+
+	/// Jobs that have been run, and how many of them were stolen from another worker, since it was made.
+	uint64_t GetJobsRun() const;
+	uint64_t GetJobsStolen() const;
+
+private:
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	struct Worker
+	{
+		Worker();
+
+		JobDeque mDeque;
+		Job mPool[JOB_POOL_SIZE];
+		unsigned int miNextJob;
+		uint32_t miRandom;
+		std::atomic<uint64_t> miJobsRun;
+		std::atomic<uint64_t> miJobsStolen;
+		std::thread mThread;
+	};
+
+	Job* AllocateJob();
+	void Submit(Job* job, JobCounter* counter);
+	void Push(Job* job);
+	void SubmitAfter(JobCounter& dependency, Job* job, JobCounter* counter);
+	bool RunOneJob(unsigned int workerIndex);
+	void Execute(Job* job);
+	Job* StealJob(unsigned int workerIndex);
+	bool HasWork() const;
+	void WorkerThread(unsigned int workerIndex);
+
+	template <typename Function>
+	Job* MakeJob(Function&& function);
+	template <typename Function>
+	void SplitRange(unsigned int begin, unsigned int end, unsigned int grainSize, const Function* function, JobCounter& counter);
+
+	std::vector<Worker*> mWorkers;
+
+	std::atomic<bool> mbStopping;
+	/// Workers that have run out of work and are waiting to be woken.
+	std::atomic<int> miSleeping;
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+};
+
+/**
+*  @brief Stores function in a new job.
+*  @return null if the calling thread isn't a worker, so function should just be called.
+*/
+template <typename Function>
+Job* JobSystem::MakeJob(Function&& function)
+{
+	typedef typename std::decay<Function>::type Stored;
+	static_assert(sizeof(Stored) <= Job::DATA_SIZE, "The job's captures don't fit in Job::DATA_SIZE, capture a pointer to them instead");
+	static_assert(alignof(Stored) <= 16, "The job's captures are aligned more than Job::mData");
+
+	Job* job = AllocateJob();
+	if (!job)
+		return nullptr;
+
+	new (job->mData) Stored(std::forward<Function>(function));
+	job->mpRun = [](Job& run)
+	{
+		// Moved out so the slot is free while it runs, a job that allocates jobs could otherwise wait on its own slot
+		Stored* stored = reinterpret_cast<Stored*>(run.mData);
+		Stored function(std::move(*stored));
+		stored->~Stored();
+		run.mbFinished.store(true, std::memory_order_release);
+		function();
+	};
+	return job;
+}
+
+template <typename Function>
+void JobSystem::Run(Function&& function, JobCounter* counter)
+{
+	Job* job = MakeJob(std::forward<Function>(function));
+	if (job)
+		Submit(job, counter);
+	else
+		function();
+}
+
+template <typename Function>
+void JobSystem::RunAfter(JobCounter& dependency, Function&& function, JobCounter* counter)
+{
+	Job* job = MakeJob(std::forward<Function>(function));
+	if (job)
+	{
+		SubmitAfter(dependency, job, counter);
+	}
+	else
+	{
+		// Not a worker, so it can't help with the jobs it's waiting on either
+		while (!dependency.IsDone())
+			std::this_thread::yield();
+		function();
+	}
+}
+
+template <typename Function>
+void JobSystem::ParallelFor(unsigned int begin, unsigned int end, unsigned int grainSize, const Function& function)
+{
+	if (begin >= end)
+		return;
+	if (grainSize == 0)
+		grainSize = 1;
+
+	JobCounter counter;
+	SplitRange(begin, end, grainSize, &function, counter);
+	Wait(counter);
+}
+
+template <typename Function>
+void JobSystem::SplitRange(unsigned int begin, unsigned int end, unsigned int grainSize, const Function* function, JobCounter& counter)
+{
+	// Leave the top halves for other workers to steal and carry on splitting the bottom half here
+	while (end - begin > grainSize)
+	{
+		const unsigned int middle = begin + (end - begin) / 2;
+		JobCounter* pCounter = &counter;
+		Run([this, middle, end, grainSize, function, pCounter]() { SplitRange(middle, end, grainSize, function, *pCounter); }, &counter);
+		end = middle;
+	}
+	(*function)(begin, end);
+}
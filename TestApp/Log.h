@@ -13,10 +13,15 @@
 #ifndef __LOG_H__
 #define __LOG_H__
 
-#include <sstream>
 #include <string>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "Globals.h"
+#include "LogQueue.h"
+#include "BinaryLog.h"
+#include "BinaryLogFormat.h"
 
 /**
 *  @brief The severity levels for the logger
@@ -30,6 +35,366 @@ enum Severity
 	VERBOSE = 4
 };
 
+// Lets the compiler check Printf's arguments against the format
+#if defined(__GNUC__) || defined(__clang__)
+#define LOG_FMTARGS(FMT) __attribute__((format(printf, FMT, FMT + 1)))
+#else
+#define LOG_FMTARGS(FMT)
+#endif
+
+/**
+*  @brief What a log call knows at compile time, worked out the first time it logs and kept.
+*/
+struct LogSite
+{
+	static const unsigned int MAX_PREFIX = 128;
+
+	LogSite(Severity level, const char* function, long line, const char* file);
+
+	/// What binary log records refer to the site by.
+	unsigned int miId;
+	Severity meLevel;
+	const char* mpFunction;
+	long miLine;
+	/// The file name without its directory.
+	const char* mpFile;
+	/// The padded level name and "[function:line] ", as it starts every line from here.
+	char mPrefix[MAX_PREFIX];
+	unsigned int miPrefixLength;
+};
+
+/**
+*  @brief Builds a log line in a fixed size buffer, so logging doesn't allocate.
+*
+*  Takes the same << arguments the logger always has, or printf style arguments through Printf.
+*  Lines that don't fit are cut short and end in "...".
+*  While the binary log is open the arguments are also, or instead, encoded as a binary record.
+*/
+class LogStream
+{
+public:
+	static const unsigned int BUFFER_SIZE = 1024;
+	static const unsigned int BINARY_BUFFER_SIZE = 1024;
+
+	LogStream() : miLength(0), mbTruncated(false), miBinaryLength(0), mbText(true), mbBinary(false) {}
+
+	void BeginBinary(unsigned int siteId, Severity level, bool text);
+	void Append(const char* text, size_t length);
+	/// Adds to the text line only, e.g. the prefix the binary log has the call site for.
+	void AppendText(const char* text, size_t length);
+	LogStream& Printf(const char* format, ...) LOG_FMTARGS(2);
+	/// Adds the end of line, after which nothing else can be added.
+	void Finish();
+
+	bool HasText() const { return mbText; }
+	const char* Data() const { return mBuffer; }
+	size_t Length() const { return miLength; }
+	bool HasBinary() const { return mbBinary; }
+	const unsigned char* BinaryData() const { return mBinary; }
+	size_t BinaryLength() const { return miBinaryLength; }
+
+	LogStream& operator<<(const char* text);
+	LogStream& operator<<(const std::string& text);
+	LogStream& operator<<(char c);
+	LogStream& operator<<(bool value);
+	LogStream& operator<<(int value) { return AppendSigned(value); }
+	LogStream& operator<<(long value) { return AppendSigned(value); }
+	LogStream& operator<<(long long value) { return AppendSigned(value); }
+	LogStream& operator<<(unsigned int value) { return AppendUnsigned(value); }
+	LogStream& operator<<(unsigned long value) { return AppendUnsigned(value); }
+	LogStream& operator<<(unsigned long long value) { return AppendUnsigned(value); }
+	LogStream& operator<<(float value);
+	LogStream& operator<<(double value);
+	LogStream& operator<<(const void* pointer);
+
+private:
+	LogStream(const LogStream&);
+	LogStream& operator=(const LogStream&);
+
+	LogStream& AppendSigned(long long value);
+	LogStream& AppendUnsigned(unsigned long long value);
+
+	/// Adds an argument to the binary record, if it fits.
+	void Encode(BinaryLogArgument tag, const void* value, size_t size);
+	void EncodeVarint(BinaryLogArgument tag, uint64_t value);
+	void EncodeString(const char* text, size_t length);
+
+	/// One byte is always kept back for the end of line.
+	char mBuffer[BUFFER_SIZE];
+	size_t miLength;
+	bool mbTruncated;
+
+	unsigned char mBinary[BINARY_BUFFER_SIZE];
+	size_t miBinaryLength;
+	bool mbText;
+	bool mbBinary;
+};
+
+inline LogSite::LogSite(Severity level, const char* function, long line, const char* file) :
+	meLevel(level),
+	mpFunction(function),
+	miLine(line),
+	miPrefixLength(0)
+{
+	static const char* const names[] = { "ERROR", "WARNING", "INFO", "DEBUG", "VERBOSE" };
+
+	// Trim the file name
+	mpFile = file;
+	for (const char* c = file; *c; c++)
+	{
+		if (*c == '/' || *c == '\\')
+			mpFile = c + 1;
+	}
+
+	int written = snprintf(mPrefix, MAX_PREFIX, "%-7s [%s:%ld] ", names[level], function, line);
+	if (written < 0)
+		written = 0;
+	miPrefixLength = (unsigned int)written < MAX_PREFIX ? (unsigned int)written : MAX_PREFIX - 1;
+
+	miId = BinaryLog::Get().RegisterSite(this);
+}
+
+/**
+*  @brief Starts a binary record for the binary log.
+*
+*  @param siteId The call site's id, or 0 if there isn't one.
+*  @param level The level of the line.
+*  @param text Whether the line is still to be written as text as well.
+*/
+inline void LogStream::BeginBinary(unsigned int siteId, Severity level, bool text)
+{
+	mbBinary = true;
+	mbText = text;
+
+	// The length is filled in by Finish
+	mBinary[0] = BINARY_LOG_MESSAGE;
+	miBinaryLength = BINARY_LOG_RECORD_HEADER;
+	miBinaryLength += BinaryLogWriteVarint(mBinary + miBinaryLength, siteId);
+	mBinary[miBinaryLength++] = (unsigned char)level;
+	miBinaryLength += BinaryLogWriteVarint(mBinary + miBinaryLength, BinaryLog::Now());
+	miBinaryLength += BinaryLogWriteVarint(mBinary + miBinaryLength, BinaryLog::ThreadId());
+}
+
+inline void LogStream::Append(const char* text, size_t length)
+{
+	if (mbText)
+		AppendText(text, length);
+	if (mbBinary)
+		EncodeString(text, length);
+}
+
+inline void LogStream::AppendText(const char* text, size_t length)
+{
+	const size_t space = BUFFER_SIZE - 1 - miLength;
+	if (length > space)
+	{
+		length = space;
+		mbTruncated = true;
+	}
+	memcpy(mBuffer + miLength, text, length);
+	miLength += length;
+}
+
+/**
+*  @brief Formats into the text buffer. The binary log gets the formatted text as one string argument.
+*/
+inline LogStream& LogStream::Printf(const char* format, ...)
+{
+	const size_t start = miLength;
+	const size_t space = BUFFER_SIZE - 1 - miLength;
+	va_list args;
+	va_start(args, format);
+	// vsnprintf always leaves room for its terminator, which is where the end of line will go
+	const int written = vsnprintf(mBuffer + miLength, space + 1, format, args);
+	va_end(args);
+
+	if (written < 0)
+		return *this;
+	if ((size_t)written > space)
+	{
+		miLength += space;
+		mbTruncated = true;
+	}
+	else
+	{
+		miLength += written;
+	}
+
+	if (mbBinary)
+		EncodeString(mBuffer + start, miLength - start);
+	if (!mbText)
+		miLength = start;
+	return *this;
+}
+
+inline void LogStream::Finish()
+{
+	if (mbText)
+	{
+		if (mbTruncated && miLength >= 3)
+			memcpy(mBuffer + miLength - 3, "...", 3);
+		mBuffer[miLength++] = '\n';
+	}
+	if (mbBinary)
+	{
+		const size_t payload = miBinaryLength - BINARY_LOG_RECORD_HEADER;
+		mBinary[1] = (unsigned char)(payload & 0xFF);
+		mBinary[2] = (unsigned char)(payload >> 8);
+	}
+}
+
+inline LogStream& LogStream::operator<<(const char* text)
+{
+	if (!text)
+		text = "(null)";
+	Append(text, strlen(text));
+	return *this;
+}
+
+inline LogStream& LogStream::operator<<(const std::string& text)
+{
+	Append(text.data(), text.size());
+	return *this;
+}
+
+inline LogStream& LogStream::operator<<(char c)
+{
+	if (mbText)
+		AppendText(&c, 1);
+	if (mbBinary)
+		Encode(BINARY_ARG_CHAR, &c, 1);
+	return *this;
+}
+
+inline LogStream& LogStream::operator<<(bool value)
+{
+	if (mbText)
+		AppendText(value ? "1" : "0", 1);
+	if (mbBinary)
+	{
+		const unsigned char byte = value ? 1 : 0;
+		Encode(BINARY_ARG_BOOL, &byte, 1);
+	}
+	return *this;
+}
+
+inline LogStream& LogStream::operator<<(float value)
+{
+	if (mbText)
+	{
+		char text[32];
+		const int length = snprintf(text, sizeof(text), "%g", value);
+		AppendText(text, length > 0 ? (size_t)length : 0);
+	}
+	if (mbBinary)
+		Encode(BINARY_ARG_FLOAT, &value, sizeof(value));
+	return *this;
+}
+
+inline LogStream& LogStream::operator<<(double value)
+{
+	if (mbText)
+	{
+		char text[32];
+		const int length = snprintf(text, sizeof(text), "%g", value);
+		AppendText(text, length > 0 ? (size_t)length : 0);
+	}
+	if (mbBinary)
+		Encode(BINARY_ARG_DOUBLE, &value, sizeof(value));
+	return *this;
+}
+
+inline LogStream& LogStream::operator<<(const void* pointer)
+{
+	if (mbText)
+	{
+		char text[32];
+		const int length = snprintf(text, sizeof(text), "%p", pointer);
+		AppendText(text, length > 0 ? (size_t)length : 0);
+	}
+	if (mbBinary)
+	{
+		const uint64_t value = (uint64_t)(uintptr_t)pointer;
+		Encode(BINARY_ARG_POINTER, &value, sizeof(value));
+	}
+	return *this;
+}
+
+inline LogStream& LogStream::AppendSigned(long long value)
+{
+	if (mbBinary)
+		EncodeVarint(BINARY_ARG_SIGNED, BinaryLogZigZag(value));
+	if (!mbText)
+		return *this;
+
+	unsigned long long magnitude = (unsigned long long)value;
+	if (value < 0)
+	{
+		AppendText("-", 1);
+		magnitude = 0ull - magnitude;
+	}
+	char digits[20];
+	char* end = digits + sizeof(digits);
+	char* c = end;
+	do
+	{
+		*--c = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude != 0);
+	AppendText(c, end - c);
+	return *this;
+}
+
+inline LogStream& LogStream::AppendUnsigned(unsigned long long value)
+{
+	if (mbBinary)
+		EncodeVarint(BINARY_ARG_UNSIGNED, value);
+	if (!mbText)
+		return *this;
+
+	char digits[20];
+	char* end = digits + sizeof(digits);
+	char* c = end;
+	do
+	{
+		*--c = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	AppendText(c, end - c);
+	return *this;
+}
+
+inline void LogStream::Encode(BinaryLogArgument tag, const void* value, size_t size)
+{
+	if (miBinaryLength + 1 + size > BINARY_BUFFER_SIZE)
+		return;
+	mBinary[miBinaryLength++] = (unsigned char)tag;
+	memcpy(mBinary + miBinaryLength, value, size);
+	miBinaryLength += size;
+}
+
+inline void LogStream::EncodeVarint(BinaryLogArgument tag, uint64_t value)
+{
+	if (miBinaryLength + 1 + BINARY_LOG_MAX_VARINT > BINARY_BUFFER_SIZE)
+		return;
+	mBinary[miBinaryLength++] = (unsigned char)tag;
+	miBinaryLength += BinaryLogWriteVarint(mBinary + miBinaryLength, value);
+}
+
+inline void LogStream::EncodeString(const char* text, size_t length)
+{
+	// Strings are cut short to fit, anything after them is dropped
+	if (miBinaryLength + 1 + BINARY_LOG_MAX_VARINT >= BINARY_BUFFER_SIZE)
+		return;
+	const size_t space = BINARY_BUFFER_SIZE - miBinaryLength - 1 - BINARY_LOG_MAX_VARINT;
+	if (length > space)
+		length = space;
+	mBinary[miBinaryLength++] = BINARY_ARG_STRING;
+	miBinaryLength += BinaryLogWriteVarint(mBinary + miBinaryLength, length);
+	memcpy(mBinary + miBinaryLength, text, length);
+	miBinaryLength += length;
+}
+
 template <typename T>
 class Log
 {
@@ -37,19 +402,21 @@ public:
 	Log();
 	virtual ~Log();
 
-	std::ostringstream& CreateLog(Severity level = INFO, const char* function = "", long line = -1, const char* file = "");
+	LogStream& CreateLog(const LogSite& site);
+	LogStream& CreateLog(Severity level = INFO);
 
 public:
 
 	static Severity& ReportingLevel();
-	static bool FileName();
-	static std::string ToString(Severity level);
+	static bool& FileName();
+	static const char* ToString(Severity level);
 	static Severity FromString(const std::string& level);
 	static void IncludeFileName(bool b);
 
 protected:
 
-	std::ostringstream os;
+	LogStream os;
+	Severity messageLevel;
 
 private:
 
@@ -59,38 +426,72 @@ private:
 };
 
 template <typename T>
-Log<T>::Log()
+Log<T>::Log() : messageLevel(INFO)
 {
 }
 
 template <typename T>
-std::ostringstream& Log<T>::CreateLog(Severity level, const char* function, long line, const char* file)
+LogStream& Log<T>::CreateLog(const LogSite& site)
 {
-	// Create severity level string
-	std::string levelString = ToString(level);
-	levelString += std::string(levelString.length() < 7 ? 7 - levelString.length() : 0, ' ');
+	messageLevel = site.meLevel;
 
-	os << levelString << " ";
+	// While the binary log is open only the more severe lines are written as text as well
+	BinaryLog& binaryLog = BinaryLog::Get();
+	if (binaryLog.IsOpen())
+		os.BeginBinary(site.miId, site.meLevel, site.meLevel <= binaryLog.GetTextLevel());
 
-	// Function and line number
-	if (function != "" && line != -1)
-		os << "[" << function << ":" << line << "] ";
-
-	// File name
-	if (file != "" && FileName())
-		os << "(" << file << ") ";
+	if (os.HasText())
+	{
+		// Level, function and line number
+		os.AppendText(site.mPrefix, site.miPrefixLength);
+
+		// File name
+		if (FileName())
+		{
+			os.AppendText("(", 1);
+			os.AppendText(site.mpFile, strlen(site.mpFile));
+			os.AppendText(") ", 2);
+		}
+	}
 
 	// Pass the stream off, to get the rest of the message
 	return os;
 }
 
+/**
+*  @brief Starts a line with just the level, for when there's no call site to go with it.
+*/
+template <typename T>
+LogStream& Log<T>::CreateLog(Severity level)
+{
+	messageLevel = level;
+	BinaryLog& binaryLog = BinaryLog::Get();
+	if (binaryLog.IsOpen())
+		os.BeginBinary(0, level, level <= binaryLog.GetTextLevel());
+
+	if (os.HasText())
+	{
+		char prefix[16];
+		const int length = snprintf(prefix, sizeof(prefix), "%-7s ", ToString(level));
+		os.AppendText(prefix, (size_t)length);
+	}
+	return os;
+}
+
 template <typename T>
 Log<T>::~Log()
 {
 	// Add an end line.
-	os << std::endl;
+	os.Finish();
 	// Actually output the string
-	T::Print(os.str());
+	if (os.HasText())
+		T::Print(os.Data(), os.Length(), messageLevel);
+	if (os.HasBinary())
+	{
+		BinaryLog::Get().Push(os.BinaryData(), os.BinaryLength(), messageLevel <= WARNING);
+		if (messageLevel == ERR)
+			BinaryLog::Get().Flush();
+	}
 }
 
 template <typename T>
@@ -101,7 +502,7 @@ Severity& Log<T>::ReportingLevel()
 }
 
 template <typename T>
-bool Log<T>::FileName()
+bool& Log<T>::FileName()
 {
 	static bool fileName = false;
 	return fileName;
@@ -110,11 +511,11 @@ bool Log<T>::FileName()
 template <typename T>
 void Log<T>::IncludeFileName(bool b)
 {
-	fileName = b;
+	FileName() = b;
 }
 
 template <typename T>
-std::string Log<T>::ToString(Severity level)
+const char* Log<T>::ToString(Severity level)
 {
 	static const char* const buffer[] = { "ERROR", "WARNING", "INFO", "DEBUG", "VERBOSE" };
 	return buffer[level];
@@ -137,11 +538,18 @@ Severity Log<T>::FromString(const std::string& level)
 	return DEBUG;
 }
 
+/**
+*  @brief Where log lines end up.
+*
+*  Print hands lines to the LogQueue, which writes them from its own thread in batches.
+*/
 class Output
 {
 public:
 	static FILE*& Stream();
-	static void Print(const std::string& msg);
+	static bool& EchoToStderr();
+	static void Print(const char* text, size_t length, Severity level = INFO);
+	static void Write(const char* text, size_t length);
 };
 
 inline FILE*& Output::Stream()
@@ -150,24 +558,53 @@ inline FILE*& Output::Stream()
 	return pStream;
 }
 
-inline void Output::Print(const std::string& msg)
+/**
+*  @brief Whether lines also go to stderr when Stream() is something else.
+*/
+inline bool& Output::EchoToStderr()
+{
+	static bool echo = true;
+	return echo;
+}
+
+/**
+*  @brief Queues a formatted line to be written.
+*
+*  Errors and warnings are never dropped. Errors are also flushed before this returns, so they're out if the process dies straight after.
+*/
+inline void Output::Print(const char* text, size_t length, Severity level)
+{
+	if (!Stream())
+		return;
+
+	LogQueue::Get().Push(text, length, level <= WARNING);
+	if (level == ERR)
+		LogQueue::Get().Flush();
+}
+
+/**
+*  @brief Writes and flushes text to the stream, stderr and the ImGui log.
+*  Only called by the LogQueue, which makes sure it's only called from one thread at a time.
+*/
+inline void Output::Write(const char* text, size_t length)
 {
 	FILE* pStream = Stream();
 
 	if (!pStream)
 		return;
 
-	fprintf(pStream, "%s", msg.c_str());
+	fwrite(text, 1, length, pStream);
 	fflush(pStream);
 
-	if (pStream != stderr)
+	if (pStream != stderr && EchoToStderr())
 	{
-		fprintf(stderr, "%s", msg.c_str());
+		fwrite(text, 1, length, stderr);
 		fflush(stderr);
 	}
 
 #if defined D_USE_IMGUI
-	GlobalSettings::Settings().imGuiAppLog.AddLog(msg.c_str());
+	// Split into lines and tagged with their level as it goes in
+	GlobalSettings::Settings().imGuiAppLog.AddText(text, length);
 #endif
 }
 
@@ -178,32 +615,81 @@ inline void Output::Print(const std::string& msg)
 class FILELOG_DECLSPEC Logger : public Log<Output> {};
 //typedef Log<Output2FILE> FILELog;
 
+// The levels as numbers, for FILELOG_MAX_LEVEL
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_VERBOSE 4
+
+// Log calls above this level are compiled out. It has to be a number, e.g. /DFILELOG_MAX_LEVEL=LOG_LEVEL_INFO
 #ifndef FILELOG_MAX_LEVEL
-#define FILELOG_MAX_LEVEL VERBOSE
+#define FILELOG_MAX_LEVEL LOG_LEVEL_VERBOSE
 #endif
 
-// Trims __FILE__ into just the file name
-#define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : strrchr(__FILE__, '\\') ? strrchr(__FILE__, '\\') + 1 : __FILE__)
+// The call site, set up the first time the call logs. The level has to be a constant.
+#define LOG_SITE(level) \
+	[](const char* function) -> const LogSite& { static const LogSite site(level, function, __LINE__, __FILE__); return site; }(__FUNCTION__)
 
 #define LOG(level) \
     if (level > FILELOG_MAX_LEVEL) ;\
     else if (level > Logger::ReportingLevel() || !Output::Stream()) ; \
-    else Logger().CreateLog(level, __FUNCTION__, __LINE__, __FILENAME__)
+    else Logger().CreateLog(LOG_SITE(level))
+
+// A compiled out log call, the arguments are still checked but never evaluated
+#define LOG_DISABLED \
+	if (true) ; else LogStream()
 
 // Log calls
+#if FILELOG_MAX_LEVEL >= LOG_LEVEL_VERBOSE
 #define LOG_VERBOSE \
 	LOG(VERBOSE)
+#else
+#define LOG_VERBOSE \
+	LOG_DISABLED
+#endif
 
+#if FILELOG_MAX_LEVEL >= LOG_LEVEL_DEBUG
 #define LOG_DEBUG \
 	LOG(DEBUG)
+#else
+#define LOG_DEBUG \
+	LOG_DISABLED
+#endif
 
+#if FILELOG_MAX_LEVEL >= LOG_LEVEL_INFO
 #define LOG_INFO \
 	LOG(INFO)
+#else
+#define LOG_INFO \
+	LOG_DISABLED
+#endif
 
+#if FILELOG_MAX_LEVEL >= LOG_LEVEL_WARNING
 #define LOG_WARNING \
 	LOG(WARNING)
+#else
+#define LOG_WARNING \
+	LOG_DISABLED
+#endif
 
 #define LOG_ERROR \
 	LOG(ERR)
 
+// printf style log calls, e.g. LOGF_INFO("Loaded %s in %.1f ms", path, ms)
+#define LOGF_VERBOSE(...) \
+	LOG_VERBOSE.Printf(__VA_ARGS__)
+
+#define LOGF_DEBUG(...) \
+	LOG_DEBUG.Printf(__VA_ARGS__)
+
+#define LOGF_INFO(...) \
+	LOG_INFO.Printf(__VA_ARGS__)
+
+#define LOGF_WARNING(...) \
+	LOG_WARNING.Printf(__VA_ARGS__)
+
+#define LOGF_ERROR(...) \
+	LOG_ERROR.Printf(__VA_ARGS__)
+
 #endif //__LOG_H__
\ No newline at end of file
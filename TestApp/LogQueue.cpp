@@ -0,0 +1,258 @@
+/**
+*  @file LogQueue.cpp
+*  @brief Hands finished log lines to a background thread to write out.
+*
+*  @bug No known bugs.
+*/
+#include "LogQueue.h"
+#include "Log.h"
+#include <string.h>
+#include <chrono>
+
+/// The writer stops adding lines to a batch once it's this big.
+static const size_t BATCH_SIZE = 64 * 1024;
+/// How long the writer sleeps for if nobody wakes it, wakeups can be missed as logging threads don't lock.
+static const std::chrono::milliseconds WRITER_IDLE_WAIT(10);
+
+/**
+*  @brief Sends the text log to Output::Write.
+*/
+class OutputLogSink : public LogSink
+{
+public:
+	virtual void Write(const char* data, size_t length)
+	{
+		Output::Write(data, length);
+	}
+
+	virtual void Dropped(uint64_t count)
+	{
+		char message[96];
+		const int length = snprintf(message, sizeof(message), "WARNING [LogQueue] Log queue full, dropped %llu lines\n", (unsigned long long)count);
+		Output::Write(message, (size_t)length);
+	}
+};
+
+LogQueue& LogQueue::Get()
+{
+	static OutputLogSink sink;
+	static LogQueue instance(&sink);
+	return instance;
+}
+
+/**
+*  @param sink Where the writer thread sends the lines, it must outlive the queue.
+*/
+LogQueue::LogQueue(LogSink* sink) :
+	miWritePos(0),
+	miReadPos(0),
+	miFlushedPos(0),
+	miDropped(0),
+	miTotalDropped(0),
+	mbAsynchronous(true),
+	mbWriterWaiting(false),
+	mbStopping(false),
+	mpSink(sink)
+{
+	for (unsigned int i = 0; i < CAPACITY; i++)
+	{
+		mRecords[i].miSequence.store(i, std::memory_order_relaxed);
+		mRecords[i].miLength = 0;
+		mRecords[i].mbContinues = 0;
+	}
+	mBatch.reserve(BATCH_SIZE + LogRecord::MAX_LENGTH);
+
+	mWriter = std::thread(&LogQueue::WriterThread, this);
+}
+
+/**
+*  @brief Writes out whatever is still queued and stops the writer.
+*/
+LogQueue::~LogQueue()
+{
+	// Anything logged from now on is written straight out
+	mbAsynchronous.store(false);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mbStopping = true;
+	}
+	mWakeWriter.notify_one();
+	if (mWriter.joinable())
+		mWriter.join();
+}
+
+/**
+*  @brief Queues a line to be written.
+*
+*  @param text The formatted line, including its end of line. It's copied.
+*  @param length The length of text in bytes.
+*  @param mustSucceed Wait for space rather than dropping the line if the ring is full.
+*  @return false if the line was dropped.
+*/
+bool LogQueue::Push(const char* text, size_t length, bool mustSucceed)
+{
+	if (!IsAsynchronous())
+	{
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		mpSink->Write(text, length);
+		return true;
+	}
+
+	if (length == 0)
+		return true;
+
+	unsigned int count = (unsigned int)((length + LogRecord::MAX_LENGTH - 1) / LogRecord::MAX_LENGTH);
+	bool truncated = false;
+	if (count > MAX_RECORDS_PER_LINE)
+	{
+		count = MAX_RECORDS_PER_LINE;
+		length = (size_t)count * LogRecord::MAX_LENGTH;
+		truncated = true;
+	}
+
+	// Claim count slots in a row. The writer frees slots in order, so if the last one is free so are the others.
+	uint64_t pos = miWritePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		const uint64_t last = pos + count - 1;
+		const uint64_t sequence = mRecords[last & (CAPACITY - 1)].miSequence.load(std::memory_order_acquire);
+		const int64_t difference = (int64_t)(sequence - last);
+
+		if (difference == 0)
+		{
+			if (miWritePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0)
+		{
+			// Full, the writer hasn't got to the slot from the last time round yet
+			if (!mustSucceed)
+			{
+				miDropped.fetch_add(1, std::memory_order_relaxed);
+				miTotalDropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			mWakeWriter.notify_one();
+			std::this_thread::yield();
+			pos = miWritePos.load(std::memory_order_relaxed);
+		}
+		else
+		{
+			// Another thread claimed it first
+			pos = miWritePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		LogRecord& record = mRecords[(pos + i) & (CAPACITY - 1)];
+		const size_t offset = (size_t)i * LogRecord::MAX_LENGTH;
+		const size_t chunk = length - offset < LogRecord::MAX_LENGTH ? length - offset : LogRecord::MAX_LENGTH;
+		memcpy(record.mText, text + offset, chunk);
+		record.miLength = (unsigned short)chunk;
+		record.mbContinues = i + 1 < count;
+		if (truncated && i == count - 1)
+			record.mText[chunk - 1] = '\n';
+		record.miSequence.store(pos + i + 1, std::memory_order_release);
+	}
+
+	if (mbWriterWaiting.load(std::memory_order_relaxed))
+		mWakeWriter.notify_one();
+	return true;
+}
+
+/**
+*  @brief Blocks until every line queued before the call has been written and flushed.
+*/
+void LogQueue::Flush()
+{
+	if (!IsAsynchronous() || std::this_thread::get_id() == mWriter.get_id())
+		return;
+
+	const uint64_t target = miWritePos.load(std::memory_order_acquire);
+	std::unique_lock<std::mutex> lock(mMutex);
+	mWakeWriter.notify_one();
+	mBatchWritten.wait(lock, [this, target] { return miFlushedPos.load(std::memory_order_relaxed) >= target || mbStopping; });
+}
+
+void LogQueue::SetAsynchronous(bool asynchronous)
+{
+	// Write out what's queued first, so lines stay in order
+	Flush();
+	mbAsynchronous.store(asynchronous);
+}
+
+bool LogQueue::HasPending() const
+{
+	return mRecords[miReadPos & (CAPACITY - 1)].miSequence.load(std::memory_order_acquire) == miReadPos + 1;
+}
+
+void LogQueue::WriterThread()
+{
+	for (;;)
+	{
+		if (WriteBatch())
+			continue;
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		// Only stop once the ring is empty, so nothing queued before shutdown is lost
+		if (mbStopping && !HasPending())
+			break;
+
+		mbWriterWaiting.store(true, std::memory_order_relaxed);
+		mWakeWriter.wait_for(lock, WRITER_IDLE_WAIT, [this] { return mbStopping || HasPending(); });
+		mbWriterWaiting.store(false, std::memory_order_relaxed);
+	}
+
+	mBatchWritten.notify_all();
+}
+
+/**
+*  @brief Takes as many lines as are ready off the ring, up to BATCH_SIZE, and writes them out in one go.
+*
+*  @return false if there was nothing to write.
+*/
+bool LogQueue::WriteBatch()
+{
+	mBatch.clear();
+
+	const uint64_t dropped = miDropped.exchange(0, std::memory_order_relaxed);
+	if (dropped > 0)
+	{
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		mpSink->Dropped(dropped);
+	}
+
+	// Only stop between lines, so the sink never sees part of one
+	bool continues = false;
+	while (continues || (mBatch.size() < BATCH_SIZE && HasPending()))
+	{
+		if (!HasPending())
+		{
+			// The rest of the line is still being copied in
+			std::this_thread::yield();
+			continue;
+		}
+
+		LogRecord& record = mRecords[miReadPos & (CAPACITY - 1)];
+		mBatch.append(record.mText, record.miLength);
+		continues = record.mbContinues != 0;
+		record.miSequence.store(miReadPos + CAPACITY, std::memory_order_release);
+		miReadPos++;
+	}
+
+	if (mBatch.empty())
+		return dropped > 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		mpSink->Write(mBatch.data(), mBatch.size());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		miFlushedPos.store(miReadPos, std::memory_order_relaxed);
+	}
+	mBatchWritten.notify_all();
+	return true;
+}
@@ -0,0 +1,117 @@
+/**
+*  @file LogQueue.h
+*  @brief Hands finished log lines to a background thread to write out.
+*
+*  Logging threads copy their formatted line into a fixed size ring without taking a lock.
+*  A writer thread drains the ring in batches and hands each batch to a LogSink. The text log's sink
+*  does one write and flush per batch to the log stream, stderr and the ImGui log, instead of one
+*  per line on the logging thread.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+*  @brief One slot in the ring. Lines longer than MAX_LENGTH take up several slots in a row.
+*/
+struct LogRecord
+{
+	/// Slots are 512 bytes.
+	static const unsigned int MAX_LENGTH = 512 - sizeof(uint64_t) - 2 * sizeof(unsigned short);
+
+	/// Equal to the slot's position when it's free to write, one past it once written.
+	std::atomic<uint64_t> miSequence;
+	unsigned short miLength;
+	/// Set if the line carries on in the next slot.
+	unsigned short mbContinues;
+	char mText[MAX_LENGTH];
+};
+
+/**
+*  @brief Where a LogQueue's writer thread sends what it takes off the ring.
+*/
+class LogSink
+{
+public:
+	virtual ~LogSink() {}
+
+	/// Writes whole lines, never part of one.
+	virtual void Write(const char* data, size_t length) = 0;
+	/// Records that count lines were dropped because the ring was full.
+	virtual void Dropped(uint64_t count) = 0;
+};
+
+/**
+*  @brief A bounded multiple producer, single consumer queue of log lines and the thread that writes them.
+*
+*  When the ring is full lines are dropped and counted, the writer reports how many were lost.
+*  Errors and warnings are never dropped, the logging thread waits for space instead.
+*/
+class LogQueue
+{
+public:
+	/// Slots in the ring, a power of 2.
+	static const unsigned int CAPACITY = 4096;
+	/// The most slots one line can take, anything longer is cut short.
+	static const unsigned int MAX_RECORDS_PER_LINE = 64;
+
+	/// The queue for the text log, written out through Output::Write.
+	static LogQueue& Get();
+
+	explicit LogQueue(LogSink* sink);
+	~LogQueue();
+
+	bool Push(const char* text, size_t length, bool mustSucceed);
+	void Flush();
+
+	/**
+	*  @brief Sets whether lines are queued for the writer thread or written out by the logging thread.
+	*  Writing straight away is slower, but nothing is lost if the process then crashes.
+	*/
+	void SetAsynchronous(bool asynchronous);
+	bool IsAsynchronous() const { return mbAsynchronous.load(std::memory_order_relaxed); }
+
+	/// Lines dropped because the ring was full, since startup.
+	uint64_t GetDroppedCount() const { return miTotalDropped.load(std::memory_order_relaxed); }
+
+private:
+	LogQueue(const LogQueue&) = delete;
+	LogQueue& operator=(const LogQueue&) = delete;
+
+	void WriterThread();
+	bool WriteBatch();
+	bool HasPending() const;
+
+	LogRecord mRecords[CAPACITY];
+	/// The next position a logging thread will claim.
+	std::atomic<uint64_t> miWritePos;
+	/// The next position the writer will read, only touched by the writer.
+	uint64_t miReadPos;
+	/// Everything before this has been written and flushed.
+	std::atomic<uint64_t> miFlushedPos;
+
+	std::atomic<uint64_t> miDropped;
+	std::atomic<uint64_t> miTotalDropped;
+	std::atomic<bool> mbAsynchronous;
+
+	/// Wakes the writer, and anyone in Flush once a batch is out.
+	std::mutex mMutex;
+	std::condition_variable mWakeWriter;
+	std::condition_variable mBatchWritten;
+	std::atomic<bool> mbWriterWaiting;
+	bool mbStopping;
+
+	/// Serialises writes made outside the writer thread.
+	std::mutex mWriteMutex;
+	/// The lines being written, kept to save reallocating it every batch.
+	std::string mBatch;
+
+	LogSink* mpSink;
+	std::thread mWriter;
+};
@@ -1,11 +1,20 @@
 #include "Mesh.h"
 #include "Log.h"
-#include <glm\common.hpp>
+#include <glm/common.hpp>
+#include <math.h>
 
 Mesh::Mesh()
 	: mLocked(false),
 	mpVbo(NULL),
-	mpIndexBuffer(NULL)
+	mpIndexBuffer(NULL),
+	mpArena(NULL),
+	mbShortIndices(false),
+	mbPackVertices(false),
+	mpQuantizationBuffer(NULL),
+	mpDevice(NULL),
+	mBoundsMin(0.0f),
+	mBoundsMax(0.0f),
+	mBoundingRadius(0.0f)
 
 {
 }
@@ -14,21 +23,33 @@ Mesh::Mesh(std::vector<Vertex> vertices) :
 	Mesh()
 {
 	mVertices = vertices;
+	ComputeBounds();
 }
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices) :
 	Mesh()
 {
 	mVertices = vertices;
-	mIndices = indices;
+	SetIndices(indices.data(), (unsigned int)indices.size());
+	ComputeBounds();
 }
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indicies, std::vector<TextureDetail> textureDetails) :
 	Mesh()
 {
 	mVertices = vertices;
-	mIndices = indicies;
+	SetIndices(indicies.data(), (unsigned int)indicies.size());
 	mTextureDetails = textureDetails;
+	ComputeBounds();
+}
+
+Mesh::Mesh(const Vertex* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices, std::vector<TextureDetail> textureDetails) :
+	Mesh()
+{
+	mVertices.assign(vertices, vertices + numVertices);
+	SetIndices(indices, numIndices);
+	mTextureDetails = textureDetails;
+	ComputeBounds();
 }
 
 
@@ -36,6 +57,84 @@ Mesh::~Mesh()
 {
 	delete mpVbo;
 	mpVbo = NULL;
+	delete mpIndexBuffer;
+	mpIndexBuffer = NULL;
+	if (mpQuantizationBuffer)
+	{
+		mpDevice->ReleaseBuffer(mpQuantizationBuffer);
+		mpQuantizationBuffer = NULL;
+	}
+}
+
+/**
+*  @brief Stores the indices, 16 bits wide if the vertex count allows it.
+*
+*  Must be called after the vertices are set.
+*
+*  @param indices The triangle list.
+*  @param numIndices The number of indices.
+*/
+void Mesh::SetIndices(const unsigned int* indices, unsigned int numIndices)
+{
+	mIndices.clear();
+	mShortIndices.clear();
+	mbShortIndices = mVertices.size() <= MAX_SHORT_INDEX_VERTICES;
+
+	if (mbShortIndices)
+	{
+		mShortIndices.resize(numIndices);
+		for (unsigned int i = 0; i < numIndices; i++)
+			mShortIndices[i] = (uint16_t)indices[i];
+	}
+	else
+	{
+		mIndices.assign(indices, indices + numIndices);
+	}
+}
+
+/**
+*  @brief Computes the bounding box and bounding sphere of the vertices.
+*
+*  The sphere is centred on the box, so it isn't the tightest possible but is cheap and stable.
+*/
+void Mesh::ComputeBounds()
+{
+	if (mVertices.empty())
+	{
+		mBoundsMin = mBoundsMax = glm::vec3(0.0f);
+		mBoundingRadius = 0.0f;
+		return;
+	}
+
+	mBoundsMin = mBoundsMax = glm::vec3(mVertices[0].x, mVertices[0].y, mVertices[0].z);
+	for (size_t i = 1; i < mVertices.size(); i++)
+	{
+		const glm::vec3 position(mVertices[i].x, mVertices[i].y, mVertices[i].z);
+		mBoundsMin = glm::min(mBoundsMin, position);
+		mBoundsMax = glm::max(mBoundsMax, position);
+	}
+
+	const glm::vec3 centre = GetBoundsCentre();
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < mVertices.size(); i++)
+	{
+		const glm::vec3 offset = glm::vec3(mVertices[i].x, mVertices[i].y, mVertices[i].z) - centre;
+		radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+	}
+	mBoundingRadius = sqrtf(radiusSquared);
+}
+
+/**
+*  @brief Copies the indices out at 32 bits, whatever width they are stored at.
+*
+*  @param indices Receives the indices.
+*/
+void Mesh::GetIndices(std::vector<unsigned int>& indices) const
+{
+	if (mbShortIndices)
+		indices.assign(mShortIndices.begin(), mShortIndices.end());
+	else
+		indices = mIndices;
 }
 
 /**
@@ -110,7 +209,7 @@ void Mesh::Reset()
 *  Creates the VBO using a GraphicsDevice, _locked is set to true.
 *  @returns The created vbo.
 */
-VBO* Mesh::CreateVBO(DirectXDevice* device)
+VBO* Mesh::CreateVBO(GraphicsDevice* device)
 {
 	mLocked = true;
 
@@ -131,11 +230,39 @@ void Mesh::Release()
 	{
 		mpVbo->Release();
 	}
+	if (mpIndexBuffer)
+	{
+		mpIndexBuffer->Release();
+	}
+	if (mpArena)
+	{
+		mpArena->Free(mAllocation);
+		mpArena = NULL;
+	}
+	if (mpQuantizationBuffer)
+	{
+		mpDevice->ReleaseBuffer(mpQuantizationBuffer);
+		mpQuantizationBuffer = NULL;
+	}
 	mLocked = false;
 	Clear();
 }
 
-void Mesh::SetupMesh(DirectXDevice* device)
+void Mesh::SetupMesh(GraphicsDevice* device)
+{
+	SetupMesh(device, nullptr);
+}
+
+/**
+*  @brief Uploads the mesh, into a shared arena if it has one that fits.
+*
+*  Meshes with 16 bit indices and the arena's vertex format are allocated in the arena, anything
+*  else, or anything that doesn't fit, gets its own vertex and index buffers.
+*
+*  @param device The device to upload to.
+*  @param arena The arena to allocate from, or nullptr for separate buffers.
+*/
+void Mesh::SetupMesh(GraphicsDevice* device, GeometryArena* arena)
 {
 	if (mpVbo)
 	{
@@ -149,51 +276,186 @@ void Mesh::SetupMesh(DirectXDevice* device)
 		delete mpIndexBuffer;
 		mpIndexBuffer = nullptr;
 	}
+	if (mpArena)
+	{
+		mpArena->Free(mAllocation);
+		mpArena = nullptr;
+	}
 	mLocked = false;
 	
-	if (mVertices.size() > 0)
+	if (mpQuantizationBuffer)
 	{
-		mpVbo = new VBO();
-		mpVbo->Create(device, mVertices);
+		mpDevice->ReleaseBuffer(mpQuantizationBuffer);
+		mpQuantizationBuffer = nullptr;
 	}
+	mpDevice = device;
 
-	if (mIndices.size() > 0)
+	if (mVertices.size() == 0)
+	{
+		return;
+	}
+
+	ComputeBounds();
+
+	const void* vertexData = mVertices.data();
+	unsigned int vertexStride = sizeof(Vertex);
+	std::vector<PackedVertex> packed;
+
+	if (mbPackVertices)
+	{
+		// Quantise within this mesh's bounds, the vertex shader gets the mapping back from its own constant buffer
+		mQuantization = VertexPacking::ComputeQuantization(mVertices.data(), (unsigned int)mVertices.size());
+		packed.resize(mVertices.size());
+		VertexPacking::Pack(mVertices.data(), (unsigned int)mVertices.size(), mQuantization, packed.data());
+		vertexData = packed.data();
+		vertexStride = sizeof(PackedVertex);
+
+		BufferDesc bufferDesc;
+		bufferDesc.miSize = sizeof(VertexQuantization);
+		bufferDesc.meType = BUFFER_CONSTANT;
+		bufferDesc.meUsage = USAGE_IMMUTABLE;
+
+		mpQuantizationBuffer = device->CreateBuffer(bufferDesc, &mQuantization);
+		if (!mpQuantizationBuffer)
+		{
+			LOG_ERROR << "Failed to create the vertex quantization buffer";
+		}
+	}
+
+	if (arena && mbShortIndices && mShortIndices.size() > 0 && arena->GetVertexStride() == vertexStride)
+	{
+		if (arena->Allocate(vertexData, (unsigned int)mVertices.size(), mShortIndices.data(), (unsigned int)mShortIndices.size(), mAllocation))
+		{
+			mpArena = arena;
+			return;
+		}
+		LOG_WARNING << "Geometry arena is full, mesh is using its own buffers";
+	}
+
+	mpVbo = new VBO();
+	mpVbo->Create(device, vertexData, vertexStride, (int)mVertices.size());
+
+	if (mbShortIndices && mShortIndices.size() > 0)
+	{
+		mpIndexBuffer = new IndexBuffer();
+		mpIndexBuffer->Create(device, mShortIndices);
+	}
+	else if (mIndices.size() > 0)
 	{
 		mpIndexBuffer = new IndexBuffer();
 		mpIndexBuffer->Create(device, mIndices);
 	}
 }
 
-void Mesh::Draw(DirectXDevice* device)
+unsigned int Mesh::GetVertexBufferSize() const
 {
-	if (!mpVbo) return;
+	if (mpArena)
+		return mAllocation.miNumVertices * mpArena->GetVertexStride();
+	return mpVbo ? mpVbo->GetSizeInBytes() : 0;
+}
 
-	mpVbo->SetVBO(device);
+unsigned int Mesh::GetIndexBufferSize() const
+{
+	if (mpArena)
+		return mAllocation.miNumIndices * sizeof(uint16_t);
+	return mpIndexBuffer ? mpIndexBuffer->GetSizeInBytes() : 0;
+}
+
+void Mesh::Draw(GraphicsDevice* device)
+{
+	if (!mpVbo && !mpArena) return;
+
+	// Meshes in an arena rely on whoever owns it having bound it
+	if (mpVbo)
+	{
+		mpVbo->SetVBO(device);
+	}
+	if (mpQuantizationBuffer)
+	{
+		device->SetVSConstantBuffer(2, mpQuantizationBuffer);
+	}
 
 
 	// select primitive type
-	device->GetContext()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY::D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	device->SetPrimitiveTopology(TOPOLOGY_TRIANGLE_LIST);
 
 	// Diffuse
 	if (mTextureDetails.size() > 0 && mTextureDetails[0].mTexture)
 	{
-		device->GetContext()->PSSetShaderResources(0, 1, mTextureDetails[0].mTexture->GetAddressOfShaderResourceView());
+		device->SetPSTexture(0, mTextureDetails[0].mTexture->GetHandle());
 	}
 
 	// Specular
 	if (mTextureDetails.size() > 1 && mTextureDetails[1].mTexture)
 	{
-		device->GetContext()->PSSetShaderResources(1, 1, mTextureDetails[1].mTexture->GetAddressOfShaderResourceView());
+		device->SetPSTexture(1, mTextureDetails[1].mTexture->GetHandle());
 	}
 
-	if (mpIndexBuffer && mIndices.size() > 0)
+	if (mpArena)
+	{
+		device->DrawIndexed(mAllocation.miNumIndices, mAllocation.miFirstIndex, mAllocation.miBaseVertex);
+	}
+	else if (mpIndexBuffer && NumIndices() > 0)
 	{
 		mpIndexBuffer->SetIndexBuffer(device);
-		device->GetContext()->DrawIndexed(mIndices.size(), 0, 0);
+		device->DrawIndexed(NumIndices(), 0, 0);
 	}
 	else
 	{
 		// draw the vertex buffer to the back buffer
-		device->GetContext()->Draw(mVertices.size(), 0);
+		device->Draw((unsigned int)mVertices.size(), 0);
+	}
+}
+
+/**
+*  @brief Draws the mesh, only binding the state that differs from what the cache last set.
+*
+*  @param device The device to draw with.
+*  @param stateCache The state bound by the previous draws.
+*/
+void Mesh::Draw(GraphicsDevice* device, DeviceStateCache& stateCache)
+{
+	if (!mpVbo && !mpArena) return;
+
+	if (mpArena)
+	{
+		stateCache.SetVertexBuffer(device, mpArena->GetVertexBuffer(), mpArena->GetVertexStride());
+		stateCache.SetIndexBuffer(device, mpArena->GetIndexBuffer(), INDEX_FORMAT_16);
+	}
+	else
+	{
+		stateCache.SetVertexBuffer(device, mpVbo->GetBuffer(), mpVbo->GetStride());
+		if (mpIndexBuffer)
+		{
+			stateCache.SetIndexBuffer(device, mpIndexBuffer->GetBuffer(), mpIndexBuffer->GetFormat());
+		}
+	}
+	if (mpQuantizationBuffer)
+	{
+		stateCache.SetVSConstantBuffer(device, 2, mpQuantizationBuffer);
+	}
+	stateCache.SetPrimitiveTopology(device, TOPOLOGY_TRIANGLE_LIST);
+
+	// Diffuse
+	if (mTextureDetails.size() > 0 && mTextureDetails[0].mTexture)
+	{
+		stateCache.SetPSTexture(device, 0, mTextureDetails[0].mTexture->GetHandle());
+	}
+
+	// Specular
+	if (mTextureDetails.size() > 1 && mTextureDetails[1].mTexture)
+	{
+		stateCache.SetPSTexture(device, 1, mTextureDetails[1].mTexture->GetHandle());
+	}
+
+	if (mpArena)
+	{
+		device->DrawIndexed(mAllocation.miNumIndices, mAllocation.miFirstIndex, mAllocation.miBaseVertex);
+		stateCache.CountDraw();
+	}
+	else if (mpIndexBuffer && NumIndices() > 0)
+	{
+		device->DrawIndexed(NumIndices(), 0, 0);
+		stateCache.CountDraw();
 	}
 }
@@ -3,32 +3,66 @@
 #include "IndexBuffer.h"
 #include "Vertex.h"
 #include "TextureDetails.h"
-#include "DirectXDevice.h"
+#include "VertexPacking.h"
+#include "GeometryArena.h"
+#include "DeviceStateCache.h"
+#include <glm/glm.hpp>
+#include "GraphicsDevice.h"
 
 #include <vector>
+#include <stdint.h>
 
 class Mesh
 {
 public:
+	/// The most vertices a mesh can have and still use 16 bit indices.
+	static const unsigned int MAX_SHORT_INDEX_VERTICES = 65536;
+
 	Mesh();
 	Mesh(std::vector<Vertex> vertices);
 	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices);
 	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indicies, std::vector<TextureDetail> textureDetails);
+	Mesh(const Vertex* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices, std::vector<TextureDetail> textureDetails);
 	~Mesh();
 
 	VBO* GetVBO() const { return mpVbo; }
 	int NumVertices() const { return (int)mVertices.size(); }
 	Vertex GetVertex(int i) const { return mVertices[i]; }
 	Vertex& GetVertexRef(int i) { return mVertices[i]; }
+	const std::vector<Vertex>& GetVertices() const { return mVertices; }
+	unsigned int NumIndices() const { return (unsigned int)(mbShortIndices ? mShortIndices.size() : mIndices.size()); }
+	bool HasShortIndices() const { return mbShortIndices; }
+	unsigned int GetIndex(unsigned int i) const { return mbShortIndices ? mShortIndices[i] : mIndices[i]; }
+	void GetIndices(std::vector<unsigned int>& indices) const;
+	unsigned int GetVertexBufferSize() const;
+	unsigned int GetIndexBufferSize() const;
+	bool IsInArena() const { return mpArena != nullptr; }
+	const std::vector<TextureDetail>& GetTextureDetails() const { return mTextureDetails; }
+	void SetTexture(unsigned int i, Texture* texture) { mTextureDetails[i].mTexture = texture; }
+
+	/// Upload the vertices in the PackedVertex format on the next SetupMesh, they must be drawn with the packed input layout.
+	void SetPackVertices(bool pack) { mbPackVertices = pack; }
+	bool GetPackVertices() const { return mbPackVertices; }
+	const VertexQuantization& GetQuantization() const { return mQuantization; }
 
-	VBO* CreateVBO(DirectXDevice* device);
+	VBO* CreateVBO(GraphicsDevice* device);
 	bool AddVertex(Vertex v);
 
-	void SetupMesh(DirectXDevice* device);
-	void Draw(DirectXDevice* device);
+	void SetupMesh(GraphicsDevice* device);
+	void SetupMesh(GraphicsDevice* device, GeometryArena* arena);
+	void Draw(GraphicsDevice* device);
+	void Draw(GraphicsDevice* device, DeviceStateCache& stateCache);
+
+	/// The bounding box of the vertices, and a sphere around its centre.
+	const glm::vec3& GetBoundsMin() const { return mBoundsMin; }
+	const glm::vec3& GetBoundsMax() const { return mBoundsMax; }
+	glm::vec3 GetBoundsCentre() const { return (mBoundsMin + mBoundsMax) * 0.5f; }
+	float GetBoundingRadius() const { return mBoundingRadius; }
+	void ComputeBounds();
 
 	bool Clear();
 	bool DeleteVertex(int i);
+	void SetIndices(const unsigned int* indices, unsigned int numIndices);
 
 	void Reset();
 	void Release();
@@ -39,9 +73,27 @@ private:
 	/// The meshes vbo.
 	VBO* mpVbo;
 	IndexBuffer* mpIndexBuffer;
+	/// The arena the mesh's geometry is in instead of mpVbo and mpIndexBuffer, not owned.
+	GeometryArena* mpArena;
+	GeometryAllocation mAllocation;
 	/// The meshes vertices.
 	std::vector<Vertex> mVertices;
+	/// The indices, only one of mIndices and mShortIndices is used depending on the vertex count.
 	std::vector<unsigned int> mIndices;
+	std::vector<uint16_t> mShortIndices;
+	bool mbShortIndices;
 	std::vector<TextureDetail> mTextureDetails;
+
+	bool mbPackVertices;
+	/// How the packed positions map back into model space.
+	VertexQuantization mQuantization;
+	/// Holds mQuantization for the vertex shader, only created for packed meshes.
+	GraphicsBuffer* mpQuantizationBuffer;
+	/// The device mpQuantizationBuffer was created on.
+	GraphicsDevice* mpDevice;
+
+	glm::vec3 mBoundsMin;
+	glm::vec3 mBoundsMax;
+	float mBoundingRadius;
 };
 
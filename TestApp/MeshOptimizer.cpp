@@ -0,0 +1,411 @@
+/**
+*  @file MeshOptimizer.cpp
+*  @brief Reorders mesh triangles and vertices for the GPU.
+*
+*  Post transform vertex cache reordering (Forsyth), overdraw aware cluster ordering and a
+*  vertex fetch remap, plus a FIFO cache simulation to measure the results.
+*  Works purely on the CPU side arrays so it can run on any thread.
+*
+*  @bug No known bugs.
+*/
+#include "MeshOptimizer.h"
+#include <math.h>
+#include <algorithm>
+
+// Forsyth's tuning values, see "Linear-Speed Vertex Cache Optimisation".
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float FORSYTH_DECAY_POWER = 1.5f;
+static const float FORSYTH_LAST_TRI_SCORE = 0.75f;
+static const float FORSYTH_VALENCE_SCALE = 2.0f;
+static const float FORSYTH_VALENCE_POWER = 0.5f;
+
+static float ForsythVertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			// The last triangle's vertices get a fixed score so its neighbours aren't favoured over each other
+			score = FORSYTH_LAST_TRI_SCORE;
+		}
+		else
+		{
+			const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, FORSYTH_DECAY_POWER);
+		}
+	}
+
+	// Boost vertices with few triangles left, so lone triangles don't get stranded
+	score += FORSYTH_VALENCE_SCALE * powf((float)remainingTriangles, -FORSYTH_VALENCE_POWER);
+	return score;
+}
+
+/**
+*  @brief Runs every optimisation in the order they depend on each other.
+*
+*  Vertex cache first, then clusters of that order are sorted for overdraw, then the vertices are
+*  remapped into the final triangle order.
+*
+*  @param vertices The vertices, reordered and with unused vertices removed.
+*  @param indices The triangle list, reordered and remapped.
+*/
+void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	if (indices.size() < 3 || vertices.empty())
+		return;
+
+	OptimizeVertexCache(indices, (unsigned int)vertices.size());
+	OptimizeOverdraw(indices, vertices);
+	OptimizeVertexFetch(vertices, indices);
+}
+
+/**
+*  @brief Simulates a FIFO post transform cache over a triangle list.
+*
+*  @param indices The triangle list.
+*  @param vertexCount The number of vertices the indices refer to.
+*  @param cacheSize The number of entries in the simulated cache.
+*  @return The ACMR and ATVR of the triangle list.
+*/
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.acmr = 0.0f;
+	stats.atvr = 0.0f;
+	if (indices.size() < 3 || vertexCount == 0)
+		return stats;
+
+	// Each vertex remembers when it was last put in the cache, it's still there if fewer than cacheSize went in since.
+	std::vector<unsigned int> insertedAt(vertexCount, 0);
+	std::vector<bool> used(vertexCount, false);
+	unsigned int misses = 0;
+	unsigned int unique = 0;
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		const unsigned int v = indices[i];
+		if (!used[v])
+		{
+			used[v] = true;
+			unique++;
+		}
+		if (insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize)
+		{
+			misses++;
+			insertedAt[v] = misses;
+		}
+	}
+
+	stats.acmr = (float)misses / (float)(indices.size() / 3);
+	stats.atvr = (float)misses / (float)unique;
+	return stats;
+}
+
+/**
+*  @brief Reorders the triangles to make the best use of the post transform vertex cache.
+*
+*  Tom Forsyth's greedy algorithm, each step emits the triangle whose vertices score highest
+*  from their position in a simulated LRU cache and the number of triangles they have left.
+*
+*  @param indices The triangle list to reorder.
+*  @param vertexCount The number of vertices the indices refer to.
+*/
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+	const unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+	if (triangleCount == 0)
+		return;
+
+	// Triangles using each vertex, packed per vertex
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		remaining[indices[i]]++;
+
+	std::vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = t;
+	}
+
+	// Initial scores
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (unsigned int t = 0; t < triangleCount; t++)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	int bestTriangle = (int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+
+	int cache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	unsigned int scanPosition = 0;
+
+	for (unsigned int emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		if (bestTriangle < 0)
+		{
+			// Nothing in the cache is connected to anything left, carry on from the next triangle in input order
+			while (emitted[scanPosition])
+				scanPosition++;
+			bestTriangle = (int)scanPosition;
+		}
+
+		const unsigned int* triangle = &indices[bestTriangle * 3];
+		emitted[bestTriangle] = true;
+
+		// Emit it and take it off its vertices' lists
+		for (int k = 0; k < 3; k++)
+		{
+			const unsigned int v = triangle[k];
+			output.push_back(v);
+
+			unsigned int* begin = &adjacency[offsets[v]];
+			unsigned int* end = begin + remaining[v];
+			unsigned int* found = std::find(begin, end, (unsigned int)bestTriangle);
+			*found = *(end - 1);
+			remaining[v]--;
+		}
+
+		// New cache order, the triangle's vertices go to the front
+		int newCache[FORSYTH_CACHE_SIZE + 3];
+		int newCount = 0;
+		for (int k = 0; k < 3; k++)
+			newCache[newCount++] = (int)triangle[k];
+		for (int i = 0; i < cacheCount; i++)
+		{
+			const int v = cache[i];
+			if (v != (int)triangle[0] && v != (int)triangle[1] && v != (int)triangle[2])
+				newCache[newCount++] = v;
+		}
+
+		// Anything pushed off the end leaves the cache
+		for (int i = FORSYTH_CACHE_SIZE; i < newCount; i++)
+		{
+			cachePosition[newCache[i]] = -1;
+			vertexScore[newCache[i]] = ForsythVertexScore(-1, remaining[newCache[i]]);
+		}
+		cacheCount = newCount < FORSYTH_CACHE_SIZE ? newCount : FORSYTH_CACHE_SIZE;
+
+		for (int i = 0; i < cacheCount; i++)
+		{
+			cache[i] = newCache[i];
+			cachePosition[cache[i]] = i;
+			vertexScore[cache[i]] = ForsythVertexScore(i, remaining[cache[i]]);
+		}
+
+		// Rescore the triangles touching the changed vertices, the best one goes next
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < newCount; i++)
+		{
+			const unsigned int v = (unsigned int)newCache[i];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				const unsigned int t = adjacency[offsets[v] + j];
+				const float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				triangleScore[t] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = (int)t;
+				}
+			}
+		}
+	}
+
+	// Any trailing indices that don't form a triangle are dropped, as they would be drawn anyway.
+	indices.swap(output);
+}
+
+/**
+*  @brief Sorts clusters of triangles so outward facing ones are drawn first.
+*
+*  The triangle list is split into clusters at its hard cache boundaries, where every vertex of a
+*  triangle misses the cache, so moving the clusters around costs almost nothing in cache efficiency.
+*  Clusters are then sorted by how much they face away from the centre of the mesh, as those are
+*  the most likely to occlude the rest. Should be run after OptimizeVertexCache.
+*
+*  @param indices The triangle list to reorder.
+*  @param vertices The vertices, for positions and normals.
+*/
+void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices)
+{
+	const unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+	if (triangleCount < 2)
+		return;
+
+	// Find the cluster boundaries with the same FIFO simulation used for the stats
+	std::vector<unsigned int> clusterStarts;
+	std::vector<unsigned int> insertedAt(vertices.size(), 0);
+	unsigned int misses = 0;
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		int triangleMisses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			const unsigned int v = indices[t * 3 + k];
+			if (insertedAt[v] == 0 || misses - insertedAt[v] >= ANALYSIS_CACHE_SIZE)
+			{
+				misses++;
+				insertedAt[v] = misses;
+				triangleMisses++;
+			}
+		}
+		if (t == 0 || triangleMisses == 3)
+			clusterStarts.push_back(t);
+	}
+	if (clusterStarts.size() < 2)
+		return;
+
+	// Mesh centre
+	float centre[3] = { 0.0f, 0.0f, 0.0f };
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		centre[0] += vertices[i].x;
+		centre[1] += vertices[i].y;
+		centre[2] += vertices[i].z;
+	}
+	for (int c = 0; c < 3; c++)
+		centre[c] /= (float)vertices.size();
+
+	// Sort key for each cluster, dot of its offset from the centre with its average normal
+	struct Cluster
+	{
+		unsigned int start;
+		unsigned int end;
+		float sortKey;
+	};
+	std::vector<Cluster> clusters(clusterStarts.size());
+	for (size_t c = 0; c < clusterStarts.size(); c++)
+	{
+		Cluster& cluster = clusters[c];
+		cluster.start = clusterStarts[c];
+		cluster.end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+
+		float position[3] = { 0.0f, 0.0f, 0.0f };
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+		for (unsigned int i = cluster.start * 3; i < cluster.end * 3; i++)
+		{
+			const Vertex& v = vertices[indices[i]];
+			position[0] += v.x; position[1] += v.y; position[2] += v.z;
+			normal[0] += v.nx; normal[1] += v.ny; normal[2] += v.nz;
+		}
+		const float count = (float)((cluster.end - cluster.start) * 3);
+		cluster.sortKey = 0.0f;
+		for (int k = 0; k < 3; k++)
+			cluster.sortKey += (position[k] / count - centre[k]) * normal[k];
+
+		const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length > 0.0f)
+			cluster.sortKey /= length;
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (size_t c = 0; c < clusters.size(); c++)
+		output.insert(output.end(), indices.begin() + clusters[c].start * 3, indices.begin() + clusters[c].end * 3);
+	indices.swap(output);
+}
+
+/**
+*  @brief Reorders the vertices into the order the triangles first use them.
+*
+*  Makes vertex fetches walk through memory in order, and drops any vertices that aren't used.
+*
+*  @param vertices The vertices to reorder.
+*  @param indices The triangle list, remapped to the new vertex order.
+*/
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	const unsigned int unassigned = 0xffffffff;
+	std::vector<unsigned int> remap(vertices.size(), unassigned);
+	std::vector<Vertex> output;
+	output.reserve(vertices.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int& target = remap[indices[i]];
+		if (target == unassigned)
+		{
+			target = (unsigned int)output.size();
+			output.push_back(vertices[indices[i]]);
+		}
+		indices[i] = target;
+	}
+	vertices.swap(output);
+}
+
+/**
+*  @brief Splits a mesh into pieces that each use at most maxVertices vertices.
+*
+*  Triangles are kept in order, a new piece starts whenever the next triangle would take the current
+*  one over the limit. Run after the other optimisations so each piece keeps their ordering.
+*
+*  @param vertices The vertices of the mesh.
+*  @param indices The triangle list of the mesh.
+*  @param maxVertices The most vertices a piece can use, at least 3.
+*  @param splitVertices Receives the vertices of each piece.
+*  @param splitIndices Receives the triangle list of each piece, indexing its own vertices.
+*/
+void MeshOptimizer::SplitMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int maxVertices,
+	std::vector<std::vector<Vertex>>& splitVertices, std::vector<std::vector<unsigned int>>& splitIndices)
+{
+	splitVertices.clear();
+	splitIndices.clear();
+
+	const unsigned int unassigned = 0xffffffff;
+	std::vector<unsigned int> remap(vertices.size(), unassigned);
+	std::vector<unsigned int> used;
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		unsigned int newVertices = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			if (remap[indices[i + k]] == unassigned)
+				newVertices++;
+		}
+
+		if (splitVertices.empty() || splitVertices.back().size() + newVertices > maxVertices)
+		{
+			// Start a new piece, forgetting the old piece's vertices
+			for (size_t j = 0; j < used.size(); j++)
+				remap[used[j]] = unassigned;
+			used.clear();
+			splitVertices.push_back(std::vector<Vertex>());
+			splitIndices.push_back(std::vector<unsigned int>());
+		}
+
+		std::vector<Vertex>& pieceVertices = splitVertices.back();
+		for (int k = 0; k < 3; k++)
+		{
+			const unsigned int v = indices[i + k];
+			if (remap[v] == unassigned)
+			{
+				remap[v] = (unsigned int)pieceVertices.size();
+				pieceVertices.push_back(vertices[v]);
+				used.push_back(v);
+			}
+			splitIndices.back().push_back(remap[v]);
+		}
+	}
+}
@@ -0,0 +1,48 @@
+/**
+*  @file MeshOptimizer.h
+*  @brief Reorders mesh triangles and vertices for the GPU.
+*
+*  Post transform vertex cache reordering (Forsyth), overdraw aware cluster ordering and a
+*  vertex fetch remap, plus a FIFO cache simulation to measure the results.
+*  Works purely on the CPU side arrays so it can run on any thread.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <vector>
+#include "Vertex.h"
+
+/**
+*  @brief Results of simulating a FIFO post transform vertex cache.
+*/
+struct VertexCacheStats
+{
+	/// Average cache miss ratio, vertices transformed per triangle. 0.5 is the ideal for large meshes, 3 the worst.
+	float acmr;
+	/// Average transform to vertex ratio, vertices transformed per unique vertex. 1 is ideal.
+	float atvr;
+};
+
+/**
+*  @brief Reorders mesh triangles and vertices for the GPU.
+*/
+class MeshOptimizer
+{
+public:
+	/// Size of the FIFO cache used to measure meshes and find cluster boundaries.
+	static const unsigned int ANALYSIS_CACHE_SIZE = 16;
+
+	static void Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	static VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize = ANALYSIS_CACHE_SIZE);
+
+	static void OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount);
+	static void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices);
+	static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	static void SplitMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int maxVertices,
+		std::vector<std::vector<Vertex>>& splitVertices, std::vector<std::vector<unsigned int>>& splitIndices);
+
+private:
+	MeshOptimizer() = delete;
+};
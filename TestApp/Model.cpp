@@ -1,44 +1,824 @@
 #include "Model.h"
 #include "Log.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
+#include <assimp/ProgressHandler.hpp>
+#include <assimp/DefaultIOSystem.h>
 #include "Texture.h"
+#include "ModelCache.h"
+#include "TextureCache.h"
+#include "MeshOptimizer.h"
+#include "GeometryArena.h"
+#include "DrawList.h"
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <thread>
 
+// The assimp post processing steps, part of the cache key as they change the processed data.
+static const unsigned int IMPORT_FLAGS = aiProcess_FlipUVs | aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_GenUVCoords;
 
+// The share of the import progress assimp's reading and post processing make up, building the meshes and hierarchies is the rest.
+static const float ASSIMP_PROGRESS = 0.8f;
+// How the overall load progress is split between the import, the mesh uploads and the textures.
+static const float IMPORT_WEIGHT = 0.4f;
+static const float MESH_WEIGHT = 0.2f;
+static const float TEXTURE_WEIGHT = 0.4f;
 
-Model::Model(DirectXDevice* device, const std::string path)
+/**
+*  @brief Passes assimp's progress on to the model, and stops the import once the load is cancelled.
+*/
+class ImportProgressHandler : public Assimp::ProgressHandler
+{
+public:
+	ImportProgressHandler(std::atomic<float>& progress, const std::atomic<bool>& cancel) :
+		mProgress(progress),
+		mCancel(cancel)
+	{
+	}
+
+	virtual bool Update(float percentage)
+	{
+		if (percentage >= 0.0f)
+			mProgress.store(percentage * ASSIMP_PROGRESS, std::memory_order_relaxed);
+
+		// Returning false makes assimp give up
+		return !mCancel.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<float>& mProgress;
+	const std::atomic<bool>& mCancel;
+};
+
+/**
+*  @brief Opens files like assimp's default, remembering every one besides the source so the model cache can depend on them.
+*/
+class DependencyRecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+	DependencyRecordingIOSystem(const std::string& sourcePath, std::vector<std::string>& dependencies) :
+		mSourcePath(sourcePath),
+		mDependencies(dependencies)
+	{
+	}
+
+	virtual Assimp::IOStream* Open(const char* file, const char* mode)
+	{
+		Assimp::IOStream* stream = Assimp::DefaultIOSystem::Open(file, mode);
+		if (stream && mSourcePath != file && std::find(mDependencies.begin(), mDependencies.end(), file) == mDependencies.end())
+			mDependencies.push_back(file);
+		return stream;
+	}
+
+private:
+	std::string mSourcePath;
+	std::vector<std::string>& mDependencies;
+};
+
+Model::Model(GraphicsDevice* device, const std::string path, unsigned int decodeThreads, bool packVertices, bool background)
+	: mpGeometry(nullptr),
+	miNumVisible(0),
+	mbCullWithBVH(false),
+	meLoadState(MODEL_LOADING),
+	mbCancelLoad(false),
+	mbGeometryLoaded(false),
+	mbFromCache(false),
+	mbLoadFinished(false),
+	mImportProgress(0.0f),
+	miMeshesUploaded(0),
+	miTexturesTotal(0),
+	miTexturesUploaded(0),
+	mpDiffusePlaceholder(nullptr),
+	mpPlaceholder(nullptr),
+	mbUploadStarted(false),
+	mbUploadFinished(false)
 {
 	mpDevice = device;
 	mbGenerateMipMaps = true;
+	miDecodeThreads = decodeThreads;
+	mbPackVertices = packVertices;
+
+	if (background)
+	{
+		mLoadThread = std::thread([this, path]()
+		{
+			Profiler::Get().SetThreadName("Model load");
+			LoadModel(path);
+		});
+		return;
+	}
+
+	// Everything has been queued by the time LoadModel returns, so one unlimited Upload finishes it
 	LoadModel(path);
+	Upload(0.0f);
 }
 
 Model::~Model()
 {
+	CancelLoad();
+	if (mLoadThread.joinable())
+		mLoadThread.join();
+
+	// Images Upload never got to, those from the cache hold a reference
+	for (size_t i = 0; i < mImages.size(); i++)
+	{
+		if (mImages[i].mpCached)
+			TextureCache::Get().Release(mImages[i].mKey);
+		ImageDecoder::FreePixels(mImages[i]);
+	}
+	mImages.clear();
+
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		mMeshes[i]->Release();
+		delete mMeshes[i];
+	}
+	mMeshes.clear();
+
+	// After the meshes, they free their space in it on release
+	delete mpGeometry;
+	mpGeometry = nullptr;
+
+	// The textures are shared through the cache, so only give back our references.
+	for (unsigned int i = 0; i < mTextureKeys.size(); i++)
+	{
+		TextureCache::Get().Release(mTextureKeys[i]);
+	}
+	mTextureKeys.clear();
+
+	// The placeholders aren't shared, they never go in the cache
+	Texture* placeholders[] = { mpDiffusePlaceholder, mpPlaceholder };
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		if (placeholders[i])
+		{
+			placeholders[i]->Release();
+			delete placeholders[i];
+		}
+	}
+	mpDiffusePlaceholder = nullptr;
+	mpPlaceholder = nullptr;
+}
+
+/**
+*  @brief How far the load has got, from 0 to 1.
+*/
+float Model::GetLoadProgress() const
+{
+	if (!IsGeometryLoaded())
+		return mImportProgress.load(std::memory_order_relaxed) * IMPORT_WEIGHT;
+
+	const unsigned int numMeshes = (unsigned int)mMeshes.size();
+	const unsigned int numTextures = miTexturesTotal.load(std::memory_order_relaxed);
+	const float meshes = numMeshes > 0 ? (float)GetNumMeshesReady() / numMeshes : 1.0f;
+	const float textures = numTextures > 0 ? (float)miTexturesUploaded.load(std::memory_order_relaxed) / numTextures : 1.0f;
+	return IMPORT_WEIGHT + meshes * MESH_WEIGHT + textures * TEXTURE_WEIGHT;
+}
+
+void Model::Draw(GraphicsDevice* device)
+{
+	// The arena is only bound once, meshes that didn't fit in it rebind their own buffers
+	DeviceStateCache stateCache;
+	const unsigned int numReady = GetNumMeshesReady();
+	for (unsigned int i = 0; i < numReady; i++)
+	{
+		mMeshes[i]->Draw(device, stateCache);
+	}
 }
 
-void Model::Draw(DirectXDevice* device)
+/**
+*  @brief Adds every mesh to a draw list, keyed so meshes sharing buffers and textures sort together.
+*
+*  @param drawList The list to add to.
+*  @param pass The pass the draws are for.
+*  @param cameraPosition Used to sort each texture set's meshes front to back.
+*  @param farDistance The distance that maps to the furthest depth bucket.
+*  @param frustum Meshes outside it are left out, or nullptr to add every mesh.
+*  @param occlusion Meshes hidden behind its occluders are left out, it must have rendered them for this view. Can be nullptr.
+*
+*  While the model is loading only the meshes Upload has finished are added.
+*/
+void Model::AddToDrawList(DrawList& drawList, unsigned int pass, const glm::vec3& cameraPosition, float farDistance, const Frustum* frustum, const OcclusionCuller* occlusion, JobSystem* jobs)
 {
-	for (int i = 0; i < mMeshes.size(); i++)
+	// Seeing a mesh as uploaded also means the bounds and hierarchies are finished
+	const unsigned int numReady = GetNumMeshesReady();
+	if (numReady == 0)
+	{
+		miNumVisible = 0;
+		return;
+	}
+
+	// Cull every mesh in one batch before building any keys
+	mVisible.resize(mMeshBounds.PaddedSize());
+	if (frustum && mbCullWithBVH && !mMeshBVH.IsEmpty())
+	{
+		mMeshBVH.QueryFrustum(*frustum, mBVHVisible);
+		std::fill(mVisible.begin(), mVisible.end(), (uint8_t)0);
+		for (size_t i = 0; i < mBVHVisible.size(); i++)
+			mVisible[mBVHVisible[i]] = 1;
+		miNumVisible = (unsigned int)mBVHVisible.size();
+	}
+	else if (frustum)
+	{
+		miNumVisible = frustum->CullBoxes(mMeshBounds, mVisible.data());
+	}
+	else
+	{
+		std::fill(mVisible.begin(), mVisible.end(), (uint8_t)1);
+		miNumVisible = (unsigned int)mMeshes.size();
+	}
+
+	// Only the meshes that survived the frustum are worth projecting
+	if (occlusion && jobs && jobs->GetWorkerCount() > 1)
+	{
+		std::atomic<unsigned int> numVisible(0);
+		uint8_t* visible = mVisible.data();
+		jobs->ParallelFor(0, mMeshBounds.Size(), OCCLUSION_GRAIN_SIZE, [this, occlusion, visible, &numVisible](unsigned int begin, unsigned int end)
+		{
+			numVisible.fetch_add(occlusion->CullBoxes(mMeshBounds, visible, begin, end), std::memory_order_relaxed);
+		});
+		miNumVisible = numVisible.load();
+	}
+	else if (occlusion)
+	{
+		miNumVisible = occlusion->CullBoxes(mMeshBounds, mVisible.data());
+	}
+
+	if (numReady < mMeshes.size())
+		miNumVisible = numReady - (unsigned int)std::count(mVisible.begin(), mVisible.begin() + numReady, (uint8_t)0);
+
+	for (unsigned int i = 0; i < numReady; i++)
 	{
-		mMeshes[i]->Draw(device);
+		if (!mVisible[i])
+			continue;
+
+		// Every mesh in the arena shares its buffers, the rest have their own
+		const unsigned int geometry = mMeshes[i]->IsInArena() ? 0 : i + 1;
+		const unsigned int textureSet = i < mTextureSets.size() ? mTextureSets[i] : 0;
+		const float distance = glm::length(mMeshes[i]->GetBoundsCentre() - cameraPosition);
+
+		drawList.Add(DrawList::MakeKey(pass, geometry, textureSet, DrawList::DepthBucket(distance, farDistance)), mMeshes[i]);
 	}
 }
 
+/**
+*  @brief Picks the meshes best suited to hide others and adds them to an occlusion culler.
+*
+*  Meshes with the largest bounding boxes are chosen first, as long as they fit the triangle budget.
+*  Meshes whose diffuse texture is alpha tested are never used, they can be seen through.
+*  The model must have finished loading, until then the meshes may have placeholder textures.
+*
+*  @param culler The culler to add the occluders to.
+*  @param triangleBudget The most triangles to add.
+*  @return The number of meshes added.
+*/
+unsigned int Model::AddOccluders(OcclusionCuller& culler, unsigned int triangleBudget) const
+{
+	std::vector<std::pair<float, unsigned int>> candidates;
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		bool alphaTested = false;
+		const std::vector<TextureDetail>& details = mMeshes[i]->GetTextureDetails();
+		for (unsigned int j = 0; j < details.size(); j++)
+		{
+			if (details[j].mType == "texture_diffuse" && details[j].mTexture && details[j].mTexture->HasAlpha())
+				alphaTested = true;
+		}
+		if (alphaTested)
+			continue;
+
+		const glm::vec3 size = mMeshes[i]->GetBoundsMax() - mMeshes[i]->GetBoundsMin();
+		candidates.push_back(std::make_pair(size.x * size.y + size.y * size.z + size.z * size.x, i));
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b)
+	{
+		return a.first > b.first;
+	});
+
+	unsigned int numTriangles = 0;
+	unsigned int numOccluders = 0;
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		const Mesh* mesh = mMeshes[candidates[c].second];
+		const unsigned int meshTriangles = mesh->NumIndices() / 3;
+		if (numTriangles + meshTriangles > triangleBudget)
+			continue;
+
+		const std::vector<Vertex>& vertices = mesh->GetVertices();
+		positions.resize(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+			positions[v] = glm::vec3(vertices[v].x, vertices[v].y, vertices[v].z);
+		mesh->GetIndices(indices);
+
+		culler.AddOccluder(positions.data(), (unsigned int)positions.size(), indices.data(), (unsigned int)indices.size());
+		numTriangles += meshTriangles;
+		numOccluders++;
+	}
+
+	LOG_INFO << "Occluders: " << numOccluders << "/" << mMeshes.size() << " meshes, " << numTriangles << " triangles";
+	return numOccluders;
+}
+
+/**
+*  @brief Finds the closest triangle of any mesh along a ray.
+*
+*  @param origin The start of the ray.
+*  @param direction The direction of the ray, distances are in multiples of it.
+*  @param maxDistance Hits further than this are ignored.
+*  @param mesh Set to the index of the mesh hit.
+*  @param distance Set to the distance along the ray of the hit.
+*  @return true if a triangle was hit.
+*/
+bool Model::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, unsigned int& mesh, float& distance) const
+{
+	if (!IsGeometryLoaded())
+		return false;
+
+	BVHRayHit hit;
+	if (!mTriangleBVH.Raycast(origin, direction, maxDistance, hit))
+		return false;
+
+	// The offsets are sorted, the mesh is the last one starting at or before the triangle
+	mesh = (unsigned int)(std::upper_bound(mTriangleOffsets.begin(), mTriangleOffsets.end(), hit.miPrimitive) - mTriangleOffsets.begin()) - 1;
+	distance = hit.mDistance;
+	return true;
+}
+
+/**
+*  @brief Imports the meshes, builds everything computed from them and decodes the textures, queueing them for Upload.
+*
+*  Runs on the load thread when loading in the background, so it never touches the device.
+*  It checks for CancelLoad between each step, and assimp checks too through the progress handler.
+*/
 void Model::LoadModel(const std::string path)
 {
-	Assimp::Importer importer;
-	const aiScene *scene = importer.ReadFile(path, aiProcess_FlipUVs | aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_GenUVCoords);
+	PROFILE_SCOPE("Model::LoadModel");
+
+	LoadModelData(path);
+
+	// Upload knows there's nothing more coming once it sees this
+	mbLoadFinished.store(true, std::memory_order_release);
+}
+
+void Model::LoadModelData(const std::string& path)
+{
+	mDirectory = path.substr(0, path.find_last_of('/'));
+
+	// Use the binary cache if it was built from this exact file, and the files it pulls in, so warm starts skip assimp
+	const std::string cachePath = ModelCache::GetCachePath(path);
+	uint64_t sourceHash = 0;
+	const bool hashed = ModelCache::HashFile(path, sourceHash);
 
-	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+	// The triangle numbering depends on how the meshes were imported and processed as well as the source
+	const std::string bvhPath = path + ".bvh";
+	const uint64_t bvhKey = hashed ? sourceHash ^ ((uint64_t)IMPORT_FLAGS << 32) ^ ModelCache::VERSION : 0;
+	const bool cached = hashed && LoadFromCache(cachePath, sourceHash);
+	mbFromCache = cached;
+	std::vector<std::string> dependencies;
+	if (!cached)
 	{
-		LOG_ERROR << "Error loading model: " << path;
-		LOG_ERROR << "ERROR::ASSIMP::" << importer.GetErrorString();
+		Assimp::Importer importer;
+		// The importer deletes the handlers
+		importer.SetProgressHandler(new ImportProgressHandler(mImportProgress, mbCancelLoad));
+		importer.SetIOHandler(new DependencyRecordingIOSystem(path, dependencies));
+		const aiScene *scene = importer.ReadFile(path, IMPORT_FLAGS);
+		if (StopIfCancelled(path))
+			return;
+
+		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+		{
+			LOG_ERROR << "Error loading model: " << path;
+			LOG_ERROR << "ERROR::ASSIMP::" << importer.GetErrorString();
+			meLoadState.store(MODEL_FAILED, std::memory_order_release);
+			return;
+		}
+
+		ProcessNode(scene->mRootNode, scene);
+	}
+	mImportProgress.store(ASSIMP_PROGRESS, std::memory_order_relaxed);
+	if (StopIfCancelled(path))
 		return;
+
+	std::vector<DecodedImage> images;
+	PrepareMeshes(images);
+	BuildSpatialIndex(hashed ? bvhPath : std::string(), bvhKey);
+
+	// Before the meshes are published, Upload changes their textures
+	if (hashed && !cached)
+	{
+		WriteCache(cachePath, sourceHash, dependencies);
 	}
-	mDirectory = path.substr(0, path.find_last_of('/'));
+	mImportProgress.store(1.0f, std::memory_order_relaxed);
 
-	ProcessNode(scene->mRootNode, scene);
+	// Upload and the update thread can use the meshes from here on, this thread only reads their paths
+	mbGeometryLoaded.store(true, std::memory_order_release);
+	if (StopIfCancelled(path))
+		return;
+
+	LoadTextures(images);
+	StopIfCancelled(path);
+}
+
+/**
+*  @brief Marks the load as cancelled if CancelLoad has been called.
+*
+*  @return true if the load should stop.
+*/
+bool Model::StopIfCancelled(const std::string& path)
+{
+	if (!mbCancelLoad.load())
+		return false;
+
+	LOG_INFO << "Cancelled loading model: " << path;
+	meLoadState.store(MODEL_CANCELLED, std::memory_order_release);
+	return true;
+}
+
+/**
+*  @brief Creates the meshes from the binary cache instead of importing the source file.
+*
+*  @param cachePath The path of the cache file.
+*  @param sourceHash The hash of the source file, the cache must have been built from the same contents.
+*  @return true if the cache was valid and the meshes were created.
+*/
+bool Model::LoadFromCache(const std::string& cachePath, uint64_t sourceHash)
+{
+	PROFILE_SCOPE("Model::LoadFromCache");
+
+	ModelCache cache;
+	if (!cache.Open(cachePath, sourceHash, IMPORT_FLAGS))
+	{
+		return false;
+	}
+
+	for (unsigned int i = 0; i < cache.NumMeshes(); i++)
+	{
+		unsigned int numVertices = 0;
+		unsigned int numIndices = 0;
+		const Vertex* vertices = cache.GetVertices(i, numVertices);
+		const unsigned int* indices = cache.GetIndices(i, numIndices);
+
+		Mesh* modelMesh = new Mesh(vertices, numVertices, indices, numIndices, cache.GetTextures(i));
+		mMeshes.push_back(modelMesh);
+		mImportProgress.store(ASSIMP_PROGRESS * (i + 1) / cache.NumMeshes(), std::memory_order_relaxed);
+	}
+
+	LOG_INFO << "Loaded " << mMeshes.size() << " meshes from model cache: " << cachePath;
+	return true;
+}
+
+/**
+*  @brief Writes the processed meshes into the binary cache for the next start up.
+*
+*  @param cachePath The path of the cache file.
+*  @param sourceHash The hash of the source file the meshes were imported from.
+*  @param dependencies The other files assimp read for the import.
+*/
+void Model::WriteCache(const std::string& cachePath, uint64_t sourceHash, const std::vector<std::string>& dependencies)
+{
+	// The cache always stores 32 bit indices, the meshes narrow them again when they're loaded
+	std::vector<CachedMeshData> meshes(mMeshes.size());
+	std::vector<std::vector<unsigned int>> indices(mMeshes.size());
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		const std::vector<Vertex>& vertices = mMeshes[i]->GetVertices();
+		mMeshes[i]->GetIndices(indices[i]);
+		meshes[i].mpVertices = vertices.data();
+		meshes[i].miNumVertices = (unsigned int)vertices.size();
+		meshes[i].mpIndices = indices[i].data();
+		meshes[i].miNumIndices = (unsigned int)indices[i].size();
+		meshes[i].mTextures = mMeshes[i]->GetTextureDetails();
+	}
+	ModelCache::Write(cachePath, sourceHash, IMPORT_FLAGS, dependencies, meshes);
+}
+
+/**
+*  @brief Logs how much memory the vertex and index buffers use, and what they would use unpacked and at 32 bits.
+*/
+void Model::LogGeometryMemory() const
+{
+	size_t numVertices = 0;
+	size_t vertexBytes = 0;
+	size_t numIndices = 0;
+	size_t indexBytes = 0;
+	unsigned int numShortMeshes = 0;
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		numVertices += mMeshes[i]->GetVertices().size();
+		vertexBytes += mMeshes[i]->GetVertexBufferSize();
+
+		numIndices += mMeshes[i]->NumIndices();
+		indexBytes += mMeshes[i]->GetIndexBufferSize();
+		if (mMeshes[i]->HasShortIndices())
+			numShortMeshes++;
+	}
+	LOG_INFO << "Vertex buffers: " << numVertices << " vertices, " << vertexBytes / 1024 << " KB"
+		<< (mbPackVertices ? " packed" : "") << ", " << numVertices * sizeof(Vertex) / 1024 << " KB unpacked";
+	LOG_INFO << "Index buffers: " << numIndices << " indices, " << indexBytes / 1024 << " KB with "
+		<< numShortMeshes << "/" << mMeshes.size() << " meshes at 16 bits, " << numIndices * sizeof(unsigned int) / 1024 << " KB at 32 bits";
+}
+
+/**
+*  @brief Creates the GPU resources for the meshes and textures the load has finished with.
+*
+*  The meshes go first, in order and with placeholder textures, then each texture as it's decoded,
+*  swapped into the meshes that use it. At least one thing is uploaded each call, after that it
+*  stops once the budget has gone so the frame isn't held up.
+*
+*  @param budgetMs Roughly how long to spend, 0 to upload everything that's ready.
+*/
+void Model::Upload(float budgetMs)
+{
+	if (mbUploadFinished)
+		return;
+
+	// Read first, so once it's set the queue can't be refilled after it's seen empty
+	const bool loadFinished = mbLoadFinished.load(std::memory_order_acquire);
+	if (!IsGeometryLoaded())
+	{
+		// Failed or cancelled before there were any meshes
+		mbUploadFinished = loadFinished;
+		return;
+	}
+
+	PROFILE_SCOPE("Model::Upload");
+
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	auto outOfTime = [budgetMs, &start]()
+	{
+		return budgetMs > 0.0f && std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() >= budgetMs;
+	};
+
+	if (!mbUploadStarted)
+	{
+		CreateArena();
+		mpDiffusePlaceholder = CreatePlaceholder(128, 128, 128);
+		mpPlaceholder = CreatePlaceholder(0, 0, 0);
+		mbUploadStarted = true;
+	}
+
+	unsigned int numUploaded = miMeshesUploaded.load(std::memory_order_relaxed);
+	while (numUploaded < mMeshes.size())
+	{
+		UploadMesh(numUploaded);
+
+		// The update thread can draw it once it sees the new count
+		miMeshesUploaded.store(++numUploaded, std::memory_order_release);
+		if (outOfTime())
+			return;
+	}
+
+	for (;;)
+	{
+		DecodedImage image;
+		{
+			std::lock_guard<std::mutex> lock(mImageMutex);
+			if (mImages.empty())
+				break;
+			image = std::move(mImages.front());
+			mImages.pop_front();
+		}
+
+		UploadTexture(image);
+		miTexturesUploaded.fetch_add(1, std::memory_order_relaxed);
+		if (outOfTime())
+			return;
+	}
+
+	if (loadFinished)
+	{
+		FinishUpload();
+	}
+}
+
+/**
+*  @brief Creates the geometry arena, sized to fit every mesh.
+*/
+void Model::CreateArena()
+{
+	PROFILE_SCOPE("Model::CreateArena");
+
+	unsigned int numVertices = 0;
+	unsigned int numIndices = 0;
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		numVertices += (unsigned int)mMeshes[i]->GetVertices().size();
+		numIndices += mMeshes[i]->NumIndices();
+	}
+
+	if (numVertices > 0 && numIndices > 0)
+	{
+		mpGeometry = new GeometryArena();
+		const unsigned int vertexStride = mbPackVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+		if (!mpGeometry->Create(mpDevice, vertexStride, numVertices, numIndices))
+		{
+			delete mpGeometry;
+			mpGeometry = nullptr;
+		}
+	}
+}
+
+/**
+*  @brief Uploads one mesh into the arena, with whichever of its textures are ready and placeholders for the rest.
+*/
+void Model::UploadMesh(unsigned int i)
+{
+	mMeshes[i]->SetPackVertices(mbPackVertices);
+	mMeshes[i]->SetupMesh(mpDevice, mpGeometry);
+
+	const std::vector<TextureDetail>& details = mMeshes[i]->GetTextureDetails();
+	for (unsigned int j = 0; j < details.size(); j++)
+	{
+		std::unordered_map<std::string, Texture*>::const_iterator it = mTextures.find(details[j].mPath);
+		if (it != mTextures.end())
+			mMeshes[i]->SetTexture(j, it->second);
+		else
+			mMeshes[i]->SetTexture(j, details[j].mType == "texture_diffuse" ? mpDiffusePlaceholder : mpPlaceholder);
+	}
+}
+
+/**
+*  @brief Creates the GPU texture for a decoded image, or takes the cached one, and points the meshes at it.
+*
+*  @param image The image, its pixels are freed.
+*/
+void Model::UploadTexture(DecodedImage& image)
+{
+	Texture* texture = image.mpCached;
+	if (!texture)
+	{
+		texture = CreateTexture(image);
+		ImageDecoder::FreePixels(image);
+		std::vector<unsigned char>().swap(image.mFileData);
+
+		// Another model may have loaded the same texture meanwhile, the cache keeps the first
+		if (texture)
+			texture = TextureCache::Get().Insert(image.mKey, texture);
+	}
+
+	// A texture that failed to load keeps its placeholder
+	if (!texture)
+		return;
+
+	mTextureKeys.push_back(image.mKey);
+	mTextures[image.mPath] = texture;
+	const unsigned int numUploaded = miMeshesUploaded.load(std::memory_order_relaxed);
+	for (unsigned int i = 0; i < numUploaded; i++)
+	{
+		const std::vector<TextureDetail>& details = mMeshes[i]->GetTextureDetails();
+		for (unsigned int j = 0; j < details.size(); j++)
+		{
+			if (details[j].mPath == image.mPath)
+				mMeshes[i]->SetTexture(j, texture);
+		}
+	}
+}
+
+/**
+*  @brief Called once everything the load produced has been uploaded.
+*/
+void Model::FinishUpload()
+{
+	mbUploadFinished = true;
+
+	unsigned int numInArena = 0;
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		if (mMeshes[i]->IsInArena())
+			numInArena++;
+	}
+	LOG_INFO << "Geometry arena holds " << numInArena << "/" << mMeshes.size() << " meshes";
+	LogGeometryMemory();
+
+	TextureCache& cache = TextureCache::Get();
+	LOG_INFO << "Texture cache: " << cache.GetNumEntries() << " entries, " << cache.GetHits() << " hits, " << cache.GetMisses() << " misses";
+
+	// A cancelled load stays cancelled, the update thread may add occluders once it sees this
+	int loading = MODEL_LOADING;
+	meLoadState.compare_exchange_strong(loading, MODEL_LOADED, std::memory_order_acq_rel);
+}
+
+/**
+*  @brief Creates a 1x1 texture of one colour, shown until a mesh's real texture has loaded.
+*/
+Texture* Model::CreatePlaceholder(unsigned char r, unsigned char g, unsigned char b)
+{
+	const unsigned char texel[4] = { r, g, b, 255 };
+
+	Texture* texture = new Texture();
+	texture->ResetFlags();
+	texture->SetUsage(USAGE_IMMUTABLE);
+	texture->SetDimensions(1, 1);
+	texture->SetFormat(TEXTURE_FORMAT_RGBA8);
+	texture->SetInitialData(texel, 4, 0);
+	texture->Initialise(mpDevice);
+	return texture;
+}
+
+/**
+*  @brief Fills in the mesh bounds and texture sets, and gathers the unique texture paths in first use order.
+*
+*  @param images Filled with one image per texture to load, with its path and cache key.
+*/
+void Model::PrepareMeshes(std::vector<DecodedImage>& images)
+{
+	PROFILE_SCOPE("Model::PrepareMeshes");
+
+	mMeshBounds.Resize((unsigned int)mMeshes.size());
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		mMeshBounds.Set(i, mMeshes[i]->GetBoundsMin(), mMeshes[i]->GetBoundsMax());
+	}
+
+	// Number each distinct combination of textures, for sorting draws. The keys stand in for the
+	// textures, which don't exist yet, the cache gives every key the one texture.
+	std::unordered_map<std::string, std::string> keys;
+	std::map<std::vector<std::string>, unsigned int> textureSets;
+	mTextureSets.resize(mMeshes.size());
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		const std::vector<TextureDetail>& details = mMeshes[i]->GetTextureDetails();
+		std::vector<std::string> set(details.size());
+		for (unsigned int j = 0; j < details.size(); j++)
+		{
+			std::unordered_map<std::string, std::string>::iterator key = keys.find(details[j].mPath);
+			if (key == keys.end())
+			{
+				key = keys.insert(std::make_pair(details[j].mPath, TextureCache::NormalisePath(mDirectory + '/' + details[j].mPath))).first;
+
+				DecodedImage image;
+				image.mPath = details[j].mPath;
+				image.mKey = key->second;
+				images.push_back(image);
+			}
+			set[j] = key->second;
+		}
+
+		std::map<std::vector<std::string>, unsigned int>::iterator it = textureSets.find(set);
+		if (it == textureSets.end())
+			it = textureSets.insert(std::make_pair(set, (unsigned int)textureSets.size())).first;
+		mTextureSets[i] = it->second;
+	}
+	miTexturesTotal.store((unsigned int)images.size(), std::memory_order_relaxed);
+}
+
+/**
+*  @brief Builds the mesh and triangle hierarchies, reading the triangle one from disk if it is up to date.
+*
+*  The mesh hierarchy is small enough to always build, the triangle one is saved for the next start up.
+*
+*  @param bvhPath Where the triangle hierarchy is saved, or empty to not save it.
+*  @param key Identifies the source and import settings the hierarchy was built from.
+*/
+void Model::BuildSpatialIndex(const std::string& bvhPath, uint64_t key)
+{
+	PROFILE_SCOPE("Model::BuildSpatialIndex");
+
+	std::vector<glm::vec3> boundsMin(mMeshes.size()), boundsMax(mMeshes.size());
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		boundsMin[i] = mMeshes[i]->GetBoundsMin();
+		boundsMax[i] = mMeshes[i]->GetBoundsMax();
+	}
+	mMeshBVH.Build(boundsMin, boundsMax, 1);
+
+	// Number the triangles mesh by mesh
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	mTriangleOffsets.resize(mMeshes.size());
+	for (unsigned int i = 0; i < mMeshes.size(); i++)
+	{
+		const uint32_t baseVertex = (uint32_t)positions.size();
+		const std::vector<Vertex>& vertices = mMeshes[i]->GetVertices();
+		for (size_t v = 0; v < vertices.size(); v++)
+			positions.push_back(glm::vec3(vertices[v].x, vertices[v].y, vertices[v].z));
+
+		mTriangleOffsets[i] = (unsigned int)(indices.size() / 3);
+		for (unsigned int n = 0; n < mMeshes[i]->NumIndices(); n++)
+			indices.push_back(baseVertex + mMeshes[i]->GetIndex(n));
+	}
+
+	if (!bvhPath.empty() && mTriangleBVH.Load(bvhPath, key) && mTriangleBVH.NumPrimitives() == indices.size() / 3)
+	{
+		LOG_INFO << "Loaded triangle BVH: " << mTriangleBVH.NumNodes() << " nodes over " << mTriangleBVH.NumPrimitives() << " triangles";
+		return;
+	}
+
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	mTriangleBVH.BuildFromTriangles(positions, indices);
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	LOG_INFO << "Built triangle BVH: " << mTriangleBVH.NumNodes() << " nodes over " << mTriangleBVH.NumPrimitives() << " triangles in " << ms << " ms";
+
+	if (!bvhPath.empty() && !mTriangleBVH.Save(bvhPath, key))
+	{
+		LOG_WARNING << "Failed to write triangle BVH: " << bvhPath;
+	}
 }
 
 void Model::ProcessNode(aiNode * node, const aiScene * scene)
@@ -47,9 +827,8 @@ void Model::ProcessNode(aiNode * node, const aiScene * scene)
 	for (int i = 0; i < node->mNumMeshes; i++)
 	{
 		aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-		Mesh* modelMesh = ProcessMesh(mesh, scene);
-		modelMesh->SetupMesh(mpDevice);
-		mMeshes.push_back(modelMesh);
+		std::vector<Mesh*> modelMeshes = ProcessMesh(mesh, scene);
+		mMeshes.insert(mMeshes.end(), modelMeshes.begin(), modelMeshes.end());
 	}
 	// then do the same for each of its children
 	for (int i = 0; i < node->mNumChildren; i++)
@@ -58,7 +837,12 @@ void Model::ProcessNode(aiNode * node, const aiScene * scene)
 	}
 }
 
-Mesh* Model::ProcessMesh(aiMesh * mesh, const aiScene * scene)
+/**
+*  @brief Converts an assimp mesh, split into pieces small enough for 16 bit indices.
+*
+*  @return The meshes, usually just the one.
+*/
+std::vector<Mesh*> Model::ProcessMesh(aiMesh * mesh, const aiScene * scene)
 {
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
@@ -102,88 +886,166 @@ Mesh* Model::ProcessMesh(aiMesh * mesh, const aiScene * scene)
 		std::vector<TextureDetail> specularMaps = LoadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
 		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 	}
-	Mesh* modelMesh = new Mesh(vertices, indices, textures);
-	return modelMesh;
+	// Reorder for the vertex cache and overdraw before it's uploaded, the cache stores the optimised arrays
+	const VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(indices, (unsigned int)vertices.size());
+	MeshOptimizer::Optimize(vertices, indices);
+	const VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(indices, (unsigned int)vertices.size());
+	LOG_DEBUG << "Optimised mesh " << mesh->mName.C_Str() << ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr;
+
+	std::vector<Mesh*> modelMeshes;
+	if (vertices.size() <= Mesh::MAX_SHORT_INDEX_VERTICES)
+	{
+		modelMeshes.push_back(new Mesh(vertices, indices, textures));
+		return modelMeshes;
+	}
+
+	// Too big to address with 16 bit indices, split it
+	std::vector<std::vector<Vertex>> splitVertices;
+	std::vector<std::vector<unsigned int>> splitIndices;
+	MeshOptimizer::SplitMesh(vertices, indices, Mesh::MAX_SHORT_INDEX_VERTICES, splitVertices, splitIndices);
+	LOG_DEBUG << "Split mesh " << mesh->mName.C_Str() << " with " << vertices.size() << " vertices into " << splitVertices.size() << " pieces";
+	for (unsigned int i = 0; i < splitVertices.size(); i++)
+	{
+		modelMeshes.push_back(new Mesh(splitVertices[i], splitIndices[i], textures));
+	}
+	return modelMeshes;
 }
 
 std::vector<TextureDetail> Model::LoadMaterialTextures(aiMaterial * mat, aiTextureType type, std::string typeName)
 {
+	// Only the paths are recorded here, the textures are loaded together in LoadTextures once every mesh is known.
 	std::vector<TextureDetail> textures;
 	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
-		bool skip = false;
-		for (unsigned int j = 0; j < mTexturesLoaded.size(); j++)
-		{
-			if (std::strcmp(mTexturesLoaded[j].mPath.data(), str.C_Str()) == 0)
-			{
-				textures.push_back(mTexturesLoaded[j]);
-				skip = true;
-				break;
-			}
-		}
-		if (!skip)
-		{   // if texture hasn't been loaded already, load it
-			TextureDetail texture;
-			texture.mTexture = TextureFromFile(str.C_Str(), mDirectory);
-			texture.mType = typeName;
-			texture.mPath = str.C_Str();
-			textures.push_back(texture);
-			mTexturesLoaded.push_back(texture); // add to loaded textures
-		}
+		textures.push_back(TextureDetail(nullptr, typeName, str.C_Str()));
 	}
 	return textures;
 }
 
-Texture* Model::TextureFromFile(const std::string path, const std::string directory)
+/**
+*  @brief Finds or decodes every texture the meshes use, queueing each for Upload as soon as it's ready.
+*
+*  Textures already in the process wide cache are shared and queued first, the rest are decoded in parallel
+*  on miDecodeThreads threads, or the hardware concurrency if that is 0.
+*
+*  @param images The unique textures, from PrepareMeshes.
+*/
+void Model::LoadTextures(std::vector<DecodedImage>& images)
 {
-	// Generate mip maps on textures with width and heights above or equal to this value
-	static const int MIP_MAPS_ABOVE = 512;
+	PROFILE_SCOPE("Model::LoadTextures");
 
-	// Get the full file name
-	std::string filename = std::string(path);
-	filename = directory + '/' + filename;
+	TextureCache& cache = TextureCache::Get();
+	std::vector<DecodedImage> decode;
+	for (unsigned int i = 0; i < images.size(); i++)
+	{
+		images[i].mpCached = cache.Acquire(images[i].mKey);
+		if (images[i].mpCached)
+			QueueImage(images[i]);
+		else
+			decode.push_back(images[i]);
+	}
 
-	Texture* texture = new Texture();
+	ImageDecoder::DecodeImages(mDirectory, decode, miDecodeThreads, mbCancelLoad, [this](DecodedImage& image) { QueueImage(image); });
+}
+
+/**
+*  @brief Hands an image to Upload.
+*/
+void Model::QueueImage(DecodedImage& image)
+{
+	std::lock_guard<std::mutex> lock(mImageMutex);
+	mImages.push_back(std::move(image));
+	image.mpData = nullptr;
+}
 
-	// Get the data from stbi
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 4);
+/**
+*  @brief Creates an immutable, block compressed GPU texture from a baked DDS.
+*
+*  @param image The image with the DDS file contents.
+*  @return The texture, with every mip filled in.
+*/
+Texture* Model::CreateBakedTexture(const DecodedImage& image)
+{
+	TextureFormat format = TEXTURE_FORMAT_BC1;
+	if (image.mDDS.format == DDS_FORMAT_BC3) format = TEXTURE_FORMAT_BC3;
+	if (image.mDDS.format == DDS_FORMAT_BC5) format = TEXTURE_FORMAT_BC5;
 
-	// Create the texture
-	if (data)
+	// Point each subresource at its mip in the file
+	std::vector<SubresourceData> mips(image.mDDS.mipCount);
+	size_t offset = image.mDDS.dataOffset;
+	uint32_t width = image.mDDS.width;
+	uint32_t height = image.mDDS.height;
+	for (uint32_t i = 0; i < image.mDDS.mipCount; i++)
 	{
-		// If the size is above the constant then set all the properties needed to generate mip maps
-		if (mbGenerateMipMaps)
-		{
-			if (width >= MIP_MAPS_ABOVE && height >= MIP_MAPS_ABOVE)
-			{
-				texture->SetBindFlags(D3D11_BIND_RENDER_TARGET);
-				texture->SetMiscFlags(D3D11_RESOURCE_MISC_GENERATE_MIPS);
-				int numLevels = 1 + floor(log2(max(width, height)));
-				texture->SetMipLevels(numLevels);
-				texture->SetUsage(D3D11_USAGE_DEFAULT);
-			}
-		}
+		mips[i].mpData = &image.mFileData[offset];
+		mips[i].miRowPitch = DDSMipPitch(image.mDDS.format, width);
+		offset += DDSMipSize(image.mDDS.format, width, height);
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
 
-		// Create and init the texture
-		texture->SetDimensions(width, height);
-		texture->SetFormat(DXGI_FORMAT_R8G8B8A8_UNORM);
-		texture->SetInitialData(data, width * 4, 0);
-		texture->Initialise(mpDevice);
+	Texture* texture = new Texture();
+	texture->ResetFlags();
+	texture->SetUsage(USAGE_IMMUTABLE);
+	texture->SetDimensions(image.mDDS.width, image.mDDS.height);
+	texture->SetFormat(format);
+	texture->SetInitialMipData(mips);
+	texture->SetHasAlpha(image.mbHasAlpha);
+	texture->Initialise(mpDevice);
+	return texture;
+}
+
+/**
+*  @brief Creates the GPU texture for a decoded image.
+*
+*  @param image The decoded image.
+*  @return The texture, or nullptr if the image failed to decode.
+*/
+Texture* Model::CreateTexture(const DecodedImage& image)
+{
+	PROFILE_SCOPE("Model::CreateTexture");
 
-		// Actually generate the mip maps
-		if (mbGenerateMipMaps)
-			if (width >= MIP_MAPS_ABOVE && height >= MIP_MAPS_ABOVE)
-				mpDevice->GetContext()->GenerateMips(texture->GetShaderResourceView());
+	// Generate mip maps on textures with width and heights above or equal to this value
+	static const int MIP_MAPS_ABOVE = 512;
+
+	if (image.mbBaked)
+	{
+		return CreateBakedTexture(image);
 	}
-	else
+
+	if (!image.mpData)
 	{
-		LOG_ERROR << "Texture failed to load at path: " << path;
+		LOG_ERROR << "Texture failed to load at path: " << image.mPath;
+		return nullptr;
 	}
 
-	// Free the image data
-	stbi_image_free(data);
+	const int width = image.miWidth;
+	const int height = image.miHeight;
+	const bool generateMips = mbGenerateMipMaps && width >= MIP_MAPS_ABOVE && height >= MIP_MAPS_ABOVE;
+
+	Texture* texture = new Texture();
+
+	// If the size is above the constant then set all the properties needed to generate mip maps
+	if (generateMips)
+	{
+		texture->SetFlags(TEXTURE_GENERATE_MIPS);
+		int numLevels = 1 + floor(log2(max(width, height)));
+		texture->SetMipLevels(numLevels);
+		texture->SetUsage(USAGE_DEFAULT);
+	}
+
+	// Create and init the texture
+	texture->SetDimensions(width, height);
+	texture->SetFormat(TEXTURE_FORMAT_RGBA8);
+	texture->SetInitialData(image.mpData, width * 4, 0);
+	texture->SetHasAlpha(image.mbHasAlpha);
+	texture->Initialise(mpDevice);
+
+	// Actually generate the mip maps
+	if (generateMips)
+		mpDevice->GenerateMips(texture->GetHandle());
+
 	return texture;
 }
@@ -2,34 +2,156 @@
 #include "Mesh.h"
 #include <string>
 #include <vector>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 #include <assimp/Importer.hpp>      // C++ importer interface
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
 
-#include "DirectXDevice.h"
+#include "GraphicsDevice.h"
+#include <stdint.h>
+#include "ImageDecoder.h"
+#include <glm/glm.hpp>
+#include "Frustum.h"
+#include "BVH.h"
+
+class DrawList;
+class OcclusionCuller;
+class JobSystem;
+
+enum ModelLoadState
+{
+	MODEL_LOADING,
+	MODEL_LOADED,
+	MODEL_FAILED,
+	MODEL_CANCELLED
+};
 
 class Model
 {
 public:
-	Model(DirectXDevice* device, std::string path);
+	/// The most triangles AddOccluders adds by default.
+	static const unsigned int OCCLUDER_TRIANGLE_BUDGET = 20000;
+	/// Meshes each job tests against the occlusion culler when AddToDrawList is given a JobSystem.
+	static const unsigned int OCCLUSION_GRAIN_SIZE = 64;
+
+	/// @param background Load on a thread of its own and return straight away, Upload then makes the meshes and textures drawable as they arrive.
+	Model(GraphicsDevice* device, std::string path, unsigned int decodeThreads = 0, bool packVertices = false, bool background = false);
 	~Model();
 
-	void Draw(DirectXDevice* device);
+	/// Creates the GPU resources for whatever the load has finished, for about budgetMs. Only call it on the thread that renders.
+	void Upload(float budgetMs);
+	/// Stops the load at the next chance it gets, whatever was already loaded stays drawable.
+	void CancelLoad() { mbCancelLoad.store(true); }
+	ModelLoadState GetLoadState() const { return (ModelLoadState)meLoadState.load(std::memory_order_acquire); }
+	/// From 0 to 1, the import, the mesh uploads and the textures together.
+	float GetLoadProgress() const;
+
+	/// Whether the meshes, their bounds and hierarchies exist yet. Until then the model has no meshes.
+	bool IsGeometryLoaded() const { return mbGeometryLoaded.load(std::memory_order_acquire); }
+	unsigned int GetNumMeshes() const { return IsGeometryLoaded() ? (unsigned int)mMeshes.size() : 0; }
+	/// Whether the meshes were read from the model cache rather than imported. Only meaningful once IsGeometryLoaded.
+	bool IsFromCache() const { return mbFromCache; }
+	/// The meshes that can be drawn so far, they're uploaded in order.
+	unsigned int GetNumMeshesReady() const { return miMeshesUploaded.load(std::memory_order_acquire); }
+
+	void Draw(GraphicsDevice* device);
+	void AddToDrawList(DrawList& drawList, unsigned int pass, const glm::vec3& cameraPosition, float farDistance, const Frustum* frustum = nullptr, const OcclusionCuller* occlusion = nullptr, JobSystem* jobs = nullptr);
+	unsigned int AddOccluders(OcclusionCuller& culler, unsigned int triangleBudget = OCCLUDER_TRIANGLE_BUDGET) const;
+
+	/// The number of meshes that passed culling in the last AddToDrawList, of those that were ready.
+	unsigned int GetNumVisible() const { return miNumVisible; }
+
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, unsigned int& mesh, float& distance) const;
+
+	/// Whether the meshes use the PackedVertex format, and so need the packed input layout and vertex shader.
+	bool UsesPackedVertices() const { return mbPackVertices; }
 
 private:
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
 	void LoadModel(const std::string path);
+	void LoadModelData(const std::string& path);
+	bool StopIfCancelled(const std::string& path);
+	bool LoadFromCache(const std::string& cachePath, uint64_t sourceHash);
+	void WriteCache(const std::string& cachePath, uint64_t sourceHash, const std::vector<std::string>& dependencies);
+	void PrepareMeshes(std::vector<DecodedImage>& images);
+	void CreateArena();
+	void UploadMesh(unsigned int i);
+	void UploadTexture(DecodedImage& image);
+	void FinishUpload();
+	Texture* CreatePlaceholder(unsigned char r, unsigned char g, unsigned char b);
+	void BuildSpatialIndex(const std::string& bvhPath, uint64_t key);
+	void LogGeometryMemory() const;
 	void ProcessNode(aiNode *node, const aiScene *scene);
-	Mesh* ProcessMesh(aiMesh *mesh, const aiScene *scene);
+	std::vector<Mesh*> ProcessMesh(aiMesh *mesh, const aiScene *scene);
 	std::vector<TextureDetail> LoadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName);
-	Texture* TextureFromFile(const std::string path, const std::string directory);
+	void LoadTextures(std::vector<DecodedImage>& images);
+	void QueueImage(DecodedImage& image);
+	Texture* CreateTexture(const DecodedImage& image);
+	Texture* CreateBakedTexture(const DecodedImage& image);
 
 public:
 	std::vector<Mesh*> mMeshes;
+	/// The vertex and index buffers all the meshes share.
+	GeometryArena* mpGeometry;
+	/// Identifies each mesh's combination of textures, meshes with the same textures share an id.
+	std::vector<unsigned int> mTextureSets;
+	/// Every mesh's bounding box, laid out for the culling kernel.
+	BoundingBoxesSoA mMeshBounds;
+	std::vector<uint8_t> mVisible;
+	unsigned int miNumVisible;
+	/// Hierarchy over the mesh bounding boxes, for culling.
+	BVH mMeshBVH;
+	/// Hierarchy over every triangle, for picking and ray queries.
+	BVH mTriangleBVH;
+	/// The first triangle of each mesh in mTriangleBVH's numbering.
+	std::vector<unsigned int> mTriangleOffsets;
+	std::vector<uint32_t> mBVHVisible;
+	/// Cull with mMeshBVH rather than testing every mesh's box.
+	bool mbCullWithBVH;
 	std::string mDirectory;
-	std::vector<TextureDetail> mTexturesLoaded;
+	/// Texture cache keys this model holds a reference on.
+	std::vector<std::string> mTextureKeys;
 
-	DirectXDevice* mpDevice;
+	GraphicsDevice* mpDevice;
 	bool mbGenerateMipMaps;
+	/// Threads used to decode textures, 0 uses the hardware concurrency.
+	unsigned int miDecodeThreads;
+	bool mbPackVertices;
+
+private:
+	/// Runs LoadModel when loading in the background.
+	std::thread mLoadThread;
+	/// A ModelLoadState, only LOADED is set by Upload, the rest by the load.
+	std::atomic<int> meLoadState;
+	std::atomic<bool> mbCancelLoad;
+	/// Set once mMeshes and everything computed from them is finished, the load doesn't touch them after.
+	std::atomic<bool> mbGeometryLoaded;
+	/// Written by the load before it sets mbGeometryLoaded.
+	bool mbFromCache;
+	/// Set once the load has queued everything it's going to, whether it finished, failed or was cancelled.
+	std::atomic<bool> mbLoadFinished;
+	/// How far assimp or the model cache has got, from 0 to 1.
+	std::atomic<float> mImportProgress;
+	std::atomic<unsigned int> miMeshesUploaded;
+	std::atomic<unsigned int> miTexturesTotal;
+	std::atomic<unsigned int> miTexturesUploaded;
+
+	/// Images the load has finished with, in the order they're first used, waiting for Upload.
+	std::mutex mImageMutex;
+	std::deque<DecodedImage> mImages;
+
+	/// Only used by Upload: the texture for each path once it's been uploaded, and what meshes show until then.
+	std::unordered_map<std::string, Texture*> mTextures;
+	Texture* mpDiffusePlaceholder;
+	Texture* mpPlaceholder;
+	bool mbUploadStarted;
+	bool mbUploadFinished;
 };
 
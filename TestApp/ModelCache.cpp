@@ -0,0 +1,477 @@
+/**
+*  @file ModelCache.cpp
+*  @brief Binary cache of the processed mesh data for a model.
+*
+*  Stores the vertex and index arrays, and the material texture paths, produced by the assimp import
+*  in a versioned binary file next to the source asset so warm starts never have to touch assimp.
+*
+*  @bug No known bugs.
+*/
+#include "ModelCache.h"
+#include "Log.h"
+#include <stdio.h>
+
+/*----------------------------------------------------------------------------------------------------------------*/
+// FILE LAYOUT
+/*----------------------------------------------------------------------------------------------------------------*/
+
+// All offsets are in bytes from the start of the file, arrays are 8 byte aligned.
+// [CacheHeader][CacheMeshEntry * numMeshes][CacheDependencyEntry * numDependencies]
+// [per mesh: vertices, indices, CacheTextureEntry * numTextures][strings]
+
+static const uint32_t CACHE_MAGIC = 0x4843444D; // "MDCH"
+
+struct CacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t importFlags;
+	uint32_t vertexSize;
+	uint32_t numMeshes;
+	uint32_t numDependencies;
+	uint64_t fileSize;
+	/// Hash of the contents of the files the import read besides the source, e.g. an .obj's material library.
+	uint64_t dependencyHash;
+	uint64_t dependencyOffset;
+};
+
+struct CacheMeshEntry
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t textureOffset;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t numTextures;
+	uint32_t reserved;
+};
+
+struct CacheDependencyEntry
+{
+	uint64_t pathOffset;
+	uint32_t pathLength;
+	uint32_t reserved;
+};
+
+struct CacheTextureEntry
+{
+	uint64_t typeOffset;
+	uint64_t pathOffset;
+	uint32_t typeLength;
+	uint32_t pathLength;
+};
+
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+static uint64_t Align8(uint64_t offset)
+{
+	return (offset + 7) & ~7ull;
+}
+
+static void HashBytes(uint64_t& hash, const unsigned char* data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+}
+
+/*----------------------------------------------------------------------------------------------------------------*/
+// CONSTRUCTORS
+/*----------------------------------------------------------------------------------------------------------------*/
+
+ModelCache::ModelCache() :
+	mFile(INVALID_HANDLE_VALUE),
+	mMapping(NULL),
+	mpData(nullptr),
+	miSize(0)
+{
+}
+
+ModelCache::~ModelCache()
+{
+	Close();
+}
+
+/*----------------------------------------------------------------------------------------------------------------*/
+// FUNCTIONS
+/*----------------------------------------------------------------------------------------------------------------*/
+
+/**
+*  @brief Gets the path of the cache file that sits next to a source asset.
+*
+*  @param sourcePath The path of the source model.
+*  @return The path of the cache file.
+*/
+std::string ModelCache::GetCachePath(const std::string& sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+/**
+*  @brief Hashes the contents of a file with 64 bit FNV-1a.
+*
+*  @param path The file to hash.
+*  @param hash Set to the hash of the file contents.
+*  @return true if the file could be read.
+*/
+bool ModelCache::HashFile(const std::string& path, uint64_t& hash)
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, path.c_str(), "rb") != 0 || !file)
+		return false;
+
+	hash = FNV_OFFSET_BASIS;
+	unsigned char buffer[64 * 1024];
+	size_t read = 0;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		HashBytes(hash, buffer, read);
+
+	fclose(file);
+	return true;
+}
+
+/**
+*  @brief Hashes the contents of several files together, in order.
+*
+*  @param paths The files to hash.
+*  @param hash Set to the combined hash, FNV-1a over each file's own hash.
+*  @return true if every file could be read.
+*/
+bool ModelCache::HashFiles(const std::vector<std::string>& paths, uint64_t& hash)
+{
+	hash = FNV_OFFSET_BASIS;
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		uint64_t fileHash = 0;
+		if (!HashFile(paths[i], fileHash))
+			return false;
+		HashBytes(hash, reinterpret_cast<const unsigned char*>(&fileHash), sizeof(fileHash));
+	}
+	return true;
+}
+
+/**
+*  @brief Writes the processed meshes of a model into a cache file.
+*
+*  The file is written to a temporary path first and then moved over the old cache,
+*  so a crash part way through never leaves a truncated cache behind.
+*
+*  @param cachePath The path to write the cache to.
+*  @param sourceHash The hash of the source asset the meshes were imported from.
+*  @param importFlags The assimp post processing flags used for the import.
+*  @param dependencies The other files the import read, their contents are hashed into the cache as well.
+*  @param meshes The processed meshes.
+*  @return true if the cache was written.
+*/
+bool ModelCache::Write(const std::string& cachePath, uint64_t sourceHash, unsigned int importFlags, const std::vector<std::string>& dependencies, const std::vector<CachedMeshData>& meshes)
+{
+	uint64_t dependencyHash = 0;
+	if (!HashFiles(dependencies, dependencyHash))
+	{
+		LOG_WARNING << "Failed to read the files model cache depends on: " << cachePath;
+		return false;
+	}
+
+	// Lay the file out
+	std::vector<CacheMeshEntry> entries(meshes.size());
+	const uint64_t dependencyOffset = sizeof(CacheHeader) + sizeof(CacheMeshEntry) * meshes.size();
+	uint64_t offset = Align8(dependencyOffset + sizeof(CacheDependencyEntry) * dependencies.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		entries[i].numVertices = meshes[i].miNumVertices;
+		entries[i].numIndices = meshes[i].miNumIndices;
+		entries[i].numTextures = (uint32_t)meshes[i].mTextures.size();
+		entries[i].reserved = 0;
+
+		entries[i].vertexOffset = offset;
+		offset = Align8(offset + sizeof(Vertex) * (uint64_t)meshes[i].miNumVertices);
+		entries[i].indexOffset = offset;
+		offset = Align8(offset + sizeof(unsigned int) * (uint64_t)meshes[i].miNumIndices);
+		entries[i].textureOffset = offset;
+		offset = Align8(offset + sizeof(CacheTextureEntry) * (uint64_t)entries[i].numTextures);
+	}
+
+	// Strings go at the end
+	std::vector<CacheDependencyEntry> dependencyEntries(dependencies.size());
+	std::vector<CacheTextureEntry> textures;
+	std::string strings;
+	for (size_t i = 0; i < dependencies.size(); i++)
+	{
+		dependencyEntries[i].pathOffset = offset + strings.size();
+		dependencyEntries[i].pathLength = (uint32_t)dependencies[i].size();
+		dependencyEntries[i].reserved = 0;
+		strings += dependencies[i];
+	}
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		for (size_t j = 0; j < meshes[i].mTextures.size(); j++)
+		{
+			const TextureDetail& detail = meshes[i].mTextures[j];
+			CacheTextureEntry texture;
+			texture.typeOffset = offset + strings.size();
+			texture.typeLength = (uint32_t)detail.mType.size();
+			strings += detail.mType;
+			texture.pathOffset = offset + strings.size();
+			texture.pathLength = (uint32_t)detail.mPath.size();
+			strings += detail.mPath;
+			textures.push_back(texture);
+		}
+	}
+
+	CacheHeader header;
+	header.magic = CACHE_MAGIC;
+	header.version = VERSION;
+	header.sourceHash = sourceHash;
+	header.importFlags = importFlags;
+	header.vertexSize = sizeof(Vertex);
+	header.numMeshes = (uint32_t)meshes.size();
+	header.numDependencies = (uint32_t)dependencies.size();
+	header.fileSize = offset + strings.size();
+	header.dependencyHash = dependencyHash;
+	header.dependencyOffset = dependencyOffset;
+
+	// Fill the file in
+	std::vector<unsigned char> data((size_t)header.fileSize, 0);
+	memcpy(&data[0], &header, sizeof(CacheHeader));
+	if (!entries.empty())
+		memcpy(&data[sizeof(CacheHeader)], &entries[0], sizeof(CacheMeshEntry) * entries.size());
+	if (!dependencyEntries.empty())
+		memcpy(&data[(size_t)dependencyOffset], &dependencyEntries[0], sizeof(CacheDependencyEntry) * dependencyEntries.size());
+
+	size_t textureIndex = 0;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (entries[i].numVertices > 0)
+			memcpy(&data[(size_t)entries[i].vertexOffset], meshes[i].mpVertices, sizeof(Vertex) * entries[i].numVertices);
+		if (entries[i].numIndices > 0)
+			memcpy(&data[(size_t)entries[i].indexOffset], meshes[i].mpIndices, sizeof(unsigned int) * entries[i].numIndices);
+		if (entries[i].numTextures > 0)
+			memcpy(&data[(size_t)entries[i].textureOffset], &textures[textureIndex], sizeof(CacheTextureEntry) * entries[i].numTextures);
+		textureIndex += entries[i].numTextures;
+	}
+	if (!strings.empty())
+		memcpy(&data[(size_t)offset], strings.data(), strings.size());
+
+	// Write it out
+	const std::string tempPath = cachePath + ".tmp";
+	FILE* file = nullptr;
+	if (fopen_s(&file, tempPath.c_str(), "wb") != 0 || !file)
+	{
+		LOG_WARNING << "Failed to open model cache for writing: " << tempPath;
+		return false;
+	}
+	bool written = fwrite(&data[0], 1, data.size(), file) == data.size();
+	fclose(file);
+
+	if (!written || !MoveFileExA(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		LOG_WARNING << "Failed to write model cache: " << cachePath;
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+
+	LOG_INFO << "Wrote model cache: " << cachePath << " (" << data.size() / 1024 << " KB)";
+	return true;
+}
+
+/**
+*  @brief Memory maps a cache file and checks it matches the source asset.
+*
+*  The files the import read besides the source are hashed again too, so editing e.g. a material
+*  library makes the cache out of date even when the source itself hasn't changed.
+*
+*  @param cachePath The path of the cache file.
+*  @param sourceHash The hash of the source asset.
+*  @param importFlags The assimp post processing flags that would be used for a fresh import.
+*  @return true if the cache is open and valid for the source asset.
+*/
+bool ModelCache::Open(const std::string& cachePath, uint64_t sourceHash, unsigned int importFlags)
+{
+	Close();
+
+	mFile = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size) || size.QuadPart < (LONGLONG)sizeof(CacheHeader))
+	{
+		Close();
+		return false;
+	}
+	miSize = (uint64_t)size.QuadPart;
+
+	mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mMapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	mpData = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	uint64_t dependencyHash = 0;
+	if (!mpData || !Validate(sourceHash, importFlags) ||
+		!HashFiles(GetDependencies(), dependencyHash) || dependencyHash != reinterpret_cast<const CacheHeader*>(mpData)->dependencyHash)
+	{
+		LOG_INFO << "Model cache is out of date: " << cachePath;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+/**
+*  @brief Unmaps and closes the cache file.
+*/
+void ModelCache::Close()
+{
+	if (mpData)
+	{
+		UnmapViewOfFile(mpData);
+		mpData = nullptr;
+	}
+	if (mMapping != NULL)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+	if (mFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+	miSize = 0;
+}
+
+/**
+*  @brief Checks the header matches and every range in the file is in bounds.
+*/
+bool ModelCache::Validate(uint64_t sourceHash, unsigned int importFlags) const
+{
+	const CacheHeader* header = reinterpret_cast<const CacheHeader*>(mpData);
+	if (header->magic != CACHE_MAGIC ||
+		header->version != VERSION ||
+		header->sourceHash != sourceHash ||
+		header->importFlags != importFlags ||
+		header->vertexSize != sizeof(Vertex) ||
+		header->fileSize != miSize)
+	{
+		return false;
+	}
+
+	if (sizeof(CacheHeader) + sizeof(CacheMeshEntry) * (uint64_t)header->numMeshes > miSize ||
+		header->dependencyOffset + sizeof(CacheDependencyEntry) * (uint64_t)header->numDependencies > miSize)
+	{
+		return false;
+	}
+
+	const CacheDependencyEntry* dependencies = reinterpret_cast<const CacheDependencyEntry*>(mpData + header->dependencyOffset);
+	for (uint32_t i = 0; i < header->numDependencies; i++)
+	{
+		if (dependencies[i].pathOffset + dependencies[i].pathLength > miSize)
+			return false;
+	}
+
+	const CacheMeshEntry* entries = reinterpret_cast<const CacheMeshEntry*>(mpData + sizeof(CacheHeader));
+	for (uint32_t i = 0; i < header->numMeshes; i++)
+	{
+		const CacheMeshEntry& entry = entries[i];
+		if (entry.vertexOffset + sizeof(Vertex) * (uint64_t)entry.numVertices > miSize ||
+			entry.indexOffset + sizeof(unsigned int) * (uint64_t)entry.numIndices > miSize ||
+			entry.textureOffset + sizeof(CacheTextureEntry) * (uint64_t)entry.numTextures > miSize)
+		{
+			return false;
+		}
+
+		const CacheTextureEntry* textures = reinterpret_cast<const CacheTextureEntry*>(mpData + entry.textureOffset);
+		for (uint32_t j = 0; j < entry.numTextures; j++)
+		{
+			if (textures[j].typeOffset + textures[j].typeLength > miSize ||
+				textures[j].pathOffset + textures[j].pathLength > miSize)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+unsigned int ModelCache::NumMeshes() const
+{
+	if (!mpData) return 0;
+	return reinterpret_cast<const CacheHeader*>(mpData)->numMeshes;
+}
+
+/**
+*  @brief Gets the vertices of a cached mesh, they point straight into the mapped file.
+*
+*  @param mesh The index of the mesh.
+*  @param count Set to the number of vertices.
+*  @return Pointer to the first vertex, only valid while the cache is open.
+*/
+const Vertex* ModelCache::GetVertices(unsigned int mesh, unsigned int& count) const
+{
+	const CacheMeshEntry& entry = reinterpret_cast<const CacheMeshEntry*>(mpData + sizeof(CacheHeader))[mesh];
+	count = entry.numVertices;
+	return reinterpret_cast<const Vertex*>(mpData + entry.vertexOffset);
+}
+
+/**
+*  @brief Gets the indices of a cached mesh, they point straight into the mapped file.
+*
+*  @param mesh The index of the mesh.
+*  @param count Set to the number of indices.
+*  @return Pointer to the first index, only valid while the cache is open.
+*/
+const unsigned int* ModelCache::GetIndices(unsigned int mesh, unsigned int& count) const
+{
+	const CacheMeshEntry& entry = reinterpret_cast<const CacheMeshEntry*>(mpData + sizeof(CacheHeader))[mesh];
+	count = entry.numIndices;
+	return reinterpret_cast<const unsigned int*>(mpData + entry.indexOffset);
+}
+
+/**
+*  @brief Gets the material textures of a cached mesh.
+*
+*  Only the type and path are stored, the textures themselves still need loading.
+*
+*  @param mesh The index of the mesh.
+*  @return The texture details, with null texture pointers.
+*/
+std::vector<TextureDetail> ModelCache::GetTextures(unsigned int mesh) const
+{
+	const CacheMeshEntry& entry = reinterpret_cast<const CacheMeshEntry*>(mpData + sizeof(CacheHeader))[mesh];
+	const CacheTextureEntry* textures = reinterpret_cast<const CacheTextureEntry*>(mpData + entry.textureOffset);
+
+	std::vector<TextureDetail> details;
+	for (uint32_t i = 0; i < entry.numTextures; i++)
+	{
+		std::string type(reinterpret_cast<const char*>(mpData + textures[i].typeOffset), textures[i].typeLength);
+		std::string path(reinterpret_cast<const char*>(mpData + textures[i].pathOffset), textures[i].pathLength);
+		details.push_back(TextureDetail(nullptr, type, path));
+	}
+	return details;
+}
+
+/**
+*  @brief Gets the paths of the files the import read besides the source, as assimp opened them.
+*
+*  @return The paths, in the order they were first opened.
+*/
+std::vector<std::string> ModelCache::GetDependencies() const
+{
+	std::vector<std::string> paths;
+	if (!mpData)
+		return paths;
+
+	const CacheHeader* header = reinterpret_cast<const CacheHeader*>(mpData);
+	const CacheDependencyEntry* dependencies = reinterpret_cast<const CacheDependencyEntry*>(mpData + header->dependencyOffset);
+	for (uint32_t i = 0; i < header->numDependencies; i++)
+		paths.push_back(std::string(reinterpret_cast<const char*>(mpData + dependencies[i].pathOffset), dependencies[i].pathLength));
+	return paths;
+}
@@ -0,0 +1,74 @@
+/**
+*  @file ModelCache.h
+*  @brief Binary cache of the processed mesh data for a model.
+*
+*  Stores the vertex and index arrays, and the material texture paths, produced by the assimp import
+*  in a versioned binary file next to the source asset so warm starts never have to touch assimp.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Vertex.h"
+#include "TextureDetails.h"
+
+/**
+*  @brief The processed data for one mesh, as it is written into the cache.
+*/
+struct CachedMeshData
+{
+	const Vertex* mpVertices;
+	unsigned int miNumVertices;
+	const unsigned int* mpIndices;
+	unsigned int miNumIndices;
+	std::vector<TextureDetail> mTextures;
+};
+
+/**
+*  @brief Reads and writes the binary model cache.
+*
+*  A cache file is only valid for the exact source file contents and import flags it was built from,
+*  along with the contents of every other file the import read, the current cache version and Vertex layout. Opening a cache memory-maps the file so the
+*  vertex and index arrays can be handed straight to the meshes.
+*/
+class ModelCache
+{
+public:
+	/// Bump whenever the file layout, or the processing that produces the cached data, changes.
+	static const uint32_t VERSION = 5;
+
+	ModelCache();
+	~ModelCache();
+
+	static std::string GetCachePath(const std::string& sourcePath);
+	static bool HashFile(const std::string& path, uint64_t& hash);
+	static bool HashFiles(const std::vector<std::string>& paths, uint64_t& hash);
+	static bool Write(const std::string& cachePath, uint64_t sourceHash, unsigned int importFlags, const std::vector<std::string>& dependencies, const std::vector<CachedMeshData>& meshes);
+
+	bool Open(const std::string& cachePath, uint64_t sourceHash, unsigned int importFlags);
+	void Close();
+
+	bool IsOpen() const { return mpData != nullptr; }
+	unsigned int NumMeshes() const;
+
+	const Vertex* GetVertices(unsigned int mesh, unsigned int& count) const;
+	const unsigned int* GetIndices(unsigned int mesh, unsigned int& count) const;
+	std::vector<TextureDetail> GetTextures(unsigned int mesh) const;
+	std::vector<std::string> GetDependencies() const;
+
+private:
+	ModelCache(const ModelCache&) = delete;
+	ModelCache& operator=(const ModelCache&) = delete;
+
+	bool Validate(uint64_t sourceHash, unsigned int importFlags) const;
+
+	HANDLE mFile;
+	HANDLE mMapping;
+	/// The mapped view of the whole cache file.
+	const unsigned char* mpData;
+	uint64_t miSize;
+};
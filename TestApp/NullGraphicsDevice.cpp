@@ -0,0 +1,277 @@
+/**
+*  @file NullGraphicsDevice.cpp
+*  @brief A GraphicsDevice that records what it is asked to do instead of drawing anything.
+*
+*  Lets the frame loop run headless, so its CPU cost can be measured without a GPU or a window.
+*
+*  @bug No known bugs.
+*/
+#include "NullGraphicsDevice.h"
+#include "Log.h"
+#include <string.h>
+
+NullGraphicsDevice::NullGraphicsDevice()
+	: mpVertexBuffer(nullptr),
+	mpIndexBuffer(nullptr),
+	mpInputLayout(nullptr),
+	mpVertexShader(nullptr),
+	mpPixelShader(nullptr),
+	meTopology(TOPOLOGY_UNDEFINED)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	memset(&mBackBuffer, 0, sizeof(mBackBuffer));
+	memset(&mDepthBuffer, 0, sizeof(mDepthBuffer));
+	mBackBuffer.mDesc.miFlags = TEXTURE_RENDER_TARGET;
+	mDepthBuffer.mDesc.miFlags = TEXTURE_RENDER_TARGET;
+}
+
+NullGraphicsDevice::~NullGraphicsDevice()
+{
+	if (mStats.miLiveBuffers > 0 || mStats.miLiveTextures > 0)
+	{
+		LOG_WARNING << "Null device destroyed with " << mStats.miLiveBuffers << " buffers and " << mStats.miLiveTextures << " textures still alive";
+	}
+}
+
+/**
+*  @brief Zeroes every count except the live resources.
+*/
+void NullGraphicsDevice::ResetStats()
+{
+	NullGraphicsStats live = mStats;
+	memset(&mStats, 0, sizeof(mStats));
+	mStats.miLiveBuffers = live.miLiveBuffers;
+	mStats.miLiveTextures = live.miLiveTextures;
+	mStats.miLiveBufferBytes = live.miLiveBufferBytes;
+	mStats.miLiveTextureBytes = live.miLiveTextureBytes;
+}
+
+GraphicsBuffer* NullGraphicsDevice::CreateBuffer(const BufferDesc& desc, const void* data)
+{
+	NullBuffer* buffer = new NullBuffer();
+	buffer->mDesc = desc;
+	mStats.miLiveBuffers++;
+	mStats.miLiveBufferBytes += desc.miSize;
+	if (data)
+		mStats.miUploadedBytes += desc.miSize;
+	return reinterpret_cast<GraphicsBuffer*>(buffer);
+}
+
+void NullGraphicsDevice::UpdateBuffer(GraphicsBuffer* buffer, unsigned int offset, const void* /*data*/, unsigned int size)
+{
+	const NullBuffer* nullBuffer = reinterpret_cast<NullBuffer*>(buffer);
+	if (!nullBuffer || offset + size > nullBuffer->mDesc.miSize || nullBuffer->mDesc.meUsage == USAGE_IMMUTABLE)
+	{
+		LOG_ERROR << "Invalid buffer update of " << size << " bytes at " << offset;
+		return;
+	}
+	mStats.miUploadedBytes += size;
+}
+
+void NullGraphicsDevice::ReleaseBuffer(GraphicsBuffer* buffer)
+{
+	NullBuffer* nullBuffer = reinterpret_cast<NullBuffer*>(buffer);
+	if (!nullBuffer)
+		return;
+	mStats.miLiveBuffers--;
+	mStats.miLiveBufferBytes -= nullBuffer->mDesc.miSize;
+	delete nullBuffer;
+}
+
+GraphicsTexture* NullGraphicsDevice::CreateTexture(const TextureDesc& desc, const SubresourceData* mips, unsigned int numMips)
+{
+	NullTexture* texture = new NullTexture();
+	texture->mDesc = desc;
+	texture->miSize = TextureSizeInBytes(desc.meFormat, desc.miWidth, desc.miHeight, desc.miMipLevels);
+	mStats.miLiveTextures++;
+	mStats.miLiveTextureBytes += texture->miSize;
+	if (mips && numMips > 0)
+		mStats.miUploadedBytes += TextureSizeInBytes(desc.meFormat, desc.miWidth, desc.miHeight, numMips);
+	return reinterpret_cast<GraphicsTexture*>(texture);
+}
+
+bool NullGraphicsDevice::UpdateTexture(GraphicsTexture* texture, const void* /*data*/, unsigned int rowPitch)
+{
+	const NullTexture* nullTexture = reinterpret_cast<NullTexture*>(texture);
+	if (!nullTexture || nullTexture->mDesc.meUsage == USAGE_IMMUTABLE)
+		return false;
+	mStats.miUploadedBytes += (size_t)rowPitch * nullTexture->mDesc.miHeight;
+	return true;
+}
+
+void NullGraphicsDevice::GenerateMips(GraphicsTexture* /*texture*/)
+{
+}
+
+void NullGraphicsDevice::ReleaseTexture(GraphicsTexture* texture)
+{
+	NullTexture* nullTexture = reinterpret_cast<NullTexture*>(texture);
+	if (!nullTexture || nullTexture == &mBackBuffer || nullTexture == &mDepthBuffer)
+		return;
+	mStats.miLiveTextures--;
+	mStats.miLiveTextureBytes -= nullTexture->miSize;
+	delete nullTexture;
+}
+
+GraphicsVertexShader* NullGraphicsDevice::CreateVertexShader(const void* /*bytecode*/, size_t /*size*/)
+{
+	return reinterpret_cast<GraphicsVertexShader*>(new NullObject());
+}
+
+GraphicsPixelShader* NullGraphicsDevice::CreatePixelShader(const void* /*bytecode*/, size_t /*size*/)
+{
+	return reinterpret_cast<GraphicsPixelShader*>(new NullObject());
+}
+
+GraphicsInputLayout* NullGraphicsDevice::CreateInputLayout(const VertexElement* /*elements*/, unsigned int /*numElements*/, const void* /*vertexShaderBytecode*/, size_t /*size*/)
+{
+	return reinterpret_cast<GraphicsInputLayout*>(new NullObject());
+}
+
+GraphicsSampler* NullGraphicsDevice::CreateSampler(SamplerFilter /*filter*/, unsigned int /*maxAnisotropy*/)
+{
+	return reinterpret_cast<GraphicsSampler*>(new NullObject());
+}
+
+void NullGraphicsDevice::ReleaseVertexShader(GraphicsVertexShader* shader)
+{
+	delete reinterpret_cast<NullObject*>(shader);
+}
+
+void NullGraphicsDevice::ReleasePixelShader(GraphicsPixelShader* shader)
+{
+	delete reinterpret_cast<NullObject*>(shader);
+}
+
+void NullGraphicsDevice::ReleaseInputLayout(GraphicsInputLayout* layout)
+{
+	delete reinterpret_cast<NullObject*>(layout);
+}
+
+void NullGraphicsDevice::ReleaseSampler(GraphicsSampler* sampler)
+{
+	delete reinterpret_cast<NullObject*>(sampler);
+}
+
+void NullGraphicsDevice::SetVertexBuffer(GraphicsBuffer* buffer, unsigned int /*stride*/)
+{
+	mpVertexBuffer = buffer;
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetIndexBuffer(GraphicsBuffer* buffer, IndexFormat /*format*/)
+{
+	mpIndexBuffer = buffer;
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetPrimitiveTopology(PrimitiveTopology topology)
+{
+	meTopology = topology;
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetInputLayout(GraphicsInputLayout* layout)
+{
+	mpInputLayout = layout;
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetVertexShader(GraphicsVertexShader* shader)
+{
+	mpVertexShader = shader;
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetPixelShader(GraphicsPixelShader* shader)
+{
+	mpPixelShader = shader;
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetVSConstantBuffer(unsigned int /*slot*/, GraphicsBuffer* /*buffer*/)
+{
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetPSConstantBuffer(unsigned int /*slot*/, GraphicsBuffer* /*buffer*/)
+{
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetPSTexture(unsigned int /*slot*/, GraphicsTexture* /*texture*/)
+{
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetPSSampler(unsigned int /*slot*/, GraphicsSampler* /*sampler*/)
+{
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::SetRenderTargets(GraphicsTexture* const* /*targets*/, unsigned int /*numTargets*/, GraphicsTexture* /*depth*/)
+{
+	mStats.miStateChanges++;
+	mStats.miRenderTargetChanges++;
+}
+
+void NullGraphicsDevice::EnableWireFrame(bool /*enable*/)
+{
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::EnableDepthBuffering(bool /*enable*/)
+{
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::EnableAlphaBlending(bool /*enable*/)
+{
+	mStats.miStateChanges++;
+}
+
+void NullGraphicsDevice::ClearScreen()
+{
+	mStats.miClears += 2;
+}
+
+void NullGraphicsDevice::ClearRenderTarget(GraphicsTexture* /*target*/, const float /*colour*/[4])
+{
+	mStats.miClears++;
+}
+
+bool NullGraphicsDevice::IsDrawValid(bool indexed) const
+{
+	return mpVertexShader && mpPixelShader && mpInputLayout && mpVertexBuffer && meTopology != TOPOLOGY_UNDEFINED && (!indexed || mpIndexBuffer);
+}
+
+void NullGraphicsDevice::Draw(unsigned int numVertices, unsigned int /*firstVertex*/)
+{
+	mStats.miDraws++;
+	mStats.miVerticesDrawn += numVertices;
+	if (!IsDrawValid(false))
+		mStats.miInvalidDraws++;
+}
+
+void NullGraphicsDevice::DrawIndexed(unsigned int numIndices, unsigned int /*firstIndex*/, int /*baseVertex*/)
+{
+	mStats.miDraws++;
+	mStats.miVerticesDrawn += numIndices;
+	if (!IsDrawValid(true))
+		mStats.miInvalidDraws++;
+}
+
+void NullGraphicsDevice::SwapBuffers()
+{
+	mStats.miFrames++;
+}
+
+GraphicsTexture* NullGraphicsDevice::GetBackBufferTexture()
+{
+	return reinterpret_cast<GraphicsTexture*>(&mBackBuffer);
+}
+
+GraphicsTexture* NullGraphicsDevice::GetDepthTexture()
+{
+	return reinterpret_cast<GraphicsTexture*>(&mDepthBuffer);
+}
@@ -0,0 +1,123 @@
+/**
+*  @file NullGraphicsDevice.h
+*  @brief A GraphicsDevice that records what it is asked to do instead of drawing anything.
+*
+*  Lets the frame loop run headless, so its CPU cost can be measured without a GPU or a window.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include "GraphicsDevice.h"
+
+/**
+*  @brief What a NullGraphicsDevice has been asked to do.
+*
+*  The live counts track the resources that currently exist, everything else counts since the last ResetStats.
+*/
+struct NullGraphicsStats
+{
+	unsigned int miLiveBuffers;
+	unsigned int miLiveTextures;
+	size_t miLiveBufferBytes;
+	size_t miLiveTextureBytes;
+
+	/// Bytes passed in at creation and in updates.
+	size_t miUploadedBytes;
+	unsigned int miStateChanges;
+	unsigned int miRenderTargetChanges;
+	unsigned int miClears;
+	unsigned int miDraws;
+	uint64_t miVerticesDrawn;
+	/// Draws made without a shader, input layout, topology or buffer bound.
+	unsigned int miInvalidDraws;
+	unsigned int miFrames;
+};
+
+class NullGraphicsDevice : public GraphicsDevice
+{
+public:
+	NullGraphicsDevice();
+	virtual ~NullGraphicsDevice();
+
+	const NullGraphicsStats& GetStats() const { return mStats; }
+	void ResetStats();
+
+	// Resources
+	virtual GraphicsBuffer* CreateBuffer(const BufferDesc& desc, const void* data);
+	virtual void UpdateBuffer(GraphicsBuffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	virtual void ReleaseBuffer(GraphicsBuffer* buffer);
+
+	virtual GraphicsTexture* CreateTexture(const TextureDesc& desc, const SubresourceData* mips, unsigned int numMips);
+	virtual bool UpdateTexture(GraphicsTexture* texture, const void* data, unsigned int rowPitch);
+	virtual void GenerateMips(GraphicsTexture* texture);
+	virtual void ReleaseTexture(GraphicsTexture* texture);
+
+	virtual GraphicsVertexShader* CreateVertexShader(const void* bytecode, size_t size);
+	virtual GraphicsPixelShader* CreatePixelShader(const void* bytecode, size_t size);
+	virtual GraphicsInputLayout* CreateInputLayout(const VertexElement* elements, unsigned int numElements, const void* vertexShaderBytecode, size_t size);
+	virtual GraphicsSampler* CreateSampler(SamplerFilter filter, unsigned int maxAnisotropy);
+	virtual void ReleaseVertexShader(GraphicsVertexShader* shader);
+	virtual void ReleasePixelShader(GraphicsPixelShader* shader);
+	virtual void ReleaseInputLayout(GraphicsInputLayout* layout);
+	virtual void ReleaseSampler(GraphicsSampler* sampler);
+
+	// Pipeline state
+	virtual void SetVertexBuffer(GraphicsBuffer* buffer, unsigned int stride);
+	virtual void SetIndexBuffer(GraphicsBuffer* buffer, IndexFormat format);
+	virtual void SetPrimitiveTopology(PrimitiveTopology topology);
+	virtual void SetInputLayout(GraphicsInputLayout* layout);
+	virtual void SetVertexShader(GraphicsVertexShader* shader);
+	virtual void SetPixelShader(GraphicsPixelShader* shader);
+	virtual void SetVSConstantBuffer(unsigned int slot, GraphicsBuffer* buffer);
+	virtual void SetPSConstantBuffer(unsigned int slot, GraphicsBuffer* buffer);
+	virtual void SetPSTexture(unsigned int slot, GraphicsTexture* texture);
+	virtual void SetPSSampler(unsigned int slot, GraphicsSampler* sampler);
+	virtual void SetRenderTargets(GraphicsTexture* const* targets, unsigned int numTargets, GraphicsTexture* depth);
+	virtual void EnableWireFrame(bool enable);
+	virtual void EnableDepthBuffering(bool enable);
+	virtual void EnableAlphaBlending(bool enable);
+
+	// Commands
+	virtual void ClearScreen();
+	virtual void ClearRenderTarget(GraphicsTexture* target, const float colour[4]);
+	virtual void Draw(unsigned int numVertices, unsigned int firstVertex);
+	virtual void DrawIndexed(unsigned int numIndices, unsigned int firstIndex, int baseVertex);
+	virtual void SwapBuffers();
+
+	virtual GraphicsTexture* GetBackBufferTexture();
+	virtual GraphicsTexture* GetDepthTexture();
+
+private:
+	NullGraphicsDevice(const NullGraphicsDevice&);
+	NullGraphicsDevice& operator=(const NullGraphicsDevice&);
+
+	bool IsDrawValid(bool indexed) const;
+
+	/// The resources the handles point at.
+	struct NullBuffer
+	{
+		BufferDesc mDesc;
+	};
+	struct NullTexture
+	{
+		TextureDesc mDesc;
+		size_t miSize;
+	};
+	/// Shaders, input layouts and samplers, which have nothing worth recording.
+	struct NullObject
+	{
+		int miKind;
+	};
+
+	NullGraphicsStats mStats;
+	NullTexture mBackBuffer;
+	NullTexture mDepthBuffer;
+
+	// What is bound, to check draws against
+	GraphicsBuffer* mpVertexBuffer;
+	GraphicsBuffer* mpIndexBuffer;
+	GraphicsInputLayout* mpInputLayout;
+	GraphicsVertexShader* mpVertexShader;
+	GraphicsPixelShader* mpPixelShader;
+	PrimitiveTopology meTopology;
+};
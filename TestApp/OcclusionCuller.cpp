@@ -0,0 +1,383 @@
+/**
+*  @file OcclusionCuller.cpp
+*  @brief Software occlusion culling against a low resolution depth buffer drawn on the CPU.
+*
+*  Occluder triangles are rasterized with SSE2, 4 pixels at a time, into a small depth buffer that is then
+*  reduced into a max depth pyramid. Boxes are tested against the pyramid level where their screen
+*  rectangle covers only a few texels. Has no D3D dependencies so it can run headless.
+*
+*  @bug No known bugs.
+*/
+#include "OcclusionCuller.h"
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+/// The depth the buffer is cleared to, the far plane in NDC.
+static const float FAR_DEPTH = 1.0f;
+/// Boxes are tested at the pyramid level where their rectangle is at most this many texels across.
+static const int TEST_TEXELS = 4;
+
+OcclusionCuller::OcclusionCuller()
+	: miWidth(0),
+	miHeight(0),
+	mViewProjection(1.0f),
+	miTrianglesRasterized(0)
+{
+	Resize(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+}
+
+/**
+*  @brief Sets the resolution of the depth buffer, the width is rounded up to a multiple of 4.
+*/
+void OcclusionCuller::Resize(unsigned int width, unsigned int height)
+{
+	miWidth = std::max(4u, (width + 3) & ~3u);
+	miHeight = std::max(1u, height);
+
+	mLevels.clear();
+	mLevelWidths.clear();
+	mLevelHeights.clear();
+	unsigned int levelWidth = miWidth;
+	unsigned int levelHeight = miHeight;
+	while (true)
+	{
+		mLevels.push_back(std::vector<float>(levelWidth * levelHeight, FAR_DEPTH));
+		mLevelWidths.push_back(levelWidth);
+		mLevelHeights.push_back(levelHeight);
+		if (levelWidth == 1 && levelHeight == 1)
+			break;
+		levelWidth = std::max(1u, (levelWidth + 1) / 2);
+		levelHeight = std::max(1u, (levelHeight + 1) / 2);
+	}
+}
+
+void OcclusionCuller::ClearOccluders()
+{
+	mPositions.clear();
+	mIndices.clear();
+}
+
+/**
+*  @brief Adds a triangle list to the occluders.
+*
+*  Only add geometry that is really drawn opaque, anything behind it will be culled.
+*
+*  @param positions The vertex positions in world space.
+*  @param numPositions The number of positions.
+*  @param indices Three indices per triangle into positions.
+*  @param numIndices The number of indices.
+*/
+void OcclusionCuller::AddOccluder(const glm::vec3* positions, unsigned int numPositions, const uint32_t* indices, unsigned int numIndices)
+{
+	const uint32_t baseVertex = (uint32_t)mPositions.size();
+	mPositions.insert(mPositions.end(), positions, positions + numPositions);
+	for (unsigned int i = 0; i + 2 < numIndices; i += 3)
+	{
+		mIndices.push_back(baseVertex + indices[i]);
+		mIndices.push_back(baseVertex + indices[i + 1]);
+		mIndices.push_back(baseVertex + indices[i + 2]);
+	}
+}
+
+OcclusionCuller::ScreenVertex OcclusionCuller::ToScreen(const glm::vec4& clip) const
+{
+	const float inverseW = 1.0f / clip.w;
+	ScreenVertex vertex;
+	vertex.x = (clip.x * inverseW * 0.5f + 0.5f) * miWidth;
+	vertex.y = (0.5f - clip.y * inverseW * 0.5f) * miHeight;
+	vertex.z = clip.z * inverseW;
+	return vertex;
+}
+
+/**
+*  @brief Clears the depth buffer, draws every occluder from a view and rebuilds the pyramid.
+*
+*  @param viewProjection The camera's view projection matrix, with OpenGL clip space like the Frustum.
+*/
+void OcclusionCuller::RenderOccluders(const glm::mat4& viewProjection)
+{
+	mViewProjection = viewProjection;
+	std::fill(mLevels[0].begin(), mLevels[0].end(), FAR_DEPTH);
+	miTrianglesRasterized = 0;
+
+	mClipPositions.resize(mPositions.size());
+	for (size_t i = 0; i < mPositions.size(); i++)
+		mClipPositions[i] = viewProjection * glm::vec4(mPositions[i], 1.0f);
+
+	for (size_t i = 0; i + 2 < mIndices.size(); i += 3)
+	{
+		const glm::vec4 clip[3] = { mClipPositions[mIndices[i]], mClipPositions[mIndices[i + 1]], mClipPositions[mIndices[i + 2]] };
+
+		// Skip triangles entirely outside one of the side planes
+		if ((clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) ||
+			(clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) ||
+			(clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) ||
+			(clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w))
+			continue;
+
+		// Clip against the near plane, z >= -w, which leaves at most a quad
+		float distances[3];
+		unsigned int numInside = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			distances[k] = clip[k].z + clip[k].w;
+			if (distances[k] >= 0.0f)
+				numInside++;
+		}
+		if (numInside == 0)
+			continue;
+
+		if (numInside == 3)
+		{
+			RasterizeTriangle(ToScreen(clip[0]), ToScreen(clip[1]), ToScreen(clip[2]));
+			continue;
+		}
+
+		ScreenVertex polygon[4];
+		unsigned int numPolygon = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			const int next = (k + 1) % 3;
+			if (distances[k] >= 0.0f)
+				polygon[numPolygon++] = ToScreen(clip[k]);
+			if ((distances[k] >= 0.0f) != (distances[next] >= 0.0f))
+			{
+				const float t = distances[k] / (distances[k] - distances[next]);
+				polygon[numPolygon++] = ToScreen(clip[k] + (clip[next] - clip[k]) * t);
+			}
+		}
+		for (unsigned int k = 2; k < numPolygon; k++)
+			RasterizeTriangle(polygon[0], polygon[k - 1], polygon[k]);
+	}
+
+	BuildPyramid();
+}
+
+/**
+*  @brief Draws one screen space triangle into the depth buffer, keeping the closest depth.
+*
+*  Pixels are covered when their centre is inside the triangle, 4 pixels of a row are done at a time.
+*/
+void OcclusionCuller::RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2)
+{
+	const float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+	if (area == 0.0f || area != area)
+		return;
+
+	const int minX = std::max(0, (int)floorf(std::min(v0.x, std::min(v1.x, v2.x))));
+	const int maxX = std::min((int)miWidth - 1, (int)ceilf(std::max(v0.x, std::max(v1.x, v2.x))));
+	const int minY = std::max(0, (int)floorf(std::min(v0.y, std::min(v1.y, v2.y))));
+	const int maxY = std::min((int)miHeight - 1, (int)ceilf(std::max(v0.y, std::max(v1.y, v2.y))));
+	if (minX > maxX || minY > maxY)
+		return;
+
+	miTrianglesRasterized++;
+
+	// Edge functions a * x + b * y + c, flipped so the inside is positive whatever the winding
+	const float sign = area > 0.0f ? 1.0f : -1.0f;
+	const ScreenVertex* vertices[3] = { &v0, &v1, &v2 };
+	__m128 edgeA[3], edgeB[3], edgeC[3];
+	for (int k = 0; k < 3; k++)
+	{
+		const ScreenVertex& a = *vertices[k];
+		const ScreenVertex& b = *vertices[(k + 1) % 3];
+		edgeA[k] = _mm_set1_ps((a.y - b.y) * sign);
+		edgeB[k] = _mm_set1_ps((b.x - a.x) * sign);
+		edgeC[k] = _mm_set1_ps((a.x * b.y - a.y * b.x) * sign);
+	}
+
+	// Depth is linear in screen space, z = zA * x + zB * y + zC
+	const float zA = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+	const float zB = ((v1.x - v0.x) * (v2.z - v0.z) - (v2.x - v0.x) * (v1.z - v0.z)) / area;
+	const __m128 depthA = _mm_set1_ps(zA);
+	const __m128 depthB = _mm_set1_ps(zB);
+	const __m128 depthC = _mm_set1_ps(v0.z - zA * v0.x - zB * v0.y);
+
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	float* depth = mLevels[0].data();
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		const __m128 py = _mm_set1_ps(y + 0.5f);
+		float* row = depth + y * miWidth;
+		for (int x = minX & ~3; x <= maxX; x += 4)
+		{
+			const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], px), _mm_mul_ps(edgeB[0], py)), edgeC[0]), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], px), _mm_mul_ps(edgeB[1], py)), edgeC[1]), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], px), _mm_mul_ps(edgeB[2], py)), edgeC[2]), zero));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(depthA, px), _mm_mul_ps(depthB, py)), depthC);
+			const __m128 current = _mm_loadu_ps(row + x);
+			const __m128 closer = _mm_min_ps(current, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, current)));
+		}
+	}
+}
+
+/**
+*  @brief Fills every level of the pyramid below the first with the furthest depth of the texels it covers.
+*/
+void OcclusionCuller::BuildPyramid()
+{
+	for (size_t level = 1; level < mLevels.size(); level++)
+	{
+		const std::vector<float>& source = mLevels[level - 1];
+		const unsigned int sourceWidth = mLevelWidths[level - 1];
+		const unsigned int sourceHeight = mLevelHeights[level - 1];
+		std::vector<float>& destination = mLevels[level];
+		for (unsigned int y = 0; y < mLevelHeights[level]; y++)
+		{
+			const unsigned int y0 = y * 2;
+			const unsigned int y1 = std::min(y0 + 1, sourceHeight - 1);
+			for (unsigned int x = 0; x < mLevelWidths[level]; x++)
+			{
+				const unsigned int x0 = x * 2;
+				const unsigned int x1 = std::min(x0 + 1, sourceWidth - 1);
+				destination[y * mLevelWidths[level] + x] = std::max(
+					std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+					std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+			}
+		}
+	}
+}
+
+/**
+*  @brief Finds the pixels a box covers on screen and its closest depth.
+*
+*  @param crossesNear Set if part of the box is in front of the near plane, then the rectangle isn't valid.
+*  @return false if the box is entirely off screen.
+*/
+bool OcclusionCuller::ProjectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, ScreenRect& rect, bool& crossesNear) const
+{
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	rect.minDepth = FLT_MAX;
+	crossesNear = false;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const glm::vec3 position(corner & 1 ? boundsMax.x : boundsMin.x, corner & 2 ? boundsMax.y : boundsMin.y, corner & 4 ? boundsMax.z : boundsMin.z);
+		const glm::vec4 clip = mViewProjection * glm::vec4(position, 1.0f);
+		if (clip.z < -clip.w)
+		{
+			crossesNear = true;
+			return true;
+		}
+
+		const ScreenVertex vertex = ToScreen(clip);
+		minX = std::min(minX, vertex.x);
+		maxX = std::max(maxX, vertex.x);
+		minY = std::min(minY, vertex.y);
+		maxY = std::max(maxY, vertex.y);
+		rect.minDepth = std::min(rect.minDepth, vertex.z);
+	}
+
+	// Every pixel whose centre the rectangle could touch
+	rect.minX = std::max(0, (int)floorf(minX - 0.5f));
+	rect.maxX = std::min((int)miWidth - 1, (int)ceilf(maxX - 0.5f));
+	rect.minY = std::max(0, (int)floorf(minY - 0.5f));
+	rect.maxY = std::min((int)miHeight - 1, (int)ceilf(maxY - 0.5f));
+	return rect.minX <= rect.maxX && rect.minY <= rect.maxY;
+}
+
+/**
+*  @brief Tests a box against the depth pyramid from the last RenderOccluders.
+*
+*  Conservative, a box is only reported hidden if every pixel it could cover has an occluder in front of it.
+*
+*  @return false if the box is hidden behind the occluders.
+*/
+bool OcclusionCuller::IsBoxVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	ScreenRect rect;
+	bool crossesNear;
+	if (!ProjectBox(boundsMin, boundsMax, rect, crossesNear))
+		return false;
+	if (crossesNear)
+		return true;
+
+	// Go down the pyramid until the rectangle is only a few texels across
+	unsigned int level = 0;
+	int minX = rect.minX, minY = rect.minY, maxX = rect.maxX, maxY = rect.maxY;
+	while (level + 1 < mLevels.size() && (maxX - minX >= TEST_TEXELS || maxY - minY >= TEST_TEXELS))
+	{
+		minX >>= 1; minY >>= 1; maxX >>= 1; maxY >>= 1;
+		level++;
+	}
+
+	const std::vector<float>& depth = mLevels[level];
+	const unsigned int width = mLevelWidths[level];
+	for (int y = minY; y <= maxY; y++)
+	{
+		for (int x = minX; x <= maxX; x++)
+		{
+			if (rect.minDepth <= depth[y * width + x])
+				return true;
+		}
+	}
+	return false;
+}
+
+/**
+*  @brief Tests a box against every pixel of the full resolution depth buffer, to check IsBoxVisible against.
+*
+*  IsBoxVisible may report boxes visible that this reports hidden, but never the other way round.
+*/
+bool OcclusionCuller::IsBoxVisibleReference(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	ScreenRect rect;
+	bool crossesNear;
+	if (!ProjectBox(boundsMin, boundsMax, rect, crossesNear))
+		return false;
+	if (crossesNear)
+		return true;
+
+	const std::vector<float>& depth = mLevels[0];
+	for (int y = rect.minY; y <= rect.maxY; y++)
+	{
+		for (int x = rect.minX; x <= rect.maxX; x++)
+		{
+			if (rect.minDepth <= depth[y * miWidth + x])
+				return true;
+		}
+	}
+	return false;
+}
+
+/**
+*  @brief Tests a batch of boxes, only the ones still marked visible are tested.
+*
+*  @param boxes The boxes to test.
+*  @param visible One flag per box, cleared for the boxes that are hidden.
+*  @return The number of boxes still visible.
+*/
+unsigned int OcclusionCuller::CullBoxes(const BoundingBoxesSoA& boxes, uint8_t* visible) const
+{
+	return CullBoxes(boxes, visible, 0, (unsigned int)boxes.Size());
+}
+
+/**
+*  @brief Tests the boxes in [begin, end), only the ones still marked visible are tested.
+*
+*  Only reads the depth pyramid, so separate ranges can be tested on separate threads.
+*  @return The number of boxes in the range still visible.
+*/
+unsigned int OcclusionCuller::CullBoxes(const BoundingBoxesSoA& boxes, uint8_t* visible, unsigned int begin, unsigned int end) const
+{
+	unsigned int numVisible = 0;
+	for (unsigned int i = begin; i < end; i++)
+	{
+		if (!visible[i])
+			continue;
+
+		const glm::vec3 centre(boxes.mCentreX[i], boxes.mCentreY[i], boxes.mCentreZ[i]);
+		const glm::vec3 extent(boxes.mExtentX[i], boxes.mExtentY[i], boxes.mExtentZ[i]);
+		visible[i] = IsBoxVisible(centre - extent, centre + extent) ? 1 : 0;
+		numVisible += visible[i];
+	}
+	return numVisible;
+}
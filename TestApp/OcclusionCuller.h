@@ -0,0 +1,78 @@
+/**
+*  @file OcclusionCuller.h
+*  @brief Software occlusion culling against a low resolution depth buffer drawn on the CPU.
+*
+*  Occluder triangles are rasterized with SSE2, 4 pixels at a time, into a small depth buffer that is then
+*  reduced into a max depth pyramid. Boxes are tested against the pyramid level where their screen
+*  rectangle covers only a few texels. Has no D3D dependencies so it can run headless.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+class OcclusionCuller
+{
+public:
+	static const unsigned int DEFAULT_WIDTH = 256;
+	static const unsigned int DEFAULT_HEIGHT = 128;
+
+	OcclusionCuller();
+
+	void Resize(unsigned int width, unsigned int height);
+
+	void ClearOccluders();
+	void AddOccluder(const glm::vec3* positions, unsigned int numPositions, const uint32_t* indices, unsigned int numIndices);
+
+	void RenderOccluders(const glm::mat4& viewProjection);
+
+	bool IsBoxVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+	bool IsBoxVisibleReference(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+	unsigned int CullBoxes(const BoundingBoxesSoA& boxes, uint8_t* visible) const;
+	unsigned int CullBoxes(const BoundingBoxesSoA& boxes, uint8_t* visible, unsigned int begin, unsigned int end) const;
+
+	unsigned int GetWidth() const { return miWidth; }
+	unsigned int GetHeight() const { return miHeight; }
+	/// The rasterized depth, NDC z with smaller values closer, row by row from the top.
+	const std::vector<float>& GetDepth() const { return mLevels[0]; }
+	unsigned int NumOccluderTriangles() const { return (unsigned int)(mIndices.size() / 3); }
+	unsigned int NumTrianglesRasterized() const { return miTrianglesRasterized; }
+
+private:
+	struct ScreenVertex
+	{
+		float x, y, z;
+	};
+
+	struct ScreenRect
+	{
+		int minX, minY, maxX, maxY;
+		float minDepth;
+	};
+
+	void RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2);
+	ScreenVertex ToScreen(const glm::vec4& clip) const;
+	bool ProjectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, ScreenRect& rect, bool& crossesNear) const;
+	void BuildPyramid();
+
+	unsigned int miWidth;
+	unsigned int miHeight;
+
+	/// The occluders in world space, as a triangle list.
+	std::vector<glm::vec3> mPositions;
+	std::vector<uint32_t> mIndices;
+	/// mPositions in clip space for the current view.
+	std::vector<glm::vec4> mClipPositions;
+
+	glm::mat4 mViewProjection;
+	/// The depth buffer at level 0, then each level holds the furthest depth of 2x2 texels of the one above.
+	std::vector<std::vector<float>> mLevels;
+	std::vector<unsigned int> mLevelWidths;
+	std::vector<unsigned int> mLevelHeights;
+
+	unsigned int miTrianglesRasterized;
+};
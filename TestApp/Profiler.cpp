@@ -0,0 +1,401 @@
+/**
+*  @file Profiler.cpp
+*  @brief Hierarchical CPU profiler built from scoped markers.
+*
+*  @bug No known bugs.
+*/
+#include "Profiler.h"
+#include "Log.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined D_USE_IMGUI
+#include "ImGui\imgui.h"
+#endif
+
+const char* const Profiler::FRAME_MARKER = "Frame";
+
+namespace
+{
+	/**
+	*  @brief Hands a thread's buffer back to the profiler when the thread exits.
+	*/
+	struct ThreadBufferOwner
+	{
+		ThreadBufferOwner() : mpBuffer(nullptr) {}
+		~ThreadBufferOwner()
+		{
+			if (mpBuffer)
+			{
+				mpBuffer->miDepth = 0;
+				mpBuffer->mbInUse.store(false, std::memory_order_release);
+			}
+		}
+
+		ProfilerThreadBuffer* mpBuffer;
+	};
+
+	thread_local ThreadBufferOwner tThreadBuffer;
+
+	/**
+	*  @brief Copies the events still in a buffer, oldest first.
+	*
+	*  The owner may keep writing while this runs, so anything it could have overwritten
+	*  during the copy is dropped.
+	*/
+	void CopyEvents(const ProfilerThreadBuffer& buffer, std::vector<ProfileEvent>& events)
+	{
+		const uint64_t written = buffer.miWritten.load(std::memory_order_acquire);
+		uint64_t first = written > ProfilerThreadBuffer::CAPACITY ? written - ProfilerThreadBuffer::CAPACITY : 0;
+
+		events.clear();
+		for (uint64_t i = first; i < written; i++)
+		{
+			events.push_back(buffer.mEvents[i & (ProfilerThreadBuffer::CAPACITY - 1)]);
+		}
+
+		const uint64_t writtenAfter = buffer.miWritten.load(std::memory_order_acquire);
+		if (writtenAfter > ProfilerThreadBuffer::CAPACITY && writtenAfter - ProfilerThreadBuffer::CAPACITY > first)
+		{
+			const uint64_t lapped = std::min<uint64_t>(writtenAfter - ProfilerThreadBuffer::CAPACITY - first, events.size());
+			events.erase(events.begin(), events.begin() + (size_t)lapped);
+		}
+	}
+
+	void WriteJSONString(FILE* file, const char* text)
+	{
+		fputc('"', file);
+		for (const char* c = text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				fputc('\\', file);
+			if ((unsigned char)*c >= 0x20)
+				fputc(*c, file);
+		}
+		fputc('"', file);
+	}
+}
+
+/**
+*  @brief Gets a percentile of the recent frame times.
+*
+*  @param percentile From 0 to 100, 50 is the median.
+*  @return The time in milliseconds, or 0 if there are none yet.
+*/
+float ProfileMarkerHistory::GetPercentile(float percentile) const
+{
+	if (miCount == 0)
+		return 0.0f;
+
+	float sorted[HISTORY_SIZE];
+	std::copy(mTimesMs, mTimesMs + miCount, sorted);
+	std::sort(sorted, sorted + miCount);
+
+	const float position = percentile / 100.0f * (float)(miCount - 1);
+	const unsigned int index = std::min((unsigned int)(position + 0.5f), miCount - 1);
+	return sorted[index];
+}
+
+float ProfileMarkerHistory::GetMax() const
+{
+	float result = 0.0f;
+	for (unsigned int i = 0; i < miCount; i++)
+		result = std::max(result, mTimesMs[i]);
+	return result;
+}
+
+Profiler::Profiler() :
+	mbEnabled(true),
+	mpFrameThread(nullptr),
+	miFrameFirstEvent(0),
+	miFrameStart(0)
+{
+}
+
+Profiler::~Profiler()
+{
+	for (size_t i = 0; i < mThreads.size(); i++)
+	{
+		delete mThreads[i];
+	}
+}
+
+uint64_t Profiler::Now()
+{
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+/**
+*  @brief Gets the calling thread's buffer, the first call on a thread takes one.
+*
+*  Buffers left by threads that have exited are reused before new ones are made, so short
+*  lived worker threads don't grow the profiler.
+*/
+ProfilerThreadBuffer* Profiler::GetThreadBuffer()
+{
+	if (tThreadBuffer.mpBuffer)
+		return tThreadBuffer.mpBuffer;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	ProfilerThreadBuffer* buffer = nullptr;
+	for (size_t i = 0; i < mThreads.size() && !buffer; i++)
+	{
+		bool inUse = false;
+		if (mThreads[i]->mbInUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+			buffer = mThreads[i];
+	}
+
+	if (!buffer)
+	{
+		buffer = new ProfilerThreadBuffer();
+		buffer->miThreadId = (unsigned int)mThreads.size() + 1;
+		buffer->mName = "Thread " + std::to_string(buffer->miThreadId);
+		mThreads.push_back(buffer);
+	}
+
+	tThreadBuffer.mpBuffer = buffer;
+	return buffer;
+}
+
+/**
+*  @brief Names the calling thread in traces.
+*/
+void Profiler::SetThreadName(const char* name)
+{
+	ProfilerThreadBuffer* buffer = GetThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	buffer->mName = name;
+}
+
+/**
+*  @brief Starts a frame on the calling thread, which becomes the frame thread.
+*
+*  The time since the previous BeginFrame is recorded as the FRAME_MARKER.
+*/
+void Profiler::BeginFrame()
+{
+	const uint64_t now = Now();
+	if (mpFrameThread && miFrameStart != 0)
+	{
+		ProfileMarkerHistory& frame = mMarkers[FRAME_MARKER];
+		if (!frame.mpName)
+		{
+			frame.mpName = FRAME_MARKER;
+			mMarkerOrder.insert(mMarkerOrder.begin(), &frame);
+		}
+		frame.mLastMs = (float)((now - miFrameStart) / 1000000.0);
+		frame.mTimesMs[frame.miNext] = frame.mLastMs;
+		frame.miNext = (frame.miNext + 1) % ProfileMarkerHistory::HISTORY_SIZE;
+		if (frame.miCount < ProfileMarkerHistory::HISTORY_SIZE)
+			frame.miCount++;
+	}
+
+	mpFrameThread = GetThreadBuffer();
+	miFrameFirstEvent = mpFrameThread->miWritten.load(std::memory_order_relaxed);
+	miFrameStart = now;
+}
+
+/**
+*  @brief Adds up the time spent in each marker the frame thread closed since BeginFrame.
+*/
+void Profiler::EndFrame()
+{
+	if (!mpFrameThread)
+		return;
+
+	const uint64_t written = mpFrameThread->miWritten.load(std::memory_order_relaxed);
+	uint64_t first = miFrameFirstEvent;
+	if (written - first > ProfilerThreadBuffer::CAPACITY)
+		first = written - ProfilerThreadBuffer::CAPACITY;
+
+	// Sum each marker's events, a marker can close many times in a frame
+	std::unordered_map<const char*, double>& frameTotals = mFrameTotals;
+	frameTotals.clear();
+	bool added = false;
+	for (uint64_t i = first; i < written; i++)
+	{
+		const ProfileEvent& event = mpFrameThread->mEvents[i & (ProfilerThreadBuffer::CAPACITY - 1)];
+		const uint64_t startOffset = event.miStart > miFrameStart ? event.miStart - miFrameStart : 0;
+
+		ProfileMarkerHistory& history = mMarkers[event.mpName];
+		if (!history.mpName)
+		{
+			history.mpName = event.mpName;
+			mMarkerOrder.push_back(&history);
+			added = true;
+		}
+
+		std::unordered_map<const char*, double>::iterator total = frameTotals.find(event.mpName);
+		if (total == frameTotals.end())
+		{
+			frameTotals[event.mpName] = 0.0;
+			total = frameTotals.find(event.mpName);
+			history.miStartOffset = startOffset;
+			history.miDepth = event.miDepth;
+		}
+		else if (startOffset < history.miStartOffset)
+		{
+			history.miStartOffset = startOffset;
+			history.miDepth = event.miDepth;
+		}
+		total->second += (event.miEnd - event.miStart) / 1000000.0;
+	}
+
+	for (std::unordered_map<const char*, double>::iterator it = frameTotals.begin(); it != frameTotals.end(); ++it)
+	{
+		ProfileMarkerHistory& history = mMarkers[it->first];
+		history.mLastMs = (float)it->second;
+		history.mTimesMs[history.miNext] = history.mLastMs;
+		history.miNext = (history.miNext + 1) % ProfileMarkerHistory::HISTORY_SIZE;
+		if (history.miCount < ProfileMarkerHistory::HISTORY_SIZE)
+			history.miCount++;
+	}
+
+	// Markers start before the markers inside them, so ordering by start time nests them
+	if (added || frameTotals.size() > 1)
+	{
+		std::stable_sort(mMarkerOrder.begin(), mMarkerOrder.end(), [](const ProfileMarkerHistory* a, const ProfileMarkerHistory* b)
+		{
+			if ((a->mpName == FRAME_MARKER) != (b->mpName == FRAME_MARKER))
+				return a->mpName == FRAME_MARKER;
+			if (a->miStartOffset != b->miStartOffset)
+				return a->miStartOffset < b->miStartOffset;
+			return a->miDepth < b->miDepth;
+		});
+	}
+
+	miFrameFirstEvent = written;
+}
+
+const ProfileMarkerHistory* Profiler::FindMarker(const char* name) const
+{
+	for (size_t i = 0; i < mMarkerOrder.size(); i++)
+	{
+		if (mMarkerOrder[i]->mpName == name || strcmp(mMarkerOrder[i]->mpName, name) == 0)
+			return mMarkerOrder[i];
+	}
+	return nullptr;
+}
+
+/**
+*  @brief Writes the events still in every thread's buffer as a Chrome trace event file.
+*
+*  Each marker is a complete ("X") event, with a metadata event naming each thread.
+*  Safe to call while other threads are still recording.
+*
+*  @param path The file to write, usually ending in .json.
+*  @return false if the file couldn't be written.
+*/
+bool Profiler::WriteChromeTrace(const std::string& path)
+{
+	std::vector<ProfilerThreadBuffer*> threads;
+	std::vector<std::string> names;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		threads = mThreads;
+		for (size_t i = 0; i < mThreads.size(); i++)
+			names.push_back(mThreads[i]->mName);
+	}
+
+	FILE* file = nullptr;
+#if defined _WIN32
+	if (fopen_s(&file, path.c_str(), "wb") != 0)
+		file = nullptr;
+#else
+	file = fopen(path.c_str(), "wb");
+#endif
+	if (!file)
+	{
+		LOG_ERROR << "Failed to open the trace file: " << path;
+		mLastTrace = "Failed to write " + path;
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	size_t numEvents = 0;
+	std::vector<ProfileEvent> events;
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", threads[i]->miThreadId);
+		WriteJSONString(file, names[i].c_str());
+		fprintf(file, "}}");
+		first = false;
+
+		CopyEvents(*threads[i], events);
+		for (size_t j = 0; j < events.size(); j++)
+		{
+			fprintf(file, ",\n{\"name\":");
+			WriteJSONString(file, events[j].mpName);
+			fprintf(file, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				threads[i]->miThreadId, events[j].miStart / 1000.0, (events[j].miEnd - events[j].miStart) / 1000.0);
+		}
+		numEvents += events.size();
+	}
+	fprintf(file, "\n]}\n");
+
+	const bool ok = ferror(file) == 0;
+	fclose(file);
+	if (!ok)
+	{
+		LOG_ERROR << "Failed to write the trace file: " << path;
+		mLastTrace = "Failed to write " + path;
+		return false;
+	}
+
+	LOG_INFO << "Wrote " << numEvents << " profile events from " << threads.size() << " threads to " << path;
+	mLastTrace = "Wrote " + std::to_string(numEvents) + " events to " + path;
+	return true;
+}
+
+/**
+*  @brief Draws the overlay of the frame thread's markers with their rolling percentiles.
+*/
+void Profiler::DrawUI()
+{
+#if defined D_USE_IMGUI
+	ImGui::SetNextWindowSize(ImVec2(520, 300), ImGuiCond_FirstUseEver);
+	ImGui::Begin("Profiler");
+
+	bool enabled = IsEnabled();
+	if (ImGui::Checkbox("Enabled", &enabled))
+		SetEnabled(enabled);
+	ImGui::SameLine();
+	if (ImGui::Button("Save trace"))
+		WriteChromeTrace("profile.json");
+	if (!mLastTrace.empty())
+	{
+		ImGui::SameLine();
+		ImGui::TextUnformatted(mLastTrace.c_str());
+	}
+
+	ImGui::Text("Milliseconds over the last %u frames", ProfileMarkerHistory::HISTORY_SIZE);
+	ImGui::Columns(6, "ProfilerMarkers");
+	ImGui::Separator();
+	ImGui::Text("Marker"); ImGui::NextColumn();
+	ImGui::Text("Last"); ImGui::NextColumn();
+	ImGui::Text("p50"); ImGui::NextColumn();
+	ImGui::Text("p95"); ImGui::NextColumn();
+	ImGui::Text("p99"); ImGui::NextColumn();
+	ImGui::Text("Max"); ImGui::NextColumn();
+	ImGui::Separator();
+	for (size_t i = 0; i < mMarkerOrder.size(); i++)
+	{
+		const ProfileMarkerHistory& marker = *mMarkerOrder[i];
+		ImGui::Text("%*s%s", (int)marker.miDepth * 2, "", marker.mpName); ImGui::NextColumn();
+		ImGui::Text("%.2f", marker.mLastMs); ImGui::NextColumn();
+		ImGui::Text("%.2f", marker.GetPercentile(50.0f)); ImGui::NextColumn();
+		ImGui::Text("%.2f", marker.GetPercentile(95.0f)); ImGui::NextColumn();
+		ImGui::Text("%.2f", marker.GetPercentile(99.0f)); ImGui::NextColumn();
+		ImGui::Text("%.2f", marker.GetMax()); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+
+	ImGui::End();
+#endif
+}
@@ -0,0 +1,195 @@
+/**
+*  @file Profiler.h
+*  @brief Hierarchical CPU profiler built from scoped markers.
+*
+*  Each thread records the markers it closes into its own ring buffer without taking a lock.
+*  The frame thread turns its markers into per frame timings for the rolling percentiles,
+*  and every thread's buffer can be written out as a Chrome trace (chrome://tracing, Perfetto).
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+*  @brief One closed marker, times are in nanoseconds from Profiler::Now().
+*/
+struct ProfileEvent
+{
+	/// A string literal, markers are told apart by the pointer.
+	const char* mpName;
+	uint64_t miStart;
+	uint64_t miEnd;
+	/// How many markers were open around this one on its thread.
+	unsigned int miDepth;
+};
+
+/**
+*  @brief The events recorded by one thread.
+*
+*  Only the owning thread writes. Readers copy what they need and check miWritten again afterwards,
+*  dropping anything the writer may have lapped while they were copying.
+*/
+struct ProfilerThreadBuffer
+{
+	/// Events kept per thread, a power of 2.
+	static const unsigned int CAPACITY = 16384;
+
+	ProfilerThreadBuffer() : miWritten(0), miDepth(0), miThreadId(0), mbInUse(true) {}
+
+	ProfileEvent mEvents[CAPACITY];
+	/// The number of events ever written, the next goes in mEvents[miWritten % CAPACITY].
+	std::atomic<uint64_t> miWritten;
+	/// The number of open markers, only touched by the owning thread.
+	unsigned int miDepth;
+
+	unsigned int miThreadId;
+	std::string mName;
+	/// False once the thread has exited, so the next new thread can take the buffer over.
+	std::atomic<bool> mbInUse;
+};
+
+/**
+*  @brief The recent per frame times of one marker on the frame thread.
+*/
+struct ProfileMarkerHistory
+{
+	static const unsigned int HISTORY_SIZE = 240;
+
+	ProfileMarkerHistory() : mpName(nullptr), miDepth(0), miStartOffset(0), miCount(0), miNext(0), mLastMs(0.0f) {}
+
+	const char* mpName;
+	unsigned int miDepth;
+	/// When it first started in the last frame it was seen in, relative to the frame start. Used to order the overlay.
+	uint64_t miStartOffset;
+	/// Total milliseconds in each of the last frames it was seen in.
+	float mTimesMs[HISTORY_SIZE];
+	unsigned int miCount;
+	unsigned int miNext;
+	float mLastMs;
+
+	float GetPercentile(float percentile) const;
+	float GetMax() const;
+};
+
+/**
+*  @brief Collects the markers from every thread.
+*
+*  Marker names must be string literals, or otherwise outlive the profiler.
+*/
+class Profiler
+{
+public:
+	/// The name frame times are kept under in the marker histories.
+	static const char* const FRAME_MARKER;
+
+	static Profiler& Get()
+	{
+		static Profiler instance;
+		return instance;
+	}
+
+	/// Nanoseconds on a monotonic clock, from when the profiler was first used.
+	static uint64_t Now();
+
+	void SetEnabled(bool enabled) { mbEnabled.store(enabled, std::memory_order_relaxed); }
+	bool IsEnabled() const { return mbEnabled.load(std::memory_order_relaxed); }
+
+	ProfilerThreadBuffer* GetThreadBuffer();
+	void SetThreadName(const char* name);
+
+	void BeginFrame();
+	void EndFrame();
+
+	const std::vector<ProfileMarkerHistory*>& GetMarkers() const { return mMarkerOrder; }
+	const ProfileMarkerHistory* FindMarker(const char* name) const;
+
+	bool WriteChromeTrace(const std::string& path);
+
+	void DrawUI();
+
+private:
+	Profiler();
+	~Profiler();
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	std::atomic<bool> mbEnabled;
+
+	/// Every thread buffer ever created, they are reused but never freed until shutdown.
+	std::mutex mMutex;
+	std::vector<ProfilerThreadBuffer*> mThreads;
+
+	/// The frame thread's buffer and where the current frame's events start in it.
+	ProfilerThreadBuffer* mpFrameThread;
+	uint64_t miFrameFirstEvent;
+	uint64_t miFrameStart;
+
+	std::unordered_map<const char*, ProfileMarkerHistory> mMarkers;
+	/// The markers as the overlay shows them, parents above their children.
+	std::vector<ProfileMarkerHistory*> mMarkerOrder;
+	/// Scratch for EndFrame, kept to save reallocating it every frame.
+	std::unordered_map<const char*, double> mFrameTotals;
+
+	/// The result of the last WriteChromeTrace, for the overlay.
+	std::string mLastTrace;
+};
+
+/**
+*  @brief Records the time from its construction to its destruction as a marker.
+*/
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name)
+	{
+		Profiler& profiler = Profiler::Get();
+		if (!profiler.IsEnabled())
+		{
+			mpBuffer = nullptr;
+			return;
+		}
+		mpBuffer = profiler.GetThreadBuffer();
+		mpName = name;
+		miDepth = mpBuffer->miDepth++;
+		miStart = Profiler::Now();
+	}
+
+	~ProfileScope()
+	{
+		if (!mpBuffer)
+			return;
+
+		const uint64_t end = Profiler::Now();
+		const uint64_t index = mpBuffer->miWritten.load(std::memory_order_relaxed);
+		ProfileEvent& event = mpBuffer->mEvents[index & (ProfilerThreadBuffer::CAPACITY - 1)];
+		event.mpName = mpName;
+		event.miStart = miStart;
+		event.miEnd = end;
+		event.miDepth = miDepth;
+		mpBuffer->miWritten.store(index + 1, std::memory_order_release);
+		mpBuffer->miDepth--;
+	}
+
+private:
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+	ProfilerThreadBuffer* mpBuffer;
+	const char* mpName;
+	uint64_t miStart;
+	unsigned int miDepth;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+/// Profiles the rest of the enclosing scope under a string literal name.
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+/// Profiles the rest of the enclosing function under its name.
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
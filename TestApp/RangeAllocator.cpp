@@ -0,0 +1,101 @@
+/**
+*  @file RangeAllocator.cpp
+*  @brief Hands out ranges of a fixed size resource, like a buffer, without touching the resource itself.
+*
+*  @bug No known bugs.
+*/
+#include "RangeAllocator.h"
+
+RangeAllocator::RangeAllocator(unsigned int capacity)
+{
+	Reset(capacity);
+}
+
+/**
+*  @brief Frees everything and changes the capacity.
+*
+*  @param capacity The size of the resource being allocated from.
+*/
+void RangeAllocator::Reset(unsigned int capacity)
+{
+	mFreeBlocks.clear();
+	miCapacity = capacity;
+	miUsed = 0;
+	if (capacity > 0)
+		mFreeBlocks[0] = capacity;
+}
+
+/**
+*  @brief Allocates a range from the first free block big enough.
+*
+*  @param size The size of the range, must be greater than 0.
+*  @return The offset of the range, or INVALID_OFFSET if there isn't a big enough block.
+*/
+unsigned int RangeAllocator::Allocate(unsigned int size)
+{
+	if (size == 0)
+		return INVALID_OFFSET;
+
+	for (std::map<unsigned int, unsigned int>::iterator it = mFreeBlocks.begin(); it != mFreeBlocks.end(); ++it)
+	{
+		if (it->second < size)
+			continue;
+
+		const unsigned int offset = it->first;
+		const unsigned int remaining = it->second - size;
+		mFreeBlocks.erase(it);
+		if (remaining > 0)
+			mFreeBlocks[offset + size] = remaining;
+
+		miUsed += size;
+		return offset;
+	}
+	return INVALID_OFFSET;
+}
+
+/**
+*  @brief Gives a range back, merging it with any free neighbours.
+*
+*  @param offset The offset returned by Allocate.
+*  @param size The size it was allocated with.
+*/
+void RangeAllocator::Free(unsigned int offset, unsigned int size)
+{
+	if (offset == INVALID_OFFSET || size == 0)
+		return;
+
+	miUsed -= size;
+	std::map<unsigned int, unsigned int>::iterator next = mFreeBlocks.lower_bound(offset);
+
+	// Merge with the following block
+	if (next != mFreeBlocks.end() && offset + size == next->first)
+	{
+		size += next->second;
+		next = mFreeBlocks.erase(next);
+	}
+
+	// Merge with the preceding block
+	if (next != mFreeBlocks.begin())
+	{
+		std::map<unsigned int, unsigned int>::iterator previous = next;
+		--previous;
+		if (previous->first + previous->second == offset)
+		{
+			previous->second += size;
+			return;
+		}
+	}
+
+	mFreeBlocks[offset] = size;
+}
+
+unsigned int RangeAllocator::GetLargestFreeBlock() const
+{
+	unsigned int largest = 0;
+	for (std::map<unsigned int, unsigned int>::const_iterator it = mFreeBlocks.begin(); it != mFreeBlocks.end(); ++it)
+	{
+		if (it->second > largest)
+			largest = it->second;
+	}
+	return largest;
+}
@@ -0,0 +1,38 @@
+/**
+*  @file RangeAllocator.h
+*  @brief Hands out ranges of a fixed size resource, like a buffer, without touching the resource itself.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <map>
+
+/**
+*  @brief First fit allocator of [offset, offset + size) ranges within a fixed capacity.
+*
+*  Free ranges are kept sorted by offset and merged with their neighbours when freed, so the
+*  space can be reused after models are unloaded. Units are whatever the caller wants, vertices, indices or bytes.
+*/
+class RangeAllocator
+{
+public:
+	static const unsigned int INVALID_OFFSET = 0xffffffff;
+
+	explicit RangeAllocator(unsigned int capacity = 0);
+
+	void Reset(unsigned int capacity);
+
+	unsigned int Allocate(unsigned int size);
+	void Free(unsigned int offset, unsigned int size);
+
+	unsigned int GetCapacity() const { return miCapacity; }
+	unsigned int GetUsed() const { return miUsed; }
+	unsigned int GetNumFreeBlocks() const { return (unsigned int)mFreeBlocks.size(); }
+	unsigned int GetLargestFreeBlock() const;
+
+private:
+	/// Free ranges, offset to size.
+	std::map<unsigned int, unsigned int> mFreeBlocks;
+	unsigned int miCapacity;
+	unsigned int miUsed;
+};
@@ -0,0 +1,533 @@
+/**
+*  @file RenderGraph.cpp
+*  @brief Orders a frame's passes from what they read and write, leaves out the ones nothing uses
+*  and shares render targets between passes whose targets are never needed at the same time.
+*
+*  @bug No known bugs.
+*/
+#include "RenderGraph.h"
+#include "Log.h"
+#include <algorithm>
+
+/// The most render targets a pass can write at once, as many as D3D11 can bind.
+static const unsigned int MAX_PASS_OUTPUTS = 8;
+/// The most texture slots a pass can read from, Execute tracks which are bound in a mask.
+static const unsigned int MAX_INPUT_SLOTS = 32;
+/// Render targets are cleared to this when their life starts.
+static const float CLEAR_COLOUR[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+RenderGraph::RenderGraph() :
+	mStats(),
+	mbAliasing(true),
+	mbCompiled(false)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	// ReleaseTextures needs the device, by now it's too late to release them
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		if (mTextures[i].mpTexture)
+		{
+			LOG_WARNING << "Render graph destroyed without releasing its textures";
+			break;
+		}
+	}
+}
+
+void RenderGraph::Reset()
+{
+	mResources.clear();
+	mPasses.clear();
+	mOrder.clear();
+	mbCompiled = false;
+}
+
+RenderGraphResource RenderGraph::CreateTarget(const std::string& name, const RenderGraphTargetDesc& desc)
+{
+	Resource resource;
+	resource.mName = name;
+	resource.mDesc = desc;
+	resource.mpImported = nullptr;
+	resource.miFirstUse = NONE;
+	resource.miLastUse = NONE;
+	resource.miTexture = NONE;
+	mResources.push_back(resource);
+	return (RenderGraphResource)(mResources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::Import(const std::string& name, GraphicsTexture* texture)
+{
+	const RenderGraphResource resource = CreateTarget(name, RenderGraphTargetDesc());
+	mResources[resource].mpImported = texture;
+	return resource;
+}
+
+unsigned int RenderGraph::AddPass(const std::string& name, const ExecuteFunction& execute)
+{
+	Pass pass;
+	pass.mName = name;
+	pass.mExecute = execute;
+	pass.mDepth = NONE;
+	pass.mbCulled = false;
+	mPasses.push_back(pass);
+	return (unsigned int)(mPasses.size() - 1);
+}
+
+void RenderGraph::Read(unsigned int pass, RenderGraphResource resource, unsigned int slot)
+{
+	Input input;
+	input.mResource = resource;
+	input.miSlot = slot;
+	mPasses[pass].mInputs.push_back(input);
+	mResources[resource].mReaders.push_back(pass);
+}
+
+void RenderGraph::Write(unsigned int pass, RenderGraphResource resource)
+{
+	mPasses[pass].mOutputs.push_back(resource);
+	mResources[resource].mWriters.push_back(pass);
+}
+
+void RenderGraph::WriteDepth(unsigned int pass, RenderGraphResource resource)
+{
+	mPasses[pass].mDepth = resource;
+	mResources[resource].mWriters.push_back(pass);
+}
+
+/**
+*  @brief Works out the order, culling, lifetimes, texture sharing and unbinds for the passes declared.
+*
+*  Only touches the CPU, the textures are created in Execute.
+*  @return false if the passes can't be ordered, e.g. one reads what it writes.
+*/
+bool RenderGraph::Compile()
+{
+	mbCompiled = false;
+	mStats = RenderGraphStats();
+	mStats.miPasses = (unsigned int)mPasses.size();
+
+	// Compiling again, e.g. with aliasing changed, starts over
+	mOrder.clear();
+	for (size_t i = 0; i < mResources.size(); i++)
+	{
+		mResources[i].miFirstUse = NONE;
+		mResources[i].miLastUse = NONE;
+		mResources[i].miTexture = NONE;
+	}
+
+	for (size_t i = 0; i < mPasses.size(); i++)
+	{
+		Pass& pass = mPasses[i];
+		pass.mClears.clear();
+		pass.mUnbinds.clear();
+		if (pass.mOutputs.size() > MAX_PASS_OUTPUTS)
+		{
+			LOG_ERROR << "Render graph pass " << pass.mName << " writes more than " << MAX_PASS_OUTPUTS << " targets";
+			return false;
+		}
+		for (size_t j = 0; j < pass.mInputs.size(); j++)
+		{
+			if (pass.mInputs[j].miSlot >= MAX_INPUT_SLOTS)
+			{
+				LOG_ERROR << "Render graph pass " << pass.mName << " reads into slot " << pass.mInputs[j].miSlot;
+				return false;
+			}
+		}
+	}
+
+	CullPasses();
+	if (!SortPasses())
+		return false;
+	FindLifetimes();
+	AssignTextures();
+	FindUnbinds();
+
+	mbCompiled = true;
+	return true;
+}
+
+/**
+*  @brief Keeps the passes that write an imported resource, and every pass they depend on.
+*/
+void RenderGraph::CullPasses()
+{
+	std::vector<unsigned int> work;
+	for (unsigned int i = 0; i < mPasses.size(); i++)
+	{
+		mPasses[i].mbCulled = true;
+		for (size_t j = 0; j < mResources.size(); j++)
+		{
+			if (mResources[j].mpImported && WritesResource(mPasses[i], (RenderGraphResource)j))
+			{
+				mPasses[i].mbCulled = false;
+				work.push_back(i);
+				break;
+			}
+		}
+	}
+
+	// What a kept pass reads has to be written, and what it writes may build on an earlier write
+	while (!work.empty())
+	{
+		const Pass& pass = mPasses[work.back()];
+		work.pop_back();
+
+		std::vector<RenderGraphResource> used(pass.mOutputs);
+		for (size_t i = 0; i < pass.mInputs.size(); i++)
+			used.push_back(pass.mInputs[i].mResource);
+		if (pass.mDepth != NONE)
+			used.push_back(pass.mDepth);
+
+		for (size_t i = 0; i < used.size(); i++)
+		{
+			const std::vector<unsigned int>& writers = mResources[used[i]].mWriters;
+			for (size_t w = 0; w < writers.size(); w++)
+			{
+				if (mPasses[writers[w]].mbCulled)
+				{
+					mPasses[writers[w]].mbCulled = false;
+					work.push_back(writers[w]);
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < mPasses.size(); i++)
+	{
+		if (mPasses[i].mbCulled)
+			mStats.miCulledPasses++;
+	}
+}
+
+/**
+*  @brief Orders the passes that weren't culled so each runs after everything it reads is written.
+*
+*  A read sees every write to the resource, and passes writing the same resource run in the order
+*  they were declared. Otherwise passes keep the order they were declared in.
+*  @return false if there's a cycle.
+*/
+bool RenderGraph::SortPasses()
+{
+	const unsigned int numPasses = (unsigned int)mPasses.size();
+	std::vector<std::vector<unsigned int>> next(numPasses);
+	std::vector<unsigned int> numBefore(numPasses, 0);
+	for (size_t r = 0; r < mResources.size(); r++)
+	{
+		const Resource& resource = mResources[r];
+		for (size_t w = 0; w < resource.mWriters.size(); w++)
+		{
+			const unsigned int writer = resource.mWriters[w];
+			if (mPasses[writer].mbCulled)
+				continue;
+
+			if (w + 1 < resource.mWriters.size() && resource.mWriters[w + 1] != writer)
+			{
+				next[writer].push_back(resource.mWriters[w + 1]);
+				numBefore[resource.mWriters[w + 1]]++;
+			}
+			for (size_t i = 0; i < resource.mReaders.size(); i++)
+			{
+				next[writer].push_back(resource.mReaders[i]);
+				numBefore[resource.mReaders[i]]++;
+			}
+		}
+	}
+
+	// Kahn's algorithm, taking the earliest declared of the passes ready to run
+	unsigned int numKept = 0;
+	std::vector<bool> done(numPasses, false);
+	for (unsigned int i = 0; i < numPasses; i++)
+	{
+		if (!mPasses[i].mbCulled)
+			numKept++;
+	}
+	while (mOrder.size() < numKept)
+	{
+		unsigned int ready = NONE;
+		for (unsigned int i = 0; i < numPasses && ready == NONE; i++)
+		{
+			if (!done[i] && !mPasses[i].mbCulled && numBefore[i] == 0)
+				ready = i;
+		}
+		if (ready == NONE)
+		{
+			LOG_ERROR << "Render graph passes depend on each other in a cycle, e.g. one reads what it writes";
+			mOrder.clear();
+			return false;
+		}
+
+		done[ready] = true;
+		mOrder.push_back(ready);
+		for (size_t i = 0; i < next[ready].size(); i++)
+			numBefore[next[ready][i]]--;
+	}
+	return true;
+}
+
+/**
+*  @brief Finds the first and last pass, in execution order, that uses each render target.
+*/
+void RenderGraph::FindLifetimes()
+{
+	for (unsigned int i = 0; i < mOrder.size(); i++)
+	{
+		Pass& pass = mPasses[mOrder[i]];
+		for (size_t r = 0; r < mResources.size(); r++)
+		{
+			Resource& resource = mResources[r];
+			if (resource.mpImported || !UsesResource(pass, (RenderGraphResource)r))
+				continue;
+
+			// Its life starts here, so its contents start here too
+			if (resource.miFirstUse == NONE)
+			{
+				resource.miFirstUse = i;
+				pass.mClears.push_back((RenderGraphResource)r);
+			}
+			resource.miLastUse = i;
+		}
+	}
+}
+
+/**
+*  @brief Gives each render target a texture, sharing one between targets of the same size and
+*  format whose lifetimes don't overlap.
+*
+*  Textures from earlier frames are reused where they fit, so a graph that doesn't change creates
+*  nothing after its first frame.
+*/
+void RenderGraph::AssignTextures()
+{
+	// Entries without a texture were never created or have been released, they're free to drop
+	for (size_t i = 0; i < mTextures.size();)
+	{
+		if (!mTextures[i].mpTexture)
+		{
+			mTextures.erase(mTextures.begin() + i);
+			continue;
+		}
+		mTextures[i].mbUsed = false;
+		mTextures[i].miBusyUntil = NONE;
+		i++;
+	}
+
+	// In the order their lives start, each takes a texture the last user has finished with
+	std::vector<RenderGraphResource> targets;
+	for (size_t r = 0; r < mResources.size(); r++)
+	{
+		if (!mResources[r].mpImported && mResources[r].miFirstUse != NONE)
+			targets.push_back((RenderGraphResource)r);
+	}
+	std::stable_sort(targets.begin(), targets.end(), [this](RenderGraphResource a, RenderGraphResource b)
+	{
+		return mResources[a].miFirstUse < mResources[b].miFirstUse;
+	});
+
+	for (size_t t = 0; t < targets.size(); t++)
+	{
+		Resource& resource = mResources[targets[t]];
+		unsigned int chosen = NONE;
+		for (unsigned int i = 0; i < mTextures.size(); i++)
+		{
+			const PooledTexture& texture = mTextures[i];
+			if (!(texture.mDesc == resource.mDesc))
+				continue;
+
+			const bool free = !texture.mbUsed || (mbAliasing && texture.miBusyUntil < resource.miFirstUse);
+			if (!free)
+				continue;
+
+			// Prefer one already shared this frame, so the others can go unused and be released
+			if (chosen == NONE || (texture.mbUsed && !mTextures[chosen].mbUsed))
+				chosen = i;
+		}
+
+		if (chosen == NONE)
+		{
+			PooledTexture texture;
+			texture.mDesc = resource.mDesc;
+			texture.mpTexture = nullptr;
+			texture.miUnusedFrames = 0;
+			mTextures.push_back(texture);
+			chosen = (unsigned int)(mTextures.size() - 1);
+		}
+
+		mTextures[chosen].mbUsed = true;
+		mTextures[chosen].miBusyUntil = resource.miLastUse;
+		resource.miTexture = chosen;
+
+		const size_t bytes = TextureSizeInBytes(resource.mDesc.meFormat, resource.mDesc.miWidth, resource.mDesc.miHeight, 1);
+		mStats.miTransients++;
+		mStats.miTransientBytes += bytes;
+	}
+
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		if (!mTextures[i].mbUsed)
+			continue;
+		mStats.miTextures++;
+		mStats.miAliasedBytes += TextureSizeInBytes(mTextures[i].mDesc.meFormat, mTextures[i].mDesc.miWidth, mTextures[i].mDesc.miHeight, 1);
+	}
+
+	for (unsigned int i = 0; i < mOrder.size(); i++)
+	{
+		size_t live = 0;
+		for (size_t t = 0; t < targets.size(); t++)
+		{
+			const Resource& resource = mResources[targets[t]];
+			if (resource.miFirstUse <= i && i <= resource.miLastUse)
+				live += TextureSizeInBytes(resource.mDesc.meFormat, resource.mDesc.miWidth, resource.mDesc.miHeight, 1);
+		}
+		mStats.miPeakLiveBytes = std::max(mStats.miPeakLiveBytes, live);
+	}
+}
+
+/**
+*  @brief Finds the texture slots each pass has to unbind afterwards.
+*
+*  A texture can't be bound as an input while a later pass renders to it. With sharing that can
+*  be another render target given the same texture, not just the same resource.
+*/
+void RenderGraph::FindUnbinds()
+{
+	for (unsigned int i = 0; i < mOrder.size(); i++)
+	{
+		Pass& pass = mPasses[mOrder[i]];
+		for (size_t in = 0; in < pass.mInputs.size(); in++)
+		{
+			const Resource& input = mResources[pass.mInputs[in].mResource];
+			bool writtenLater = false;
+			for (unsigned int j = i + 1; j < mOrder.size() && !writtenLater; j++)
+			{
+				const Pass& later = mPasses[mOrder[j]];
+				for (size_t r = 0; r < mResources.size() && !writtenLater; r++)
+				{
+					const Resource& output = mResources[r];
+					const bool sameTexture = input.mpImported ? output.mpImported == input.mpImported : (!output.mpImported && output.miTexture == input.miTexture);
+					writtenLater = sameTexture && WritesResource(later, (RenderGraphResource)r);
+				}
+			}
+
+			if (writtenLater)
+			{
+				pass.mUnbinds.push_back(pass.mInputs[in].miSlot);
+				mStats.miUnbinds++;
+			}
+		}
+	}
+}
+
+/**
+*  @brief Runs the passes in order, creating any textures they need and releasing those unused for a while.
+*
+*  Each pass has its render targets cleared when their life starts, its outputs and inputs bound,
+*  and any inputs a later pass writes unbound afterwards. Inputs still bound at the end are unbound
+*  too, as the next frame will write them. The last pass's outputs are left bound.
+*/
+void RenderGraph::Execute(GraphicsDevice* device)
+{
+	if (!mbCompiled)
+		return;
+
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		PooledTexture& texture = mTextures[i];
+		if (!texture.mbUsed)
+		{
+			if (texture.mpTexture && ++texture.miUnusedFrames > UNUSED_FRAMES_BEFORE_RELEASE)
+			{
+				device->ReleaseTexture(texture.mpTexture);
+				texture.mpTexture = nullptr;
+			}
+			continue;
+		}
+
+		texture.miUnusedFrames = 0;
+		if (!texture.mpTexture)
+		{
+			TextureDesc desc;
+			desc.miWidth = texture.mDesc.miWidth;
+			desc.miHeight = texture.mDesc.miHeight;
+			desc.miMipLevels = 1;
+			desc.meFormat = texture.mDesc.meFormat;
+			desc.meUsage = USAGE_DEFAULT;
+			desc.miFlags = TEXTURE_RENDER_TARGET;
+			texture.mpTexture = device->CreateTexture(desc, nullptr, 0);
+		}
+	}
+
+	uint32_t boundSlots = 0;
+	for (size_t i = 0; i < mOrder.size(); i++)
+	{
+		const Pass& pass = mPasses[mOrder[i]];
+
+		for (size_t c = 0; c < pass.mClears.size(); c++)
+			device->ClearRenderTarget(GetTexture(pass.mClears[c]), CLEAR_COLOUR);
+
+		GraphicsTexture* targets[MAX_PASS_OUTPUTS];
+		for (size_t o = 0; o < pass.mOutputs.size(); o++)
+			targets[o] = GetTexture(pass.mOutputs[o]);
+		device->SetRenderTargets(targets, (unsigned int)pass.mOutputs.size(), pass.mDepth != NONE ? GetTexture(pass.mDepth) : nullptr);
+
+		for (size_t in = 0; in < pass.mInputs.size(); in++)
+		{
+			device->SetPSTexture(pass.mInputs[in].miSlot, GetTexture(pass.mInputs[in].mResource));
+			boundSlots |= 1u << pass.mInputs[in].miSlot;
+		}
+
+		if (pass.mExecute)
+			pass.mExecute(device);
+
+		for (size_t u = 0; u < pass.mUnbinds.size(); u++)
+		{
+			device->SetPSTexture(pass.mUnbinds[u], nullptr);
+			boundSlots &= ~(1u << pass.mUnbinds[u]);
+		}
+	}
+
+	for (unsigned int slot = 0; slot < MAX_INPUT_SLOTS; slot++)
+	{
+		if (boundSlots & (1u << slot))
+			device->SetPSTexture(slot, nullptr);
+	}
+}
+
+void RenderGraph::ReleaseTextures(GraphicsDevice* device)
+{
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		if (mTextures[i].mpTexture)
+			device->ReleaseTexture(mTextures[i].mpTexture);
+	}
+	mTextures.clear();
+
+	// The resources point into the textures
+	mbCompiled = false;
+}
+
+GraphicsTexture* RenderGraph::GetTexture(RenderGraphResource resource) const
+{
+	const Resource& r = mResources[resource];
+	if (r.mpImported)
+		return r.mpImported;
+	return r.miTexture != NONE ? mTextures[r.miTexture].mpTexture : nullptr;
+}
+
+bool RenderGraph::UsesResource(const Pass& pass, RenderGraphResource resource) const
+{
+	if (WritesResource(pass, resource))
+		return true;
+	for (size_t i = 0; i < pass.mInputs.size(); i++)
+	{
+		if (pass.mInputs[i].mResource == resource)
+			return true;
+	}
+	return false;
+}
+
+bool RenderGraph::WritesResource(const Pass& pass, RenderGraphResource resource) const
+{
+	return pass.mDepth == resource || std::find(pass.mOutputs.begin(), pass.mOutputs.end(), resource) != pass.mOutputs.end();
+}
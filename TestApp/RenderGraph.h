@@ -0,0 +1,174 @@
+/**
+*  @file RenderGraph.h
+*  @brief Orders a frame's passes from what they read and write, leaves out the ones nothing uses
+*  and shares render targets between passes whose targets are never needed at the same time.
+*
+*  Each frame the passes are declared with the resources they read and write, then Compile works
+*  out the rest on the CPU alone: the order, which passes can be culled, when each render target is
+*  first and last used, which targets can share a texture, and what has to be unbound between passes.
+*  Execute then creates any textures that are missing and runs the passes.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include "GraphicsDevice.h"
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// Identifies a resource declared in a RenderGraph, valid until the next Reset.
+typedef unsigned int RenderGraphResource;
+
+/**
+*  @brief A render target the graph creates, it only lasts for the frame.
+*/
+struct RenderGraphTargetDesc
+{
+	RenderGraphTargetDesc() : miWidth(0), miHeight(0), meFormat(TEXTURE_FORMAT_RGBA8) {}
+	RenderGraphTargetDesc(unsigned int width, unsigned int height, TextureFormat format) : miWidth(width), miHeight(height), meFormat(format) {}
+
+	bool operator==(const RenderGraphTargetDesc& other) const { return miWidth == other.miWidth && miHeight == other.miHeight && meFormat == other.meFormat; }
+
+	unsigned int miWidth;
+	unsigned int miHeight;
+	TextureFormat meFormat;
+};
+
+/**
+*  @brief What the last Compile found.
+*/
+struct RenderGraphStats
+{
+	unsigned int miPasses;
+	unsigned int miCulledPasses;
+	/// Render targets used by the passes that run.
+	unsigned int miTransients;
+	/// Textures those were given, fewer if some share.
+	unsigned int miTextures;
+	/// The memory the render targets would need with a texture each.
+	size_t miTransientBytes;
+	/// The memory the shared textures need.
+	size_t miAliasedBytes;
+	/// The most memory live at any one pass, the least sharing could get down to.
+	size_t miPeakLiveBytes;
+	/// Shader inputs unbound because a later pass writes to them.
+	unsigned int miUnbinds;
+};
+
+class RenderGraph
+{
+public:
+	/// Draws a pass. The targets it writes and the textures it reads are already bound.
+	typedef std::function<void(GraphicsDevice* device)> ExecuteFunction;
+
+	/// How many frames an unused texture is kept in case it's needed again.
+	static const unsigned int UNUSED_FRAMES_BEFORE_RELEASE = 60;
+
+	RenderGraph();
+	~RenderGraph();
+
+	/// Forgets the passes and resources declared, ready for the next frame. The textures are kept.
+	void Reset();
+
+	RenderGraphResource CreateTarget(const std::string& name, const RenderGraphTargetDesc& desc);
+	/// A texture the graph doesn't own, e.g. the back buffer. Passes that write one are never culled.
+	RenderGraphResource Import(const std::string& name, GraphicsTexture* texture);
+
+	unsigned int AddPass(const std::string& name, const ExecuteFunction& execute);
+	/// The pass samples the resource, bound to the pixel shader texture slot.
+	void Read(unsigned int pass, RenderGraphResource resource, unsigned int slot);
+	/// The pass renders to the resource, bound after the targets it already writes.
+	void Write(unsigned int pass, RenderGraphResource resource);
+	void WriteDepth(unsigned int pass, RenderGraphResource resource);
+
+	/// Whether render targets whose lifetimes don't overlap may share a texture.
+	void SetAliasing(bool aliasing) { mbAliasing = aliasing; }
+	bool IsAliasing() const { return mbAliasing; }
+
+	bool Compile();
+	void Execute(GraphicsDevice* device);
+	/// Releases every texture the graph created, e.g. before the device's size changes.
+	void ReleaseTextures(GraphicsDevice* device);
+
+	const RenderGraphStats& GetStats() const { return mStats; }
+	/// The passes that run, in the order they run, after Compile.
+	const std::vector<unsigned int>& GetOrder() const { return mOrder; }
+	const std::string& GetPassName(unsigned int pass) const { return mPasses[pass].mName; }
+	bool IsCulled(unsigned int pass) const { return mPasses[pass].mbCulled; }
+	/// The texture slot a render target was given after Compile, targets with the same one share a texture.
+	unsigned int GetTextureIndex(RenderGraphResource resource) const { return mResources[resource].miTexture; }
+	/// Only valid inside a pass's ExecuteFunction.
+	GraphicsTexture* GetTexture(RenderGraphResource resource) const;
+
+private:
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	static const unsigned int NONE = ~0u;
+
+	struct Resource
+	{
+		std::string mName;
+		RenderGraphTargetDesc mDesc;
+		/// Set for imported resources.
+		GraphicsTexture* mpImported;
+		/// Passes that write it, in the order they were declared.
+		std::vector<unsigned int> mWriters;
+		std::vector<unsigned int> mReaders;
+
+		// Found by Compile
+		unsigned int miFirstUse;
+		unsigned int miLastUse;
+		unsigned int miTexture;
+	};
+
+	struct Input
+	{
+		RenderGraphResource mResource;
+		unsigned int miSlot;
+	};
+
+	struct Pass
+	{
+		std::string mName;
+		ExecuteFunction mExecute;
+		std::vector<Input> mInputs;
+		std::vector<RenderGraphResource> mOutputs;
+		RenderGraphResource mDepth;
+
+		// Found by Compile
+		bool mbCulled;
+		/// Render targets that start their life here, cleared before the pass.
+		std::vector<RenderGraphResource> mClears;
+		/// Texture slots to unbind after the pass, a later pass writes what they hold.
+		std::vector<unsigned int> mUnbinds;
+	};
+
+	/// A texture render targets are given, it lasts between frames.
+	struct PooledTexture
+	{
+		RenderGraphTargetDesc mDesc;
+		GraphicsTexture* mpTexture;
+		/// The last pass, in execution order, of the render target using it this frame.
+		unsigned int miBusyUntil;
+		bool mbUsed;
+		unsigned int miUnusedFrames;
+	};
+
+	bool SortPasses();
+	void CullPasses();
+	void FindLifetimes();
+	void AssignTextures();
+	void FindUnbinds();
+	bool UsesResource(const Pass& pass, RenderGraphResource resource) const;
+	bool WritesResource(const Pass& pass, RenderGraphResource resource) const;
+
+	std::vector<Resource> mResources;
+	std::vector<Pass> mPasses;
+	std::vector<unsigned int> mOrder;
+	std::vector<PooledTexture> mTextures;
+	RenderGraphStats mStats;
+	bool mbAliasing;
+	bool mbCompiled;
+};
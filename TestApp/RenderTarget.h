@@ -1,7 +1,6 @@
 #pragma once
 #include "Texture.h"
-#include <D3D11.h>
-#include "DirectXDevice.h"
+#include "GraphicsDevice.h"
 
 class RenderTarget : public Texture
 {
@@ -9,16 +8,10 @@ public:
 	RenderTarget();
 	~RenderTarget();
 
-	bool Initialise(DirectXDevice* device);
+	bool Initialise(GraphicsDevice* device);
 	bool Release();
 
-	ID3D11RenderTargetView* GetRenderTargetView() { return mpRenderTargetView; }
-	ID3D11RenderTargetView** GetAddressOfRenderTargetView() { return &mpRenderTargetView; }
-
 	void SetDimensionsToFullscreen();
 
-	void Clear(DirectXDevice* device);
-
-private:
-	ID3D11RenderTargetView*	mpRenderTargetView;
-};
\ No newline at end of file
+	void Clear(GraphicsDevice* device);
+};
@@ -21,20 +21,37 @@
 #include "VertexShader.h"
 
 #include "PixelShaderPfx.h"
+#include "PixelShaderPfxCompact.h"
 #include "VertexShaderPfx.h"
 
 #include "GBuffer_PixelShader.h"
+#include "GBuffer_CompactPixelShader.h"
 #include "GBuffer_VertexShader.h"
+#include "GBuffer_PackedVertexShader.h"
 
 #include "Camera.h"
 
 #include "ImGui\imgui.h"
 
 #include "Log.h"
+#include "BinaryLog.h"
+#include "Config.h"
 #include "Globals.h"
+#include "TextureCache.h"
+#include "Profiler.h"
 
+// How long each Render may spend creating the model's buffers and textures while it loads.
+static const float MODEL_UPLOAD_BUDGET_MS = 2.0f;
+// How many frames a texture no model uses stays cached, in case a model that uses it loads again.
+static const unsigned int TEXTURE_EVICT_FRAMES = 300;
 
-TestAppGame::TestAppGame() : Game()
+
+TestAppGame::TestAppGame() : Game(),
+	mbOccludersAdded(false),
+	mbCompactGBuffer(false),
+	mDrawStats(),
+	mGraphStats(),
+	mbBinaryLogChanged(false)
 {
 }
 
@@ -48,34 +65,87 @@ TestAppGame::~TestAppGame()
 void TestAppGame::Initialise(Window_DX * win)
 {
 	mBoostMultiplier = 1.0f;
+	LoadSettings();
 	// Init DirectX.
 	LOG_INFO << "Initialise the direct X device";
 	mpDirectX = new DirectXDevice(win);
 	mpDirectX->Initialise(win->GetWidth(), win->GetHeight());
+	mpGraphics = mpDirectX;
 
 	// Parent init.
 	Game::Initialise(win);
 
-	// Create Render Targets
-	for (int i = 0; i < RT::Count; i++)
-	{
-		mpRenderTargets[i] = new RenderTarget();
-		mpRenderTargets[i]->SetDimensionsToFullscreen();
-		mpRenderTargets[i]->SetFormat(DXGI_FORMAT_R16G16B16A16_FLOAT);
-		mpRenderTargets[i]->Initialise(mpDirectX);
-	}
+	monitor = 1;
+	// Create Camera
+	mpCamera = new Camera();
+}
 
+/**
+*  @brief Initialises the game to render through a device with no window, e.g. a NullGraphicsDevice.
+*
+*  @param device The device to render with, owned by the caller.
+*/
+void TestAppGame::InitialiseHeadless(GraphicsDevice* device)
+{
+	mBoostMultiplier = 1.0f;
+	LoadSettings();
 
-	for (int i = 0; i < GBUFFER_SIZE; i++)
-	{
-		mpGBuffer[i] = mpRenderTargets[RT::GBufferStart + i]->GetRenderTargetView();
-	}
+	// Parent init.
+	Game::InitialiseHeadless(device);
 
 	monitor = 1;
 	// Create Camera
 	mpCamera = new Camera();
 }
 
+/**
+*  @brief Reads the app settings, which are watched for changes from then on.
+*/
+void TestAppGame::LoadSettings()
+{
+	mSettings.ReadInFromFile("../Resources/Settings/AppSettings.cfg");
+
+	mBinaryLogSetting = mSettings.GetHandle("BINARY_LOG");
+	mBinaryLogPathSetting = mSettings.GetHandle("BINARY_LOG_PATH");
+	mBinaryLogFileMBSetting = mSettings.GetHandle("BINARY_LOG_FILE_MB");
+	mBinaryLogFilesSetting = mSettings.GetHandle("BINARY_LOG_FILES");
+
+	// Turning the binary log on or off, or changing its files, takes effect straight away
+	const ConfigHandle binaryLogSettings[] = { mBinaryLogSetting, mBinaryLogPathSetting, mBinaryLogFileMBSetting, mBinaryLogFilesSetting };
+	for (const ConfigHandle& setting : binaryLogSettings)
+		mSettings.AddCallback(setting, [this](const ConfigValue&) { mbBinaryLogChanged = true; });
+
+	// Update and render on separate threads, Game::Run starts or stops the render thread between frames
+	mPipelinedSetting = mSettings.GetHandle("PIPELINED_RENDERING");
+	mSettings.AddCallback(mPipelinedSetting, [this](const ConfigValue& value) { SetPipelined(value.AsBool()); });
+	SetPipelined(mSettings.Get(mPipelinedSetting).AsBool());
+
+	// The G-buffer's layout, Render declares its targets each frame so it can change at any time
+	mCompactGBufferSetting = mSettings.GetHandle("COMPACT_GBUFFER");
+	mSettings.AddCallback(mCompactGBufferSetting, [this](const ConfigValue& value) { mbCompactGBuffer = value.AsBool(); });
+	mbCompactGBuffer = mSettings.Get(mCompactGBufferSetting).AsBool();
+
+	ApplyBinaryLogSettings();
+}
+
+/**
+*  @brief Switches to the binary log if the app settings ask for it, for long runs, or back to the text log if not.
+*/
+void TestAppGame::ApplyBinaryLogSettings()
+{
+	mbBinaryLogChanged = false;
+	if (!mSettings.Get(mBinaryLogSetting).AsBool())
+	{
+		BinaryLog::Get().Close();
+		return;
+	}
+
+	const std::string& path = mSettings.Get(mBinaryLogPathSetting).AsString();
+	const int fileMB = mSettings.Get(mBinaryLogFileMBSetting).AsInt();
+	const int maxFiles = mSettings.Get(mBinaryLogFilesSetting).AsInt();
+	BinaryLog::Get().Open(path.empty() ? "TestApp" : path, (size_t)(fileMB > 0 ? fileMB : 64) * 1024 * 1024, maxFiles > 0 ? maxFiles : 0);
+}
+
 /**
 *  @brief Loads all the game assets
 *
@@ -85,23 +155,13 @@ void TestAppGame::Initialise(Window_DX * win)
 */
 void TestAppGame::LoadAssets()
 {
-	// Load the model.
-	mpModel = new Model(mpDirectX, "../Resources/Models/Sponza/sponza.obj");
+	// Load the model in the background, it's drawn piece by piece as Render uploads it
+	mpModel = new Model(mpGraphics, "../Resources/Models/Sponza/sponza.obj", 0, true, true);
+	mbOccludersAdded = false;
 	
 
 	// Create a sampler
-	D3D11_SAMPLER_DESC samplerDesc;
-	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;// D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.MipLODBias = 0.0f;
-	samplerDesc.MaxAnisotropy = 16;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-	samplerDesc.MinLOD = -FLT_MAX;
-	samplerDesc.MaxLOD = FLT_MAX;
-
-	HRESULT result = mpDirectX->GetDevice()->CreateSamplerState(&samplerDesc, &mpSamplerState);
+	mpSamplerState = mpGraphics->CreateSampler(SAMPLER_ANISOTROPIC, 16);
 
 	// Create full screen quad
 	std::vector<Vertex> vertices;
@@ -113,69 +173,79 @@ void TestAppGame::LoadAssets()
 	vertices.push_back(Vertex(-1.0f, 1.0f, 0.0f, 0.0f, 0.0f));
 	std::vector<unsigned int> indices = { 0, 1, 2, 3, 4, 5 };
 	mpFullscreenQuad = new Mesh(vertices, indices);
-	mpFullscreenQuad->SetupMesh(mpDirectX);
+	mpFullscreenQuad->SetupMesh(mpGraphics);
 	
 	// SHADERS
 	// Create shader
-	result = mpDirectX->GetDevice()->CreateVertexShader(VertexShader, sizeof(VertexShader), NULL, &mpVertexShader);
-	_ASSERT(result == S_OK);
-	result = mpDirectX->GetDevice()->CreatePixelShader(PixelShader, sizeof(PixelShader), NULL, &mpPixelShader);
-	_ASSERT(result == S_OK);
-
-	result = mpDirectX->GetDevice()->CreateVertexShader(VertexShaderPfx, sizeof(VertexShaderPfx), NULL, &mpVertexShaderPfx);
-	_ASSERT(result == S_OK);
-	result = mpDirectX->GetDevice()->CreatePixelShader(PixelShaderPfx, sizeof(PixelShaderPfx), NULL, &mpPixelShaderPfx);
-	_ASSERT(result == S_OK);
-
-	result = mpDirectX->GetDevice()->CreateVertexShader(GBuffer_VertexShader, sizeof(GBuffer_VertexShader), NULL, &mpVertexShaderGBuffer);
-	_ASSERT(result == S_OK);
-	result = mpDirectX->GetDevice()->CreatePixelShader(GBuffer_PixelShader, sizeof(GBuffer_PixelShader), NULL, &mpPixelShaderGBuffer);
-	_ASSERT(result == S_OK);
+	mpVertexShader = mpGraphics->CreateVertexShader(VertexShader, sizeof(VertexShader));
+	_ASSERT(mpVertexShader != NULL);
+	mpPixelShader = mpGraphics->CreatePixelShader(PixelShader, sizeof(PixelShader));
+	_ASSERT(mpPixelShader != NULL);
+
+	mpVertexShaderPfx = mpGraphics->CreateVertexShader(VertexShaderPfx, sizeof(VertexShaderPfx));
+	_ASSERT(mpVertexShaderPfx != NULL);
+	mpPixelShaderPfx = mpGraphics->CreatePixelShader(PixelShaderPfx, sizeof(PixelShaderPfx));
+	_ASSERT(mpPixelShaderPfx != NULL);
+	mpPixelShaderPfxCompact = mpGraphics->CreatePixelShader(PixelShaderPfxCompact, sizeof(PixelShaderPfxCompact));
+	_ASSERT(mpPixelShaderPfxCompact != NULL);
+
+	mpVertexShaderGBuffer = mpGraphics->CreateVertexShader(GBuffer_VertexShader, sizeof(GBuffer_VertexShader));
+	_ASSERT(mpVertexShaderGBuffer != NULL);
+	mpPixelShaderGBuffer = mpGraphics->CreatePixelShader(GBuffer_PixelShader, sizeof(GBuffer_PixelShader));
+	_ASSERT(mpPixelShaderGBuffer != NULL);
+	mpPixelShaderGBufferCompact = mpGraphics->CreatePixelShader(GBuffer_CompactPixelShader, sizeof(GBuffer_CompactPixelShader));
+	_ASSERT(mpPixelShaderGBufferCompact != NULL);
+	mpVertexShaderGBufferPacked = mpGraphics->CreateVertexShader(GBuffer_PackedVertexShader, sizeof(GBuffer_PackedVertexShader));
+	_ASSERT(mpVertexShaderGBufferPacked != NULL);
 
 	// set the shader objects
-	mpDirectX->GetContext()->VSSetShader(mpVertexShader, 0, 0);
-	mpDirectX->GetContext()->PSSetShader(mpPixelShader, 0, 0);
+	mpGraphics->SetVertexShader(mpVertexShader);
+	mpGraphics->SetPixelShader(mpPixelShader);
 
 	// create the input layout object
 	int liNumberOfElements = 3;
-	D3D11_INPUT_ELEMENT_DESC ied[] =
+	VertexElement ied[] =
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "POSITION", VERTEX_FORMAT_FLOAT3, 0 },
+		{ "NORMAL",   VERTEX_FORMAT_FLOAT3, 12 },
+		{ "TEXCOORD", VERTEX_FORMAT_FLOAT2, 24 },
 	};
-	result = mpDirectX->GetDevice()->CreateInputLayout(ied, liNumberOfElements, VertexShader, sizeof(VertexShader), &mpLayout);
-	_ASSERT(result == S_OK);
+	mpLayout = mpGraphics->CreateInputLayout(ied, liNumberOfElements, VertexShader, sizeof(VertexShader));
+	_ASSERT(mpLayout != NULL);
 	// Set the input layout
-	mpDirectX->GetContext()->IASetInputLayout(mpLayout);
+	mpGraphics->SetInputLayout(mpLayout);
+
+	// The layout for meshes in the PackedVertex format
+	VertexElement packedIed[] =
+	{
+		{ "POSITION", VERTEX_FORMAT_UNORM16X4, 0 },
+		{ "NORMAL",   VERTEX_FORMAT_SNORM16X2, 8 },
+		{ "TEXCOORD", VERTEX_FORMAT_HALF2,     12 },
+	};
+	mpLayoutPacked = mpGraphics->CreateInputLayout(packedIed, 3, GBuffer_PackedVertexShader, sizeof(GBuffer_PackedVertexShader));
+	_ASSERT(mpLayoutPacked != NULL);
 
 	// Render settings
 	mbFullscreen = false;
 	mbScreenStateChanged = false;
 	mbResolutionChanged = false;
+	mbFocusLost = false;
 	mbPostFx = true;
+	mbFrustumCulling = true;
+	mbOcclusionCulling = true;
 	width = SCREEN_WIDTH;
 	height = SCREEN_HEIGHT;
 
 	// Create frame buffer
 	PerFrameBuffer frameBuffer;
 
-	D3D11_BUFFER_DESC cbDesc1;
-	cbDesc1.ByteWidth = sizeof(frameBuffer);
-	cbDesc1.Usage = D3D11_USAGE_DYNAMIC;
-	cbDesc1.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cbDesc1.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	cbDesc1.MiscFlags = 0;
-	cbDesc1.StructureByteStride = 0;
-
-	// Fill in the subresource data.
-	D3D11_SUBRESOURCE_DATA InitData1;
-	InitData1.pSysMem = &frameBuffer;
-	InitData1.SysMemPitch = 0;
-	InitData1.SysMemSlicePitch = 0;
+	BufferDesc cbDesc1;
+	cbDesc1.miSize = sizeof(frameBuffer);
+	cbDesc1.meType = BUFFER_CONSTANT;
+	cbDesc1.meUsage = USAGE_DYNAMIC;
 
 	// Create the buffer.
-	mpDirectX->GetDevice()->CreateBuffer(&cbDesc1, &InitData1, &perFrameBuffer);
+	perFrameBuffer = mpGraphics->CreateBuffer(cbDesc1, &frameBuffer);
 }
 
 /**
@@ -186,43 +256,70 @@ void TestAppGame::LoadAssets()
 */
 void TestAppGame::Shutdown()
 {
+	// Nothing can be released while the render thread might be drawing with it
+	StopRenderThread();
+
 	mpFullscreenQuad->Release();
 	delete mpFullscreenQuad;
 
-	mpSamplerState->Release();
+	delete mpModel;
+	mpModel = nullptr;
+	TextureCache::Get().EvictUnreferenced();
+	TextureCache::Get().Clear();
+
+	mpGraphics->ReleaseBuffer(perFrameBuffer);
+	perFrameBuffer = nullptr;
+
+	mpGraphics->ReleaseSampler(mpSamplerState);
 	mpSamplerState = nullptr;
 
-	mpVertexShader->Release();
+	mpGraphics->ReleaseVertexShader(mpVertexShader);
 	mpVertexShader = nullptr;
 
-	mpPixelShader->Release();
+	mpGraphics->ReleasePixelShader(mpPixelShader);
 	mpPixelShader = nullptr;
 
-	mpVertexShaderPfx->Release();
+	mpGraphics->ReleaseVertexShader(mpVertexShaderPfx);
 	mpVertexShaderPfx = nullptr;
 
-	mpPixelShaderPfx->Release();
+	mpGraphics->ReleasePixelShader(mpPixelShaderPfx);
 	mpPixelShaderPfx = nullptr;
 
-	mpVertexShaderGBuffer->Release();
+	mpGraphics->ReleasePixelShader(mpPixelShaderPfxCompact);
+	mpPixelShaderPfxCompact = nullptr;
+
+	mpGraphics->ReleaseVertexShader(mpVertexShaderGBuffer);
 	mpVertexShaderGBuffer = nullptr;
 
-	mpPixelShaderGBuffer->Release();
+	mpGraphics->ReleasePixelShader(mpPixelShaderGBuffer);
 	mpPixelShaderGBuffer = nullptr;
 
-	mpLayout->Release();
+	mpGraphics->ReleasePixelShader(mpPixelShaderGBufferCompact);
+	mpPixelShaderGBufferCompact = nullptr;
+
+	mpGraphics->ReleaseVertexShader(mpVertexShaderGBufferPacked);
+	mpVertexShaderGBufferPacked = nullptr;
+
+	mpGraphics->ReleaseInputLayout(mpLayout);
 	mpLayout = nullptr;
 
+	mpGraphics->ReleaseInputLayout(mpLayoutPacked);
+	mpLayoutPacked = nullptr;
+
 	// Clean up Rendertargets
-	for (int i = 0; i < RT::Count; i++)
+	mRenderGraph.ReleaseTextures(mpGraphics);
+
+	// A headless device belongs to whoever passed it in
+	if (mpDirectX)
 	{
-		mpRenderTargets[i]->Release();
-		delete mpRenderTargets[i];
+		mpDirectX->Shutdown();
+		delete mpDirectX;
+		mpDirectX = nullptr;
 	}
-
-	mpDirectX->Shutdown();
-	delete mpDirectX;
+	mpGraphics = nullptr;
 	Game::Shutdown();
+
+	BinaryLog::Get().Close();
 }
 
 void TestAppGame::OnKeypress(int key, bool down)
@@ -266,14 +363,86 @@ void TestAppGame::OnKeypress(int key, bool down)
 }
 
 /**
-*  @brief Updates the game
+*  @brief Updates the game, and writes what the frame's Render needs into the slot it will draw.
 *
 */
 void TestAppGame::Update(float deltaTime)
 {
+	PROFILE_SCOPE("TestAppGame::Update");
+
+	FrameState& frame = mFrames[mPipeline.GetUpdateSlot()];
+	// The slot was last drawn a few frames ago, keep its stats for the UI before they're overwritten
+	mDrawStats = frame.mDrawStats;
+	mGraphStats = frame.mGraphStats;
+
+	// Pick up edits to the settings file, the binary log is only reopened once for several changed settings
+	if (mSettings.Update())
+		LOG_INFO << "Reloaded the app settings";
+	if (mbBinaryLogChanged)
+		ApplyBinaryLogSettings();
+
 	//LOG_INFO << "FPS: " << 1.0f / deltaTime;
 	mpCamera->Update(deltaTime);
 
+	// The occluders are picked by their real textures, so wait for the model to finish
+	if (!mbOccludersAdded && mpModel->GetLoadState() == MODEL_LOADED)
+	{
+		mpModel->AddOccluders(mOcclusionCuller);
+		mbOccludersAdded = true;
+	}
+
+	// Changing the window recreates the targets, so the render thread has to be done with them
+	if (mbScreenStateChanged || mbResolutionChanged)
+	{
+		mPipeline.Flush();
+		ApplyScreenChanges();
+	}
+
+	BuildFrame(frame);
+
+	// ImGui is only set up by the window
+	if (GetWindow())
+	{
+		DrawUI();
+#if defined D_USE_IMGUI
+		ImGui::Render();
+		frame.mUI.Capture(ImGui::GetDrawData(), ImGui::GetIO().DisplaySize);
+#endif
+	}
+}
+
+/**
+*  @brief Writes the camera and the culled, sorted draws into the frame's state.
+*/
+void TestAppGame::BuildFrame(FrameState& frame)
+{
+	PROFILE_SCOPE("Build frame");
+
+	frame.mPerFrame.VM = mpCamera->GetViewMatrix();
+	frame.mPerFrame.VM_Inv = glm::inverse(mpCamera->GetViewMatrix());
+	frame.mPerFrame.PM = mpCamera->GetProjectionMatrix();
+	frame.mPerFrame.PM_Inv = glm::inverse(mpCamera->GetProjectionMatrix());
+	frame.mPerFrame.CameraPosition = glm::vec4(mpCamera->GetPosition(), 1.0f);
+	frame.mbPostFx = mbPostFx;
+	frame.mbCompactGBuffer = mbCompactGBuffer;
+
+	frame.mDrawList.Clear();
+	const Frustum frustum(mpCamera->GetViewProjectionMatrix());
+	if (mbOcclusionCulling)
+	{
+		PROFILE_SCOPE("Render occluders");
+		mOcclusionCuller.RenderOccluders(mpCamera->GetViewProjectionMatrix());
+	}
+	{
+		PROFILE_SCOPE("Build draw list");
+		mpModel->AddToDrawList(frame.mDrawList, DrawList::PASS_GBUFFER, mpCamera->GetPosition(), mpCamera->GetFarPlane(),
+			mbFrustumCulling ? &frustum : nullptr, mbOcclusionCulling ? &mOcclusionCuller : nullptr, mpJobs);
+		frame.mDrawList.Sort();
+	}
+}
+
+void TestAppGame::DrawUI()
+{
 #if defined D_USE_IMGUI
 	if (ImGui::Button("Go Fullscreen"))
 	{
@@ -336,148 +505,256 @@ void TestAppGame::Update(float deltaTime)
 		GlobalSettings::Settings().imGuiAppLog.Draw("Logger", &GlobalSettings::Settings().renderLog);
 	}
 
+	static bool sbShowProfiler = false;
+	if (ImGui::Button("Show Profiler"))
+	{
+		sbShowProfiler = !sbShowProfiler;
+	}
+	if (sbShowProfiler)
+	{
+		Profiler::Get().DrawUI();
+	}
+
 	if (ImGui::Button("Toggle PostFx"))
 	{
 		mbPostFx = !mbPostFx;
 	}
+	ImGui::Checkbox("Compact G-buffer", &mbCompactGBuffer);
 
 	ImGui::InputFloat("Boost", &mBoostMultiplier);
+	mpCamera->DrawUI();
+
+	Timer* timer = GetTimer();
+	int frameCap = (int)timer->GetMaxFrameRate();
+	if (ImGui::SliderInt("Frame cap (0 is off)", &frameCap, 0, 240))
+	{
+		timer->SetMaxFrameRate(frameCap);
+	}
+	const FrameStats frameStats = timer->GetStats();
+	ImGui::Text("Frame ms over %u frames: min %.2f, avg %.2f, p99 %.2f, max %.2f", frameStats.miFrames,
+		frameStats.mMinMs, frameStats.mAverageMs, frameStats.mP99Ms, frameStats.mMaxMs);
+
+	ImGui::Checkbox("Frustum culling", &mbFrustumCulling);
+	ImGui::Checkbox("Cull with BVH", &mpModel->mbCullWithBVH);
+	ImGui::Checkbox("Occlusion culling", &mbOcclusionCulling);
+	ImGui::Text("Occluders: %u triangles, %u rasterized", mOcclusionCuller.NumOccluderTriangles(), mOcclusionCuller.NumTrianglesRasterized());
+	ImGui::Text("Meshes visible: %u/%u", mpModel->GetNumVisible(), mpModel->GetNumMeshes());
+
+	const ModelLoadState loadState = mpModel->GetLoadState();
+	if (loadState == MODEL_LOADING)
+	{
+		ImGui::ProgressBar(mpModel->GetLoadProgress(), ImVec2(0.0f, 0.0f), "Loading model");
+		ImGui::SameLine();
+		if (ImGui::Button("Cancel"))
+			mpModel->CancelLoad();
+		ImGui::Text("Meshes ready: %u/%u", mpModel->GetNumMeshesReady(), mpModel->GetNumMeshes());
+	}
+	else if (loadState == MODEL_CANCELLED)
+	{
+		ImGui::Text("Model loading cancelled, %u/%u meshes ready", mpModel->GetNumMeshesReady(), mpModel->GetNumMeshes());
+	}
+	else if (loadState == MODEL_FAILED)
+	{
+		ImGui::Text("Model failed to load");
+	}
+
+	unsigned int pickedMesh = 0;
+	float pickedDistance = 0.0f;
+	if (mpModel->Raycast(mpCamera->GetPosition(), mpCamera->GetForward(), mpCamera->GetFarPlane(), pickedMesh, pickedDistance))
+		ImGui::Text("Looking at mesh %u, %.1f away", pickedMesh, pickedDistance);
+	else
+		ImGui::Text("Looking at nothing");
+
+	TextureCache& textureCache = TextureCache::Get();
+	ImGui::Text("Texture cache: %u entries, %u hits, %u misses, %u evictions", textureCache.GetNumEntries(),
+		textureCache.GetHits(), textureCache.GetMisses(), textureCache.GetEvictions());
+
+	ImGui::Text("Draws: %u, state changes: %u, redundant skipped: %u", mDrawStats.miDraws, mDrawStats.miStateChanges, mDrawStats.miSkippedStateChanges);
+	ImGui::Text("Render graph: %u/%u passes, %u targets in %u textures, %.1f MB (%.1f MB unshared)",
+		mGraphStats.miPasses - mGraphStats.miCulledPasses, mGraphStats.miPasses, mGraphStats.miTransients, mGraphStats.miTextures,
+		mGraphStats.miAliasedBytes / (1024.0 * 1024.0), mGraphStats.miTransientBytes / (1024.0 * 1024.0));
+
+	bool pipelined = IsPipelined();
+	if (ImGui::Checkbox("Render on its own thread", &pipelined))
+	{
+		SetPipelined(pipelined);
+	}
+	ImGui::Text("Frames updated: %llu, rendered: %llu, waited %.1f ms for a slot, render waited %.1f ms",
+		(unsigned long long)mPipeline.GetFramesUpdated(), (unsigned long long)mPipeline.GetFramesRendered(),
+		mPipeline.GetUpdateWaitMs(), mPipeline.GetRenderWaitMs());
 #endif
 }
 
 /**
 *  @brief Render the game
 *
+*  Draws the state an Update wrote, on the render thread when pipelined.
 */
 void TestAppGame::Render(float deltaTime)
 {
-
-	// Clear the screen
-	mpDirectX->ClearScreen();
-	for (int i = 0; i < RT::Count; i++)
-	{
-		mpRenderTargets[i]->Clear(mpDirectX);
-	}
-
-	mpDirectX->EnableDepthBuffering(true);
-	mpDirectX->EnableAlphaBlending(false);
+	PROFILE_SCOPE("TestAppGame::Render");
+
+	// Written by an earlier Update, which may be writing the next frame by now
+	FrameState& frame = mFrames[mPipeline.GetRenderSlot()];
+
+	// Whatever the model finishes now is drawn from the next frame built
+	mpModel->Upload(MODEL_UPLOAD_BUDGET_MS);
+
+	// The back buffer and depth, the graph clears its own targets
+	mpGraphics->ClearScreen();
+
+	// The passes are declared every frame, the graph keeps its textures between them
+	mRenderGraph.Reset();
+	const bool compact = frame.mbCompactGBuffer;
+	const RenderGraphTargetDesc targetDesc(SCREEN_WIDTH, SCREEN_HEIGHT, TEXTURE_FORMAT_RGBA16_FLOAT);
+	const RenderGraphTargetDesc normalDesc(SCREEN_WIDTH, SCREEN_HEIGHT, compact ? TEXTURE_FORMAT_RG16_SNORM : TEXTURE_FORMAT_RGBA16_FLOAT);
+	const RenderGraphTargetDesc diffuseDesc(SCREEN_WIDTH, SCREEN_HEIGHT, compact ? TEXTURE_FORMAT_RGBA8 : TEXTURE_FORMAT_RGBA16_FLOAT);
+	const RenderGraphResource backBuffer = mRenderGraph.Import("Back buffer", mpGraphics->GetBackBufferTexture());
+	const RenderGraphResource depth = mRenderGraph.Import("Depth", mpGraphics->GetDepthTexture());
+	// The compact G-buffer leaves the position target unused, PostFx rebuilds positions from the depth
+	const RenderGraphResource position = mRenderGraph.CreateTarget("Position", targetDesc);
+	const RenderGraphResource normal = mRenderGraph.CreateTarget("Normal", normalDesc);
+	const RenderGraphResource diffuse = mRenderGraph.CreateTarget("Diffuse", diffuseDesc);
+	const RenderGraphResource postFx = mRenderGraph.CreateTarget("PostFx", targetDesc);
 
 	// First Pass
-	// set the shader objects
-	mpDirectX->GetContext()->VSSetShader(mpVertexShaderGBuffer, 0, 0);
-	mpDirectX->GetContext()->PSSetShader(mpPixelShaderGBuffer, 0, 0);
-
-	mpDirectX->GetContext()->OMSetRenderTargets(GBUFFER_SIZE, mpGBuffer, mpDirectX->GetDepthStencilView());
-	mpDirectX->GetContext()->PSSetSamplers(0, 1, &mpSamplerState);
-
-	// Set camera
-	PerFrameBuffer frameBuffer;
-	memcpy(&frameBuffer.VM, &mpCamera->GetViewMatrix()[0][0], sizeof(glm::mat4x4));
-	memcpy(&frameBuffer.VM_Inv, &(glm::inverse(mpCamera->GetViewMatrix()))[0][0], sizeof(glm::mat4x4));
-	memcpy(&frameBuffer.PM, &mpCamera->GetProjectionMatrix()[0][0], sizeof(glm::mat4x4));
-	memcpy(&frameBuffer.PM_Inv, &(glm::inverse(mpCamera->GetProjectionMatrix()))[0][0], sizeof(glm::mat4x4));
-	memcpy(&frameBuffer.CameraPosition, &glm::vec4(mpCamera->GetPosition(), 1.0f)[0], sizeof(glm::vec4));
-
-	D3D11_MAPPED_SUBRESOURCE ms1;
-	mpDirectX->GetContext()->Map(perFrameBuffer, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &ms1);
-	memcpy(ms1.pData, &frameBuffer, sizeof(PerFrameBuffer));
-	mpDirectX->GetContext()->Unmap(perFrameBuffer, NULL);
-	mpDirectX->GetContext()->VSSetConstantBuffers(1, 1, &perFrameBuffer);
-	mpDirectX->GetContext()->PSSetConstantBuffers(1, 1, &perFrameBuffer);
-
-	// Draw the model
-	mpModel->Draw(mpDirectX);
-
-	ID3D11RenderTargetView* clearGBuffer[GBUFFER_SIZE];
-	for (int i = 0; i < GBUFFER_SIZE; i++)
+	const unsigned int gBufferPass = mRenderGraph.AddPass("G-buffer", [this, &frame, compact](GraphicsDevice* device)
 	{
-		clearGBuffer[i] = NULL;
-	}
-	mpDirectX->GetContext()->OMSetRenderTargets(GBUFFER_SIZE, clearGBuffer, NULL);
+		device->EnableDepthBuffering(true);
+		device->EnableAlphaBlending(false);
 
-	mpDirectX->EnableDepthBuffering(false);
-	mpDirectX->EnableAlphaBlending(false);
-	// Post FX pass
-	if (mbPostFx)
-	{
 		// set the shader objects
-		mpDirectX->GetContext()->VSSetShader(mpVertexShaderPfx, 0, 0);
-		mpDirectX->GetContext()->PSSetShader(mpPixelShaderPfx, 0, 0);
-		mpDirectX->GetContext()->OMSetRenderTargets(1, mpRenderTargets[PostFx]->GetAddressOfRenderTargetView(), NULL);
-
-		mpDirectX->GetContext()->PSSetSamplers(0, 1, &mpSamplerState);
-		mpDirectX->GetContext()->PSSetShaderResources(0, 1, mpRenderTargets[DiffuseBuffer]->GetAddressOfShaderResourceView());
-		mpDirectX->GetContext()->PSSetShaderResources(1, 1, mpRenderTargets[PositionBuffer]->GetAddressOfShaderResourceView());
-		mpDirectX->GetContext()->PSSetShaderResources(2, 1, mpRenderTargets[NormalBuffer]->GetAddressOfShaderResourceView());
-		mpDirectX->GetContext()->PSSetShaderResources(3, 1, mpDirectX->GetAddressOfDepthStencilSRV());
+		device->SetVertexShader(mpVertexShaderGBuffer);
+		device->SetPixelShader(compact ? mpPixelShaderGBufferCompact : mpPixelShaderGBuffer);
+		device->SetPSSampler(0, mpSamplerState);
 
-		mpDirectX->GetContext()->PSSetConstantBuffers(1, 1, &perFrameBuffer);
+		// Set camera
+		device->UpdateBuffer(perFrameBuffer, 0, &frame.mPerFrame, sizeof(PerFrameBuffer));
+		device->SetVSConstantBuffer(1, perFrameBuffer);
+		device->SetPSConstantBuffer(1, perFrameBuffer);
 
-		mpFullscreenQuad->Draw(mpDirectX);
+		// Draw the model
+		if (mpModel->UsesPackedVertices())
+		{
+			device->SetVertexShader(mpVertexShaderGBufferPacked);
+			device->SetInputLayout(mpLayoutPacked);
+		}
+		mStateCache.Invalidate();
+		mStateCache.ResetStats();
+		{
+			PROFILE_SCOPE("Submit draws");
+			frame.mDrawList.Submit(device, mStateCache);
+		}
+		frame.mDrawStats = mStateCache.GetStats();
+		device->SetInputLayout(mpLayout);
+	});
+	if (!compact)
+		mRenderGraph.Write(gBufferPass, position);
+	mRenderGraph.Write(gBufferPass, normal);
+	mRenderGraph.Write(gBufferPass, diffuse);
+	mRenderGraph.WriteDepth(gBufferPass, depth);
+
+	// Post FX pass, culled by the graph when the final pass doesn't read it
+	const unsigned int postFxPass = mRenderGraph.AddPass("PostFx", [this, compact](GraphicsDevice* device)
+	{
+		device->EnableDepthBuffering(false);
+		device->EnableAlphaBlending(false);
 
-		ID3D11ShaderResourceView *const pSRV[1] = { NULL };
-		mpDirectX->GetContext()->PSSetShaderResources(0, 1, pSRV);
-		mpDirectX->GetContext()->PSSetShaderResources(1, 1, pSRV);
-		mpDirectX->GetContext()->PSSetShaderResources(2, 1, pSRV);
-		mpDirectX->GetContext()->PSSetShaderResources(3, 1, pSRV);
-	}
+		// set the shader objects
+		device->SetVertexShader(mpVertexShaderPfx);
+		device->SetPixelShader(compact ? mpPixelShaderPfxCompact : mpPixelShaderPfx);
+		device->SetPSSampler(0, mpSamplerState);
+		device->SetPSConstantBuffer(1, perFrameBuffer);
+
+		mpFullscreenQuad->Draw(device);
+	});
+	mRenderGraph.Read(postFxPass, diffuse, 0);
+	if (!compact)
+		mRenderGraph.Read(postFxPass, position, 1);
+	mRenderGraph.Read(postFxPass, normal, 2);
+	mRenderGraph.Read(postFxPass, depth, 3);
+	mRenderGraph.Write(postFxPass, postFx);
 
 	// Final Pass - Copy pfx or colour buffer to the back buffer
-	// set the shader objects
-	mpDirectX->GetContext()->VSSetShader(mpVertexShaderPfx, 0, 0);
-	mpDirectX->GetContext()->PSSetShader(mpPixelShader, 0, 0);
+	const unsigned int finalPass = mRenderGraph.AddPass("Copy to back buffer", [this](GraphicsDevice* device)
+	{
+		device->EnableDepthBuffering(false);
+		device->EnableAlphaBlending(false);
 
-	mpDirectX->GetContext()->OMSetRenderTargets(1, mpDirectX->GetAddressOfBackBuffer(), mpDirectX->GetDepthStencilView());
+		// set the shader objects
+		device->SetVertexShader(mpVertexShaderPfx);
+		device->SetPixelShader(mpPixelShader);
+		device->SetPSSampler(0, mpSamplerState);
 
-	mpDirectX->GetContext()->PSSetSamplers(0, 1, &mpSamplerState);
-	if (mbPostFx)
-		mpDirectX->GetContext()->PSSetShaderResources(0, 1, mpRenderTargets[PostFx]->GetAddressOfShaderResourceView());
-	else
-		mpDirectX->GetContext()->PSSetShaderResources(0, 1, mpRenderTargets[DiffuseBuffer]->GetAddressOfShaderResourceView());
+		mpFullscreenQuad->Draw(device);
+	});
+	mRenderGraph.Read(finalPass, frame.mbPostFx ? postFx : diffuse, 0);
+	mRenderGraph.Write(finalPass, backBuffer);
 
-	//mpFullscreenQuad->GetVBO()->Draw(mpDirectX);
-	mpFullscreenQuad->Draw(mpDirectX);
+	{
+		PROFILE_SCOPE("Compile render graph");
+		mRenderGraph.Compile();
+	}
+	frame.mGraphStats = mRenderGraph.GetStats();
+	{
+		PROFILE_SCOPE("Execute render graph");
+		mRenderGraph.Execute(mpGraphics);
+	}
 
-	// Present
-	mpDirectX->SwapBuffers();
+	// Present, with the UI on top
+#if defined D_USE_IMGUI
+	if (mpDirectX)
+	{
+		mpDirectX->SetUIDrawData(frame.mUI.GetDrawData(), frame.mUI.DisplaySize.x, frame.mUI.DisplaySize.y);
+	}
+#endif
+	{
+		PROFILE_SCOPE("Present");
+		mpGraphics->SwapBuffers();
+	}
 
+	// Textures are released on the device, so this happens here rather than in Update
+	TextureCache& textureCache = TextureCache::Get();
+	textureCache.EvictUnreferenced(TEXTURE_EVICT_FRAMES);
+	textureCache.EndFrame();
+}
 
-	// -- HANDLE CHANGE OF SCREEN STATE OR RESOLUTION --
+/**
+*  @brief Changes the window's mode or size, and recreates the render targets to match.
+*
+*  Called from Update once the render thread has drawn everything it had, so it isn't using the targets.
+*/
+void TestAppGame::ApplyScreenChanges()
+{
+	// Only a window can change its mode or size
+	if (!mpDirectX)
+	{
+		mbScreenStateChanged = false;
+		mbResolutionChanged = false;
+		return;
+	}
 
 	if (mbScreenStateChanged)
 	{
-		// Clean up Rendertargets
-		for (int i = 0; i < RT::Count; i++)
-		{
-			mpRenderTargets[i]->Release();
-		}
+		// Clean up Rendertargets, the graph creates them again when it next needs them
+		mRenderGraph.ReleaseTextures(mpGraphics);
 
-		GetDevice()->SetWindowMode(mbFullscreen, mbBorderless, monitor - 1);
+		GetDevice()->SetWindowMode(mbFullscreen && !mbFocusLost, mbBorderless, monitor - 1);
 		mbScreenStateChanged = false;
 
-		// Recreate up Rendertargets
-		for (int i = 0; i < RT::Count; i++)
+		// Minimise only once out of exclusive fullscreen
+		if (mbFullscreen && mbFocusLost)
 		{
-			mpRenderTargets[i]->Initialise(mpDirectX);
+			ShowWindow(GetWindow()->GetHWND(), SW_SHOWMINNOACTIVE);
 		}
 	}
 
 	if (mbResolutionChanged)
 	{
-		// Clean up Rendertargets
-		for (int i = 0; i < RT::Count; i++)
-		{
-			mpRenderTargets[i]->Release();
-		}
+		// Clean up Rendertargets, the graph creates them again at the new size
+		mRenderGraph.ReleaseTextures(mpGraphics);
 
 		GetDevice()->SetSize((float)SCREEN_WIDTH, (float)SCREEN_HEIGHT);
 		mbResolutionChanged = false;
-
-		// Recreate up Rendertargets
-		for (int i = 0; i < RT::Count; i++)
-		{
-			mpRenderTargets[i]->SetDimensionsToFullscreen();
-			mpRenderTargets[i]->Initialise(mpDirectX);
-		}
 	}
-}
\ No newline at end of file
+}
@@ -11,37 +11,27 @@
 #include "Game.h"
 #include <stdlib.h>
 
-#include <d3d11.h>
 #include <glm/glm.hpp>
 
-#include "RenderTarget.h"
+#include "RenderGraph.h"
 #include <vector>
 
+#include "GraphicsDevice.h"
 #include "Texture.h"
 #include "Mesh.h"
 #include "Model.h"
+#include "DrawList.h"
+#include "DeviceStateCache.h"
+#include "OcclusionCuller.h"
 
 #include "Camera.h"
+#include "Config.h"
+#include "FramePipeline.h"
+#include "ImGui\ImGuiDrawSnapshot.h"
 
 // Forward declarations
 class DirectXDevice;
 
-enum RT
-{
-	PositionBuffer,
-	NormalBuffer,
-	DiffuseBuffer,
-	ColourBuffer,
-	PostFx,
-
-	Count,
-
-	GBufferStart = PositionBuffer,
-	GBufferEnd = DiffuseBuffer,
-};
-
-static const int GBUFFER_SIZE = RT::GBufferEnd - RT::GBufferStart + 1;
-
 struct PerFrameBuffer
 {
 	glm::mat4x4 VM;
@@ -51,6 +41,31 @@ struct PerFrameBuffer
 	glm::vec4 CameraPosition;
 };
 
+/**
+*  @brief Everything Render needs from an Update.
+*
+*  There's one per FramePipeline slot, so the update thread can write the next frame's while the
+*  render thread draws this one. Render only reads it, apart from the stats it writes back.
+*/
+struct FrameState
+{
+	FrameState() : mbPostFx(true), mbCompactGBuffer(false), mDrawStats(), mGraphStats() {}
+
+	PerFrameBuffer mPerFrame;
+	/// The meshes that passed culling, sorted.
+	DrawList mDrawList;
+	bool mbPostFx;
+	bool mbCompactGBuffer;
+#if defined D_USE_IMGUI
+	/// A copy of the frame's UI, ImGui starts the next frame while this one is drawn.
+	ImGuiDrawSnapshot mUI;
+#endif
+
+	/// What drawing it took, written by Render and read by the Update that next writes the slot.
+	DeviceStateStats mDrawStats;
+	RenderGraphStats mGraphStats;
+};
+
 
 /**
 * A game specific implementation of the parent class "Game.h", loads
@@ -67,6 +82,7 @@ public:
 public:
 	// Public Functions
 	virtual void Initialise(Window_DX* win);
+	virtual void InitialiseHeadless(GraphicsDevice* device);
 	virtual void LoadAssets();
 	virtual void Shutdown();
 	virtual void OnKeypress(int key, bool down);
@@ -78,37 +94,69 @@ public:
 	float Random() { return ((float)rand() / (RAND_MAX)); }
 
 	void SetFullscreen(const bool lbFullscreen) { mbFullscreen = lbFullscreen; mbScreenStateChanged = true; }
+	void SetFocusLost(const bool lbFocusLost) { mbFocusLost = lbFocusLost; mbScreenStateChanged = true; }
 	const bool GetFullscreen() const { return mbFullscreen; }
+	/// The model being drawn, headless runs wait on its load.
+	const Model* GetModel() const { return mpModel; }
 
 private:
-	// Render Targets
-	RenderTarget* mpRenderTargets[RT::Count];
-	ID3D11RenderTargetView* mpGBuffer[GBUFFER_SIZE];
+	void LoadSettings();
+	void ApplyBinaryLogSettings();
+	void ApplyScreenChanges();
+	void BuildFrame(FrameState& frame);
+	void DrawUI();
+
+	// Orders the passes and owns the render targets, only used by Render
+	RenderGraph mRenderGraph;
 
-	// DirectX Stuff
-	ID3D11SamplerState* mpSamplerState;
+	// Device Stuff
+	GraphicsSampler* mpSamplerState;
 
-	ID3D11VertexShader* mpVertexShader;
-	ID3D11PixelShader* mpPixelShader;
+	GraphicsVertexShader* mpVertexShader;
+	GraphicsPixelShader* mpPixelShader;
 
-	ID3D11VertexShader* mpVertexShaderPfx;
-	ID3D11PixelShader* mpPixelShaderPfx;
+	GraphicsVertexShader* mpVertexShaderPfx;
+	GraphicsPixelShader* mpPixelShaderPfx;
+	GraphicsPixelShader* mpPixelShaderPfxCompact;
 
-	ID3D11VertexShader* mpVertexShaderGBuffer;
-	ID3D11PixelShader* mpPixelShaderGBuffer;
+	GraphicsVertexShader* mpVertexShaderGBuffer;
+	GraphicsPixelShader* mpPixelShaderGBuffer;
+	GraphicsPixelShader* mpPixelShaderGBufferCompact;
+	GraphicsVertexShader* mpVertexShaderGBufferPacked;
 
-	ID3D11InputLayout* mpLayout;
+	GraphicsInputLayout* mpLayout;
+	GraphicsInputLayout* mpLayoutPacked;
 
 	// Meshes
 	Mesh* mpFullscreenQuad;
 
 	Model* mpModel;
+	// The occluders are added once the model has finished loading
+	bool mbOccludersAdded;
+
+	// What each Update hands to Render, and the state the render last bound
+	FrameState mFrames[FramePipeline::MAX_SLOTS];
+	DeviceStateCache mStateCache;
+	// The draw and render graph stats of an earlier frame, for the UI
+	DeviceStateStats mDrawStats;
+	RenderGraphStats mGraphStats;
+	OcclusionCuller mOcclusionCuller;
+
+	// App settings, reloaded when the file changes
+	Config mSettings;
+	ConfigHandle mBinaryLogSetting;
+	ConfigHandle mBinaryLogPathSetting;
+	ConfigHandle mBinaryLogFileMBSetting;
+	ConfigHandle mBinaryLogFilesSetting;
+	bool mbBinaryLogChanged;
+	ConfigHandle mPipelinedSetting;
+	ConfigHandle mCompactGBufferSetting;
 
 	// Camera
 	Camera* mpCamera;
 	float mBoostMultiplier;
 	// The per frame buffer.
-	ID3D11Buffer* perFrameBuffer;
+	GraphicsBuffer* perFrameBuffer;
 
 	// Screen width and height
 	int width;
@@ -120,7 +168,15 @@ private:
 	bool mbScreenStateChanged;
 	bool mbResolutionChanged;
 	bool mbBorderless;
+	// Fullscreen is left while the app is in the background
+	bool mbFocusLost;
 	// Do the post fx pass
 	bool mbPostFx;
+	// Rebuild positions from depth and pack the normals and colours, instead of three RGBA16F targets
+	bool mbCompactGBuffer;
+	// Leave meshes outside the view frustum out of the draw list
+	bool mbFrustumCulling;
+	// Leave meshes hidden behind the occluders out of the draw list
+	bool mbOcclusionCulling;
 };
 
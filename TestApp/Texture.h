@@ -1,6 +1,6 @@
 #pragma once
-#include <D3D11.h>
-#include "DirectXDevice.h"
+#include "GraphicsDevice.h"
+#include <vector>
 
 class Texture
 {
@@ -8,45 +8,48 @@ public:
 	Texture();
 	virtual ~Texture();
 
-	virtual bool Initialise(DirectXDevice* device);
+	virtual bool Initialise(GraphicsDevice* device);
 	virtual bool Release();
 
-	ID3D11Texture2D* GetTexture() { return mpTexture; }
-	ID3D11Texture2D** GetAddressOfTexture() { return &mpTexture; }
-	ID3D11ShaderResourceView* GetShaderResourceView() { return mpTextureSRV; }
-	ID3D11ShaderResourceView** GetAddressOfShaderResourceView() { return &mpTextureSRV; }
+	GraphicsTexture* GetHandle() const { return mpTexture; }
 
-	void SetDimensions(UINT width, UINT height) { miWidth = width; miHeight = height; }
-	void SetWidth(UINT width) { miWidth = width; }
-	void SetHeight(UINT height) { miHeight = height; }
+	void SetDimensions(unsigned int width, unsigned int height) { miWidth = width; miHeight = height; }
+	void SetWidth(unsigned int width) { miWidth = width; }
+	void SetHeight(unsigned int height) { miHeight = height; }
 
 	void SetInitialData(const void* data, unsigned int pitch, unsigned int depth);
+	void SetInitialMipData(const std::vector<SubresourceData>& mips);
 
-	void ResetFlags() { miBindFlags = 0; miCPUAccessFlags = 0; }
-	void SetBindFlags(UINT flags) { miBindFlags |= flags; }
-	void SetMiscFlags(UINT flags) { miMiscFlags |= flags; }
-	void SetCPUAccessFlags(UINT flags) { miCPUAccessFlags |= flags; }
-	void SetUsage(D3D11_USAGE usage) { meUsage = usage; }
+	void ResetFlags() { miFlags = 0; }
+	/// Adds TextureFlags.
+	void SetFlags(unsigned int flags) { miFlags |= flags; }
+	void SetUsage(ResourceUsage usage) { meUsage = usage; }
 
-	void SetFormat(DXGI_FORMAT format) { mFormat = format; }
+	void SetFormat(TextureFormat format) { meFormat = format; }
 
-	void SetMipLevels(UINT levels) { miMipLevels = levels; }
+	void SetMipLevels(unsigned int levels) { miMipLevels = levels; }
 
-	bool CopyDataIntoTexture(DirectXDevice* device, BYTE* data, const int rowPitch);
+	/// Whether some texels are transparent enough to be clipped by the G-buffer pixel shader.
+	void SetHasAlpha(bool hasAlpha) { mbHasAlpha = hasAlpha; }
+	bool HasAlpha() const { return mbHasAlpha; }
+
+	bool CopyDataIntoTexture(const unsigned char* data, const int rowPitch);
 
 protected:
 	int miWidth;
 	int miHeight;
-	DXGI_FORMAT mFormat;
-	UINT miBindFlags;
-	UINT miCPUAccessFlags;
-	UINT miMiscFlags;
-	D3D11_USAGE meUsage;
+	TextureFormat meFormat;
+	unsigned int miFlags;
+	ResourceUsage meUsage;
 	int miMipLevels;
+	bool mbHasAlpha;
 
 	bool mInitialData;
-	D3D11_SUBRESOURCE_DATA mTexInitData;
-
-	ID3D11Texture2D* mpTexture;
-	ID3D11ShaderResourceView* mpTextureSRV;
-};
\ No newline at end of file
+	SubresourceData mTexInitData;
+	/// Initial data for every mip, used instead of mTexInitData when set.
+	std::vector<SubresourceData> mMipInitData;
+
+	/// The device the texture was created on.
+	GraphicsDevice* mpDevice;
+	GraphicsTexture* mpTexture;
+};
@@ -0,0 +1,201 @@
+/**
+*  @file TextureCache.cpp
+*  @brief Process wide cache of loaded textures.
+*
+*  Textures are keyed by their normalised path and reference counted, so every model that
+*  uses the same file shares one Texture.
+*
+*  @bug No known bugs.
+*/
+#include "TextureCache.h"
+#include "Log.h"
+#include <vector>
+
+/**
+*  @brief Normalises a path so different spellings of the same file share a key.
+*
+*  Lower cases the path, converts '\' to '/', and removes "." and "dir/.." segments.
+*
+*  @param path The path to normalise.
+*  @return The normalised path.
+*/
+std::string TextureCache::NormalisePath(const std::string& path)
+{
+	// Split into segments
+	std::vector<std::string> segments;
+	std::string segment;
+	for (size_t i = 0; i <= path.size(); i++)
+	{
+		char c = i < path.size() ? path[i] : '/';
+		if (c == '/' || c == '\\')
+		{
+			if (segment == "..")
+			{
+				if (!segments.empty() && segments.back() != "..")
+					segments.pop_back();
+				else
+					segments.push_back(segment);
+			}
+			else if (!segment.empty() && segment != ".")
+			{
+				segments.push_back(segment);
+			}
+			segment.clear();
+		}
+		else
+		{
+			segment += (char)tolower((unsigned char)c);
+		}
+	}
+
+	std::string normalised = (!path.empty() && (path[0] == '/' || path[0] == '\\')) ? "/" : "";
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		if (i > 0) normalised += '/';
+		normalised += segments[i];
+	}
+	return normalised;
+}
+
+/**
+*  @brief Looks a texture up and takes a reference to it.
+*
+*  @param key The normalised path of the texture.
+*  @return The texture, or nullptr if it isn't cached, in which case no reference is taken.
+*/
+Texture* TextureCache::Acquire(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	std::unordered_map<std::string, Entry>::iterator it = mEntries.find(key);
+	if (it == mEntries.end())
+	{
+		miMisses++;
+		return nullptr;
+	}
+
+	miHits++;
+	it->second.miRefCount++;
+	return it->second.mpTexture;
+}
+
+/**
+*  @brief Adds a newly loaded texture to the cache, the caller holds the first reference.
+*
+*  @param key The normalised path of the texture.
+*  @param texture The texture, the cache takes ownership of it.
+*  @return The texture the cache holds for the key, another one if somebody else inserted it first.
+*/
+Texture* TextureCache::Insert(const std::string& key, Texture* texture)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	std::unordered_map<std::string, Entry>::iterator it = mEntries.find(key);
+	if (it != mEntries.end())
+	{
+		// Somebody else loaded it first, keep theirs.
+		LOG_INFO << "Texture already cached, sharing it: " << key;
+		it->second.miRefCount++;
+		if (it->second.mpTexture != texture)
+			DestroyTexture(texture);
+		return it->second.mpTexture;
+	}
+
+	Entry entry;
+	entry.mpTexture = texture;
+	entry.miRefCount = 1;
+	entry.miReleasedFrame = miFrame;
+	mEntries[key] = entry;
+	return texture;
+}
+
+/**
+*  @brief Gives back a reference taken with Acquire or Insert.
+*
+*  @param key The normalised path of the texture.
+*/
+void TextureCache::Release(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	std::unordered_map<std::string, Entry>::iterator it = mEntries.find(key);
+	if (it == mEntries.end() || it->second.miRefCount == 0)
+	{
+		LOG_WARNING << "Released a texture that isn't referenced: " << key;
+		return;
+	}
+	it->second.miRefCount--;
+	if (it->second.miRefCount == 0)
+		it->second.miReleasedFrame = miFrame;
+}
+
+/**
+*  @brief Destroys every texture that nothing has referenced for the given number of frames.
+*
+*  Must be called from the thread that renders, the textures go back to the device.
+*
+*  @param unusedFrames How many EndFrame calls a texture has to stay unreferenced for, 0 evicts them all.
+*  @return The number of textures evicted.
+*/
+unsigned int TextureCache::EvictUnreferenced(unsigned int unusedFrames)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	unsigned int evicted = 0;
+	std::unordered_map<std::string, Entry>::iterator it = mEntries.begin();
+	while (it != mEntries.end())
+	{
+		if (it->second.miRefCount == 0 && miFrame - it->second.miReleasedFrame >= unusedFrames)
+		{
+			DestroyTexture(it->second.mpTexture);
+			it = mEntries.erase(it);
+			evicted++;
+		}
+		else
+		{
+			++it;
+		}
+	}
+	miEvictions += evicted;
+	return evicted;
+}
+
+/**
+*  @brief Destroys every cached texture, whether it is referenced or not. Only for shutdown.
+*/
+void TextureCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (std::unordered_map<std::string, Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+	{
+		if (it->second.miRefCount > 0)
+			LOG_WARNING << "Texture still referenced at shutdown: " << it->first;
+		DestroyTexture(it->second.mpTexture);
+	}
+	mEntries.clear();
+}
+
+/**
+*  @brief Advances the frame count EvictUnreferenced measures how long textures have been unused by.
+*/
+void TextureCache::EndFrame()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	miFrame++;
+}
+
+unsigned int TextureCache::GetNumEntries()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (unsigned int)mEntries.size();
+}
+
+void TextureCache::DestroyTexture(Texture* texture)
+{
+	if (texture)
+	{
+		texture->Release();
+		delete texture;
+	}
+}
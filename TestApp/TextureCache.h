@@ -0,0 +1,75 @@
+/**
+*  @file TextureCache.h
+*  @brief Process wide cache of loaded textures.
+*
+*  Textures are keyed by their normalised path and reference counted, so every model that
+*  uses the same file shares one Texture.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+#include "Texture.h"
+
+/**
+*  @brief Process wide, reference counted cache of loaded textures.
+*
+*  Acquire and Insert each add a reference that the owner must give back with Release.
+*  Textures whose references drop to zero stay cached until EvictUnreferenced finds them
+*  unused for long enough, so a model that is reloaded straight away doesn't have to decode
+*  them again. EndFrame counts the frames.
+*/
+class TextureCache
+{
+public:
+	/**
+	*  Provides access to the singleton instance.
+	*/
+	static TextureCache& Get()
+	{
+		static TextureCache instance;
+		return instance;
+	}
+
+	static std::string NormalisePath(const std::string& path);
+
+	Texture* Acquire(const std::string& key);
+	Texture* Insert(const std::string& key, Texture* texture);
+	void Release(const std::string& key);
+
+	unsigned int EvictUnreferenced(unsigned int unusedFrames = 0);
+	void EndFrame();
+	void Clear();
+
+	unsigned int GetNumEntries();
+	unsigned int GetHits() const { return miHits; }
+	unsigned int GetMisses() const { return miMisses; }
+	unsigned int GetEvictions() const { return miEvictions; }
+
+private:
+	TextureCache() : miFrame(0), miHits(0), miMisses(0), miEvictions(0) {}
+	TextureCache(const TextureCache&);
+	TextureCache& operator=(const TextureCache&);
+
+	static void DestroyTexture(Texture* texture);
+
+	struct Entry
+	{
+		Texture* mpTexture;
+		unsigned int miRefCount;
+		/// The frame the last reference was released in.
+		unsigned int miReleasedFrame;
+	};
+
+	/// All cached textures, keyed by normalised path.
+	std::unordered_map<std::string, Entry> mEntries;
+	std::mutex mMutex;
+
+	unsigned int miFrame;
+	unsigned int miHits;
+	unsigned int miMisses;
+	unsigned int miEvictions;
+};
@@ -4,7 +4,7 @@
 
 struct TextureDetail 
 {
-	TextureDetail() {}
+	TextureDetail() : mTexture(nullptr) {}
 
 	TextureDetail(Texture* texture, std::string type, std::string path) :
 		mTexture(texture),
@@ -13,6 +13,7 @@ struct TextureDetail
 	{
 	}
 
+	/// Not owned, textures belong to the TextureCache.
 	Texture* mTexture;
 	std::string mType;
 	std::string mPath;
@@ -9,10 +9,62 @@
 */
 
 #include "Timer.h"
+#include <algorithm>
+#include <math.h>
+#include <thread>
 
+const double Timer::MAX_DELTA_TIME = 0.25;
 
+Clock::Duration SteadyClock::Now()
+{
+	return std::chrono::duration_cast<Duration>(std::chrono::steady_clock::now().time_since_epoch());
+}
 
-Timer::Timer() : currentTime(0), deltaTime(0)
+/**
+*  @brief Sleeps for most of the time then spins for the rest.
+*
+*  Sleeps can overshoot by a scheduler tick, which would miss a frame rate cap, so the last
+*  couple of milliseconds are spent yielding instead.
+*/
+void SteadyClock::SleepFor(Duration duration)
+{
+	static const Duration SPIN_TIME = std::chrono::milliseconds(2);
+
+	const Duration deadline = Now() + duration;
+	if (duration > SPIN_TIME)
+	{
+		std::this_thread::sleep_for(duration - SPIN_TIME);
+	}
+	while (Now() < deadline)
+	{
+		std::this_thread::yield();
+	}
+}
+
+Timer::Timer() : Timer(nullptr)
+{
+}
+
+/**
+*  @param source Where to get the time from, or nullptr for the real time. Not owned.
+*/
+Timer::Timer(Clock* source) :
+	timeSource(source ? source : &ownClock),
+	started(false),
+	lastTime(0),
+	deltaTime(0),
+	rawDeltaTime(0),
+	totalTime(0),
+	frameCount(0),
+	smoothingFrames(4),
+	smoothingCount(0),
+	smoothingNext(0),
+	maxFrameRate(0),
+	fixedTimestep(0),
+	accumulator(0),
+	fixedStepsThisFrame(0),
+	statsCount(0),
+	statsNext(0)
 {
 }
 
@@ -23,12 +75,146 @@ Timer::~Timer()
 
 /**
 *  @brief Updates the deltaTime
-*  
+*
 *  Calculates the new deltaTime from how long it's been since UpdateTime() was last called.
+*  If the frame rate is capped and the frame was quicker than that this waits out the rest of it.
+*  The first call starts the timer and gives a delta of 0.
 */
 void Timer::UpdateTime()
 {
-	double tempTime = clock();
-	deltaTime = (tempTime - currentTime) / CLOCKS_PER_SEC;
-	currentTime = tempTime;
-}
\ No newline at end of file
+	Clock::Duration now = timeSource->Now();
+
+	if (!started)
+	{
+		started = true;
+		lastTime = now;
+		return;
+	}
+
+	if (maxFrameRate > 0.0)
+	{
+		const Clock::Duration frameTime = std::chrono::duration_cast<Clock::Duration>(std::chrono::duration<double>(1.0 / maxFrameRate));
+		if (now - lastTime < frameTime)
+		{
+			timeSource->SleepFor(frameTime - (now - lastTime));
+			now = timeSource->Now();
+		}
+	}
+
+	// The stats show how long the frame really took, only what the game moves by is clamped
+	const double measured = std::max(std::chrono::duration<double>(now - lastTime).count(), 0.0);
+	rawDeltaTime = std::min(measured, MAX_DELTA_TIME);
+	lastTime = now;
+	totalTime += rawDeltaTime;
+	frameCount++;
+
+	// Average the last few deltas, so one late frame doesn't make everything lurch
+	smoothingHistory[smoothingNext] = rawDeltaTime;
+	smoothingNext = (smoothingNext + 1) % smoothingFrames;
+	if (smoothingCount < smoothingFrames)
+		smoothingCount++;
+
+	double sum = 0.0;
+	for (unsigned int i = 0; i < smoothingCount; i++)
+		sum += smoothingHistory[i];
+	deltaTime = sum / smoothingCount;
+
+	accumulator += rawDeltaTime;
+	fixedStepsThisFrame = 0;
+
+	frameTimesMs[statsNext] = measured * 1000.0;
+	statsNext = (statsNext + 1) % STATS_FRAMES;
+	if (statsCount < STATS_FRAMES)
+		statsCount++;
+}
+
+/**
+*  @brief Sets how many of the last frames' deltas are averaged into DeltaTime.
+*
+*  @param frames From 1, which turns smoothing off, to MAX_SMOOTHING_FRAMES.
+*/
+void Timer::SetSmoothingFrames(unsigned int frames)
+{
+	if (frames < 1)
+		frames = 1;
+	if (frames > MAX_SMOOTHING_FRAMES)
+		frames = MAX_SMOOTHING_FRAMES;
+	smoothingFrames = frames;
+	smoothingCount = 0;
+	smoothingNext = 0;
+}
+
+/**
+*  @brief Caps how often UpdateTime returns.
+*
+*  @param framesPerSecond The most frames a second, or 0 for no cap.
+*/
+void Timer::SetMaxFrameRate(double framesPerSecond)
+{
+	maxFrameRate = std::max(framesPerSecond, 0.0);
+}
+
+/**
+*  @brief Sets the length of the steps handed out by ConsumeFixedStep.
+*
+*  @param seconds The step length, or 0 to stop handing out steps.
+*/
+void Timer::SetFixedTimestep(double seconds)
+{
+	fixedTimestep = std::max(seconds, 0.0);
+	accumulator = 0.0;
+}
+
+/**
+*  @brief Takes one fixed step out of the time built up by UpdateTime.
+*
+*  Call it in a loop after UpdateTime, running one fixed update each time it returns true.
+*  A frame long enough to owe more than MAX_FIXED_STEPS_PER_FRAME steps drops the rest,
+*  so a slow fixed update can't make every following frame slower.
+*
+*  @return true if a whole step was available.
+*/
+bool Timer::ConsumeFixedStep()
+{
+	if (fixedTimestep <= 0.0 || accumulator < fixedTimestep)
+		return false;
+
+	if (fixedStepsThisFrame >= MAX_FIXED_STEPS_PER_FRAME)
+	{
+		accumulator = fmod(accumulator, fixedTimestep);
+		return false;
+	}
+
+	accumulator -= fixedTimestep;
+	fixedStepsThisFrame++;
+	return true;
+}
+
+/**
+*  @brief Gets the minimum, average, 99th percentile and maximum of the last STATS_FRAMES frame times.
+*/
+FrameStats Timer::GetStats() const
+{
+	FrameStats stats;
+	stats.miFrames = statsCount;
+	stats.mMinMs = 0.0;
+	stats.mAverageMs = 0.0;
+	stats.mP99Ms = 0.0;
+	stats.mMaxMs = 0.0;
+	if (statsCount == 0)
+		return stats;
+
+	double sorted[STATS_FRAMES];
+	std::copy(frameTimesMs, frameTimesMs + statsCount, sorted);
+	std::sort(sorted, sorted + statsCount);
+
+	double sum = 0.0;
+	for (unsigned int i = 0; i < statsCount; i++)
+		sum += sorted[i];
+
+	stats.mMinMs = sorted[0];
+	stats.mAverageMs = sum / statsCount;
+	stats.mP99Ms = sorted[std::min((unsigned int)ceil(0.99 * statsCount) - 1, statsCount - 1)];
+	stats.mMaxMs = sorted[statsCount - 1];
+	return stats;
+}
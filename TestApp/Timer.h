@@ -3,35 +3,149 @@
 *  @brief Timer used to get the deltaTime for the games and threaded systems
 *
 *  Timer class used to create and access a deltaTime value for a game loop, or threaded systems.
+*  Measures wall time on a monotonic clock, smooths the frame delta, can cap the frame rate,
+*  hands out fixed timesteps, and keeps statistics on recent frame times.
 
 *  @author Sam Murphy
 *  @bug No known bugs.
 */
 
 #pragma once
-#include "stdafx.h"
-#include <windows.h>
-#include <time.h>
+#include <chrono>
+
+/**
+*  @brief Where a Timer gets the time from, replaceable so timing code can be driven by hand.
+*/
+class Clock
+{
+public:
+	typedef std::chrono::nanoseconds Duration;
+
+	virtual ~Clock() {}
+
+	/// The time since an arbitrary fixed point, never goes backwards.
+	virtual Duration Now() = 0;
+	/// Blocks for at least the given time.
+	virtual void SleepFor(Duration duration) = 0;
+};
+
+/**
+*  @brief The real time, from std::chrono::steady_clock.
+*/
+class SteadyClock : public Clock
+{
+public:
+	virtual Duration Now();
+	virtual void SleepFor(Duration duration);
+};
+
+/**
+*  @brief A clock that only moves when told to, sleeping just advances it.
+*/
+class ManualClock : public Clock
+{
+public:
+	ManualClock() : mNow(0) {}
+
+	virtual Duration Now() { return mNow; }
+	virtual void SleepFor(Duration duration) { mNow += duration; }
+
+	void Advance(Duration duration) { mNow += duration; }
+	void AdvanceSeconds(double seconds) { mNow += std::chrono::duration_cast<Duration>(std::chrono::duration<double>(seconds)); }
+
+private:
+	Duration mNow;
+};
+
+/**
+*  @brief Statistics over the most recent frames, in milliseconds.
+*/
+struct FrameStats
+{
+	unsigned int miFrames;
+	double mMinMs;
+	double mAverageMs;
+	double mP99Ms;
+	double mMaxMs;
+};
 
 /**
 *  @brief Timer used to get the deltaTime for the games and threaded systems
-*  
+*
 *  Used to create and access a deltaTime value for a game loop, or threaded systems.
 */
 class Timer
 {
 public:
+	/// Frames kept for GetStats.
+	static const unsigned int STATS_FRAMES = 256;
+	/// The most frames SetSmoothingFrames can average over.
+	static const unsigned int MAX_SMOOTHING_FRAMES = 32;
+	/// Longer deltas, e.g. after a breakpoint or a load, are clamped to this so the game doesn't jump.
+	static const double MAX_DELTA_TIME;
+	/// Fixed steps owed beyond this many in one frame are dropped rather than run.
+	static const unsigned int MAX_FIXED_STEPS_PER_FRAME = 8;
+
 	Timer();
+	explicit Timer(Clock* source);
 	~Timer();
 
 	void UpdateTime();
 
+	/// The smoothed seconds since the last UpdateTime, what the game should move by.
 	double DeltaTime() const { return deltaTime; }
+	/// The measured seconds since the last UpdateTime, after capping and clamping.
+	double RawDeltaTime() const { return rawDeltaTime; }
+	/// Seconds since the first UpdateTime, the sum of the raw deltas.
+	double TotalTime() const { return totalTime; }
+	unsigned long long FrameCount() const { return frameCount; }
+
+	void SetSmoothingFrames(unsigned int frames);
+	unsigned int GetSmoothingFrames() const { return smoothingFrames; }
+
+	void SetMaxFrameRate(double framesPerSecond);
+	double GetMaxFrameRate() const { return maxFrameRate; }
+
+	void SetFixedTimestep(double seconds);
+	double GetFixedTimestep() const { return fixedTimestep; }
+	bool ConsumeFixedStep();
+	/// How far the time left over from the fixed steps is towards the next one, for interpolating.
+	double GetFixedStepAlpha() const { return fixedTimestep > 0.0 ? accumulator / fixedTimestep : 0.0; }
+
+	FrameStats GetStats() const;
 
 private:
-	/// The current time as a double.
-	double currentTime;
+	Timer(const Timer&) = delete;
+	Timer& operator=(const Timer&) = delete;
+
+	/// The clock the time comes from, either ownClock or one passed in.
+	Clock* timeSource;
+	SteadyClock ownClock;
+	bool started;
+	Clock::Duration lastTime;
+
 	/// The most recently calculated delta time.
 	double deltaTime;
-};
+	double rawDeltaTime;
+	double totalTime;
+	unsigned long long frameCount;
+
+	/// The last raw deltas, averaged for deltaTime.
+	double smoothingHistory[MAX_SMOOTHING_FRAMES];
+	unsigned int smoothingFrames;
+	unsigned int smoothingCount;
+	unsigned int smoothingNext;
+
+	/// 0 for uncapped.
+	double maxFrameRate;
 
+	/// 0 if fixed steps aren't used.
+	double fixedTimestep;
+	double accumulator;
+	unsigned int fixedStepsThisFrame;
+
+	/// The last measured deltas in milliseconds, before clamping to MAX_DELTA_TIME, for GetStats.
+	double frameTimesMs[STATS_FRAMES];
+	unsigned int statsCount;
+	unsigned int statsNext;
+};
@@ -4,6 +4,10 @@
 
 
 VBO::VBO()
+	: mpDevice(nullptr),
+	mpVBO(nullptr),
+	miNumVertices(0),
+	miStride(sizeof(Vertex))
 {
 }
 
@@ -13,96 +17,68 @@ VBO::~VBO()
 }
 
 
-void VBO::Create(DirectXDevice* device, Vertex vertices[], int numVertices)
+void VBO::Create(GraphicsDevice* device, Vertex vertices[], int numVertices)
 {
-	miNumVertices = numVertices;
-
-	if (miNumVertices <= 0) LOG_ERROR << "No vertices for vbo creation";
-
-	D3D11_BUFFER_DESC bd;
-	ZeroMemory(&bd, sizeof(bd));
-
-	bd.Usage = D3D11_USAGE_DYNAMIC;
-	bd.ByteWidth = sizeof(Vertex) * numVertices;
-	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-	// Create the buffer
-	HRESULT result;
-	result = device->GetDevice()->CreateBuffer(&bd, NULL, &mpVBO);
-	if (result != S_OK)
-	{
-		LOG_ERROR << "Failed to create directX vbo";
-	}
+	Create(device, vertices, sizeof(Vertex), numVertices);
+}
 
-	// Copy vertices into buffer
-	D3D11_MAPPED_SUBRESOURCE ms;
-	result = device->GetContext()->Map(mpVBO, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &ms);
-	if (result != S_OK)
-	{
-		LOG_ERROR << "Failed to create directX vbo";
-	}
-	memcpy(ms.pData, vertices, sizeof(Vertex) * numVertices);
-	device->GetContext()->Unmap(mpVBO, NULL);
+void VBO::Create(GraphicsDevice * device, std::vector<Vertex> vertices)
+{
+	Create(device, vertices.data(), sizeof(Vertex), (int)vertices.size());
 }
 
-void VBO::Create(DirectXDevice * device, std::vector<Vertex> vertices)
+/**
+*  @brief Creates the vbo from vertices of any format.
+*
+*  @param device The device to create the buffer on.
+*  @param vertices The vertex data.
+*  @param stride The size of one vertex in bytes, must match the input layout it is drawn with.
+*  @param numVertices The number of vertices.
+*/
+void VBO::Create(GraphicsDevice* device, const void* vertices, unsigned int stride, int numVertices)
 {
-	miNumVertices = vertices.size();
+	mpDevice = device;
+	miNumVertices = numVertices;
+	miStride = stride;
 
 	if (miNumVertices <= 0) LOG_ERROR << "No vertices for vbo creation";
 
-	D3D11_BUFFER_DESC bd;
-	ZeroMemory(&bd, sizeof(bd));
+	BufferDesc desc;
+	desc.miSize = stride * numVertices;
+	desc.meType = BUFFER_VERTEX;
+	desc.meUsage = USAGE_DYNAMIC;
 
-	bd.Usage = D3D11_USAGE_DYNAMIC;
-	bd.ByteWidth = sizeof(Vertex) * miNumVertices;
-	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-	// Create the buffer
-	HRESULT result;
-	result = device->GetDevice()->CreateBuffer(&bd, NULL, &mpVBO);
-	if (result != S_OK)
+	// Create the buffer with the vertices in it
+	mpVBO = device->CreateBuffer(desc, vertices);
+	if (!mpVBO)
 	{
-		LOG_ERROR << "Failed to create directX vbo";
+		LOG_ERROR << "Failed to create vbo";
 	}
-
-	// Copy vertices into buffer
-	D3D11_MAPPED_SUBRESOURCE ms;
-	result = device->GetContext()->Map(mpVBO, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &ms);
-	if (result != S_OK)
-	{
-		LOG_ERROR << "Failed to create directX vbo";
-	}
-	memcpy(ms.pData, &vertices[0], sizeof(Vertex) * miNumVertices);
-	device->GetContext()->Unmap(mpVBO, NULL);
 }
 
-void VBO::Draw(DirectXDevice* device)
+void VBO::Draw(GraphicsDevice* device)
 {
 	// select the buffer
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	device->GetContext()->IASetVertexBuffers(0, 1, &mpVBO, &stride, &offset);
+	device->SetVertexBuffer(mpVBO, miStride);
 
 	// select primitive type
-	device->GetContext()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY::D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	device->SetPrimitiveTopology(TOPOLOGY_TRIANGLE_LIST);
 
 	// draw the vertex buffer to the back buffer
-	device->GetContext()->Draw(miNumVertices, 0);
+	device->Draw(miNumVertices, 0);
 }
 
-void VBO::SetVBO(DirectXDevice * device)
+void VBO::SetVBO(GraphicsDevice * device)
 {
 	// select the buffer
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	device->GetContext()->IASetVertexBuffers(0, 1, &mpVBO, &stride, &offset);
+	device->SetVertexBuffer(mpVBO, miStride);
 }
 
 void VBO::Release()
 {
 	if (mpVBO)
-		mpVBO->Release();
+	{
+		mpDevice->ReleaseBuffer(mpVBO);
+		mpVBO = nullptr;
+	}
 }
\ No newline at end of file
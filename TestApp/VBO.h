@@ -1,5 +1,5 @@
 #pragma once
-#include "DirectXDevice.h"
+#include "GraphicsDevice.h"
 #include "Vertex.h"
 #include <vector>
 
@@ -9,17 +9,25 @@ public:
 	VBO();
 	~VBO();
 
-	void Create(DirectXDevice* device, Vertex vertices[], int numVerticies);
-	void Create(DirectXDevice* device, std::vector<Vertex> vertices);
+	void Create(GraphicsDevice* device, Vertex vertices[], int numVerticies);
+	void Create(GraphicsDevice* device, std::vector<Vertex> vertices);
+	void Create(GraphicsDevice* device, const void* vertices, unsigned int stride, int numVertices);
 
-	void Draw(DirectXDevice* device);
-	void SetVBO(DirectXDevice* device);
+	void Draw(GraphicsDevice* device);
+	void SetVBO(GraphicsDevice* device);
 
 	void Release();
 
+	unsigned int GetSizeInBytes() const { return miStride * (unsigned int)miNumVertices; }
+	GraphicsBuffer* GetBuffer() const { return mpVBO; }
+	unsigned int GetStride() const { return miStride; }
+
 private:
+	/// The device the buffer was created on.
+	GraphicsDevice* mpDevice;
+	GraphicsBuffer* mpVBO;
 	/// The number of vertices in the vbo.
-	ID3D11Buffer* mpVBO;
 	int miNumVertices;
+	/// The size of one vertex in bytes.
+	unsigned int miStride;
 };
-
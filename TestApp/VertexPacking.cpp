@@ -0,0 +1,299 @@
+/**
+*  @file VertexPacking.cpp
+*  @brief The packed 16 byte vertex format and the routines to convert to and from it.
+*
+*  Positions are quantised to 16 bit unorm within the mesh's bounding box, normals are octahedral
+*  encoded as 16 bit snorm and texture coordinates are half floats. Conversion is done 4 vertices
+*  at a time with SSE2, so it matches the formats the input assembler expands on the GPU.
+*
+*  @bug No known bugs.
+*/
+#include "VertexPacking.h"
+#include <emmintrin.h>
+#include <float.h>
+#include <string.h>
+
+static_assert(sizeof(Vertex) == 32, "Packing expects Vertex to be eight floats");
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must match the packed input layout");
+
+/**
+*  @brief Converts 4 floats to half floats, rounding to nearest even. The results are in the low 16 bits of each lane.
+*
+*  Fabian Giesen's SSE2 conversion, handles denormals, infinities and NaNs.
+*/
+static __m128i FloatToHalf(__m128 f)
+{
+	const __m128i f16Max = _mm_set1_epi32((127 + 16) << 23);
+	const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+	const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+	const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+	const __m128 sign = _mm_and_ps(f, _mm_set1_ps(-0.0f));
+	const __m128 absF = _mm_xor_ps(f, sign);
+	const __m128i absInt = _mm_castps_si128(absF);
+
+	// Infinity, or a quiet NaN
+	const __m128i isNaN = _mm_castps_si128(_mm_cmpunord_ps(absF, absF));
+	const __m128i special = _mm_or_si128(_mm_and_si128(isNaN, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+	const __m128i isRegular = _mm_cmpgt_epi32(f16Max, absInt);
+
+	// Subnormal results, the float add does the rounding
+	const __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absInt);
+	const __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+
+	// Normal results, rebias the exponent and round the mantissa to nearest even
+	const __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absInt, 31 - 13), 31);
+	const __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absInt, normalBias), mantissaOdd), 13);
+
+	const __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+	const __m128i result = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, special));
+	return _mm_or_si128(result, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+}
+
+/**
+*  @brief Converts 4 half floats, zero extended in each lane, to floats.
+*/
+static __m128 HalfToFloat(__m128i h)
+{
+	const __m128i expMantissa = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+	const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMantissa), 16);
+
+	// Shift into place and let a multiply fix up the exponent, which handles denormals too
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+	const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMantissa, 13)), magic);
+
+	const __m128i wasInfNaN = _mm_cmpgt_epi32(expMantissa, _mm_set1_epi32(0x7bff));
+	const __m128 infNaNExponent = _mm_and_ps(_mm_castsi128_ps(wasInfNaN), _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+	return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infNaNExponent));
+}
+
+static __m128 Clamp(__m128 v, __m128 low, __m128 high)
+{
+	return _mm_min_ps(_mm_max_ps(v, low), high);
+}
+
+static __m128 Abs(__m128 v)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+static __m128 Select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/// 1.0 with the sign of each lane, zero counts as positive, negative zero too as it does in the shaders.
+static __m128 SignNotZero(__m128 v)
+{
+	return Select(_mm_cmpge_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f), _mm_set1_ps(-1.0f));
+}
+
+/**
+*  @brief Finds the bounding box of the vertices, which the positions are quantised within.
+*
+*  @param vertices The vertices.
+*  @param count The number of vertices.
+*  @return The offset and scale to decode positions packed with it.
+*/
+VertexQuantization VertexPacking::ComputeQuantization(const Vertex* vertices, unsigned int count)
+{
+	float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const float position[3] = { vertices[i].x, vertices[i].y, vertices[i].z };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (position[axis] < minimum[axis]) minimum[axis] = position[axis];
+			if (position[axis] > maximum[axis]) maximum[axis] = position[axis];
+		}
+	}
+
+	VertexQuantization quantization;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		quantization.offset[axis] = count > 0 ? minimum[axis] : 0.0f;
+		quantization.scale[axis] = count > 0 ? maximum[axis] - minimum[axis] : 0.0f;
+	}
+	quantization.offset[3] = 0.0f;
+	quantization.scale[3] = 0.0f;
+	return quantization;
+}
+
+/**
+*  @brief Packs vertices into the compact format.
+*
+*  @param vertices The vertices to pack.
+*  @param count The number of vertices.
+*  @param quantization The box to quantise positions within, from ComputeQuantization.
+*  @param packed Receives count packed vertices.
+*/
+void VertexPacking::Pack(const Vertex* vertices, unsigned int count, const VertexQuantization& quantization, PackedVertex* packed)
+{
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		PackBlock(vertices + i, quantization, packed + i);
+	}
+
+	// Pad the last few out to a whole block
+	if (i < count)
+	{
+		Vertex tail[4];
+		PackedVertex packedTail[4];
+		for (unsigned int j = 0; j < 4; j++)
+			tail[j] = i + j < count ? vertices[i + j] : vertices[i];
+		PackBlock(tail, quantization, packedTail);
+		memcpy(packed + i, packedTail, (count - i) * sizeof(PackedVertex));
+	}
+}
+
+/**
+*  @brief Expands packed vertices back into full Vertex structs.
+*
+*  @param packed The packed vertices.
+*  @param count The number of vertices.
+*  @param quantization The quantisation the vertices were packed with.
+*  @param vertices Receives count vertices.
+*/
+void VertexPacking::Unpack(const PackedVertex* packed, unsigned int count, const VertexQuantization& quantization, Vertex* vertices)
+{
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		UnpackBlock(packed + i, quantization, vertices + i);
+	}
+
+	if (i < count)
+	{
+		PackedVertex packedTail[4];
+		Vertex tail[4];
+		memset(packedTail, 0, sizeof(packedTail));
+		memcpy(packedTail, packed + i, (count - i) * sizeof(PackedVertex));
+		UnpackBlock(packedTail, quantization, tail);
+		memcpy(vertices + i, tail, (count - i) * sizeof(Vertex));
+	}
+}
+
+void VertexPacking::PackBlock(const Vertex* vertices, const VertexQuantization& quantization, PackedVertex* packed)
+{
+	// Load 4 vertices and transpose to one register per component
+	const float* source = &vertices[0].x;
+	__m128 x = _mm_loadu_ps(source + 0), y = _mm_loadu_ps(source + 8), z = _mm_loadu_ps(source + 16), nx = _mm_loadu_ps(source + 24);
+	__m128 ny = _mm_loadu_ps(source + 4), nz = _mm_loadu_ps(source + 12), u = _mm_loadu_ps(source + 20), v = _mm_loadu_ps(source + 28);
+	_MM_TRANSPOSE4_PS(x, y, z, nx);
+	_MM_TRANSPOSE4_PS(ny, nz, u, v);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	// Positions, normalised within the box then scaled to 16 bit unorm
+	__m128 position[3] = { x, y, z };
+	__m128i quantized[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float scale = quantization.scale[axis];
+		const __m128 inverseScale = _mm_set1_ps(scale > 0.0f ? 1.0f / scale : 0.0f);
+		const __m128 normalised = _mm_mul_ps(_mm_sub_ps(position[axis], _mm_set1_ps(quantization.offset[axis])), inverseScale);
+		quantized[axis] = _mm_cvtps_epi32(_mm_mul_ps(Clamp(normalised, zero, one), _mm_set1_ps(65535.0f)));
+	}
+
+	// Normals, project onto the octahedron and fold the lower half over
+	const __m128 length = _mm_add_ps(_mm_add_ps(Abs(nx), Abs(ny)), Abs(nz));
+	const __m128 degenerate = _mm_cmpeq_ps(length, zero);
+	const __m128 inverseLength = _mm_div_ps(one, Select(degenerate, one, length));
+	__m128 octX = _mm_mul_ps(nx, inverseLength);
+	__m128 octY = _mm_mul_ps(ny, inverseLength);
+	const __m128 lowerHalf = _mm_cmplt_ps(nz, zero);
+	const __m128 foldedX = _mm_mul_ps(_mm_sub_ps(one, Abs(octY)), SignNotZero(octX));
+	const __m128 foldedY = _mm_mul_ps(_mm_sub_ps(one, Abs(octX)), SignNotZero(octY));
+	octX = Select(lowerHalf, foldedX, octX);
+	octY = Select(lowerHalf, foldedY, octY);
+	const __m128 minusOne = _mm_set1_ps(-1.0f);
+	const __m128 snormScale = _mm_set1_ps(32767.0f);
+	const __m128i normalX = _mm_cvtps_epi32(_mm_mul_ps(Clamp(octX, minusOne, one), snormScale));
+	const __m128i normalY = _mm_cvtps_epi32(_mm_mul_ps(Clamp(octY, minusOne, one), snormScale));
+
+	const __m128i halfU = FloatToHalf(u);
+	const __m128i halfV = FloatToHalf(v);
+
+	// Bias the unsigned values so the signed saturating pack keeps them, the xor below undoes it
+	const __m128i bias = _mm_set1_epi32(32768);
+	__m128 a0 = _mm_castsi128_ps(_mm_sub_epi32(quantized[0], bias));
+	__m128 a1 = _mm_castsi128_ps(_mm_sub_epi32(quantized[1], bias));
+	__m128 a2 = _mm_castsi128_ps(_mm_sub_epi32(quantized[2], bias));
+	__m128 a3 = _mm_castsi128_ps(_mm_set1_epi32(-32768));
+	__m128 b0 = _mm_castsi128_ps(normalX);
+	__m128 b1 = _mm_castsi128_ps(normalY);
+	__m128 b2 = _mm_castsi128_ps(_mm_sub_epi32(halfU, bias));
+	__m128 b3 = _mm_castsi128_ps(_mm_sub_epi32(halfV, bias));
+	_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+	_MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+	const __m128i unbias = _mm_setr_epi16((short)0x8000, (short)0x8000, (short)0x8000, (short)0x8000, 0, 0, (short)0x8000, (short)0x8000);
+	const __m128 lo[4] = { a0, a1, a2, a3 };
+	const __m128 hi[4] = { b0, b1, b2, b3 };
+	for (int i = 0; i < 4; i++)
+	{
+		const __m128i packedVertex = _mm_xor_si128(_mm_packs_epi32(_mm_castps_si128(lo[i]), _mm_castps_si128(hi[i])), unbias);
+		_mm_storeu_si128((__m128i*)(packed + i), packedVertex);
+	}
+}
+
+void VertexPacking::UnpackBlock(const PackedVertex* packed, const VertexQuantization& quantization, Vertex* vertices)
+{
+	// Widen each vertex to 32 bit lanes, positions and texcoords zero extended, normals sign extended
+	const __m128i zeroInt = _mm_setzero_si128();
+	const __m128i normalLanes = _mm_setr_epi32(-1, -1, 0, 0);
+	__m128 a[4], b[4];
+	for (int i = 0; i < 4; i++)
+	{
+		const __m128i packedVertex = _mm_loadu_si128((const __m128i*)(packed + i));
+		const __m128i signExtended = _mm_srai_epi32(_mm_unpackhi_epi16(packedVertex, packedVertex), 16);
+		const __m128i zeroExtended = _mm_unpackhi_epi16(packedVertex, zeroInt);
+		a[i] = _mm_castsi128_ps(_mm_unpacklo_epi16(packedVertex, zeroInt));
+		b[i] = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(normalLanes, signExtended), _mm_andnot_si128(normalLanes, zeroExtended)));
+	}
+	_MM_TRANSPOSE4_PS(a[0], a[1], a[2], a[3]);
+	_MM_TRANSPOSE4_PS(b[0], b[1], b[2], b[3]);
+
+	__m128 position[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const __m128 unorm = _mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(a[axis])), _mm_set1_ps(1.0f / 65535.0f));
+		position[axis] = _mm_add_ps(_mm_set1_ps(quantization.offset[axis]), _mm_mul_ps(unorm, _mm_set1_ps(quantization.scale[axis])));
+	}
+
+	// Snorm decode the same way D3D does, then unfold the octahedron
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 minusOne = _mm_set1_ps(-1.0f);
+	const __m128 inverseSnorm = _mm_set1_ps(1.0f / 32767.0f);
+	__m128 nx = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(b[0])), inverseSnorm), minusOne);
+	__m128 ny = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(b[1])), inverseSnorm), minusOne);
+	__m128 nz = _mm_sub_ps(_mm_sub_ps(one, Abs(nx)), Abs(ny));
+	const __m128 fold = _mm_max_ps(_mm_sub_ps(zero, nz), zero);
+	nx = _mm_sub_ps(nx, _mm_mul_ps(fold, SignNotZero(nx)));
+	ny = _mm_sub_ps(ny, _mm_mul_ps(fold, SignNotZero(ny)));
+	const __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz))));
+	nx = _mm_mul_ps(nx, inverseLength);
+	ny = _mm_mul_ps(ny, inverseLength);
+	nz = _mm_mul_ps(nz, inverseLength);
+
+	__m128 u = HalfToFloat(_mm_castps_si128(b[2]));
+	__m128 v = HalfToFloat(_mm_castps_si128(b[3]));
+
+	// Back to one vertex per pair of registers
+	__m128 x = position[0], y = position[1], z = position[2];
+	_MM_TRANSPOSE4_PS(x, y, z, nx);
+	_MM_TRANSPOSE4_PS(ny, nz, u, v);
+	float* destination = &vertices[0].x;
+	_mm_storeu_ps(destination + 0, x);
+	_mm_storeu_ps(destination + 4, ny);
+	_mm_storeu_ps(destination + 8, y);
+	_mm_storeu_ps(destination + 12, nz);
+	_mm_storeu_ps(destination + 16, z);
+	_mm_storeu_ps(destination + 20, u);
+	_mm_storeu_ps(destination + 24, nx);
+	_mm_storeu_ps(destination + 28, v);
+}
@@ -0,0 +1,54 @@
+/**
+*  @file VertexPacking.h
+*  @brief The packed 16 byte vertex format and the routines to convert to and from it.
+*
+*  Positions are quantised to 16 bit unorm within the mesh's bounding box, normals are octahedral
+*  encoded as 16 bit snorm and texture coordinates are half floats. Conversion is done 4 vertices
+*  at a time with SSE2, so it matches the formats the input assembler expands on the GPU.
+*
+*  Worst case decode error: positions about half a quantisation step, extent / 131070 per axis;
+*  normals under 0.05 degrees; texture coordinates 1/2048 relative, so 0.0005 over [0, 1].
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include "Vertex.h"
+
+/**
+*  @brief A vertex in the packed format, half the size of Vertex.
+*
+*  Matches the input layout R16G16B16A16_UNORM position, R16G16_SNORM normal, R16G16_FLOAT texcoord.
+*/
+struct PackedVertex
+{
+	uint16_t x, y, z, w;
+	int16_t nx, ny;
+	uint16_t u, v;
+};
+
+/**
+*  @brief Maps quantised positions back into model space, position = offset + unorm * scale.
+*
+*  Laid out as two float4s so it can be copied straight into the per mesh constant buffer.
+*/
+struct VertexQuantization
+{
+	float offset[4];
+	float scale[4];
+};
+
+class VertexPacking
+{
+public:
+	static VertexQuantization ComputeQuantization(const Vertex* vertices, unsigned int count);
+
+	static void Pack(const Vertex* vertices, unsigned int count, const VertexQuantization& quantization, PackedVertex* packed);
+	static void Unpack(const PackedVertex* packed, unsigned int count, const VertexQuantization& quantization, Vertex* vertices);
+
+private:
+	VertexPacking() = delete;
+
+	static void PackBlock(const Vertex* vertices, const VertexQuantization& quantization, PackedVertex* packed);
+	static void UnpackBlock(const PackedVertex* packed, const VertexQuantization& quantization, Vertex* vertices);
+};
@@ -131,6 +131,8 @@ void Window_DX::Initialise()
 	}
 
 	LOG_INFO << "Shuting Down Game";
+	// The render thread may still be drawing the UI
+	GetGame()->StopRenderThread();
 #if defined D_USE_IMGUI
 	ImGui_ImplDX11_Shutdown();
 	ImGui::DestroyContext();
@@ -320,13 +322,12 @@ LRESULT CALLBACK Window_DX::WindowProc(const HWND hwnd, const UINT message, cons
 		{
 			if ((HIWORD(lParam) & KF_ALTDOWN))
 			{
-				// Alt-Enter is pressed so toggle-fullscreen
+				// Alt-Enter is pressed so toggle-fullscreen, the game switches mode
+				// in its next Update once the render thread is idle
 				LOG_DEBUG << "Alt-Enter is pressed";
 
 				TestAppGame* myGame = static_cast<TestAppGame*>(TheWindow->GetGame());
-				bool lbFullscreen = !myGame->GetFullscreen();
-				myGame->SetFullscreen(lbFullscreen);
-				TheWindow->GetDevice()->SetWindowMode(lbFullscreen, false, 0);
+				myGame->SetFullscreen(!myGame->GetFullscreen());
 			}
 		}
 	}
@@ -335,34 +336,22 @@ LRESULT CALLBACK Window_DX::WindowProc(const HWND hwnd, const UINT message, cons
 	{
 	case WM_ACTIVATEAPP:
 	{
-		// Handles alt-tab
-		// Don't do anything if the window mode hasn't been set for the first time.
+		// Handles alt-tab. The swap chain is only touched from the game's Update,
+		// where the render thread is idle, so just tell the game about the focus.
 		TestAppGame* lpGame = static_cast<TestAppGame*>(TheWindow->GetGame());
-		bool lbFullscreen = lpGame->GetFullscreen();
-		if (lbFullscreen)
+		if (lpGame->GetFullscreen())
 		{
 			// If the app has gained focus again, switch back to full screen.
 			if (wParam != FALSE)
 			{
-				IDXGISwapChain* lpSwapChain = TheWindow->GetDevice()->GetSwapChain();
-				if (lpSwapChain)
-				{
-					// Minimised the app when we lost focus, so show the window again
-					ShowWindow(hwnd, SW_SHOWNA);
-					// Go fullscreen mode
-					lpGame->SetFullscreen(true);
-				}
+				// Minimised the app when we lost focus, so show the window again
+				ShowWindow(hwnd, SW_SHOWNA);
+				lpGame->SetFocusLost(false);
 			}
-			// The app has lost focus, so minimise it.
+			// The app has lost focus, so leave full screen and minimise it.
 			else
 			{
-				IDXGISwapChain* lpSwapChain = TheWindow->GetDevice()->GetSwapChain();
-				if (lpSwapChain)
-				{
-					HRESULT hr = lpSwapChain->SetFullscreenState(false, NULL);
-					_ASSERT(hr == S_OK);
-					ShowWindow(hwnd, SW_SHOWMINNOACTIVE);
-				}
+				lpGame->SetFocusLost(true);
 			}
 		}
 	}
@@ -0,0 +1,266 @@
+/**
+*  @file BlockCompression.cpp
+*  @brief BC1, BC3 and BC5 encoders for RGBA8 images.
+*
+*  The colour endpoints come from the bounding box of the block, with the diagonal picked from the
+*  sign of the colour covariance and inset slightly, then every pixel takes the closest palette entry.
+*
+*  @bug No known bugs.
+*/
+#include "BlockCompression.h"
+#include <string.h>
+
+static uint16_t PackRGB565(int r, int g, int b)
+{
+	return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+static void UnpackRGB565(uint16_t c, int rgb[3])
+{
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+/**
+*  @brief Encodes the colour of a 4x4 RGBA block as BC1, four colour mode.
+*
+*  @param block The 16 pixels, row major, 4 bytes each.
+*  @param out The 8 byte BC1 block.
+*/
+void EncodeBC1Block(const uint8_t block[64], uint8_t out[8])
+{
+	// Bounding box and mean
+	int minC[3] = { 255, 255, 255 };
+	int maxC[3] = { 0, 0, 0 };
+	int mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			int v = block[i * 4 + c];
+			minC[c] = v < minC[c] ? v : minC[c];
+			maxC[c] = v > maxC[c] ? v : maxC[c];
+			mean[c] += v;
+		}
+	}
+	for (int c = 0; c < 3; c++)
+		mean[c] = (mean[c] + 8) / 16;
+
+	// Pick the diagonal of the box that follows the colours, relative to green
+	int covRG = 0;
+	int covBG = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int dr = block[i * 4 + 0] - mean[0];
+		int dg = block[i * 4 + 1] - mean[1];
+		int db = block[i * 4 + 2] - mean[2];
+		covRG += dr * dg;
+		covBG += db * dg;
+	}
+	if (covRG < 0) { int t = minC[0]; minC[0] = maxC[0]; maxC[0] = t; }
+	if (covBG < 0) { int t = minC[2]; minC[2] = maxC[2]; maxC[2] = t; }
+
+	// Inset by 1/16 of the range to reduce the error at the ends
+	for (int c = 0; c < 3; c++)
+	{
+		int inset = (maxC[c] - minC[c]) / 16;
+		maxC[c] -= inset;
+		minC[c] += inset;
+	}
+
+	uint16_t c0 = PackRGB565(maxC[0], maxC[1], maxC[2]);
+	uint16_t c1 = PackRGB565(minC[0], minC[1], minC[2]);
+
+	uint32_t indices = 0;
+	if (c0 == c1)
+	{
+		// Solid block, every index 0
+	}
+	else
+	{
+		// Four colour mode needs c0 > c1, swapping the ends just reverses the palette
+		if (c0 < c1)
+		{
+			uint16_t t = c0; c0 = c1; c1 = t;
+		}
+
+		int palette[4][3];
+		UnpackRGB565(c0, palette[0]);
+		UnpackRGB565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestError = 0x7fffffff;
+			for (int p = 0; p < 4; p++)
+			{
+				int error = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int d = block[i * 4 + c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+
+	out[0] = (uint8_t)(c0 & 0xff);
+	out[1] = (uint8_t)(c0 >> 8);
+	out[2] = (uint8_t)(c1 & 0xff);
+	out[3] = (uint8_t)(c1 >> 8);
+	memcpy(out + 4, &indices, 4);
+}
+
+/**
+*  @brief Encodes one channel of a 4x4 RGBA block as BC4, eight value mode.
+*
+*  @param block The 16 pixels, row major, 4 bytes each.
+*  @param channel The channel to encode, 0-3.
+*  @param out The 8 byte BC4 block.
+*/
+void EncodeBC4Block(const uint8_t block[64], int channel, uint8_t out[8])
+{
+	int minV = 255;
+	int maxV = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int v = block[i * 4 + channel];
+		minV = v < minV ? v : minV;
+		maxV = v > maxV ? v : maxV;
+	}
+
+	out[0] = (uint8_t)maxV;
+	out[1] = (uint8_t)minV;
+
+	uint64_t indices = 0;
+	if (maxV > minV)
+	{
+		// Palette: 0 = max, 1 = min, 2-7 = interpolated from max towards min
+		int palette[8];
+		palette[0] = maxV;
+		palette[1] = minV;
+		for (int p = 1; p < 7; p++)
+			palette[p + 1] = ((7 - p) * maxV + p * minV + 3) / 7;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int v = block[i * 4 + channel];
+			int best = 0;
+			int bestError = 256;
+			for (int p = 0; p < 8; p++)
+			{
+				int error = v > palette[p] ? v - palette[p] : palette[p] - v;
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+/**
+*  @brief Encodes a 4x4 RGBA block as BC3, BC4 alpha followed by BC1 colour.
+*/
+void EncodeBC3Block(const uint8_t block[64], uint8_t out[16])
+{
+	EncodeBC4Block(block, 3, out);
+	EncodeBC1Block(block, out + 8);
+}
+
+/**
+*  @brief Encodes the red and green of a 4x4 RGBA block as BC5.
+*/
+void EncodeBC5Block(const uint8_t block[64], uint8_t out[16])
+{
+	EncodeBC4Block(block, 0, out);
+	EncodeBC4Block(block, 1, out + 8);
+}
+
+/**
+*  @brief Block compresses a whole image.
+*
+*  Blocks that hang off the right or bottom edge repeat the edge pixels.
+*
+*  @param image The RGBA8 image.
+*  @param format The block compressed format to encode to.
+*  @return The encoded blocks, row by row.
+*/
+std::vector<uint8_t> EncodeImage(const Image& image, DDSFormat format)
+{
+	const uint32_t blocksWide = (image.width + 3) / 4;
+	const uint32_t blocksHigh = (image.height + 3) / 4;
+	const uint32_t blockBytes = DDSBlockBytes(format);
+	std::vector<uint8_t> encoded((size_t)blocksWide * blocksHigh * blockBytes);
+
+	uint8_t block[64];
+	for (uint32_t by = 0; by < blocksHigh; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksWide; bx++)
+		{
+			for (uint32_t y = 0; y < 4; y++)
+			{
+				uint32_t sy = by * 4 + y < image.height ? by * 4 + y : image.height - 1;
+				for (uint32_t x = 0; x < 4; x++)
+				{
+					uint32_t sx = bx * 4 + x < image.width ? bx * 4 + x : image.width - 1;
+					memcpy(&block[(y * 4 + x) * 4], &image.pixels[((size_t)sy * image.width + sx) * 4], 4);
+				}
+			}
+
+			uint8_t* out = &encoded[((size_t)by * blocksWide + bx) * blockBytes];
+			switch (format)
+			{
+			case DDS_FORMAT_BC1: EncodeBC1Block(block, out); break;
+			case DDS_FORMAT_BC3: EncodeBC3Block(block, out); break;
+			case DDS_FORMAT_BC5: EncodeBC5Block(block, out); break;
+			default: break;
+			}
+		}
+	}
+	return encoded;
+}
+
+/**
+*  @brief Encodes a whole DDS file in memory, the header then every mip.
+*
+*  @param mips The mip chain, starting with the top level, whose sides must be a multiple of 4.
+*  @param format The block compressed format to encode to.
+*  @param alphaTested Whether any texel would be clipped, stored in the header.
+*  @return The contents of the file.
+*/
+std::vector<uint8_t> EncodeDDS(const std::vector<Image>& mips, DDSFormat format, bool alphaTested)
+{
+	DDSHeader header;
+	DDSMakeHeader(format, mips[0].width, mips[0].height, (uint32_t)mips.size(), alphaTested, header);
+
+	std::vector<uint8_t> file(sizeof(uint32_t) + sizeof(DDSHeader));
+	memcpy(&file[0], &DDS_MAGIC, sizeof(uint32_t));
+	memcpy(&file[sizeof(uint32_t)], &header, sizeof(DDSHeader));
+	for (size_t i = 0; i < mips.size(); i++)
+	{
+		const std::vector<uint8_t> encoded = EncodeImage(mips[i], format);
+		file.insert(file.end(), encoded.begin(), encoded.end());
+	}
+	return file;
+}
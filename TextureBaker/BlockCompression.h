@@ -0,0 +1,19 @@
+/**
+*  @file BlockCompression.h
+*  @brief BC1, BC3 and BC5 encoders for RGBA8 images.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "MipChain.h"
+#include "DDS.h"
+
+void EncodeBC1Block(const uint8_t block[64], uint8_t out[8]);
+void EncodeBC4Block(const uint8_t block[64], int channel, uint8_t out[8]);
+void EncodeBC3Block(const uint8_t block[64], uint8_t out[16]);
+void EncodeBC5Block(const uint8_t block[64], uint8_t out[16]);
+
+std::vector<uint8_t> EncodeImage(const Image& image, DDSFormat format);
+std::vector<uint8_t> EncodeDDS(const std::vector<Image>& mips, DDSFormat format, bool alphaTested);
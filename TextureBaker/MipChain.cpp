@@ -0,0 +1,275 @@
+/**
+*  @file MipChain.cpp
+*  @brief Builds the full mip chain of an RGBA8 image on the CPU.
+*
+*  @bug No known bugs.
+*/
+#include "MipChain.h"
+#include <math.h>
+#include <emmintrin.h>
+
+// Kaiser filter parameters, 6 taps per axis for a 2x reduction.
+static const float KAISER_ALPHA = 4.0f;
+static const float KAISER_WIDTH = 3.0f;
+static const int KAISER_TAPS = 6;
+
+/**
+*  @brief The number of mips down to and including 1x1.
+*/
+uint32_t MipCount(uint32_t width, uint32_t height)
+{
+	uint32_t largest = width > height ? width : height;
+	uint32_t count = 1;
+	while (largest > 1)
+	{
+		largest /= 2;
+		count++;
+	}
+	return count;
+}
+
+/**
+*  @brief 2x2 box filter for when both source dimensions are even.
+*
+*  Handles two output pixels per iteration with SSE2, rounding to nearest.
+*/
+static void DownsampleBoxEven(const Image& source, Image& dest)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	const size_t sourcePitch = (size_t)source.width * 4;
+
+	for (uint32_t y = 0; y < dest.height; y++)
+	{
+		const uint8_t* row0 = &source.pixels[(size_t)(y * 2) * sourcePitch];
+		const uint8_t* row1 = row0 + sourcePitch;
+		uint8_t* out = &dest.pixels[(size_t)y * dest.width * 4];
+
+		uint32_t x = 0;
+		for (; x + 2 <= dest.width; x += 2)
+		{
+			// 4 source pixels from each row
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+
+			// Vertical sums in 16 bit, lo = source pixels 0 and 1, hi = 2 and 3
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+			// Horizontal sums of neighbouring pixels
+			lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+			hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+			__m128i sum = _mm_unpacklo_epi64(lo, hi);
+
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum, zero));
+		}
+
+		// Odd destination width
+		for (; x < dest.width; x++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				uint32_t sum = row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c];
+				out[x * 4 + c] = (uint8_t)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+/**
+*  @brief Box filter for any source size, odd edges are clamped.
+*/
+static void DownsampleBoxGeneric(const Image& source, Image& dest)
+{
+	for (uint32_t y = 0; y < dest.height; y++)
+	{
+		uint32_t y0 = y * 2 < source.height ? y * 2 : source.height - 1;
+		uint32_t y1 = y * 2 + 1 < source.height ? y * 2 + 1 : source.height - 1;
+		for (uint32_t x = 0; x < dest.width; x++)
+		{
+			uint32_t x0 = x * 2 < source.width ? x * 2 : source.width - 1;
+			uint32_t x1 = x * 2 + 1 < source.width ? x * 2 + 1 : source.width - 1;
+			for (int c = 0; c < 4; c++)
+			{
+				uint32_t sum = source.pixels[((size_t)y0 * source.width + x0) * 4 + c] +
+					source.pixels[((size_t)y0 * source.width + x1) * 4 + c] +
+					source.pixels[((size_t)y1 * source.width + x0) * 4 + c] +
+					source.pixels[((size_t)y1 * source.width + x1) * 4 + c];
+				dest.pixels[((size_t)y * dest.width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+static float BesselI0(float x)
+{
+	float sum = 1.0f;
+	float term = 1.0f;
+	for (int k = 1; k < 16; k++)
+	{
+		float t = x / (2.0f * k);
+		term *= t * t;
+		sum += term;
+	}
+	return sum;
+}
+
+/**
+*  @brief Kaiser windowed sinc weights for a 2x reduction, normalised to sum to 1.
+*/
+static void KaiserWeights(float weights[KAISER_TAPS])
+{
+	float total = 0.0f;
+	for (int i = 0; i < KAISER_TAPS; i++)
+	{
+		// Distance from the centre of the two source pixels, in source pixels
+		float t = (i - (KAISER_TAPS / 2 - 1)) - 0.5f;
+		float x = t * 0.5f;
+		float sinc = x == 0.0f ? 1.0f : sinf(3.14159265f * x) / (3.14159265f * x);
+		float r = t / KAISER_WIDTH;
+		float window = r * r < 1.0f ? BesselI0(KAISER_ALPHA * sqrtf(1.0f - r * r)) / BesselI0(KAISER_ALPHA) : 0.0f;
+		weights[i] = sinc * window;
+		total += weights[i];
+	}
+	for (int i = 0; i < KAISER_TAPS; i++)
+		weights[i] /= total;
+}
+
+/**
+*  @brief Separable Kaiser filter, horizontal pass into a float buffer then vertical.
+*/
+static void DownsampleKaiser(const Image& source, Image& dest)
+{
+	float weights[KAISER_TAPS];
+	KaiserWeights(weights);
+	const int first = -(KAISER_TAPS / 2 - 1);
+
+	// Horizontal
+	std::vector<float> horizontal((size_t)dest.width * source.height * 4);
+	for (uint32_t y = 0; y < source.height; y++)
+	{
+		for (uint32_t x = 0; x < dest.width; x++)
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < KAISER_TAPS; i++)
+			{
+				int sx = (int)x * 2 + first + i;
+				sx = sx < 0 ? 0 : (sx >= (int)source.width ? (int)source.width - 1 : sx);
+				const uint8_t* pixel = &source.pixels[((size_t)y * source.width + sx) * 4];
+				for (int c = 0; c < 4; c++)
+					sum[c] += pixel[c] * weights[i];
+			}
+			for (int c = 0; c < 4; c++)
+				horizontal[((size_t)y * dest.width + x) * 4 + c] = sum[c];
+		}
+	}
+
+	// Vertical
+	for (uint32_t y = 0; y < dest.height; y++)
+	{
+		for (uint32_t x = 0; x < dest.width; x++)
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < KAISER_TAPS; i++)
+			{
+				int sy = (int)y * 2 + first + i;
+				sy = sy < 0 ? 0 : (sy >= (int)source.height ? (int)source.height - 1 : sy);
+				const float* pixel = &horizontal[((size_t)sy * dest.width + x) * 4];
+				for (int c = 0; c < 4; c++)
+					sum[c] += pixel[c] * weights[i];
+			}
+			for (int c = 0; c < 4; c++)
+			{
+				float value = sum[c] + 0.5f;
+				dest.pixels[((size_t)y * dest.width + x) * 4 + c] = (uint8_t)(value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value));
+			}
+		}
+	}
+}
+
+/**
+*  @brief Produces the next mip down from an image.
+*
+*  @param source The image to reduce, must be larger than 1x1.
+*  @param filter The reduction filter.
+*  @return The image at half the size, rounded down, of at least 1x1.
+*/
+Image Downsample(const Image& source, MipFilter filter)
+{
+	Image dest(source.width > 1 ? source.width / 2 : 1, source.height > 1 ? source.height / 2 : 1);
+
+	if (filter == MIP_FILTER_KAISER && source.width > 1 && source.height > 1)
+		DownsampleKaiser(source, dest);
+	else if (source.width % 2 == 0 && source.height % 2 == 0)
+		DownsampleBoxEven(source, dest);
+	else
+		DownsampleBoxGeneric(source, dest);
+
+	return dest;
+}
+
+/**
+*  @brief Bilinearly resizes an image so both sides are a multiple of 4.
+*
+*  D3D11 rejects block compressed textures whose top mip isn't made of whole blocks. Stretching keeps
+*  the texture coordinates lined up with the content, which padding wouldn't.
+*
+*  @param source The image to resize.
+*  @return The resized image, or a copy if it was already a multiple of 4.
+*/
+Image ResizeToBlockMultiple(const Image& source)
+{
+	Image dest((source.width + 3) & ~3u, (source.height + 3) & ~3u);
+	if (dest.width == source.width && dest.height == source.height)
+		return source;
+
+	const float scaleX = (float)source.width / dest.width;
+	const float scaleY = (float)source.height / dest.height;
+	for (uint32_t y = 0; y < dest.height; y++)
+	{
+		// Sample at the pixel centre, clamped to the edge texels
+		float sy = (y + 0.5f) * scaleY - 0.5f;
+		sy = sy < 0.0f ? 0.0f : sy;
+		uint32_t y0 = (uint32_t)sy;
+		uint32_t y1 = y0 + 1 < source.height ? y0 + 1 : y0;
+		float fy = sy - y0;
+		for (uint32_t x = 0; x < dest.width; x++)
+		{
+			float sx = (x + 0.5f) * scaleX - 0.5f;
+			sx = sx < 0.0f ? 0.0f : sx;
+			uint32_t x0 = (uint32_t)sx;
+			uint32_t x1 = x0 + 1 < source.width ? x0 + 1 : x0;
+			float fx = sx - x0;
+			for (int c = 0; c < 4; c++)
+			{
+				float top = source.pixels[((size_t)y0 * source.width + x0) * 4 + c] * (1.0f - fx) +
+					source.pixels[((size_t)y0 * source.width + x1) * 4 + c] * fx;
+				float bottom = source.pixels[((size_t)y1 * source.width + x0) * 4 + c] * (1.0f - fx) +
+					source.pixels[((size_t)y1 * source.width + x1) * 4 + c] * fx;
+				dest.pixels[((size_t)y * dest.width + x) * 4 + c] = (uint8_t)(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+	}
+	return dest;
+}
+
+/**
+*  @brief Builds every mip of an image down to 1x1.
+*
+*  @param top The full size image, mip 0.
+*  @param filter The reduction filter.
+*  @return All the mips, starting with a copy of the top level.
+*/
+std::vector<Image> BuildMipChain(const Image& top, MipFilter filter)
+{
+	std::vector<Image> mips;
+	mips.reserve(MipCount(top.width, top.height));
+	mips.push_back(top);
+	while (mips.back().width > 1 || mips.back().height > 1)
+	{
+		Image next = Downsample(mips.back(), filter);
+		mips.push_back(next);
+	}
+	return mips;
+}
@@ -0,0 +1,39 @@
+/**
+*  @file MipChain.h
+*  @brief Builds the full mip chain of an RGBA8 image on the CPU.
+*
+*  @bug No known bugs.
+*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+*  @brief An RGBA8 image, rows are tightly packed.
+*/
+struct Image
+{
+	Image() : width(0), height(0) {}
+	Image(uint32_t w, uint32_t h) : width(w), height(h), pixels((size_t)w * h * 4) {}
+
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> pixels;
+};
+
+/**
+*  @brief The filter used to produce each mip from the one above it.
+*/
+enum MipFilter
+{
+	/// 2x2 average, SIMD accelerated.
+	MIP_FILTER_BOX,
+	/// Separable Kaiser windowed sinc, sharper than the box filter.
+	MIP_FILTER_KAISER,
+};
+
+uint32_t MipCount(uint32_t width, uint32_t height);
+Image ResizeToBlockMultiple(const Image& source);
+Image Downsample(const Image& source, MipFilter filter);
+std::vector<Image> BuildMipChain(const Image& top, MipFilter filter);
@@ -0,0 +1,202 @@
+/**
+*  @file TextureBaker.cpp
+*  @brief Command line tool that bakes source images into block compressed DDS files.
+*
+*  Decodes each image with stb, builds the full mip chain and writes a BC1, BC3 or BC5 DDS next to it,
+*  which the app loads in place of the source image. Only uses the C++ standard library and SSE2, so it
+*  builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -msse2 -I../inc -I../TestApp *.cpp -o TextureBaker
+*
+*  Usage: TextureBaker [-f auto|bc1|bc3|bc5] [-m box|kaiser] [-o output.dds] input.png [input2.png ...]
+*
+*  @bug No known bugs.
+*/
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "DDS.h"
+#include "MipChain.h"
+#include "BlockCompression.h"
+
+/**
+*  @brief Picks a format from the file name and contents.
+*
+*  Bump maps only need two channels so get BC5, anything with transparency gets BC3, the rest BC1.
+*  Soft alpha that is never clipped still needs BC3, whether it's clipped is stored separately.
+*/
+static DDSFormat ChooseFormat(const std::string& path, const Image& image)
+{
+	if (path.find("_bump") != std::string::npos)
+		return DDS_FORMAT_BC5;
+
+	for (size_t i = 3; i < image.pixels.size(); i += 4)
+	{
+		if (image.pixels[i] != 255)
+			return DDS_FORMAT_BC3;
+	}
+	return DDS_FORMAT_BC1;
+}
+
+/**
+*  @brief Whether the G-buffer pixel shader would clip any texel, the same test the app does on source images.
+*/
+static bool IsAlphaTested(const Image& image)
+{
+	for (size_t i = 3; i < image.pixels.size(); i += 4)
+	{
+		if (image.pixels[i] < DDS_ALPHA_CLIP_THRESHOLD)
+			return true;
+	}
+	return false;
+}
+
+static const char* FormatName(DDSFormat format)
+{
+	switch (format)
+	{
+	case DDS_FORMAT_BC1: return "BC1";
+	case DDS_FORMAT_BC3: return "BC3";
+	case DDS_FORMAT_BC5: return "BC5";
+	default: return "unknown";
+	}
+}
+
+/**
+*  @brief The default output path, the input with its extension replaced by .dds.
+*/
+static std::string OutputPath(const std::string& input)
+{
+	size_t dot = input.find_last_of('.');
+	size_t slash = input.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return input + ".dds";
+	return input.substr(0, dot) + ".dds";
+}
+
+/**
+*  @brief Bakes one image.
+*
+*  @return true if the DDS was written.
+*/
+static bool Bake(const std::string& input, const std::string& output, DDSFormat requested, MipFilter filter)
+{
+	int width = 0;
+	int height = 0;
+	int components = 0;
+	unsigned char* data = stbi_load(input.c_str(), &width, &height, &components, 4);
+	if (!data)
+	{
+		fprintf(stderr, "Failed to load %s: %s\n", input.c_str(), stbi_failure_reason());
+		return false;
+	}
+
+	Image source((uint32_t)width, (uint32_t)height);
+	memcpy(&source.pixels[0], data, source.pixels.size());
+	stbi_image_free(data);
+
+	// The device only takes whole blocks at the top mip
+	const Image top = ResizeToBlockMultiple(source);
+	if (top.width != source.width || top.height != source.height)
+		printf("%s is %ux%u, resized to %ux%u\n", input.c_str(), source.width, source.height, top.width, top.height);
+
+	const DDSFormat format = requested != DDS_FORMAT_UNKNOWN ? requested : ChooseFormat(input, top);
+	const std::vector<Image> mips = BuildMipChain(top, filter);
+
+	const std::vector<uint8_t> encoded = EncodeDDS(mips, format, format != DDS_FORMAT_BC5 && IsAlphaTested(top));
+	const size_t bytes = encoded.size() - sizeof(uint32_t) - sizeof(DDSHeader);
+
+	FILE* file = fopen(output.c_str(), "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", output.c_str());
+		return false;
+	}
+	bool written = fwrite(&encoded[0], 1, encoded.size(), file) == encoded.size();
+	fclose(file);
+
+	if (!written)
+	{
+		fprintf(stderr, "Failed to write %s\n", output.c_str());
+		remove(output.c_str());
+		return false;
+	}
+
+	printf("%s -> %s (%ux%u, %s, %u mips, %u KB -> %u KB)\n", input.c_str(), output.c_str(), top.width, top.height,
+		FormatName(format), (unsigned int)mips.size(), (unsigned int)(top.pixels.size() / 1024), (unsigned int)(bytes / 1024));
+	return true;
+}
+
+static void PrintUsage()
+{
+	printf("Usage: TextureBaker [-f auto|bc1|bc3|bc5] [-m box|kaiser] [-o output.dds] input.png [input2.png ...]\n");
+	printf("  -f  Output format, auto picks BC5 for _bump maps, BC3 with alpha, otherwise BC1 (default auto)\n");
+	printf("  -m  Mip filter (default box)\n");
+	printf("  -o  Output path, only with a single input (default input path with a .dds extension)\n");
+}
+
+int main(int argc, char** argv)
+{
+	DDSFormat format = DDS_FORMAT_UNKNOWN;
+	MipFilter filter = MIP_FILTER_BOX;
+	std::string output;
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (arg == "-f" && i + 1 < argc)
+		{
+			const std::string value = argv[++i];
+			if (value == "bc1") format = DDS_FORMAT_BC1;
+			else if (value == "bc3") format = DDS_FORMAT_BC3;
+			else if (value == "bc5") format = DDS_FORMAT_BC5;
+			else if (value != "auto")
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (arg == "-m" && i + 1 < argc)
+		{
+			const std::string value = argv[++i];
+			if (value == "kaiser") filter = MIP_FILTER_KAISER;
+			else if (value != "box")
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (arg == "-o" && i + 1 < argc)
+		{
+			output = argv[++i];
+		}
+		else if (arg == "-h" || arg == "--help")
+		{
+			PrintUsage();
+			return 0;
+		}
+		else
+		{
+			inputs.push_back(arg);
+		}
+	}
+
+	if (inputs.empty() || (!output.empty() && inputs.size() > 1))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	int failures = 0;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		if (!Bake(inputs[i], output.empty() ? OutputPath(inputs[i]) : output, format, filter))
+			failures++;
+	}
+	return failures == 0 ? 0 : 1;
+}
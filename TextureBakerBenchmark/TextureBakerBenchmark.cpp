@@ -0,0 +1,487 @@
+/**
+*  @file TextureBakerBenchmark.cpp
+*  @brief Command line tool that checks the TextureBaker's filters, encoders and DDS files, and times them.
+*
+*  The SSE2 box filter has to match a plain 2x2 average byte for byte, on even sizes and the odd ones
+*  that fall back to the generic path, and the mip chain has to end at 1x1. Images are stretched to
+*  whole blocks without changing flat colours. Each BC1, BC3 and BC5 block is decoded again and checked:
+*  flat blocks only lose the 565 rounding, every BC4 channel is within half a palette step with its
+*  ends exact, and BC1 stays under an RMS error bound on smooth and noisy images. Every DDS written
+*  has to parse back with the same format, size, mips and alpha tested flag, with each mip where
+*  DDSParse says, while truncated files and ones that aren't whole blocks are refused.
+*  Then times the box filter against the scalar one, the Kaiser filter and each encoder.
+*  Only uses the C++ standard library and SSE2, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -msse2 -I../TextureBaker -I../TestApp -I../inc TextureBakerBenchmark.cpp ../TextureBaker/MipChain.cpp ../TextureBaker/BlockCompression.cpp -o TextureBakerBenchmark
+*
+*  Usage: TextureBakerBenchmark [size]
+*
+*  @bug No known bugs.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "BlockCompression.h"
+#include "DDS.h"
+#include "MipChain.h"
+
+/// BC1 fits each block with a line through colour space, so a gradient in two directions costs a few steps,
+/// and uniform noise only has to beat filling each block with its mean, about 74.
+static const double MAX_BC1_SMOOTH_RMS = 5.0;
+static const double MAX_BC1_NOISE_RMS = 64.0;
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+static Image RandomImage(uint32_t width, uint32_t height, std::mt19937& random)
+{
+	Image image(width, height);
+	for (size_t i = 0; i < image.pixels.size(); i++)
+		image.pixels[i] = (uint8_t)random();
+	return image;
+}
+
+/**
+*  @brief A gradient in each channel with a little noise, like most real textures.
+*/
+static Image SmoothImage(uint32_t width, uint32_t height, std::mt19937& random)
+{
+	Image image(width, height);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			uint8_t* pixel = &image.pixels[((size_t)y * width + x) * 4];
+			pixel[0] = (uint8_t)(x * 255 / (width > 1 ? width - 1 : 1));
+			pixel[1] = (uint8_t)(y * 255 / (height > 1 ? height - 1 : 1));
+			pixel[2] = (uint8_t)(128 + (int)(random() % 5) - 2);
+			pixel[3] = (uint8_t)((x + y) * 255 / (width + height));
+		}
+	}
+	return image;
+}
+
+/**
+*  @brief The 2x2 box filter one pixel at a time, clamping odd edges.
+*/
+static Image DownsampleReference(const Image& source)
+{
+	Image dest(source.width > 1 ? source.width / 2 : 1, source.height > 1 ? source.height / 2 : 1);
+	for (uint32_t y = 0; y < dest.height; y++)
+	{
+		const uint32_t y0 = y * 2;
+		const uint32_t y1 = y * 2 + 1 < source.height ? y * 2 + 1 : source.height - 1;
+		for (uint32_t x = 0; x < dest.width; x++)
+		{
+			const uint32_t x0 = x * 2;
+			const uint32_t x1 = x * 2 + 1 < source.width ? x * 2 + 1 : source.width - 1;
+			for (int c = 0; c < 4; c++)
+			{
+				const uint32_t sum = source.pixels[((size_t)y0 * source.width + x0) * 4 + c] +
+					source.pixels[((size_t)y0 * source.width + x1) * 4 + c] +
+					source.pixels[((size_t)y1 * source.width + x0) * 4 + c] +
+					source.pixels[((size_t)y1 * source.width + x1) * 4 + c];
+				dest.pixels[((size_t)y * dest.width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+			}
+		}
+	}
+	return dest;
+}
+
+static void Unpack565(uint16_t c, int rgb[3])
+{
+	const int r = (c >> 11) & 31;
+	const int g = (c >> 5) & 63;
+	const int b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+/**
+*  @brief Decodes a BC1 block's colour the way the D3D11 spec describes, into the RGB of 16 RGBA pixels.
+*/
+static void DecodeBC1Block(const uint8_t in[8], uint8_t out[64])
+{
+	const uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8));
+	const uint16_t c1 = (uint16_t)(in[2] | (in[3] << 8));
+	int palette[4][3];
+	Unpack565(c0, palette[0]);
+	Unpack565(c1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		if (c0 > c1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	uint32_t indices;
+	memcpy(&indices, in + 4, 4);
+	for (int i = 0; i < 16; i++)
+	{
+		const int index = (indices >> (i * 2)) & 3;
+		for (int c = 0; c < 3; c++)
+			out[i * 4 + c] = (uint8_t)palette[index][c];
+	}
+}
+
+/**
+*  @brief Decodes a BC4 block into one channel of 16 RGBA pixels.
+*/
+static void DecodeBC4Block(const uint8_t in[8], int channel, uint8_t out[64])
+{
+	const int v0 = in[0];
+	const int v1 = in[1];
+	int palette[8];
+	palette[0] = v0;
+	palette[1] = v1;
+	if (v0 > v1)
+	{
+		for (int p = 1; p < 7; p++)
+			palette[p + 1] = ((7 - p) * v0 + p * v1) / 7;
+	}
+	else
+	{
+		for (int p = 1; p < 5; p++)
+			palette[p + 1] = ((5 - p) * v0 + p * v1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= (uint64_t)in[2 + i] << (i * 8);
+	for (int i = 0; i < 16; i++)
+		out[i * 4 + channel] = (uint8_t)palette[(indices >> (i * 3)) & 7];
+}
+
+/**
+*  @brief Decodes a whole image, the channels a format doesn't store are left at 0.
+*/
+static Image DecodeImage(const uint8_t* encoded, uint32_t width, uint32_t height, DDSFormat format)
+{
+	Image image(width, height);
+	const uint32_t blocksWide = (width + 3) / 4;
+	const uint32_t blocksHigh = (height + 3) / 4;
+	const uint32_t blockBytes = DDSBlockBytes(format);
+
+	uint8_t block[64];
+	for (uint32_t by = 0; by < blocksHigh; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksWide; bx++)
+		{
+			memset(block, 0, sizeof(block));
+			const uint8_t* in = encoded + ((size_t)by * blocksWide + bx) * blockBytes;
+			switch (format)
+			{
+			case DDS_FORMAT_BC1: DecodeBC1Block(in, block); break;
+			case DDS_FORMAT_BC3: DecodeBC4Block(in, 3, block); DecodeBC1Block(in + 8, block); break;
+			case DDS_FORMAT_BC5: DecodeBC4Block(in, 0, block); DecodeBC4Block(in + 8, 1, block); break;
+			default: break;
+			}
+
+			for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++)
+			{
+				for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++)
+					memcpy(&image.pixels[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], &block[(y * 4 + x) * 4], 4);
+			}
+		}
+	}
+	return image;
+}
+
+/**
+*  @brief The RMS error over the RGB of two images.
+*/
+static double RMSErrorRGB(const Image& a, const Image& b)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < a.pixels.size(); i++)
+	{
+		if (i % 4 == 3)
+			continue;
+		const double d = (double)a.pixels[i] - b.pixels[i];
+		sum += d * d;
+	}
+	return sqrt(sum / ((double)a.width * a.height * 3));
+}
+
+static void CheckBoxFilter(std::mt19937& random)
+{
+	// Even sizes take the SSE2 path, including widths that leave one pixel for the scalar tail
+	const uint32_t sizes[][2] = { { 2, 2 }, { 4, 4 }, { 6, 2 }, { 8, 6 }, { 34, 18 }, { 256, 128 }, { 2, 64 },
+		{ 3, 3 }, { 5, 4 }, { 1, 7 }, { 7, 1 }, { 9, 5 }, { 255, 33 } };
+	bool matches = true;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		const Image source = RandomImage(sizes[s][0], sizes[s][1], random);
+		const Image box = Downsample(source, MIP_FILTER_BOX);
+		const Image reference = DownsampleReference(source);
+		matches = matches && box.width == reference.width && box.height == reference.height && box.pixels == reference.pixels;
+	}
+	CHECK(matches);
+
+	// Flat colours stay flat with either filter
+	Image flat(40, 24);
+	for (size_t i = 0; i < flat.pixels.size(); i++)
+		flat.pixels[i] = (uint8_t)(i % 4 * 60 + 17);
+	const Image flatBox = Downsample(flat, MIP_FILTER_BOX);
+	const Image flatKaiser = Downsample(flat, MIP_FILTER_KAISER);
+	bool flatKept = true;
+	for (size_t i = 0; i < flatBox.pixels.size(); i++)
+	{
+		const int expected = (int)(i % 4 * 60 + 17);
+		flatKept = flatKept && flatBox.pixels[i] == expected && abs(flatKaiser.pixels[i] - expected) <= 1;
+	}
+	CHECK(flatKept);
+
+	const std::vector<Image> mips = BuildMipChain(RandomImage(24, 5, random), MIP_FILTER_BOX);
+	CHECK(mips.size() == MipCount(24, 5));
+	CHECK(mips.size() == 5);
+	CHECK(mips.back().width == 1 && mips.back().height == 1);
+}
+
+static void CheckResize(std::mt19937& random)
+{
+	Image flat(10, 7);
+	for (size_t i = 0; i < flat.pixels.size(); i++)
+		flat.pixels[i] = (uint8_t)(i % 4 * 50 + 33);
+	const Image resized = ResizeToBlockMultiple(flat);
+	CHECK(resized.width == 12 && resized.height == 8);
+	bool flatKept = true;
+	for (size_t i = 0; i < resized.pixels.size(); i++)
+		flatKept = flatKept && resized.pixels[i] == i % 4 * 50 + 33;
+	CHECK(flatKept);
+
+	const Image whole = RandomImage(16, 4, random);
+	const Image same = ResizeToBlockMultiple(whole);
+	CHECK(same.width == 16 && same.height == 4 && same.pixels == whole.pixels);
+
+	const Image tiny = ResizeToBlockMultiple(RandomImage(1, 1, random));
+	CHECK(tiny.width == 4 && tiny.height == 4);
+}
+
+static void CheckEncoders(std::mt19937& random)
+{
+	// Flat blocks only lose the 565 rounding in BC1, and nothing in BC4
+	bool flatBC1 = true;
+	bool flatBC4 = true;
+	for (int i = 0; i < 1000; i++)
+	{
+		uint8_t block[64];
+		const uint8_t colour[4] = { (uint8_t)random(), (uint8_t)random(), (uint8_t)random(), (uint8_t)random() };
+		for (int p = 0; p < 16; p++)
+			memcpy(&block[p * 4], colour, 4);
+
+		uint8_t encoded[16];
+		uint8_t decoded[64];
+		EncodeBC3Block(block, encoded);
+		DecodeBC4Block(encoded, 3, decoded);
+		DecodeBC1Block(encoded + 8, decoded);
+		for (int p = 0; p < 16; p++)
+		{
+			flatBC1 = flatBC1 && abs(decoded[p * 4 + 0] - colour[0]) <= 4 && abs(decoded[p * 4 + 1] - colour[1]) <= 2 &&
+				abs(decoded[p * 4 + 2] - colour[2]) <= 4;
+			flatBC4 = flatBC4 && decoded[p * 4 + 3] == colour[3];
+		}
+	}
+	CHECK(flatBC1);
+	CHECK(flatBC4);
+
+	// BC4 picks the closest of 8 values spread over the block's range, whose ends are exact
+	bool bc4InBounds = true;
+	bool bc4EndsExact = true;
+	for (int i = 0; i < 1000; i++)
+	{
+		uint8_t block[64];
+		const int low = (int)(random() % 256);
+		const int range = (int)(random() % (256 - low));
+		for (int p = 0; p < 64; p++)
+			block[p] = (uint8_t)(low + (range ? (int)(random() % (range + 1)) : 0));
+
+		uint8_t encoded[16];
+		uint8_t decoded[64];
+		EncodeBC5Block(block, encoded);
+		DecodeBC4Block(encoded, 0, decoded);
+		DecodeBC4Block(encoded + 8, 1, decoded);
+		for (int c = 0; c < 2; c++)
+		{
+			int minV = 255;
+			int maxV = 0;
+			for (int p = 0; p < 16; p++)
+			{
+				minV = block[p * 4 + c] < minV ? block[p * 4 + c] : minV;
+				maxV = block[p * 4 + c] > maxV ? block[p * 4 + c] : maxV;
+			}
+			for (int p = 0; p < 16; p++)
+			{
+				const int error = abs(decoded[p * 4 + c] - block[p * 4 + c]);
+				bc4InBounds = bc4InBounds && error * 14 <= maxV - minV + 14;
+				if (block[p * 4 + c] == minV || block[p * 4 + c] == maxV)
+					bc4EndsExact = bc4EndsExact && error == 0;
+			}
+		}
+	}
+	CHECK(bc4InBounds);
+	CHECK(bc4EndsExact);
+
+	// Whole images through each format, including blocks that hang off the edge
+	const Image smooth = SmoothImage(61, 37, random);
+	const Image noise = RandomImage(64, 64, random);
+	const std::vector<uint8_t> smoothBC1 = EncodeImage(smooth, DDS_FORMAT_BC1);
+	const std::vector<uint8_t> noiseBC1 = EncodeImage(noise, DDS_FORMAT_BC1);
+	CHECK(smoothBC1.size() == DDSMipSize(DDS_FORMAT_BC1, 61, 37));
+	const double smoothRMS = RMSErrorRGB(smooth, DecodeImage(&smoothBC1[0], smooth.width, smooth.height, DDS_FORMAT_BC1));
+	const double noiseRMS = RMSErrorRGB(noise, DecodeImage(&noiseBC1[0], noise.width, noise.height, DDS_FORMAT_BC1));
+	CHECK(smoothRMS < MAX_BC1_SMOOTH_RMS);
+	CHECK(noiseRMS < MAX_BC1_NOISE_RMS);
+
+	// BC3 keeps the colour of BC1 and adds the alpha
+	const std::vector<uint8_t> smoothBC3 = EncodeImage(smooth, DDS_FORMAT_BC3);
+	CHECK(smoothBC3.size() == DDSMipSize(DDS_FORMAT_BC3, 61, 37));
+	const Image decodedBC3 = DecodeImage(&smoothBC3[0], smooth.width, smooth.height, DDS_FORMAT_BC3);
+	CHECK(RMSErrorRGB(smooth, decodedBC3) == smoothRMS);
+	bool alphaClose = true;
+	for (size_t i = 3; i < smooth.pixels.size(); i += 4)
+		alphaClose = alphaClose && abs(decodedBC3.pixels[i] - smooth.pixels[i]) <= 2;
+	CHECK(alphaClose);
+
+	// BC5 only keeps red and green
+	const std::vector<uint8_t> smoothBC5 = EncodeImage(smooth, DDS_FORMAT_BC5);
+	const Image decodedBC5 = DecodeImage(&smoothBC5[0], smooth.width, smooth.height, DDS_FORMAT_BC5);
+	bool redGreenClose = true;
+	for (size_t i = 0; i < smooth.pixels.size(); i += 4)
+	{
+		redGreenClose = redGreenClose && abs(decodedBC5.pixels[i] - smooth.pixels[i]) <= 2 &&
+			abs(decodedBC5.pixels[i + 1] - smooth.pixels[i + 1]) <= 2;
+	}
+	CHECK(redGreenClose);
+}
+
+static void CheckDDS(std::mt19937& random)
+{
+	const DDSFormat formats[] = { DDS_FORMAT_BC1, DDS_FORMAT_BC3, DDS_FORMAT_BC5 };
+	const std::vector<Image> mips = BuildMipChain(RandomImage(20, 12, random), MIP_FILTER_BOX);
+	for (int f = 0; f < 3; f++)
+	{
+		for (int alphaTested = 0; alphaTested < 2; alphaTested++)
+		{
+			const std::vector<uint8_t> file = EncodeDDS(mips, formats[f], alphaTested != 0);
+			DDSInfo info;
+			memset(&info, 0, sizeof(info));
+			CHECK(DDSParse(&file[0], file.size(), info));
+			CHECK(info.format == formats[f]);
+			CHECK(info.width == 20 && info.height == 12);
+			CHECK(info.mipCount == mips.size());
+			CHECK(info.alphaTested == (alphaTested != 0));
+
+			// Each mip is where the loader will point the device at, and nothing follows the last
+			size_t offset = info.dataOffset;
+			bool mipsMatch = true;
+			for (size_t i = 0; i < mips.size(); i++)
+			{
+				const std::vector<uint8_t> encoded = EncodeImage(mips[i], formats[f]);
+				mipsMatch = mipsMatch && offset + encoded.size() <= file.size() && memcmp(&file[offset], &encoded[0], encoded.size()) == 0;
+				offset += DDSMipSize(formats[f], mips[i].width, mips[i].height);
+			}
+			CHECK(mipsMatch);
+			CHECK(offset == file.size());
+
+			// A byte short of the last mip
+			CHECK(!DDSParse(&file[0], file.size() - 1, info));
+		}
+	}
+
+	std::vector<uint8_t> file = EncodeDDS(mips, DDS_FORMAT_BC3, false);
+	DDSHeader header;
+	memcpy(&header, &file[sizeof(uint32_t)], sizeof(DDSHeader));
+	DDSInfo info;
+
+	// Not whole blocks, even with every byte present
+	DDSHeader odd = header;
+	odd.width = 18;
+	memcpy(&file[sizeof(uint32_t)], &odd, sizeof(DDSHeader));
+	CHECK(!DDSParse(&file[0], file.size(), info));
+	odd = header;
+	odd.height = 10;
+	memcpy(&file[sizeof(uint32_t)], &odd, sizeof(DDSHeader));
+	CHECK(!DDSParse(&file[0], file.size(), info));
+
+	// Files from other tools don't carry the flag, so any BC3 counts as alpha tested
+	DDSHeader untagged = header;
+	untagged.reserved1[0] = 0;
+	untagged.reserved1[1] = 0;
+	memcpy(&file[sizeof(uint32_t)], &untagged, sizeof(DDSHeader));
+	CHECK(DDSParse(&file[0], file.size(), info) && info.alphaTested);
+	untagged.pixelFormat.fourCC = DDSFourCC(DDS_FORMAT_BC1);
+	memcpy(&file[sizeof(uint32_t)], &untagged, sizeof(DDSHeader));
+	CHECK(DDSParse(&file[0], file.size(), info) && !info.alphaTested);
+
+	// Not a DDS at all
+	file[0] = 'X';
+	CHECK(!DDSParse(&file[0], file.size(), info));
+}
+
+template<typename Function>
+static double TimeMs(Function function)
+{
+	double best = 1e30;
+	for (int round = 0; round < 3; round++)
+	{
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		function();
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		best = ms < best ? ms : best;
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t size = argc > 1 ? (uint32_t)atoi(argv[1]) : 2048;
+	size = size < 4 ? 4 : size & ~3u;
+
+	std::mt19937 random(1234);
+	CheckBoxFilter(random);
+	CheckResize(random);
+	CheckEncoders(random);
+	CheckDDS(random);
+	printf(gFailures == 0 ? "All checks passed\n\n" : "Checks failed\n\n");
+
+	const Image image = SmoothImage(size, size, random);
+	const double megapixels = (double)size * size / 1e6;
+	size_t sink = 0;
+
+	printf("%ux%u image\n", size, size);
+	const double boxMs = TimeMs([&]() { sink += Downsample(image, MIP_FILTER_BOX).pixels[0]; });
+	const double referenceMs = TimeMs([&]() { sink += DownsampleReference(image).pixels[0]; });
+	const double kaiserMs = TimeMs([&]() { sink += Downsample(image, MIP_FILTER_KAISER).pixels[0]; });
+	printf("  Box filter SSE2    %8.2f ms  %6.2fx\n", boxMs, referenceMs / boxMs);
+	printf("  Box filter scalar  %8.2f ms\n", referenceMs);
+	printf("  Kaiser filter      %8.2f ms\n", kaiserMs);
+
+	const DDSFormat formats[] = { DDS_FORMAT_BC1, DDS_FORMAT_BC3, DDS_FORMAT_BC5 };
+	const char* names[] = { "BC1", "BC3", "BC5" };
+	for (int f = 0; f < 3; f++)
+	{
+		const double ms = TimeMs([&]() { sink += EncodeImage(image, formats[f])[0]; });
+		printf("  Encode %s         %8.2f ms  %6.1f MPixels/s\n", names[f], ms, megapixels / (ms / 1000.0));
+	}
+
+	// Keep the results alive
+	if (sink == 1)
+		printf("\n");
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+/**
+*  @file TimerBenchmark.cpp
+*  @brief Command line tool that checks the Timer on a ManualClock, and measures the real frame rate cap.
+*
+*  Steps a ManualClock by hand and checks the Timer hands out whole fixed steps and carries the rest,
+*  drops the steps beyond MAX_FIXED_STEPS_PER_FRAME, averages DeltaTime over the smoothing frames,
+*  waits out frames quicker than the cap, and clamps long frames for the game but not for GetStats,
+*  whose 99th percentile has to pick the right frame. Then runs frames capped on the real clock and
+*  prints how close they came to the cap.
+*  Only uses the C++ standard library, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -pthread -I../TestApp TimerBenchmark.cpp ../TestApp/Timer.cpp -o TimerBenchmark
+*
+*  Usage: TimerBenchmark [max frame rate] [frames]
+*
+*  @bug No known bugs.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "Timer.h"
+
+// A power of two fraction of a second, so the steps add up exactly
+static const double STEP = 1.0 / 64.0;
+static const double TOLERANCE = 1e-9;
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+static bool Near(double a, double b)
+{
+	return fabs(a - b) < TOLERANCE;
+}
+
+/**
+*  @brief Moves the clock on and updates the timer, as one frame.
+*/
+static void Frame(ManualClock& clock, Timer& timer, double seconds)
+{
+	clock.AdvanceSeconds(seconds);
+	timer.UpdateTime();
+}
+
+static unsigned int ConsumeSteps(Timer& timer)
+{
+	unsigned int steps = 0;
+	while (timer.ConsumeFixedStep())
+		steps++;
+	return steps;
+}
+
+static void CheckFixedSteps()
+{
+	ManualClock clock;
+	Timer timer(&clock);
+	timer.SetFixedTimestep(STEP);
+
+	// The first update only starts the timer
+	timer.UpdateTime();
+	CHECK(timer.DeltaTime() == 0.0);
+	CHECK(timer.FrameCount() == 0);
+	CHECK(ConsumeSteps(timer) == 0);
+
+	// Two and a half steps, then the half left over makes the next frame's two and a half three
+	Frame(clock, timer, STEP * 2.5);
+	CHECK(ConsumeSteps(timer) == 2);
+	CHECK(Near(timer.GetFixedStepAlpha(), 0.5));
+	Frame(clock, timer, STEP * 2.5);
+	CHECK(ConsumeSteps(timer) == 3);
+	CHECK(Near(timer.GetFixedStepAlpha(), 0.0));
+
+	// Many short frames add up to the same steps as one long one
+	unsigned int steps = 0;
+	for (int i = 0; i < 100; i++)
+	{
+		Frame(clock, timer, STEP * 0.25);
+		steps += ConsumeSteps(timer);
+	}
+	CHECK(steps == 25);
+	CHECK(timer.FrameCount() == 102);
+
+	// A frame owing 12.8 steps only runs the most allowed, the whole steps beyond are dropped
+	Frame(clock, timer, STEP * 12.8);
+	CHECK(ConsumeSteps(timer) == Timer::MAX_FIXED_STEPS_PER_FRAME);
+	CHECK(Near(timer.GetFixedStepAlpha(), 0.8));
+	CHECK(!timer.ConsumeFixedStep());
+	Frame(clock, timer, STEP);
+	CHECK(ConsumeSteps(timer) == 1);
+	CHECK(Near(timer.GetFixedStepAlpha(), 0.8));
+
+	// Turning fixed steps off hands none out
+	timer.SetFixedTimestep(0.0);
+	Frame(clock, timer, STEP * 4);
+	CHECK(ConsumeSteps(timer) == 0);
+	CHECK(timer.GetFixedStepAlpha() == 0.0);
+}
+
+static void CheckSmoothing()
+{
+	ManualClock clock;
+	Timer timer(&clock);
+	timer.SetSmoothingFrames(4);
+	timer.UpdateTime();
+
+	// Averages over the frames seen so far until there are enough
+	Frame(clock, timer, 0.010);
+	CHECK(Near(timer.DeltaTime(), 0.010));
+	Frame(clock, timer, 0.030);
+	CHECK(Near(timer.DeltaTime(), 0.020));
+	Frame(clock, timer, 0.010);
+	Frame(clock, timer, 0.050);
+	CHECK(Near(timer.DeltaTime(), 0.025));
+	CHECK(Near(timer.RawDeltaTime(), 0.050));
+
+	// The oldest frame drops out
+	Frame(clock, timer, 0.050);
+	CHECK(Near(timer.DeltaTime(), 0.035));
+	CHECK(Near(timer.TotalTime(), 0.150));
+
+	timer.SetSmoothingFrames(1);
+	Frame(clock, timer, 0.030);
+	CHECK(Near(timer.DeltaTime(), 0.030));
+	Frame(clock, timer, 0.005);
+	CHECK(Near(timer.DeltaTime(), 0.005));
+
+	// Out of range counts are clamped
+	timer.SetSmoothingFrames(0);
+	CHECK(timer.GetSmoothingFrames() == 1);
+	timer.SetSmoothingFrames(Timer::MAX_SMOOTHING_FRAMES + 10);
+	CHECK(timer.GetSmoothingFrames() == Timer::MAX_SMOOTHING_FRAMES);
+}
+
+static void CheckFrameRateCap()
+{
+	ManualClock clock;
+	Timer timer(&clock);
+	timer.SetSmoothingFrames(1);
+	timer.SetMaxFrameRate(100.0);
+	timer.UpdateTime();
+	const Clock::Duration start = clock.Now();
+
+	// A quick frame waits for the rest of the 10 ms
+	Frame(clock, timer, 0.003);
+	CHECK(Near(timer.RawDeltaTime(), 0.010));
+	CHECK(clock.Now() - start == std::chrono::milliseconds(10));
+
+	// A slow one doesn't wait at all
+	Frame(clock, timer, 0.015);
+	CHECK(Near(timer.RawDeltaTime(), 0.015));
+	CHECK(clock.Now() - start == std::chrono::milliseconds(25));
+
+	timer.SetMaxFrameRate(0.0);
+	Frame(clock, timer, 0.001);
+	CHECK(Near(timer.RawDeltaTime(), 0.001));
+	CHECK(clock.Now() - start == std::chrono::milliseconds(26));
+}
+
+static void CheckStats()
+{
+	ManualClock clock;
+	Timer timer(&clock);
+	timer.SetFixedTimestep(STEP);
+	timer.UpdateTime();
+	CHECK(timer.GetStats().miFrames == 0);
+
+	// A one second hitch moves the game by MAX_DELTA_TIME, but the stats show the whole second
+	Frame(clock, timer, 1.0);
+	CHECK(Near(timer.RawDeltaTime(), Timer::MAX_DELTA_TIME));
+	CHECK(Near(timer.TotalTime(), Timer::MAX_DELTA_TIME));
+	CHECK(ConsumeSteps(timer) == Timer::MAX_FIXED_STEPS_PER_FRAME);
+	FrameStats stats = timer.GetStats();
+	CHECK(stats.miFrames == 1);
+	CHECK(Near(stats.mMaxMs, 1000.0));
+	CHECK(Near(stats.mP99Ms, 1000.0));
+
+	// 99 frames of 10 ms after it, the 99th percentile of 100 is the second slowest
+	for (int i = 0; i < 99; i++)
+		Frame(clock, timer, 0.010);
+	stats = timer.GetStats();
+	CHECK(stats.miFrames == 100);
+	CHECK(Near(stats.mMinMs, 10.0));
+	CHECK(Near(stats.mP99Ms, 10.0));
+	CHECK(Near(stats.mMaxMs, 1000.0));
+	CHECK(Near(stats.mAverageMs, (1000.0 + 99 * 10.0) / 100));
+
+	// One 40 ms frame more, the 99th percentile of 101 is still the second slowest
+	Frame(clock, timer, 0.040);
+	stats = timer.GetStats();
+	CHECK(stats.miFrames == 101);
+	CHECK(Near(stats.mP99Ms, 40.0));
+
+	// Only the last STATS_FRAMES are kept, so the hitch and the 40 ms frame age out
+	for (unsigned int i = 0; i < Timer::STATS_FRAMES; i++)
+		Frame(clock, timer, 0.020);
+	stats = timer.GetStats();
+	CHECK(stats.miFrames == Timer::STATS_FRAMES);
+	CHECK(Near(stats.mMinMs, 20.0));
+	CHECK(Near(stats.mP99Ms, 20.0));
+	CHECK(Near(stats.mMaxMs, 20.0));
+}
+
+int main(int argc, char** argv)
+{
+	const double maxFrameRate = argc > 1 ? atof(argv[1]) : 240.0;
+	const int frames = argc > 2 ? atoi(argv[2]) : 240;
+	if (maxFrameRate <= 0.0 || frames <= 0)
+	{
+		fprintf(stderr, "Usage: TimerBenchmark [max frame rate] [frames]\n");
+		return 1;
+	}
+
+	CheckFixedSteps();
+	CheckSmoothing();
+	CheckFrameRateCap();
+	CheckStats();
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	// Empty frames on the real clock, so the times are all the cap's waiting
+	Timer timer;
+	timer.SetMaxFrameRate(maxFrameRate);
+	timer.UpdateTime();
+	for (int i = 0; i < frames; i++)
+		timer.UpdateTime();
+
+	const FrameStats stats = timer.GetStats();
+	printf("%d frames capped at %.0f fps, target %.3f ms\n", frames, maxFrameRate, 1000.0 / maxFrameRate);
+	printf("  min %.3f ms  average %.3f ms  p99 %.3f ms  max %.3f ms\n", stats.mMinMs, stats.mAverageMs, stats.mP99Ms, stats.mMaxMs);
+	return gFailures == 0 ? 0 : 1;
+}
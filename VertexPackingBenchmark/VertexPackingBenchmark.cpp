@@ -0,0 +1,352 @@
+/**
+*  @file VertexPackingBenchmark.cpp
+*  @brief Command line tool that checks packed vertices stay within their error bounds, and times packing them.
+*
+*  Round trips random vertices, and the awkward ones, through VertexPacking and checks each component
+*  against the bounds in VertexPacking.h: positions on the box's faces and in flat boxes, normals along
+*  the axes and the octahedron's folds, and every half float there is. The SSE2 normal encoding has to
+*  give the same snorm values as the scalar one in GBufferPacking, and texture coordinates the same
+*  halves as rounding by hand. Then times packing and unpacking a large mesh.
+*  Only uses the C++ standard library and glm, so it builds on Linux too, e.g.
+*      g++ -O2 -std=c++14 -msse2 -I../TestApp -I../inc VertexPackingBenchmark.cpp ../TestApp/VertexPacking.cpp ../TestApp/GBufferPacking.cpp -o VertexPackingBenchmark
+*
+*  Usage: VertexPackingBenchmark [vertices]
+*
+*  @bug No known bugs.
+*/
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "GBufferPacking.h"
+#include "VertexPacking.h"
+
+/// The bounds VertexPacking.h promises.
+static const float MAX_POSITION_STEPS = 0.5f;
+static const float MAX_NORMAL_ERROR_DEGREES = 0.05f;
+static const float MAX_TEXCOORD_RELATIVE_ERROR = 1.0f / 2048.0f;
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); gFailures++; } else (void)0
+
+/**
+*  @brief Expands a half float bit by bit, the way the input assembler does.
+*/
+static float HalfToFloat(uint16_t half)
+{
+	const float sign = (half & 0x8000) ? -1.0f : 1.0f;
+	const int exponent = (half >> 10) & 0x1f;
+	const int mantissa = half & 0x3ff;
+	if (exponent == 0)
+		return sign * ldexpf((float)mantissa, -24);
+	if (exponent == 0x1f)
+		return mantissa ? NAN : sign * INFINITY;
+	return sign * ldexpf((float)(mantissa | 0x400), exponent - 25);
+}
+
+static Vertex RandomVertex(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> texcoord(-4.0f, 4.0f);
+	std::normal_distribution<float> direction;
+	glm::vec3 normal;
+	do
+	{
+		normal = glm::vec3(direction(random), direction(random), direction(random));
+	} while (glm::length(normal) < 0.001f);
+	normal = glm::normalize(normal);
+	return Vertex(position(random), position(random) * 0.5f, position(random) * 0.01f, normal.x, normal.y, normal.z, texcoord(random), texcoord(random));
+}
+
+/**
+*  @brief Packs and unpacks the vertices, checking every component against its bound.
+*/
+static void CheckRoundTrip(const std::vector<Vertex>& vertices)
+{
+	const unsigned int count = (unsigned int)vertices.size();
+	const VertexQuantization quantization = VertexPacking::ComputeQuantization(vertices.data(), count);
+	std::vector<PackedVertex> packed(count);
+	std::vector<Vertex> unpacked(count);
+	VertexPacking::Pack(vertices.data(), count, quantization, packed.data());
+	VertexPacking::Unpack(packed.data(), count, quantization, unpacked.data());
+
+	bool positionsInBounds = true, normalsInBounds = true, normalsMatchScalar = true, texcoordsInBounds = true, wZero = true;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Vertex& in = vertices[i];
+		const Vertex& out = unpacked[i];
+
+		// Half a 16 bit step of the box, plus the float rounding of offset + unorm * scale
+		const float position[3] = { in.x, in.y, in.z };
+		const float decoded[3] = { out.x, out.y, out.z };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float scale = quantization.scale[axis];
+			const float rounding = 2.0f * FLT_EPSILON * (fabsf(quantization.offset[axis]) + scale);
+			positionsInBounds = positionsInBounds && fabsf(decoded[axis] - position[axis]) <= MAX_POSITION_STEPS * scale / 65535.0f + rounding;
+		}
+
+		const glm::vec3 normal(in.nx, in.ny, in.nz);
+		const glm::vec3 decodedNormal(out.nx, out.ny, out.nz);
+		const double cosine = glm::dot(glm::dvec3(normal), glm::dvec3(decodedNormal)) / (glm::length(glm::dvec3(normal)) * glm::length(glm::dvec3(decodedNormal)));
+		const double degrees = acos(cosine < 1.0 ? cosine : 1.0) * 180.0 / 3.14159265358979;
+		normalsInBounds = normalsInBounds && degrees <= MAX_NORMAL_ERROR_DEGREES;
+		const PackedNormal scalar = GBufferPacking::EncodeNormal(normal);
+		normalsMatchScalar = normalsMatchScalar && packed[i].nx == scalar.x && packed[i].ny == scalar.y;
+
+		// Relative to the value, or to the smallest normal half below that
+		const float texcoord[2] = { in.u, in.v };
+		const float decodedTexcoord[2] = { out.u, out.v };
+		for (int j = 0; j < 2; j++)
+		{
+			const float allowed = fmaxf(fabsf(texcoord[j]), ldexpf(1.0f, -14)) * MAX_TEXCOORD_RELATIVE_ERROR;
+			texcoordsInBounds = texcoordsInBounds && fabsf(decodedTexcoord[j] - texcoord[j]) <= allowed;
+		}
+
+		wZero = wZero && packed[i].w == 0;
+	}
+	CHECK(positionsInBounds);
+	CHECK(normalsInBounds);
+	CHECK(normalsMatchScalar);
+	CHECK(texcoordsInBounds);
+	CHECK(wZero);
+}
+
+static void CheckPositions(std::mt19937& random)
+{
+	// The corners of the box land exactly on 0 and 65535
+	std::vector<Vertex> vertices;
+	for (int i = 0; i < 13; i++)
+		vertices.push_back(RandomVertex(random));
+	vertices[3].x = -250.0f;
+	vertices[7].x = 1000.0f;
+	const VertexQuantization quantization = VertexPacking::ComputeQuantization(vertices.data(), (unsigned int)vertices.size());
+	CHECK(quantization.offset[0] == -250.0f && quantization.scale[0] == 1250.0f);
+	CHECK(quantization.offset[3] == 0.0f && quantization.scale[3] == 0.0f);
+	std::vector<PackedVertex> packed(vertices.size());
+	VertexPacking::Pack(vertices.data(), (unsigned int)vertices.size(), quantization, packed.data());
+	CHECK(packed[3].x == 0 && packed[7].x == 65535);
+	CheckRoundTrip(vertices);
+
+	// A flat mesh has no extent on one axis, which has to come back exactly
+	for (Vertex& vertex : vertices)
+		vertex.y = 3.25f;
+	CheckRoundTrip(vertices);
+	std::vector<Vertex> unpacked(vertices.size());
+	const VertexQuantization flat = VertexPacking::ComputeQuantization(vertices.data(), (unsigned int)vertices.size());
+	VertexPacking::Pack(vertices.data(), (unsigned int)vertices.size(), flat, packed.data());
+	VertexPacking::Unpack(packed.data(), (unsigned int)vertices.size(), flat, unpacked.data());
+	bool exact = true;
+	for (const Vertex& vertex : unpacked)
+		exact = exact && vertex.y == 3.25f;
+	CHECK(exact);
+
+	// Far from the origin, where the offset dominates
+	for (Vertex& vertex : vertices)
+		vertex.z += 5000.0f;
+	CheckRoundTrip(vertices);
+
+	// Nothing to pack
+	const VertexQuantization empty = VertexPacking::ComputeQuantization(nullptr, 0);
+	CHECK(empty.offset[0] == 0.0f && empty.scale[0] == 0.0f);
+}
+
+static void CheckNormals(std::mt19937& random)
+{
+	std::vector<glm::vec3> normals;
+
+	// The axes, the octahedron's corners
+	for (int axis = 0; axis < 3; axis++)
+	{
+		glm::vec3 normal(0.0f);
+		normal[axis] = 1.0f;
+		normals.push_back(normal);
+		normals.push_back(-normal);
+	}
+
+	// Around the equator, where the lower half folds over, and the diagonals
+	for (int i = 0; i < 64; i++)
+	{
+		const float angle = i * 6.2831853f / 64.0f;
+		normals.push_back(glm::vec3(cosf(angle), sinf(angle), 0.0f));
+		normals.push_back(glm::normalize(glm::vec3(cosf(angle), sinf(angle), -1e-6f)));
+		normals.push_back(glm::normalize(glm::vec3(cosf(angle), sinf(angle), 1e-6f)));
+	}
+	for (float x : { -1.0f, 1.0f })
+		for (float y : { -1.0f, 1.0f })
+			for (float z : { -1.0f, 1.0f })
+				normals.push_back(glm::normalize(glm::vec3(x, y, z)));
+
+	// Near the poles, and with a negative zero
+	normals.push_back(glm::normalize(glm::vec3(1e-5f, -1e-5f, -1.0f)));
+	normals.push_back(glm::normalize(glm::vec3(-1e-5f, 1e-5f, 1.0f)));
+	normals.push_back(glm::vec3(-0.0f, -0.0f, -1.0f));
+
+	std::vector<Vertex> vertices;
+	for (const glm::vec3& normal : normals)
+	{
+		Vertex vertex = RandomVertex(random);
+		vertex.nx = normal.x;
+		vertex.ny = normal.y;
+		vertex.nz = normal.z;
+		vertices.push_back(vertex);
+	}
+	for (int i = 0; i < 100000; i++)
+		vertices.push_back(RandomVertex(random));
+	CheckRoundTrip(vertices);
+}
+
+/**
+*  @brief Every half float has to pack back to itself, halfway cases round to even, and out of range values to infinity.
+*/
+static void CheckHalfFloats()
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint16_t> expected;
+	for (unsigned int half = 0; half < 0x10000; half++)
+	{
+		if ((half & 0x7c00) == 0x7c00 && (half & 0x3ff) != 0)
+			continue;
+		vertices.push_back(Vertex(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, HalfToFloat((uint16_t)half), 0.5f));
+		expected.push_back((uint16_t)half);
+	}
+
+	// Halfway between two halves, which are each one float bit pattern apart in the upper bits
+	for (unsigned int half = 0; half < 0x7bff; half++)
+	{
+		const float low = HalfToFloat((uint16_t)half);
+		const float high = HalfToFloat((uint16_t)(half + 1));
+		vertices.push_back(Vertex(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, (low + high) * 0.5f, 0.5f));
+		expected.push_back((uint16_t)(half & 1 ? half + 1 : half));
+	}
+
+	// The largest half is 65504, anything from 65520 up rounds to infinity
+	const float large[4] = { 65519.0f, 65520.0f, 1e6f, -1e30f };
+	const uint16_t largeExpected[4] = { 0x7bff, 0x7c00, 0x7c00, 0xfc00 };
+	for (int i = 0; i < 4; i++)
+	{
+		vertices.push_back(Vertex(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, large[i], 0.5f));
+		expected.push_back(largeExpected[i]);
+	}
+
+	const unsigned int count = (unsigned int)vertices.size();
+	const VertexQuantization quantization = VertexPacking::ComputeQuantization(vertices.data(), count);
+	std::vector<PackedVertex> packed(count);
+	std::vector<Vertex> unpacked(count);
+	VertexPacking::Pack(vertices.data(), count, quantization, packed.data());
+	VertexPacking::Unpack(packed.data(), count, quantization, unpacked.data());
+
+	unsigned int wrongPacks = 0, wrongUnpacks = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		wrongPacks += packed[i].u != expected[i] || packed[i].v != 0x3800 ? 1 : 0;
+		const float decoded = HalfToFloat(expected[i]);
+		wrongUnpacks += memcmp(&unpacked[i].u, &decoded, sizeof(float)) != 0 || unpacked[i].v != 0.5f ? 1 : 0;
+	}
+	CHECK(wrongPacks == 0);
+	CHECK(wrongUnpacks == 0);
+
+	// NaN stays NaN
+	Vertex nan(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, NAN, -NAN);
+	PackedVertex packedNaN;
+	VertexPacking::Pack(&nan, 1, quantization, &packedNaN);
+	VertexPacking::Unpack(&packedNaN, 1, quantization, &nan);
+	CHECK(isnan(nan.u) && isnan(nan.v));
+}
+
+/**
+*  @brief Counts that aren't a whole number of 4 vertex blocks pack the same as the blocks do, and write no further.
+*/
+static void CheckTails(std::mt19937& random)
+{
+	std::vector<Vertex> vertices;
+	for (int i = 0; i < 16; i++)
+		vertices.push_back(RandomVertex(random));
+	const VertexQuantization quantization = VertexPacking::ComputeQuantization(vertices.data(), (unsigned int)vertices.size());
+	std::vector<PackedVertex> whole(vertices.size());
+	std::vector<Vertex> wholeUnpacked(vertices.size());
+	VertexPacking::Pack(vertices.data(), (unsigned int)vertices.size(), quantization, whole.data());
+	VertexPacking::Unpack(whole.data(), (unsigned int)vertices.size(), quantization, wholeUnpacked.data());
+
+	// Anything past the count has to keep these
+	PackedVertex packedMarker;
+	memset(&packedMarker, 0xcd, sizeof(packedMarker));
+	const Vertex marker(-1.5f, -1.5f, -1.5f, -1.5f, -1.5f, -1.5f, -1.5f, -1.5f);
+
+	for (unsigned int count = 1; count < vertices.size(); count++)
+	{
+		std::vector<PackedVertex> packed(vertices.size(), packedMarker);
+		std::vector<Vertex> unpacked(vertices.size(), marker);
+		VertexPacking::Pack(vertices.data(), count, quantization, packed.data());
+		VertexPacking::Unpack(whole.data(), count, quantization, unpacked.data());
+
+		CHECK(memcmp(packed.data(), whole.data(), count * sizeof(PackedVertex)) == 0);
+		CHECK(memcmp(unpacked.data(), wholeUnpacked.data(), count * sizeof(Vertex)) == 0);
+		bool untouched = true;
+		for (size_t i = count; i < vertices.size(); i++)
+		{
+			untouched = untouched && memcmp(&packed[i], &packedMarker, sizeof(PackedVertex)) == 0;
+			untouched = untouched && memcmp(&unpacked[i], &marker, sizeof(Vertex)) == 0;
+		}
+		CHECK(untouched);
+	}
+}
+
+/**
+*  @brief Prints the best time of a few rounds to pack and unpack the vertices.
+*/
+static void TimePacking(unsigned int count, std::mt19937& random)
+{
+	std::vector<Vertex> vertices(count);
+	for (Vertex& vertex : vertices)
+		vertex = RandomVertex(random);
+	std::vector<PackedVertex> packed(count);
+	std::vector<Vertex> unpacked(count);
+
+	double packMs = 0.0, unpackMs = 0.0;
+	for (int round = 0; round < 5; round++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const VertexQuantization quantization = VertexPacking::ComputeQuantization(vertices.data(), count);
+		VertexPacking::Pack(vertices.data(), count, quantization, packed.data());
+		const auto packDone = std::chrono::steady_clock::now();
+		VertexPacking::Unpack(packed.data(), count, quantization, unpacked.data());
+		const auto unpackDone = std::chrono::steady_clock::now();
+
+		const double pack = std::chrono::duration<double, std::milli>(packDone - start).count();
+		const double unpack = std::chrono::duration<double, std::milli>(unpackDone - packDone).count();
+		if (round == 0 || pack < packMs) packMs = pack;
+		if (round == 0 || unpack < unpackMs) unpackMs = unpack;
+	}
+
+	printf("%u vertices, %.1f MB as Vertex, %.1f MB packed, best of 5 rounds:\n", count,
+		count * sizeof(Vertex) / (1024.0 * 1024.0), count * sizeof(PackedVertex) / (1024.0 * 1024.0));
+	printf("  Pack    %8.2f ms  %7.1f M vertices/s\n", packMs, count / (packMs * 1000.0));
+	printf("  Unpack  %8.2f ms  %7.1f M vertices/s\n", unpackMs, count / (unpackMs * 1000.0));
+}
+
+int main(int argc, char** argv)
+{
+	const int count = argc > 1 ? atoi(argv[1]) : 1000000;
+	if (count <= 0)
+	{
+		fprintf(stderr, "Usage: VertexPackingBenchmark [vertices]\n");
+		return 1;
+	}
+
+	std::mt19937 random(1234);
+	CheckPositions(random);
+	CheckNormals(random);
+	CheckHalfFloats();
+	CheckTails(random);
+	printf("%s\n\n", gFailures == 0 ? "All checks passed" : "Checks failed");
+
+	TimePacking((unsigned int)count, random);
+	return gFailures == 0 ? 0 : 1;
+}